@@ -58,12 +58,14 @@ statement
     | sendStmt
     | expressionStmt
     | assignmentStmt
+    | recvAssignStmt
     | goStmt
     | returnStmt
     | gotoStmt
     | block
     | ifStmt
     | forStmt
+    | selectStmt
     | deferStmt
     | emptyStmt
     ;
@@ -79,9 +81,14 @@ sendStmt
     : IDENTIFIER '<-' expression
     ;
 
-//AssignmentStmt = identifier "=" Expression .
+//AssignmentStmt = identifier [ "[" Expression "]" ] "=" Expression .
 assignmentStmt
-    : IDENTIFIER '=' expression
+    : IDENTIFIER ( '[' index = expression ']' )? ( '.' fields += IDENTIFIER )* '=' value = expression
+    ;
+
+//RecvAssignStmt = identifier "," identifier ( "=" | ":=" ) "<-" Expression .
+recvAssignStmt
+    : IDENTIFIER ',' IDENTIFIER assign_op = ( '=' | ':=' ) '<-' expression
     ;
 
 emptyStmt
@@ -114,10 +121,36 @@ ifStmt
     : 'if' expression block ( 'else' ( ifStmt | block ) )?
     ;
 
-//ForStmt   = "for" [ Condition ] Block .
-//Condition = Expression .
+//ForStmt     = "for" [ Condition | RangeClause ] Block .
+//Condition   = Expression .
+//RangeClause = identifier ( "=" | ":=" ) "range" Expression .
 forStmt
-    : 'for' ( expression )? block
+    : 'for' ( expression | rangeClause )? block
+    ;
+
+rangeClause
+    : IDENTIFIER assign_op = ( '=' | ':=' ) 'range' expression
+    ;
+
+//SelectStmt = "select" "{" { CommClause } "}" .
+//CommClause = CommCase ":" StatementList .
+//CommCase   = "case" ( SendStmt | RecvStmt ) | "default" .
+//RecvStmt   = [ identifier [ "," identifier ] ( "=" | ":=" ) ] "<-" Expression .
+selectStmt
+    : 'select' '{' ( commClause )* '}'
+    ;
+
+commClause
+    : commCase ':' statementList
+    ;
+
+commCase
+    : 'case' ( sendStmt | recvStmt )
+    | 'default'
+    ;
+
+recvStmt
+    : ( IDENTIFIER ( ',' IDENTIFIER )? assign_op = ( '=' | ':=' ) )? '<-' expression
     ;
 
 //TODO
@@ -138,12 +171,13 @@ typeName
     : IDENTIFIER
     ;
 
-//TypeLit = StructType | PointerType | FunctionType | SliceType  | ChannelType .
+//TypeLit = StructType | PointerType | FunctionType | SliceType | MapType | ChannelType .
 typeLit
     : structType
     | pointerType
     | functionType
     | sliceType
+    | mapType
     | channelType
     ;
 
@@ -157,6 +191,11 @@ sliceType
     : '[' ']' goType
     ;
 
+//MapType = "map" "[" KeyType "]" ElementType .
+mapType
+    : 'map' '[' key = goType ']' value = goType
+    ;
+
 //ChannelType = ( "chan" | "chan" "<-" | "<-" "chan" ) Type .
 channelType
     : ( 'chan' | 'chan' '<-' | '<-' 'chan' ) goType
@@ -195,7 +234,7 @@ parameterDecl
 //StructType = "struct" "{" { FieldDecl } "}" .
 //FieldDecl  = identifier Type .
 structType
-    : 'struct' '{' ( fieldDecl  )* '}'
+    : 'struct' '{' ( fieldDecl ';'? )* '}'
     ;
 
 fieldDecl
@@ -272,6 +311,7 @@ primaryExpr
     | goType '(' expression ')'          #castExpr
     | primaryExpr '.' IDENTIFIER         #fieldExpr
     | primaryExpr '[' expression ']'     #indexExpr
+    | primaryExpr '[' ( low = expression )? ':' ( high = expression )? ']' #sliceExpr
     | primaryExpr '(' ( arguments )? ')' #callExpr
     ;
 
@@ -0,0 +1,120 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#ifdef GOATLANG_WITH_ANTLR
+#include "antlr4-runtime.h"
+#include "GOatLANGLexer.h"
+#include "GOatLANGParser.h"
+#include "AstBuilder.hpp"
+#endif
+#include "Ast.hpp"
+#include "Compiler.hpp"
+#include "Parser.hpp"
+
+/*
+ * Times the front ends on each source file: the hand-written parser alone,
+ * the hand-written parser followed by the compiler passes and, when the
+ * generated parser is built in, ANTLR followed by the tree conversion.
+ * With both front ends the dumped trees are compared and any difference
+ * fails the run, as does a file that does not parse, so this also checks
+ * the hand-written parser against the grammar.
+ */
+
+using bench_clock = std::chrono::steady_clock;
+
+template <typename F>
+static double time_per_iteration(int iterations, F&& f)
+{
+    auto start = bench_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        f();
+    }
+    std::chrono::duration<double, std::micro> elapsed = bench_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+#ifdef GOATLANG_WITH_ANTLR
+static std::string dump_to_string(const Node* tree)
+{
+    std::ostringstream out;
+    dump_ast(out, tree);
+    return out.str();
+}
+
+static SourceFileNode* parse_with_antlr(const std::string& source, AstArena& arena)
+{
+    antlr4::ANTLRInputStream input{source};
+    GOatLANGLexer lexer{&input};
+    antlr4::CommonTokenStream tokens{&lexer};
+    GOatLANGParser parser{&tokens};
+    return AstBuilder{arena}.build_source_file(parser.sourceFile());
+}
+#endif
+
+int main(int argc, const char* argv[])
+{
+    int arg = 1;
+    int iterations = 1000;
+    if (arg + 1 < argc && std::string_view{argv[arg]} == "-n") {
+        iterations = std::stoi(argv[arg + 1]);
+        arg += 2;
+    }
+    if (arg == argc) {
+        std::cerr << "Usage: " << argv[0] << " [-n <iterations>] <input_file>..." << std::endl;
+        return 1;
+    }
+
+    bool failed = false;
+    for (; arg < argc; ++arg) {
+        std::ifstream fs{argv[arg]};
+        if (!fs) {
+            std::cerr << "cannot open " << argv[arg] << std::endl;
+            return 1;
+        }
+        std::string source{std::istreambuf_iterator<char>{fs}, std::istreambuf_iterator<char>{}};
+
+        try {
+            AstArena arena;
+            Parser{source, arena}.parse_source_file();
+        } catch (const std::runtime_error& error) {
+            std::cout << argv[arg] << ": " << error.what() << std::endl;
+            failed = true;
+            continue;
+        }
+
+        double parse_us = time_per_iteration(iterations, [&source]() {
+            AstArena arena;
+            Parser{source, arena}.parse_source_file();
+        });
+        double compile_us = time_per_iteration(iterations, [&source]() {
+            AstArena arena;
+            Compiler compiler{};
+            compiler.visitSourceFile(Parser{source, arena}.parse_source_file());
+        });
+        std::cout << argv[arg] << ": parse " << parse_us << " us, parse+compile " << compile_us << " us";
+
+#ifdef GOATLANG_WITH_ANTLR
+        double antlr_us = time_per_iteration(iterations, [&source]() {
+            AstArena arena;
+            parse_with_antlr(source, arena);
+        });
+        std::cout << ", antlr " << antlr_us << " us (" << antlr_us / parse_us << "x)";
+
+        AstArena arena;
+        auto expected = dump_to_string(parse_with_antlr(source, arena));
+        auto actual = dump_to_string(Parser{source, arena}.parse_source_file());
+        if (expected != actual) {
+            std::cout << ", TREES DIFFER";
+            failed = true;
+        }
+#endif
+        std::cout << std::endl;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Common.hpp"
+
+/*
+ * Times the interpreter on whole programs. Each program is compiled to an
+ * image once, so only the VM is measured, and the image is run in a child
+ * process with its output discarded: one run to warm up, then the given
+ * number of timed runs for the minimum, median and 90th percentile wall
+ * time and the peak resident set. Given an interpreter built with
+ * GOATLANG_INSTRUMENT, one more run counts the instructions and heap
+ * allocations, and the instructions over the median time give the rate.
+ *
+ * The results can be saved as JSON, one benchmark per line, and a later
+ * run compared against them; a median slower than the baseline by more
+ * than the threshold fails the run.
+ */
+
+using bench_clock = std::chrono::steady_clock;
+
+struct Result
+{
+    std::string name;
+    u64 runs = 0;
+    double min_ms = 0;
+    double median_ms = 0;
+    double p90_ms = 0;
+    u64 peak_rss_kb = 0;
+    std::optional<u64> instructions;
+    std::optional<u64> allocations;
+};
+
+/* runs the command with its standard output discarded, returning its exit status */
+static int run_process(const std::vector<std::string>& command, rusage& usage)
+{
+    std::vector<char*> args;
+    for (const auto& arg : command) {
+        args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        throw std::runtime_error("cannot fork!");
+    }
+    if (pid == 0) {
+        int null_fd = ::open("/dev/null", O_WRONLY);
+        ::dup2(null_fd, STDOUT_FILENO);
+        ::execv(args[0], args.data());
+        ::_exit(127);
+    }
+    int status = 0;
+    if (::wait4(pid, &status, 0, &usage) < 0) {
+        throw std::runtime_error("cannot wait for the child!");
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static void run_checked(const std::vector<std::string>& command, rusage& usage)
+{
+    int status = run_process(command, usage);
+    if (status != 0) {
+        std::string text;
+        for (const auto& arg : command) {
+            text += ' ' + arg;
+        }
+        throw std::runtime_error("exit status " + std::to_string(status) + " from" + text);
+    }
+}
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream fs{path};
+    if (!fs) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    return std::string{std::istreambuf_iterator<char>{fs}, std::istreambuf_iterator<char>{}};
+}
+
+/* the number after "key": in text, enough for the JSON written here and by --counters */
+static std::optional<double> find_number(std::string_view text, std::string_view key)
+{
+    std::string pattern{"\""};
+    pattern.append(key).append("\": ");
+    auto position = text.find(pattern);
+    if (position == std::string_view::npos) {
+        return std::nullopt;
+    }
+    return std::stod(std::string{text.substr(position + pattern.size(), 32)});
+}
+
+static std::optional<std::string> find_string(std::string_view text, std::string_view key)
+{
+    std::string pattern{"\""};
+    pattern.append(key).append("\": \"");
+    auto position = text.find(pattern);
+    if (position == std::string_view::npos) {
+        return std::nullopt;
+    }
+    auto start = position + pattern.size();
+    return std::string{text.substr(start, text.find('"', start) - start)};
+}
+
+/* nearest rank, times sorted */
+static double percentile(const std::vector<double>& times, double fraction)
+{
+    auto rank = static_cast<u64>(std::ceil(fraction * times.size()));
+    return times[std::max<u64>(rank, 1) - 1];
+}
+
+static Result run_benchmark(
+    const std::string& goatlang,
+    const std::string& instrumented,
+    const std::filesystem::path& work_directory,
+    const std::filesystem::path& program,
+    u64 runs)
+{
+    Result result{.name = program.stem().string(), .runs = runs};
+    auto image = (work_directory / (result.name + ".image")).string();
+    rusage usage{};
+    run_checked({goatlang, "--compile-only", program.string(), image}, usage);
+    run_checked({goatlang, image}, usage);
+
+    std::vector<double> times;
+    for (u64 i = 0; i < runs; ++i) {
+        auto start = bench_clock::now();
+        run_checked({goatlang, image}, usage);
+        std::chrono::duration<double, std::milli> elapsed = bench_clock::now() - start;
+        times.push_back(elapsed.count());
+        result.peak_rss_kb = std::max<u64>(result.peak_rss_kb, usage.ru_maxrss);
+    }
+    std::sort(times.begin(), times.end());
+    result.min_ms = times.front();
+    result.median_ms = percentile(times, 0.5);
+    result.p90_ms = percentile(times, 0.9);
+
+    if (!instrumented.empty()) {
+        auto counters = (work_directory / (result.name + ".json")).string();
+        run_checked({instrumented, "--counters", counters, image}, usage);
+        auto text = read_file(counters);
+        if (auto instructions = find_number(text, "instructions")) {
+            result.instructions = static_cast<u64>(*instructions);
+        }
+        if (auto allocations = find_number(text, "allocations")) {
+            result.allocations = static_cast<u64>(*allocations);
+        }
+    }
+    return result;
+}
+
+static void print_result(const Result& result)
+{
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << result.name << ": median " << result.median_ms << " ms, p90 " << result.p90_ms
+              << " ms, min " << result.min_ms << " ms, peak rss " << result.peak_rss_kb / 1024.0 << " MB";
+    if (result.instructions) {
+        std::cout << ", " << *result.instructions / (result.median_ms * 1000) << " M instructions/s";
+    }
+    if (result.allocations) {
+        std::cout << ", " << *result.allocations << " allocations";
+    }
+    std::cout << std::endl;
+}
+
+static void write_json(const std::string& path, const std::vector<Result>& results)
+{
+    std::ofstream stream{path, std::ios::trunc};
+    stream << std::fixed << std::setprecision(3);
+    stream << "{\n  \"benchmarks\": [";
+    const char* separator = "";
+    for (const auto& result : results) {
+        stream << separator << "\n    {\"name\": \"" << result.name << "\", \"runs\": " << result.runs
+               << ", \"min_ms\": " << result.min_ms << ", \"median_ms\": " << result.median_ms
+               << ", \"p90_ms\": " << result.p90_ms << ", \"peak_rss_kb\": " << result.peak_rss_kb;
+        if (result.instructions) {
+            stream << ", \"instructions\": " << *result.instructions << ", \"instructions_per_second\": "
+                   << static_cast<u64>(*result.instructions / (result.median_ms / 1000));
+        }
+        if (result.allocations) {
+            stream << ", \"allocations\": " << *result.allocations;
+        }
+        stream << "}";
+        separator = ",";
+    }
+    stream << "\n  ]\n}\n";
+}
+
+/* the baseline medians and peak resident sets by benchmark name */
+static std::map<std::string, std::pair<double, double>> read_baseline(const std::string& path)
+{
+    std::map<std::string, std::pair<double, double>> baseline;
+    auto text = read_file(path);
+    std::string_view rest{text};
+    while (!rest.empty()) {
+        auto line = rest.substr(0, rest.find('\n'));
+        rest.remove_prefix(std::min(rest.size(), line.size() + 1));
+        auto name = find_string(line, "name");
+        auto median_ms = find_number(line, "median_ms");
+        auto peak_rss_kb = find_number(line, "peak_rss_kb");
+        if (name && median_ms && peak_rss_kb) {
+            baseline[*name] = {*median_ms, *peak_rss_kb};
+        }
+    }
+    return baseline;
+}
+
+/* prints the changes against the baseline, returning whether any median regressed */
+static bool compare(const std::vector<Result>& results, const std::string& baseline_path, double threshold)
+{
+    auto baseline = read_baseline(baseline_path);
+    bool regressed = false;
+    std::cout << std::showpos << std::setprecision(1);
+    for (const auto& result : results) {
+        std::cout << result.name << ": ";
+        auto it = baseline.find(result.name);
+        if (it == baseline.end()) {
+            std::cout << "not in the baseline" << std::endl;
+            continue;
+        }
+        auto [median_ms, peak_rss_kb] = it->second;
+        double time_change = (result.median_ms / median_ms - 1) * 100;
+        double rss_change = (result.peak_rss_kb / peak_rss_kb - 1) * 100;
+        std::cout << "median " << time_change << "%, peak rss " << rss_change << "%";
+        if (time_change > threshold) {
+            std::cout << ", REGRESSED";
+            regressed = true;
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::noshowpos;
+    return regressed;
+}
+
+static int usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " --goatlang <interpreter> [--instrumented <interpreter>] [-n <runs>]" << std::endl;
+    std::cerr << "       [--json <results_file>] [--baseline <results_file>] [--threshold <percent>] <program>..." << std::endl;
+    return 1;
+}
+
+int main(int argc, const char* argv[])
+{
+    std::string goatlang;
+    std::string instrumented;
+    std::string json_path;
+    std::string baseline_path;
+    u64 runs = 5;
+    double threshold = 10;
+    int arg = 1;
+    for (; arg + 1 < argc && std::string_view{argv[arg]}.starts_with("-"); arg += 2) {
+        std::string_view option{argv[arg]};
+        if (option == "--goatlang") {
+            goatlang = argv[arg + 1];
+        } else if (option == "--instrumented") {
+            instrumented = argv[arg + 1];
+        } else if (option == "-n") {
+            runs = std::max(std::stoull(argv[arg + 1]), 1ull);
+        } else if (option == "--json") {
+            json_path = argv[arg + 1];
+        } else if (option == "--baseline") {
+            baseline_path = argv[arg + 1];
+        } else if (option == "--threshold") {
+            threshold = std::stod(argv[arg + 1]);
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (goatlang.empty() || arg == argc) {
+        return usage(argv[0]);
+    }
+
+    auto work_directory = std::filesystem::temp_directory_path() / ("goatlang-bench-" + std::to_string(::getpid()));
+    std::filesystem::create_directories(work_directory);
+    std::vector<Result> results;
+    bool failed = false;
+    for (; arg < argc; ++arg) {
+        try {
+            results.push_back(run_benchmark(goatlang, instrumented, work_directory, argv[arg], runs));
+            print_result(results.back());
+        } catch (const std::exception& error) {
+            std::cout << argv[arg] << ": " << error.what() << std::endl;
+            failed = true;
+        }
+    }
+    std::filesystem::remove_all(work_directory);
+
+    if (!json_path.empty()) {
+        write_json(json_path, results);
+    }
+    if (!baseline_path.empty()) {
+        try {
+            failed = compare(results, baseline_path, threshold) || failed;
+        } catch (const std::exception& error) {
+            std::cout << error.what() << std::endl;
+            failed = true;
+        }
+    }
+    return failed ? 1 : 0;
+}
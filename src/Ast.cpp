@@ -0,0 +1,603 @@
+#include "Ast.hpp"
+
+const char* get_node_kind_name(NodeKind kind)
+{
+    switch (kind) {
+        case NodeKind::source_file:
+            return "SourceFile";
+        case NodeKind::function_decl:
+            return "FunctionDecl";
+        case NodeKind::var_decl:
+            return "VarDecl";
+        case NodeKind::function:
+            return "Function";
+        case NodeKind::signature:
+            return "Signature";
+        case NodeKind::parameter_decl:
+            return "ParameterDecl";
+        case NodeKind::block:
+            return "Block";
+        case NodeKind::labeled_stmt:
+            return "LabeledStmt";
+        case NodeKind::send_stmt:
+            return "SendStmt";
+        case NodeKind::expression_stmt:
+            return "ExpressionStmt";
+        case NodeKind::assignment_stmt:
+            return "AssignmentStmt";
+        case NodeKind::recv_assign_stmt:
+            return "RecvAssignStmt";
+        case NodeKind::go_stmt:
+            return "GoStmt";
+        case NodeKind::return_stmt:
+            return "ReturnStmt";
+        case NodeKind::goto_stmt:
+            return "GotoStmt";
+        case NodeKind::defer_stmt:
+            return "DeferStmt";
+        case NodeKind::if_stmt:
+            return "IfStmt";
+        case NodeKind::for_stmt:
+            return "ForStmt";
+        case NodeKind::range_clause:
+            return "RangeClause";
+        case NodeKind::select_stmt:
+            return "SelectStmt";
+        case NodeKind::comm_clause:
+            return "CommClause";
+        case NodeKind::recv_stmt:
+            return "RecvStmt";
+        case NodeKind::empty_stmt:
+            return "EmptyStmt";
+        case NodeKind::type_name:
+            return "TypeName";
+        case NodeKind::pointer_type:
+            return "PointerType";
+        case NodeKind::slice_type:
+            return "SliceType";
+        case NodeKind::map_type:
+            return "MapType";
+        case NodeKind::channel_type:
+            return "ChannelType";
+        case NodeKind::function_type:
+            return "FunctionType";
+        case NodeKind::struct_type:
+            return "StructType";
+        case NodeKind::field_decl:
+            return "FieldDecl";
+        case NodeKind::basic_lit:
+            return "BasicLit";
+        case NodeKind::operand_name:
+            return "OperandName";
+        case NodeKind::composite_lit:
+            return "CompositeLit";
+        case NodeKind::literal_value:
+            return "LiteralValue";
+        case NodeKind::function_lit:
+            return "FunctionLit";
+        case NodeKind::cast_expr:
+            return "CastExpr";
+        case NodeKind::field_expr:
+            return "FieldExpr";
+        case NodeKind::index_expr:
+            return "IndexExpr";
+        case NodeKind::slice_expr:
+            return "SliceExpr";
+        case NodeKind::call_expr:
+            return "CallExpr";
+        case NodeKind::unary_expr:
+            return "UnaryExpr";
+        case NodeKind::binary_expr:
+            return "BinaryExpr";
+    }
+    return "?";
+}
+
+const char* get_operator_text(Operator op)
+{
+    switch (op) {
+        case Operator::lor:
+            return "||";
+        case Operator::land:
+            return "&&";
+        case Operator::eq:
+            return "==";
+        case Operator::ne:
+            return "!=";
+        case Operator::lt:
+            return "<";
+        case Operator::le:
+            return "<=";
+        case Operator::gt:
+            return ">";
+        case Operator::ge:
+            return ">=";
+        case Operator::add:
+            return "+";
+        case Operator::sub:
+            return "-";
+        case Operator::or_:
+            return "|";
+        case Operator::xor_:
+            return "^";
+        case Operator::mul:
+            return "*";
+        case Operator::div:
+            return "/";
+        case Operator::rem:
+            return "%";
+        case Operator::shl:
+            return "<<";
+        case Operator::shr:
+            return ">>";
+        case Operator::and_:
+            return "&";
+        case Operator::plus:
+            return "+";
+        case Operator::neg:
+            return "-";
+        case Operator::not_:
+            return "!";
+        case Operator::complement:
+            return "^";
+        case Operator::deref:
+            return "*";
+        case Operator::address:
+            return "&";
+        case Operator::recv:
+            return "<-";
+    }
+    return "?";
+}
+
+/* calls f on every child in source order, with nullptr for a missing optional one */
+template <typename F>
+static void for_each_child(Node* node, F&& f)
+{
+    switch (node->kind) {
+        case NodeKind::source_file:
+            for (auto declaration : static_cast<SourceFileNode*>(node)->declarations) {
+                f(declaration);
+            }
+            break;
+        case NodeKind::function_decl:
+            f(static_cast<FunctionDeclNode*>(node)->function);
+            break;
+        case NodeKind::var_decl: {
+            auto var_decl = static_cast<VarDeclNode*>(node);
+            f(var_decl->type);
+            f(var_decl->value);
+            break;
+        }
+        case NodeKind::function: {
+            auto function = static_cast<FunctionNode*>(node);
+            f(function->signature);
+            f(function->body);
+            break;
+        }
+        case NodeKind::signature: {
+            auto signature = static_cast<SignatureNode*>(node);
+            for (auto parameter_decl : signature->parameters) {
+                f(parameter_decl);
+            }
+            f(signature->result);
+            break;
+        }
+        case NodeKind::parameter_decl:
+            f(static_cast<ParameterDeclNode*>(node)->type);
+            break;
+        case NodeKind::block:
+            for (auto statement : static_cast<BlockNode*>(node)->statements) {
+                f(statement);
+            }
+            break;
+        case NodeKind::labeled_stmt:
+            f(static_cast<LabeledStmtNode*>(node)->statement);
+            break;
+        case NodeKind::send_stmt:
+            f(static_cast<SendStmtNode*>(node)->value);
+            break;
+        case NodeKind::expression_stmt:
+            f(static_cast<ExpressionStmtNode*>(node)->expression);
+            break;
+        case NodeKind::assignment_stmt: {
+            auto assignment_stmt = static_cast<AssignmentStmtNode*>(node);
+            f(assignment_stmt->index);
+            f(assignment_stmt->value);
+            break;
+        }
+        case NodeKind::recv_assign_stmt:
+            f(static_cast<RecvAssignStmtNode*>(node)->channel);
+            break;
+        case NodeKind::go_stmt:
+            f(static_cast<GoStmtNode*>(node)->expression);
+            break;
+        case NodeKind::return_stmt:
+            f(static_cast<ReturnStmtNode*>(node)->value);
+            break;
+        case NodeKind::goto_stmt:
+            break;
+        case NodeKind::defer_stmt:
+            f(static_cast<DeferStmtNode*>(node)->expression);
+            break;
+        case NodeKind::if_stmt: {
+            auto if_stmt = static_cast<IfStmtNode*>(node);
+            f(if_stmt->condition);
+            f(if_stmt->then_block);
+            f(if_stmt->else_branch);
+            break;
+        }
+        case NodeKind::for_stmt: {
+            auto for_stmt = static_cast<ForStmtNode*>(node);
+            f(for_stmt->condition);
+            f(for_stmt->range);
+            f(for_stmt->body);
+            break;
+        }
+        case NodeKind::range_clause:
+            f(static_cast<RangeClauseNode*>(node)->channel);
+            break;
+        case NodeKind::select_stmt:
+            for (auto comm_clause : static_cast<SelectStmtNode*>(node)->clauses) {
+                f(comm_clause);
+            }
+            break;
+        case NodeKind::comm_clause: {
+            auto comm_clause = static_cast<CommClauseNode*>(node);
+            f(comm_clause->send);
+            f(comm_clause->recv);
+            for (auto statement : comm_clause->statements) {
+                f(statement);
+            }
+            break;
+        }
+        case NodeKind::recv_stmt:
+            f(static_cast<RecvStmtNode*>(node)->channel);
+            break;
+        case NodeKind::empty_stmt:
+        case NodeKind::type_name:
+            break;
+        case NodeKind::pointer_type:
+            f(static_cast<PointerTypeNode*>(node)->element_type);
+            break;
+        case NodeKind::slice_type:
+            f(static_cast<SliceTypeNode*>(node)->element_type);
+            break;
+        case NodeKind::map_type:
+            f(static_cast<MapTypeNode*>(node)->key_type);
+            f(static_cast<MapTypeNode*>(node)->value_type);
+            break;
+        case NodeKind::channel_type:
+            f(static_cast<ChannelTypeNode*>(node)->element_type);
+            break;
+        case NodeKind::function_type:
+            f(static_cast<FunctionTypeNode*>(node)->signature);
+            break;
+        case NodeKind::struct_type:
+            for (auto field_decl : static_cast<StructTypeNode*>(node)->fields) {
+                f(field_decl);
+            }
+            break;
+        case NodeKind::field_decl:
+            f(static_cast<FieldDeclNode*>(node)->type);
+            break;
+        case NodeKind::basic_lit:
+        case NodeKind::operand_name:
+            break;
+        case NodeKind::composite_lit: {
+            auto composite_lit = static_cast<CompositeLitNode*>(node);
+            f(composite_lit->type);
+            f(composite_lit->value);
+            break;
+        }
+        case NodeKind::literal_value:
+            for (auto element : static_cast<LiteralValueNode*>(node)->elements) {
+                f(element);
+            }
+            break;
+        case NodeKind::function_lit:
+            f(static_cast<FunctionLitNode*>(node)->function);
+            break;
+        case NodeKind::cast_expr: {
+            auto cast_expr = static_cast<CastExprNode*>(node);
+            f(cast_expr->type);
+            f(cast_expr->operand);
+            break;
+        }
+        case NodeKind::field_expr:
+            f(static_cast<FieldExprNode*>(node)->operand);
+            break;
+        case NodeKind::index_expr: {
+            auto index_expr = static_cast<IndexExprNode*>(node);
+            f(index_expr->operand);
+            f(index_expr->index);
+            break;
+        }
+        case NodeKind::slice_expr: {
+            auto slice_expr = static_cast<SliceExprNode*>(node);
+            f(slice_expr->operand);
+            f(slice_expr->low);
+            f(slice_expr->high);
+            break;
+        }
+        case NodeKind::call_expr: {
+            auto call_expr = static_cast<CallExprNode*>(node);
+            f(call_expr->callee);
+            f(call_expr->type_argument);
+            for (auto argument : call_expr->arguments) {
+                f(argument);
+            }
+            break;
+        }
+        case NodeKind::unary_expr:
+            f(static_cast<UnaryExprNode*>(node)->operand);
+            break;
+        case NodeKind::binary_expr: {
+            auto binary_expr = static_cast<BinaryExprNode*>(node);
+            f(binary_expr->left);
+            f(binary_expr->right);
+            break;
+        }
+    }
+}
+
+/* an error of a pass is reported at the innermost node it was visiting */
+void AstVisitor::visit(Node* node)
+{
+    try {
+        dispatch(node);
+    } catch (const SourceError&) {
+        throw;
+    } catch (const std::runtime_error& error) {
+        throw SourceError(node->line, error.what());
+    }
+}
+
+void AstVisitor::dispatch(Node* node)
+{
+    switch (node->kind) {
+        case NodeKind::source_file:
+            return visitSourceFile(static_cast<SourceFileNode*>(node));
+        case NodeKind::function_decl:
+            return visitFunctionDecl(static_cast<FunctionDeclNode*>(node));
+        case NodeKind::var_decl:
+            return visitVarDecl(static_cast<VarDeclNode*>(node));
+        case NodeKind::function:
+            return visitFunction(static_cast<FunctionNode*>(node));
+        case NodeKind::signature:
+            return visitSignature(static_cast<SignatureNode*>(node));
+        case NodeKind::parameter_decl:
+            return visitParameterDecl(static_cast<ParameterDeclNode*>(node));
+        case NodeKind::block:
+            return visitBlock(static_cast<BlockNode*>(node));
+        case NodeKind::labeled_stmt:
+            return visitLabeledStmt(static_cast<LabeledStmtNode*>(node));
+        case NodeKind::send_stmt:
+            return visitSendStmt(static_cast<SendStmtNode*>(node));
+        case NodeKind::expression_stmt:
+            return visitExpressionStmt(static_cast<ExpressionStmtNode*>(node));
+        case NodeKind::assignment_stmt:
+            return visitAssignmentStmt(static_cast<AssignmentStmtNode*>(node));
+        case NodeKind::recv_assign_stmt:
+            return visitRecvAssignStmt(static_cast<RecvAssignStmtNode*>(node));
+        case NodeKind::go_stmt:
+            return visitGoStmt(static_cast<GoStmtNode*>(node));
+        case NodeKind::return_stmt:
+            return visitReturnStmt(static_cast<ReturnStmtNode*>(node));
+        case NodeKind::goto_stmt:
+            return visitGotoStmt(static_cast<GotoStmtNode*>(node));
+        case NodeKind::defer_stmt:
+            return visitDeferStmt(static_cast<DeferStmtNode*>(node));
+        case NodeKind::if_stmt:
+            return visitIfStmt(static_cast<IfStmtNode*>(node));
+        case NodeKind::for_stmt:
+            return visitForStmt(static_cast<ForStmtNode*>(node));
+        case NodeKind::range_clause:
+            return visitRangeClause(static_cast<RangeClauseNode*>(node));
+        case NodeKind::select_stmt:
+            return visitSelectStmt(static_cast<SelectStmtNode*>(node));
+        case NodeKind::comm_clause:
+            return visitCommClause(static_cast<CommClauseNode*>(node));
+        case NodeKind::recv_stmt:
+            return visitRecvStmt(static_cast<RecvStmtNode*>(node));
+        case NodeKind::empty_stmt:
+            return visitEmptyStmt(static_cast<EmptyStmtNode*>(node));
+        case NodeKind::type_name:
+            return visitTypeName(static_cast<TypeNameNode*>(node));
+        case NodeKind::pointer_type:
+            return visitPointerType(static_cast<PointerTypeNode*>(node));
+        case NodeKind::slice_type:
+            return visitSliceType(static_cast<SliceTypeNode*>(node));
+        case NodeKind::map_type:
+            return visitMapType(static_cast<MapTypeNode*>(node));
+        case NodeKind::channel_type:
+            return visitChannelType(static_cast<ChannelTypeNode*>(node));
+        case NodeKind::function_type:
+            return visitFunctionType(static_cast<FunctionTypeNode*>(node));
+        case NodeKind::struct_type:
+            return visitStructType(static_cast<StructTypeNode*>(node));
+        case NodeKind::field_decl:
+            return visitFieldDecl(static_cast<FieldDeclNode*>(node));
+        case NodeKind::basic_lit:
+            return visitBasicLit(static_cast<BasicLitNode*>(node));
+        case NodeKind::operand_name:
+            return visitOperandName(static_cast<OperandNameNode*>(node));
+        case NodeKind::composite_lit:
+            return visitCompositeLit(static_cast<CompositeLitNode*>(node));
+        case NodeKind::literal_value:
+            return visitLiteralValue(static_cast<LiteralValueNode*>(node));
+        case NodeKind::function_lit:
+            return visitFunctionLit(static_cast<FunctionLitNode*>(node));
+        case NodeKind::cast_expr:
+            return visitCastExpr(static_cast<CastExprNode*>(node));
+        case NodeKind::field_expr:
+            return visitFieldExpr(static_cast<FieldExprNode*>(node));
+        case NodeKind::index_expr:
+            return visitIndexExpr(static_cast<IndexExprNode*>(node));
+        case NodeKind::slice_expr:
+            return visitSliceExpr(static_cast<SliceExprNode*>(node));
+        case NodeKind::call_expr:
+            return visitCallExpr(static_cast<CallExprNode*>(node));
+        case NodeKind::unary_expr:
+            return visitUnaryExpr(static_cast<UnaryExprNode*>(node));
+        case NodeKind::binary_expr:
+            return visitBinaryExpr(static_cast<BinaryExprNode*>(node));
+    }
+}
+
+void AstVisitor::visitChildren(Node* node)
+{
+    for_each_child(node, [this](Node* child) {
+        if (child) {
+            visit(child);
+        }
+    });
+}
+
+/* the attributes of a node as text, one token at a time */
+template <typename F>
+static void for_each_attribute(const Node* node, F&& f)
+{
+    switch (node->kind) {
+        case NodeKind::function_decl:
+            f(static_cast<const FunctionDeclNode*>(node)->name);
+            break;
+        case NodeKind::var_decl:
+            f(static_cast<const VarDeclNode*>(node)->name);
+            break;
+        case NodeKind::parameter_decl:
+            f(static_cast<const ParameterDeclNode*>(node)->name);
+            break;
+        case NodeKind::labeled_stmt:
+            f(static_cast<const LabeledStmtNode*>(node)->label);
+            break;
+        case NodeKind::send_stmt:
+            f(static_cast<const SendStmtNode*>(node)->channel);
+            break;
+        case NodeKind::assignment_stmt: {
+            auto assignment_stmt = static_cast<const AssignmentStmtNode*>(node);
+            f(assignment_stmt->name);
+            for (auto field : assignment_stmt->fields) {
+                f(".");
+                f(field);
+            }
+            break;
+        }
+        case NodeKind::recv_assign_stmt: {
+            auto recv_assign_stmt = static_cast<const RecvAssignStmtNode*>(node);
+            f(recv_assign_stmt->value_name);
+            f(recv_assign_stmt->ok_name);
+            f(recv_assign_stmt->declares ? ":=" : "=");
+            break;
+        }
+        case NodeKind::goto_stmt:
+            f(static_cast<const GotoStmtNode*>(node)->label);
+            break;
+        case NodeKind::range_clause: {
+            auto range_clause = static_cast<const RangeClauseNode*>(node);
+            f(range_clause->name);
+            f(range_clause->declares ? ":=" : "=");
+            break;
+        }
+        case NodeKind::recv_stmt: {
+            auto recv_stmt = static_cast<const RecvStmtNode*>(node);
+            if (!recv_stmt->value_name.empty()) {
+                f(recv_stmt->value_name);
+                if (!recv_stmt->ok_name.empty()) {
+                    f(recv_stmt->ok_name);
+                }
+                f(recv_stmt->declares ? ":=" : "=");
+            }
+            break;
+        }
+        case NodeKind::type_name:
+            f(static_cast<const TypeNameNode*>(node)->name);
+            break;
+        case NodeKind::channel_type: {
+            auto direction = static_cast<const ChannelTypeNode*>(node)->direction;
+            f(direction == ChannelDirection::send ? "chan<-" : direction == ChannelDirection::recv ? "<-chan" : "chan");
+            break;
+        }
+        case NodeKind::field_decl:
+            f(static_cast<const FieldDeclNode*>(node)->name);
+            break;
+        case NodeKind::basic_lit:
+            f(static_cast<const BasicLitNode*>(node)->text);
+            break;
+        case NodeKind::operand_name:
+            f(static_cast<const OperandNameNode*>(node)->name);
+            break;
+        case NodeKind::field_expr:
+            f(static_cast<const FieldExprNode*>(node)->field);
+            break;
+        case NodeKind::unary_expr:
+            f(get_operator_text(static_cast<const UnaryExprNode*>(node)->op));
+            break;
+        case NodeKind::binary_expr:
+            f(get_operator_text(static_cast<const BinaryExprNode*>(node)->op));
+            break;
+        default:
+            break;
+    }
+}
+
+static void dump_node(std::ostream& os, const Node* node, u64 depth)
+{
+    for (u64 i = 0; i < depth; ++i) {
+        os << "  ";
+    }
+    if (!node) {
+        os << "-\n";
+        return;
+    }
+    os << get_node_kind_name(node->kind) << ' ' << node->line;
+    for_each_attribute(node, [&os](std::string_view attribute) {
+        os << ' ' << attribute;
+    });
+    os << '\n';
+    for_each_child(const_cast<Node*>(node), [&os, depth](Node* child) {
+        dump_node(os, child, depth + 1);
+    });
+}
+
+void dump_ast(std::ostream& os, const Node* node)
+{
+    dump_node(os, node, 0);
+}
+
+/* FNV-1a over the node kinds, lines and attributes in preorder, the end of each child list marked */
+static void hash_bytes(u64& hash, const void* data, u64 size)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (u64 i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+}
+
+static void hash_node(u64& hash, const Node* node, u32 first_line)
+{
+    u8 kind = node ? static_cast<u8>(node->kind) + 1 : 0;
+    hash_bytes(hash, &kind, sizeof(kind));
+    if (!node) {
+        return;
+    }
+    u32 line = node->line - first_line;
+    hash_bytes(hash, &line, sizeof(line));
+    for_each_attribute(node, [&hash](std::string_view attribute) {
+        u64 size = attribute.size();
+        hash_bytes(hash, &size, sizeof(size));
+        hash_bytes(hash, attribute.data(), size);
+    });
+    for_each_child(const_cast<Node*>(node), [&hash, first_line](Node* child) {
+        hash_node(hash, child, first_line);
+    });
+    u8 end = 0xff;
+    hash_bytes(hash, &end, sizeof(end));
+}
+
+u64 hash_ast(const Node* node)
+{
+    u64 hash = 14695981039346656037ull;
+    hash_node(hash, node, node ? node->line : 0);
+    return hash;
+}
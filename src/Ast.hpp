@@ -0,0 +1,623 @@
+#ifndef AST_HPP
+#define AST_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "Common.hpp"
+
+/*
+ * The syntax tree shared by both front ends. Nodes are plain structs
+ * allocated from an AstArena and never destroyed one by one: names and
+ * literal texts are string_views and child lists are spans, all pointing
+ * into the same arena, so dropping the arena frees the whole tree at once.
+ * Parenthesized expressions and types do not get nodes of their own.
+ */
+
+enum class NodeKind : u8
+{
+    // DECLARATIONS
+    source_file,
+    function_decl,
+    var_decl,
+    function,
+    signature,
+    parameter_decl,
+    // STATEMENTS
+    block,
+    labeled_stmt,
+    send_stmt,
+    expression_stmt,
+    assignment_stmt,
+    recv_assign_stmt,
+    go_stmt,
+    return_stmt,
+    goto_stmt,
+    defer_stmt,
+    if_stmt,
+    for_stmt,
+    range_clause,
+    select_stmt,
+    comm_clause,
+    recv_stmt,
+    empty_stmt,
+    // TYPES
+    type_name,
+    pointer_type,
+    slice_type,
+    map_type,
+    channel_type,
+    function_type,
+    struct_type,
+    field_decl,
+    // EXPRESSIONS
+    basic_lit,
+    operand_name,
+    composite_lit,
+    literal_value,
+    function_lit,
+    cast_expr,
+    field_expr,
+    index_expr,
+    slice_expr,
+    call_expr,
+    unary_expr,
+    binary_expr,
+};
+
+enum class Operator : u8
+{
+    // BINARY
+    lor,
+    land,
+    eq,
+    ne,
+    lt,
+    le,
+    gt,
+    ge,
+    add,
+    sub,
+    or_,
+    xor_,
+    mul,
+    div,
+    rem,
+    shl,
+    shr,
+    and_,
+    // UNARY
+    plus,
+    neg,
+    not_,
+    complement,
+    deref,
+    address,
+    recv,
+};
+
+enum class LiteralKind : u8
+{
+    int_,
+    float_,
+    string,
+};
+
+enum class ChannelDirection : u8
+{
+    both,
+    send,
+    recv,
+};
+
+const char* get_node_kind_name(NodeKind kind);
+const char* get_operator_text(Operator op);
+
+/* ids number the nodes of an arena from 0, passes keep their results in NodeTables */
+struct Node
+{
+    NodeKind kind;
+    u32 line;
+    u32 id;
+};
+
+struct ParameterDeclNode;
+struct BlockNode;
+struct FunctionNode;
+struct SignatureNode;
+struct SendStmtNode;
+struct RecvStmtNode;
+struct RangeClauseNode;
+struct CommClauseNode;
+struct FieldDeclNode;
+struct LiteralValueNode;
+
+struct SourceFileNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::source_file;
+    std::span<Node*> declarations;
+    u32 node_count; /* every node of the file has a smaller id */
+};
+
+struct FunctionDeclNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::function_decl;
+    std::string_view name;
+    FunctionNode* function;
+};
+
+struct VarDeclNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::var_decl;
+    std::string_view name;
+    Node* type;
+    Node* value; /* optional */
+};
+
+struct FunctionNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::function;
+    SignatureNode* signature;
+    BlockNode* body;
+};
+
+struct SignatureNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::signature;
+    std::span<ParameterDeclNode*> parameters;
+    Node* result; /* optional */
+};
+
+struct ParameterDeclNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::parameter_decl;
+    std::string_view name; /* empty when unnamed */
+    Node* type;
+};
+
+struct BlockNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::block;
+    std::span<Node*> statements;
+};
+
+struct LabeledStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::labeled_stmt;
+    std::string_view label;
+    Node* statement;
+};
+
+struct SendStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::send_stmt;
+    std::string_view channel;
+    Node* value;
+};
+
+struct ExpressionStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::expression_stmt;
+    Node* expression;
+};
+
+struct AssignmentStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::assignment_stmt;
+    std::string_view name;
+    Node* index; /* optional, assigns an element of the slice named */
+    std::span<std::string_view> fields; /* assigns a field of the struct named or indexed */
+    Node* value;
+};
+
+struct RecvAssignStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::recv_assign_stmt;
+    std::string_view value_name;
+    std::string_view ok_name;
+    bool declares; /* := rather than = */
+    Node* channel;
+};
+
+struct GoStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::go_stmt;
+    Node* expression;
+};
+
+struct ReturnStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::return_stmt;
+    Node* value; /* optional */
+};
+
+struct GotoStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::goto_stmt;
+    std::string_view label;
+};
+
+struct DeferStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::defer_stmt;
+    Node* expression;
+};
+
+struct IfStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::if_stmt;
+    Node* condition;
+    BlockNode* then_block;
+    Node* else_branch; /* optional, a block or another if statement */
+};
+
+struct ForStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::for_stmt;
+    Node* condition;        /* optional */
+    RangeClauseNode* range; /* optional, never together with a condition */
+    BlockNode* body;
+};
+
+struct RangeClauseNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::range_clause;
+    std::string_view name;
+    bool declares;
+    Node* channel;
+};
+
+struct SelectStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::select_stmt;
+    std::span<CommClauseNode*> clauses;
+};
+
+/* the default clause has neither a send nor a receive */
+struct CommClauseNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::comm_clause;
+    SendStmtNode* send;
+    RecvStmtNode* recv;
+    std::span<Node*> statements;
+};
+
+struct RecvStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::recv_stmt;
+    std::string_view value_name; /* empty when the item is dropped */
+    std::string_view ok_name;    /* empty without the second variable */
+    bool declares;
+    Node* channel;
+};
+
+struct EmptyStmtNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::empty_stmt;
+};
+
+struct TypeNameNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::type_name;
+    std::string_view name;
+};
+
+struct PointerTypeNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::pointer_type;
+    Node* element_type;
+};
+
+struct SliceTypeNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::slice_type;
+    Node* element_type;
+};
+
+struct MapTypeNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::map_type;
+    Node* key_type;
+    Node* value_type;
+};
+
+struct ChannelTypeNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::channel_type;
+    ChannelDirection direction;
+    Node* element_type;
+};
+
+struct FunctionTypeNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::function_type;
+    SignatureNode* signature;
+};
+
+struct StructTypeNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::struct_type;
+    std::span<FieldDeclNode*> fields;
+};
+
+struct FieldDeclNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::field_decl;
+    std::string_view name;
+    Node* type;
+};
+
+/* the text is the literal as written, quotes included */
+struct BasicLitNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::basic_lit;
+    LiteralKind literal_kind;
+    std::string_view text;
+};
+
+struct OperandNameNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::operand_name;
+    std::string_view name;
+};
+
+struct CompositeLitNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::composite_lit;
+    Node* type;
+    LiteralValueNode* value;
+};
+
+/* elements are expressions or nested literal values */
+struct LiteralValueNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::literal_value;
+    std::span<Node*> elements;
+};
+
+struct FunctionLitNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::function_lit;
+    FunctionNode* function;
+};
+
+struct CastExprNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::cast_expr;
+    Node* type;
+    Node* operand;
+};
+
+struct FieldExprNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::field_expr;
+    Node* operand;
+    std::string_view field;
+};
+
+struct IndexExprNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::index_expr;
+    Node* operand;
+    Node* index;
+};
+
+struct SliceExprNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::slice_expr;
+    Node* operand;
+    Node* low;  /* optional */
+    Node* high; /* optional */
+};
+
+/* a type argument, as in make(chan int, 1), comes before the others */
+struct CallExprNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::call_expr;
+    Node* callee;
+    Node* type_argument; /* optional */
+    std::span<Node*> arguments;
+};
+
+struct UnaryExprNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::unary_expr;
+    Operator op;
+    Node* operand;
+};
+
+struct BinaryExprNode : Node
+{
+    static constexpr NodeKind node_kind = NodeKind::binary_expr;
+    Operator op;
+    Node* left;
+    Node* right;
+};
+
+template <typename T>
+T* node_cast(Node* node)
+{
+    return node && node->kind == T::node_kind ? static_cast<T*>(node) : nullptr;
+}
+
+template <typename T>
+const T* node_cast(const Node* node)
+{
+    return node && node->kind == T::node_kind ? static_cast<const T*>(node) : nullptr;
+}
+
+class AstArena
+{
+public:
+    static constexpr u64 chunk_size = 64 * 1024;
+
+    AstArena() = default;
+    AstArena(const AstArena&) = delete;
+    AstArena(AstArena&&) = default;
+    AstArena& operator=(const AstArena&) = delete;
+    AstArena& operator=(AstArena&&) = default;
+
+    void* allocate(u64 size, u64 alignment)
+    {
+        u64 offset = (alignment - reinterpret_cast<std::uintptr_t>(cursor) % alignment) % alignment;
+        if (!cursor || offset + size > static_cast<u64>(limit - cursor)) {
+            /* a request larger than a chunk gets a chunk of its own */
+            u64 new_chunk_size = std::max(chunk_size, size + alignment);
+            chunks.push_back(std::make_unique_for_overwrite<std::byte[]>(new_chunk_size));
+            cursor = chunks.back().get();
+            limit = cursor + new_chunk_size;
+            offset = (alignment - reinterpret_cast<std::uintptr_t>(cursor) % alignment) % alignment;
+        }
+        std::byte* result = cursor + offset;
+        cursor = result + size;
+        return result;
+    }
+
+    template <typename T>
+    T* make(u32 line)
+    {
+        static_assert(std::is_trivially_destructible_v<T>);
+        T* node = new (allocate(sizeof(T), alignof(T))) T{};
+        node->kind = T::node_kind;
+        node->line = line;
+        node->id = node_count++;
+        return node;
+    }
+
+    u32 get_node_count() const
+    {
+        return node_count;
+    }
+
+    std::string_view copy(std::string_view text)
+    {
+        if (text.empty()) {
+            return {};
+        }
+        auto data = static_cast<char*>(allocate(text.size(), 1));
+        std::memcpy(data, text.data(), text.size());
+        return std::string_view{data, text.size()};
+    }
+
+    template <typename T>
+    std::span<T> copy(const std::vector<T>& items)
+    {
+        if (items.empty()) {
+            return {};
+        }
+        auto data = static_cast<T*>(allocate(sizeof(T) * items.size(), alignof(T)));
+        std::uninitialized_copy(items.begin(), items.end(), data);
+        return std::span<T>{data, items.size()};
+    }
+
+private:
+    std::vector<std::unique_ptr<std::byte[]>> chunks;
+    std::byte* cursor = nullptr;
+    std::byte* limit = nullptr;
+    u32 node_count = 0;
+};
+
+/*
+ * A dense side table holding one T per node, the result of some analysis
+ * pass. Lookups index a vector by node id instead of hashing the pointer.
+ * Nodes the pass never wrote read as a value-initialized T.
+ */
+template <typename T>
+class NodeTable
+{
+public:
+    void resize(u32 node_count)
+    {
+        values.resize(node_count);
+    }
+
+    T& operator[](const Node* node)
+    {
+        return values[node->id];
+    }
+
+    const T& operator[](const Node* node) const
+    {
+        return values[node->id];
+    }
+
+private:
+    std::vector<T> values;
+};
+
+/*
+ * Walks the tree the way the ANTLR generated base visitor does: every
+ * visitXxx defaults to visiting the children of the node in source order,
+ * so a pass only overrides the nodes it cares about.
+ */
+class AstVisitor
+{
+public:
+    virtual ~AstVisitor() = default;
+
+    void visit(Node* node);
+    void visitChildren(Node* node);
+
+    virtual void visitSourceFile(SourceFileNode* node) { visitChildren(node); }
+    virtual void visitFunctionDecl(FunctionDeclNode* node) { visitChildren(node); }
+    virtual void visitVarDecl(VarDeclNode* node) { visitChildren(node); }
+    virtual void visitFunction(FunctionNode* node) { visitChildren(node); }
+    virtual void visitSignature(SignatureNode* node) { visitChildren(node); }
+    virtual void visitParameterDecl(ParameterDeclNode* node) { visitChildren(node); }
+    virtual void visitBlock(BlockNode* node) { visitChildren(node); }
+    virtual void visitLabeledStmt(LabeledStmtNode* node) { visitChildren(node); }
+    virtual void visitSendStmt(SendStmtNode* node) { visitChildren(node); }
+    virtual void visitExpressionStmt(ExpressionStmtNode* node) { visitChildren(node); }
+    virtual void visitAssignmentStmt(AssignmentStmtNode* node) { visitChildren(node); }
+    virtual void visitRecvAssignStmt(RecvAssignStmtNode* node) { visitChildren(node); }
+    virtual void visitGoStmt(GoStmtNode* node) { visitChildren(node); }
+    virtual void visitReturnStmt(ReturnStmtNode* node) { visitChildren(node); }
+    virtual void visitGotoStmt(GotoStmtNode* node) { visitChildren(node); }
+    virtual void visitDeferStmt(DeferStmtNode* node) { visitChildren(node); }
+    virtual void visitIfStmt(IfStmtNode* node) { visitChildren(node); }
+    virtual void visitForStmt(ForStmtNode* node) { visitChildren(node); }
+    virtual void visitRangeClause(RangeClauseNode* node) { visitChildren(node); }
+    virtual void visitSelectStmt(SelectStmtNode* node) { visitChildren(node); }
+    virtual void visitCommClause(CommClauseNode* node) { visitChildren(node); }
+    virtual void visitRecvStmt(RecvStmtNode* node) { visitChildren(node); }
+    virtual void visitEmptyStmt(EmptyStmtNode* node) { visitChildren(node); }
+    virtual void visitTypeName(TypeNameNode* node) { visitChildren(node); }
+    virtual void visitPointerType(PointerTypeNode* node) { visitChildren(node); }
+    virtual void visitSliceType(SliceTypeNode* node) { visitChildren(node); }
+    virtual void visitMapType(MapTypeNode* node) { visitChildren(node); }
+    virtual void visitChannelType(ChannelTypeNode* node) { visitChildren(node); }
+    virtual void visitFunctionType(FunctionTypeNode* node) { visitChildren(node); }
+    virtual void visitStructType(StructTypeNode* node) { visitChildren(node); }
+    virtual void visitFieldDecl(FieldDeclNode* node) { visitChildren(node); }
+    virtual void visitBasicLit(BasicLitNode* node) { visitChildren(node); }
+    virtual void visitOperandName(OperandNameNode* node) { visitChildren(node); }
+    virtual void visitCompositeLit(CompositeLitNode* node) { visitChildren(node); }
+    virtual void visitLiteralValue(LiteralValueNode* node) { visitChildren(node); }
+    virtual void visitFunctionLit(FunctionLitNode* node) { visitChildren(node); }
+    virtual void visitCastExpr(CastExprNode* node) { visitChildren(node); }
+    virtual void visitFieldExpr(FieldExprNode* node) { visitChildren(node); }
+    virtual void visitIndexExpr(IndexExprNode* node) { visitChildren(node); }
+    virtual void visitSliceExpr(SliceExprNode* node) { visitChildren(node); }
+    virtual void visitCallExpr(CallExprNode* node) { visitChildren(node); }
+    virtual void visitUnaryExpr(UnaryExprNode* node) { visitChildren(node); }
+    virtual void visitBinaryExpr(BinaryExprNode* node) { visitChildren(node); }
+
+private:
+    void dispatch(Node* node);
+};
+
+/* one node per line, indented by depth; used to compare the front ends */
+void dump_ast(std::ostream& os, const Node* node);
+
+/* a hash of what the dump shows, lines counted from the node's own so moving code keeps it */
+u64 hash_ast(const Node* node);
+
+#endif /* AST_HPP */
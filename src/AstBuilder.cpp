@@ -0,0 +1,489 @@
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "AstBuilder.hpp"
+
+static Operator get_unary_operator(const std::string& text)
+{
+    if (text == "+") {
+        return Operator::plus;
+    }
+    if (text == "-") {
+        return Operator::neg;
+    }
+    if (text == "!") {
+        return Operator::not_;
+    }
+    if (text == "^") {
+        return Operator::complement;
+    }
+    if (text == "*") {
+        return Operator::deref;
+    }
+    if (text == "&") {
+        return Operator::address;
+    }
+    return Operator::recv;
+}
+
+static Operator get_binary_operator(const std::string& text)
+{
+    static constexpr Operator binary_operators[] = {
+        Operator::lor,
+        Operator::land,
+        Operator::eq,
+        Operator::ne,
+        Operator::lt,
+        Operator::le,
+        Operator::gt,
+        Operator::ge,
+        Operator::add,
+        Operator::sub,
+        Operator::or_,
+        Operator::xor_,
+        Operator::mul,
+        Operator::div,
+        Operator::rem,
+        Operator::shl,
+        Operator::shr,
+        Operator::and_,
+    };
+    for (auto op : binary_operators) {
+        if (text == get_operator_text(op)) {
+            return op;
+        }
+    }
+    throw std::runtime_error("ast builder: unknown binary operator '" + text + "'");
+}
+
+AstBuilder::AstBuilder(AstArena& arena) : arena{arena}
+{
+}
+
+SourceFileNode* AstBuilder::build_source_file(GOatLANGParser::SourceFileContext* ctx)
+{
+    auto source_file = make<SourceFileNode>(ctx);
+    std::vector<Node*> declarations;
+    for (auto top_level_decl : ctx->topLevelDecl()) {
+        if (auto var_decl = top_level_decl->varDecl(); var_decl) {
+            declarations.push_back(build_var_decl(var_decl));
+        } else {
+            declarations.push_back(build_function_decl(top_level_decl->functionDecl()));
+        }
+    }
+    source_file->declarations = arena.copy(declarations);
+    source_file->node_count = arena.get_node_count();
+    return source_file;
+}
+
+FunctionDeclNode* AstBuilder::build_function_decl(GOatLANGParser::FunctionDeclContext* ctx)
+{
+    auto function_decl = make<FunctionDeclNode>(ctx);
+    function_decl->name = copy(ctx->IDENTIFIER());
+    function_decl->function = build_function(ctx->function());
+    return function_decl;
+}
+
+VarDeclNode* AstBuilder::build_var_decl(GOatLANGParser::VarDeclContext* ctx)
+{
+    auto var_decl = make<VarDeclNode>(ctx);
+    auto var_spec = ctx->varSpec();
+    var_decl->name = copy(var_spec->IDENTIFIER());
+    var_decl->type = build_type(var_spec->goType());
+    if (auto expression = var_spec->expression(); expression) {
+        var_decl->value = build_expression(expression);
+    }
+    return var_decl;
+}
+
+FunctionNode* AstBuilder::build_function(GOatLANGParser::FunctionContext* ctx)
+{
+    auto function = make<FunctionNode>(ctx);
+    function->signature = build_signature(ctx->signature());
+    function->body = build_block(ctx->block());
+    return function;
+}
+
+SignatureNode* AstBuilder::build_signature(GOatLANGParser::SignatureContext* ctx)
+{
+    auto signature = make<SignatureNode>(ctx);
+    std::vector<ParameterDeclNode*> parameters;
+    if (auto parameter_list = ctx->parameters()->parameterList(); parameter_list) {
+        for (auto parameter_decl_ctx : parameter_list->parameterDecl()) {
+            auto parameter_decl = make<ParameterDeclNode>(parameter_decl_ctx);
+            if (auto identifier = parameter_decl_ctx->IDENTIFIER(); identifier) {
+                parameter_decl->name = copy(identifier);
+            }
+            parameter_decl->type = build_type(parameter_decl_ctx->goType());
+            parameters.push_back(parameter_decl);
+        }
+    }
+    signature->parameters = arena.copy(parameters);
+    if (auto result = ctx->result(); result) {
+        signature->result = build_type(result->goType());
+    }
+    return signature;
+}
+
+BlockNode* AstBuilder::build_block(GOatLANGParser::BlockContext* ctx)
+{
+    auto block = make<BlockNode>(ctx);
+    block->statements = build_statement_list(ctx->statementList());
+    return block;
+}
+
+std::span<Node*> AstBuilder::build_statement_list(GOatLANGParser::StatementListContext* ctx)
+{
+    std::vector<Node*> statements;
+    for (auto statement : ctx->statement()) {
+        statements.push_back(build_statement(statement));
+    }
+    return arena.copy(statements);
+}
+
+Node* AstBuilder::build_statement(GOatLANGParser::StatementContext* ctx)
+{
+    if (auto var_decl = ctx->varDecl(); var_decl) {
+        return build_var_decl(var_decl);
+    }
+    if (auto labeled_stmt_ctx = ctx->labeledStmt(); labeled_stmt_ctx) {
+        auto labeled_stmt = make<LabeledStmtNode>(labeled_stmt_ctx);
+        labeled_stmt->label = copy(labeled_stmt_ctx->IDENTIFIER());
+        labeled_stmt->statement = build_statement(labeled_stmt_ctx->statement());
+        return labeled_stmt;
+    }
+    if (auto send_stmt = ctx->sendStmt(); send_stmt) {
+        return build_send_stmt(send_stmt);
+    }
+    if (auto expression_stmt_ctx = ctx->expressionStmt(); expression_stmt_ctx) {
+        auto expression_stmt = make<ExpressionStmtNode>(expression_stmt_ctx);
+        expression_stmt->expression = build_expression(expression_stmt_ctx->expression());
+        return expression_stmt;
+    }
+    if (auto assignment_stmt_ctx = ctx->assignmentStmt(); assignment_stmt_ctx) {
+        auto assignment_stmt = make<AssignmentStmtNode>(assignment_stmt_ctx);
+        assignment_stmt->name = copy(assignment_stmt_ctx->IDENTIFIER(0));
+        if (auto index = assignment_stmt_ctx->index; index) {
+            assignment_stmt->index = build_expression(index);
+        }
+        std::vector<std::string_view> fields;
+        for (auto field : assignment_stmt_ctx->fields) {
+            fields.push_back(arena.copy(field->getText()));
+        }
+        assignment_stmt->fields = arena.copy(fields);
+        assignment_stmt->value = build_expression(assignment_stmt_ctx->value);
+        return assignment_stmt;
+    }
+    if (auto recv_assign_stmt_ctx = ctx->recvAssignStmt(); recv_assign_stmt_ctx) {
+        auto recv_assign_stmt = make<RecvAssignStmtNode>(recv_assign_stmt_ctx);
+        recv_assign_stmt->value_name = copy(recv_assign_stmt_ctx->IDENTIFIER(0));
+        recv_assign_stmt->ok_name = copy(recv_assign_stmt_ctx->IDENTIFIER(1));
+        recv_assign_stmt->declares = recv_assign_stmt_ctx->assign_op->getText() == ":=";
+        recv_assign_stmt->channel = build_expression(recv_assign_stmt_ctx->expression());
+        return recv_assign_stmt;
+    }
+    if (auto go_stmt_ctx = ctx->goStmt(); go_stmt_ctx) {
+        auto go_stmt = make<GoStmtNode>(go_stmt_ctx);
+        go_stmt->expression = build_expression(go_stmt_ctx->expression());
+        return go_stmt;
+    }
+    if (auto return_stmt_ctx = ctx->returnStmt(); return_stmt_ctx) {
+        auto return_stmt = make<ReturnStmtNode>(return_stmt_ctx);
+        if (auto expression = return_stmt_ctx->expression(); expression) {
+            return_stmt->value = build_expression(expression);
+        }
+        return return_stmt;
+    }
+    if (auto goto_stmt_ctx = ctx->gotoStmt(); goto_stmt_ctx) {
+        auto goto_stmt = make<GotoStmtNode>(goto_stmt_ctx);
+        goto_stmt->label = copy(goto_stmt_ctx->IDENTIFIER());
+        return goto_stmt;
+    }
+    if (auto block = ctx->block(); block) {
+        return build_block(block);
+    }
+    if (auto if_stmt = ctx->ifStmt(); if_stmt) {
+        return build_if_stmt(if_stmt);
+    }
+    if (auto for_stmt = ctx->forStmt(); for_stmt) {
+        return build_for_stmt(for_stmt);
+    }
+    if (auto select_stmt = ctx->selectStmt(); select_stmt) {
+        return build_select_stmt(select_stmt);
+    }
+    if (auto defer_stmt_ctx = ctx->deferStmt(); defer_stmt_ctx) {
+        auto defer_stmt = make<DeferStmtNode>(defer_stmt_ctx);
+        defer_stmt->expression = build_expression(defer_stmt_ctx->expression());
+        return defer_stmt;
+    }
+    return make<EmptyStmtNode>(ctx);
+}
+
+SendStmtNode* AstBuilder::build_send_stmt(GOatLANGParser::SendStmtContext* ctx)
+{
+    auto send_stmt = make<SendStmtNode>(ctx);
+    send_stmt->channel = copy(ctx->IDENTIFIER());
+    send_stmt->value = build_expression(ctx->expression());
+    return send_stmt;
+}
+
+IfStmtNode* AstBuilder::build_if_stmt(GOatLANGParser::IfStmtContext* ctx)
+{
+    auto if_stmt = make<IfStmtNode>(ctx);
+    if_stmt->condition = build_expression(ctx->expression());
+    if_stmt->then_block = build_block(ctx->block(0));
+    if (auto block = ctx->block(1); block) {
+        if_stmt->else_branch = build_block(block);
+    } else if (auto else_if_stmt = ctx->ifStmt(); else_if_stmt) {
+        if_stmt->else_branch = build_if_stmt(else_if_stmt);
+    }
+    return if_stmt;
+}
+
+ForStmtNode* AstBuilder::build_for_stmt(GOatLANGParser::ForStmtContext* ctx)
+{
+    auto for_stmt = make<ForStmtNode>(ctx);
+    if (auto range_clause_ctx = ctx->rangeClause(); range_clause_ctx) {
+        auto range_clause = make<RangeClauseNode>(range_clause_ctx);
+        range_clause->name = copy(range_clause_ctx->IDENTIFIER());
+        range_clause->declares = range_clause_ctx->assign_op->getText() == ":=";
+        range_clause->channel = build_expression(range_clause_ctx->expression());
+        for_stmt->range = range_clause;
+    } else if (auto expression = ctx->expression(); expression) {
+        for_stmt->condition = build_expression(expression);
+    }
+    for_stmt->body = build_block(ctx->block());
+    return for_stmt;
+}
+
+SelectStmtNode* AstBuilder::build_select_stmt(GOatLANGParser::SelectStmtContext* ctx)
+{
+    auto select_stmt = make<SelectStmtNode>(ctx);
+    std::vector<CommClauseNode*> clauses;
+    for (auto comm_clause_ctx : ctx->commClause()) {
+        auto comm_clause = make<CommClauseNode>(comm_clause_ctx);
+        auto comm_case = comm_clause_ctx->commCase();
+        if (auto send_stmt = comm_case->sendStmt(); send_stmt) {
+            comm_clause->send = build_send_stmt(send_stmt);
+        } else if (auto recv_stmt_ctx = comm_case->recvStmt(); recv_stmt_ctx) {
+            auto recv_stmt = make<RecvStmtNode>(recv_stmt_ctx);
+            if (auto identifier = recv_stmt_ctx->IDENTIFIER(0); identifier) {
+                recv_stmt->value_name = copy(identifier);
+            }
+            if (auto identifier = recv_stmt_ctx->IDENTIFIER(1); identifier) {
+                recv_stmt->ok_name = copy(identifier);
+            }
+            recv_stmt->declares = recv_stmt_ctx->assign_op && recv_stmt_ctx->assign_op->getText() == ":=";
+            recv_stmt->channel = build_expression(recv_stmt_ctx->expression());
+            comm_clause->recv = recv_stmt;
+        }
+        comm_clause->statements = build_statement_list(comm_clause_ctx->statementList());
+        clauses.push_back(comm_clause);
+    }
+    select_stmt->clauses = arena.copy(clauses);
+    return select_stmt;
+}
+
+Node* AstBuilder::build_type(GOatLANGParser::GoTypeContext* ctx)
+{
+    if (auto type_name = ctx->typeName(); type_name) {
+        return build_type_name(type_name);
+    }
+    if (auto type_lit = ctx->typeLit(); type_lit) {
+        return build_type_lit(type_lit);
+    }
+    return build_type(ctx->goType());
+}
+
+Node* AstBuilder::build_type_lit(GOatLANGParser::TypeLitContext* ctx)
+{
+    if (auto struct_type = ctx->structType(); struct_type) {
+        return build_struct_type(struct_type);
+    }
+    if (auto pointer_type_ctx = ctx->pointerType(); pointer_type_ctx) {
+        auto pointer_type = make<PointerTypeNode>(pointer_type_ctx);
+        pointer_type->element_type = build_type(pointer_type_ctx->goType());
+        return pointer_type;
+    }
+    if (auto function_type_ctx = ctx->functionType(); function_type_ctx) {
+        auto function_type = make<FunctionTypeNode>(function_type_ctx);
+        function_type->signature = build_signature(function_type_ctx->signature());
+        return function_type;
+    }
+    if (auto slice_type = ctx->sliceType(); slice_type) {
+        return build_slice_type(slice_type);
+    }
+    if (auto map_type_ctx = ctx->mapType(); map_type_ctx) {
+        auto map_type = make<MapTypeNode>(map_type_ctx);
+        map_type->key_type = build_type(map_type_ctx->key);
+        map_type->value_type = build_type(map_type_ctx->value);
+        return map_type;
+    }
+    auto channel_type_ctx = ctx->channelType();
+    auto channel_type = make<ChannelTypeNode>(channel_type_ctx);
+    /* chan T, chan <- T or <- chan T */
+    if (channel_type_ctx->getStart()->getText() == "<-") {
+        channel_type->direction = ChannelDirection::recv;
+    } else if (channel_type_ctx->children.size() == 3) {
+        channel_type->direction = ChannelDirection::send;
+    }
+    channel_type->element_type = build_type(channel_type_ctx->goType());
+    return channel_type;
+}
+
+TypeNameNode* AstBuilder::build_type_name(GOatLANGParser::TypeNameContext* ctx)
+{
+    auto type_name = make<TypeNameNode>(ctx);
+    type_name->name = copy(ctx->IDENTIFIER());
+    return type_name;
+}
+
+SliceTypeNode* AstBuilder::build_slice_type(GOatLANGParser::SliceTypeContext* ctx)
+{
+    auto slice_type = make<SliceTypeNode>(ctx);
+    slice_type->element_type = build_type(ctx->goType());
+    return slice_type;
+}
+
+StructTypeNode* AstBuilder::build_struct_type(GOatLANGParser::StructTypeContext* ctx)
+{
+    auto struct_type = make<StructTypeNode>(ctx);
+    std::vector<FieldDeclNode*> fields;
+    for (auto field_decl_ctx : ctx->fieldDecl()) {
+        auto field_decl = make<FieldDeclNode>(field_decl_ctx);
+        field_decl->name = copy(field_decl_ctx->IDENTIFIER());
+        field_decl->type = build_type(field_decl_ctx->goType());
+        fields.push_back(field_decl);
+    }
+    struct_type->fields = arena.copy(fields);
+    return struct_type;
+}
+
+Node* AstBuilder::build_expression(GOatLANGParser::ExpressionContext* ctx)
+{
+    if (auto primary_expr = dynamic_cast<GOatLANGParser::PrimaryExpr_Context*>(ctx); primary_expr) {
+        return build_primary_expr(primary_expr->primaryExpr());
+    }
+    if (auto unary_expr_ctx = dynamic_cast<GOatLANGParser::UnaryExprContext*>(ctx); unary_expr_ctx) {
+        auto unary_expr = make<UnaryExprNode>(unary_expr_ctx);
+        unary_expr->op = get_unary_operator(unary_expr_ctx->unary_op->getText());
+        unary_expr->operand = build_expression(unary_expr_ctx->expression());
+        return unary_expr;
+    }
+    auto binary_expr_ctx = dynamic_cast<GOatLANGParser::BinaryExprContext*>(ctx);
+    auto binary_expr = make<BinaryExprNode>(binary_expr_ctx);
+    binary_expr->op = get_binary_operator(binary_expr_ctx->binary_op->getText());
+    binary_expr->left = build_expression(binary_expr_ctx->expression(0));
+    binary_expr->right = build_expression(binary_expr_ctx->expression(1));
+    return binary_expr;
+}
+
+Node* AstBuilder::build_primary_expr(GOatLANGParser::PrimaryExprContext* ctx)
+{
+    if (auto operand = dynamic_cast<GOatLANGParser::Operand_Context*>(ctx); operand) {
+        return build_operand(operand->operand());
+    }
+    if (auto cast_expr_ctx = dynamic_cast<GOatLANGParser::CastExprContext*>(ctx); cast_expr_ctx) {
+        auto cast_expr = make<CastExprNode>(cast_expr_ctx);
+        cast_expr->type = build_type(cast_expr_ctx->goType());
+        cast_expr->operand = build_expression(cast_expr_ctx->expression());
+        return cast_expr;
+    }
+    if (auto field_expr_ctx = dynamic_cast<GOatLANGParser::FieldExprContext*>(ctx); field_expr_ctx) {
+        auto field_expr = make<FieldExprNode>(field_expr_ctx);
+        field_expr->operand = build_primary_expr(field_expr_ctx->primaryExpr());
+        field_expr->field = copy(field_expr_ctx->IDENTIFIER());
+        return field_expr;
+    }
+    if (auto index_expr_ctx = dynamic_cast<GOatLANGParser::IndexExprContext*>(ctx); index_expr_ctx) {
+        auto index_expr = make<IndexExprNode>(index_expr_ctx);
+        index_expr->operand = build_primary_expr(index_expr_ctx->primaryExpr());
+        index_expr->index = build_expression(index_expr_ctx->expression());
+        return index_expr;
+    }
+    if (auto slice_expr_ctx = dynamic_cast<GOatLANGParser::SliceExprContext*>(ctx); slice_expr_ctx) {
+        auto slice_expr = make<SliceExprNode>(slice_expr_ctx);
+        slice_expr->operand = build_primary_expr(slice_expr_ctx->primaryExpr());
+        if (auto low = slice_expr_ctx->low; low) {
+            slice_expr->low = build_expression(low);
+        }
+        if (auto high = slice_expr_ctx->high; high) {
+            slice_expr->high = build_expression(high);
+        }
+        return slice_expr;
+    }
+    auto call_expr_ctx = dynamic_cast<GOatLANGParser::CallExprContext*>(ctx);
+    auto call_expr = make<CallExprNode>(call_expr_ctx);
+    call_expr->callee = build_primary_expr(call_expr_ctx->primaryExpr());
+    std::vector<Node*> arguments;
+    if (auto arguments_ctx = call_expr_ctx->arguments(); arguments_ctx) {
+        if (auto go_type = arguments_ctx->goType(); go_type) {
+            call_expr->type_argument = build_type(go_type);
+        }
+        if (auto expression_list = arguments_ctx->expressionList(); expression_list) {
+            for (auto expression : expression_list->expression()) {
+                arguments.push_back(build_expression(expression));
+            }
+        }
+    }
+    call_expr->arguments = arena.copy(arguments);
+    return call_expr;
+}
+
+Node* AstBuilder::build_operand(GOatLANGParser::OperandContext* ctx)
+{
+    if (auto operand_name_ctx = ctx->operandName(); operand_name_ctx) {
+        auto operand_name = make<OperandNameNode>(operand_name_ctx);
+        operand_name->name = copy(operand_name_ctx->IDENTIFIER());
+        return operand_name;
+    }
+    if (auto expression = ctx->expression(); expression) {
+        return build_expression(expression);
+    }
+    auto literal = ctx->literal();
+    if (auto basic_lit_ctx = literal->basicLit(); basic_lit_ctx) {
+        auto basic_lit = make<BasicLitNode>(basic_lit_ctx);
+        if (basic_lit_ctx->INT_LIT()) {
+            basic_lit->literal_kind = LiteralKind::int_;
+        } else if (basic_lit_ctx->FLOAT_LIT()) {
+            basic_lit->literal_kind = LiteralKind::float_;
+        } else {
+            basic_lit->literal_kind = LiteralKind::string;
+        }
+        basic_lit->text = arena.copy(basic_lit_ctx->getText());
+        return basic_lit;
+    }
+    if (auto composite_lit_ctx = literal->compositeLit(); composite_lit_ctx) {
+        auto composite_lit = make<CompositeLitNode>(composite_lit_ctx);
+        auto literal_type = composite_lit_ctx->literalType();
+        if (auto struct_type = literal_type->structType(); struct_type) {
+            composite_lit->type = build_struct_type(struct_type);
+        } else if (auto slice_type = literal_type->sliceType(); slice_type) {
+            composite_lit->type = build_slice_type(slice_type);
+        } else {
+            composite_lit->type = build_type_name(literal_type->typeName());
+        }
+        composite_lit->value = build_literal_value(composite_lit_ctx->literalValue());
+        return composite_lit;
+    }
+    auto function_lit_ctx = literal->functionLit();
+    auto function_lit = make<FunctionLitNode>(function_lit_ctx);
+    function_lit->function = build_function(function_lit_ctx->function());
+    return function_lit;
+}
+
+LiteralValueNode* AstBuilder::build_literal_value(GOatLANGParser::LiteralValueContext* ctx)
+{
+    auto literal_value = make<LiteralValueNode>(ctx);
+    std::vector<Node*> elements;
+    for (auto element : ctx->elementList()->element()) {
+        if (auto expression = element->expression(); expression) {
+            elements.push_back(build_expression(expression));
+        } else {
+            elements.push_back(build_literal_value(element->literalValue()));
+        }
+    }
+    literal_value->elements = arena.copy(elements);
+    return literal_value;
+}
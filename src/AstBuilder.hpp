@@ -0,0 +1,60 @@
+#ifndef AST_BUILDER_HPP
+#define AST_BUILDER_HPP
+
+#include "Ast.hpp"
+
+#include "GOatLANGParser.h"
+
+/*
+ * Converts an ANTLR parse tree of GOatLANG.g4 into the arena tree the
+ * hand-written parser builds, so both front ends feed the same compiler and
+ * their trees can be compared node for node. Parenthesised expressions and
+ * types are collapsed, lines are those of each rule's first token.
+ */
+class AstBuilder
+{
+public:
+    AstBuilder(AstArena& arena);
+
+    SourceFileNode* build_source_file(GOatLANGParser::SourceFileContext* ctx);
+
+private:
+    FunctionDeclNode* build_function_decl(GOatLANGParser::FunctionDeclContext* ctx);
+    VarDeclNode* build_var_decl(GOatLANGParser::VarDeclContext* ctx);
+    FunctionNode* build_function(GOatLANGParser::FunctionContext* ctx);
+    SignatureNode* build_signature(GOatLANGParser::SignatureContext* ctx);
+
+    BlockNode* build_block(GOatLANGParser::BlockContext* ctx);
+    std::span<Node*> build_statement_list(GOatLANGParser::StatementListContext* ctx);
+    Node* build_statement(GOatLANGParser::StatementContext* ctx);
+    SendStmtNode* build_send_stmt(GOatLANGParser::SendStmtContext* ctx);
+    IfStmtNode* build_if_stmt(GOatLANGParser::IfStmtContext* ctx);
+    ForStmtNode* build_for_stmt(GOatLANGParser::ForStmtContext* ctx);
+    SelectStmtNode* build_select_stmt(GOatLANGParser::SelectStmtContext* ctx);
+
+    Node* build_type(GOatLANGParser::GoTypeContext* ctx);
+    Node* build_type_lit(GOatLANGParser::TypeLitContext* ctx);
+    TypeNameNode* build_type_name(GOatLANGParser::TypeNameContext* ctx);
+    SliceTypeNode* build_slice_type(GOatLANGParser::SliceTypeContext* ctx);
+    StructTypeNode* build_struct_type(GOatLANGParser::StructTypeContext* ctx);
+
+    Node* build_expression(GOatLANGParser::ExpressionContext* ctx);
+    Node* build_primary_expr(GOatLANGParser::PrimaryExprContext* ctx);
+    Node* build_operand(GOatLANGParser::OperandContext* ctx);
+    LiteralValueNode* build_literal_value(GOatLANGParser::LiteralValueContext* ctx);
+
+    template <typename T>
+    T* make(antlr4::ParserRuleContext* ctx)
+    {
+        return arena.make<T>(static_cast<u32>(ctx->getStart()->getLine()));
+    }
+
+    std::string_view copy(antlr4::tree::TerminalNode* node)
+    {
+        return arena.copy(node->getText());
+    }
+
+    AstArena& arena;
+};
+
+#endif /* AST_BUILDER_HPP */
@@ -1,21 +1,96 @@
 #ifndef BLOCKING_QUEUE_HPP
 #define BLOCKING_QUEUE_HPP
 
+#include <algorithm>
 #include <condition_variable>
 #include <deque>
 #include <mutex>
+#include <random>
+#include <stdexcept>
+#include <vector>
 
 #include "Common.hpp"
 
+struct SelectWaiter
+{
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool signaled = false;
+};
+
+/*
+ * Told when a queue operation is about to sleep and, after the queue is
+ * unlocked again, that it has woken up. Operations that never sleep don't
+ * call it.
+ */
+class WaitListener
+{
+public:
+    virtual ~WaitListener() = default;
+    virtual void on_wait() = 0;
+    virtual void on_wake() = 0;
+};
+
+class BlockingQueue;
+
+struct SelectCase
+{
+    BlockingQueue* queue;
+    bool is_send;
+    u64 item;
+    bool ok = true;
+};
+
 class BlockingQueue
 {
     std::deque<u64> content;
     u64 capacity;
+    bool closed = false;
 
     std::mutex mutex;
     std::condition_variable not_empty;
     std::condition_variable not_full;
 
+    /* selects currently parked on this queue, woken on every state change */
+    std::vector<SelectWaiter*> waiters;
+
+    void notify_waiters()
+    {
+        for (SelectWaiter* waiter : waiters) {
+            std::lock_guard lock{waiter->mutex};
+            waiter->signaled = true;
+            waiter->ready.notify_one();
+        }
+    }
+
+    bool can_push() const { return content.size() < capacity; }
+    bool can_pop() const { return !content.empty(); }
+
+    void check_open() const
+    {
+        if (closed) {
+            throw std::runtime_error("send on closed channel");
+        }
+    }
+
+    template <typename Predicate>
+    static void wait(
+        std::condition_variable& condition,
+        std::unique_lock<std::mutex>& lock,
+        Predicate predicate,
+        WaitListener* listener,
+        bool& waited)
+    {
+        if (predicate()) {
+            return;
+        }
+        if (listener) {
+            listener->on_wait();
+        }
+        condition.wait(lock, predicate);
+        waited = true;
+    }
+
 public:
     BlockingQueue() = delete;
     BlockingQueue(const BlockingQueue&) = delete;
@@ -25,51 +100,199 @@ public:
 
     BlockingQueue(u64 capacity) : capacity(capacity) {}
 
-    void push(u64 item)
+    void push(u64 item, WaitListener* listener = nullptr)
     {
+        bool waited = false;
         {
             std::unique_lock<std::mutex> lock{mutex};
-            not_full.wait(lock, [this]() { return content.size() < capacity; });
+            wait(not_full, lock, [this]() { return closed || can_push(); }, listener, waited);
+            if (closed) {
+                lock.unlock();
+                if (waited) {
+                    listener->on_wake();
+                }
+                throw std::runtime_error("send on closed channel");
+            }
             content.push_back(item);
+            notify_waiters();
         }
         not_empty.notify_one();
+        if (waited) {
+            listener->on_wake();
+        }
     }
 
     bool try_push(u64 item)
     {
         {
             std::unique_lock<std::mutex> lock{mutex};
-            if (content.size() == capacity)
+            check_open();
+            if (!can_push())
                 return false;
             content.push_back(item);
+            notify_waiters();
         }
         not_empty.notify_one();
         return true;
     }
 
-    void pop(u64& item)
+    /* returns false once the queue is closed and drained */
+    bool pop(u64& item, WaitListener* listener = nullptr)
     {
+        bool waited = false;
+        bool popped = false;
         {
             std::unique_lock<std::mutex> lock{mutex};
-            not_empty.wait(lock, [this]() { return !content.empty(); });
-            item = content.front();
-            content.pop_front();
+            wait(not_empty, lock, [this]() { return closed || can_pop(); }, listener, waited);
+            if (can_pop()) {
+                item = content.front();
+                content.pop_front();
+                notify_waiters();
+                popped = true;
+            }
         }
-        not_full.notify_one();
+        if (popped) {
+            not_full.notify_one();
+        }
+        if (waited) {
+            listener->on_wake();
+        }
+        return popped;
     }
 
     bool try_pop(u64& item)
     {
         {
             std::unique_lock<std::mutex> lock{mutex};
-            if (content.empty())
+            if (!can_pop())
                 return false;
             item = content.front();
             content.pop_front();
+            notify_waiters();
         }
         not_full.notify_one();
         return true;
     }
+
+    void close()
+    {
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            if (closed) {
+                throw std::runtime_error("close of closed channel");
+            }
+            closed = true;
+            notify_waiters();
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+    /*
+     * Completes one of the cases and returns its index, or -1 when no case is
+     * ready and the select is non-blocking. The queues are locked together in
+     * address order, so readiness is checked and a single waiter is registered
+     * on every queue atomically; a wakeup can't slip in between the two.
+     * A received item is written back to the item field of its case; a
+     * receive from a closed and drained queue completes with ok cleared.
+     */
+    static i64 select(std::vector<SelectCase>& cases, bool blocking, WaitListener* listener = nullptr)
+    {
+        thread_local std::minstd_rand random{std::random_device{}()};
+
+        std::vector<BlockingQueue*> queues;
+        for (const auto& select_case : cases) {
+            queues.push_back(select_case.queue);
+        }
+        std::sort(queues.begin(), queues.end());
+        queues.erase(std::unique(queues.begin(), queues.end()), queues.end());
+
+        SelectWaiter waiter;
+        bool registered = false;
+        bool waited = false;
+        /* wakes the listener on every way out once the queues are unlocked */
+        auto finish = [&](i64 index) {
+            if (waited && listener) {
+                listener->on_wake();
+            }
+            return index;
+        };
+        while (true) {
+            for (BlockingQueue* queue : queues) {
+                queue->mutex.lock();
+            }
+            if (registered) {
+                for (BlockingQueue* queue : queues) {
+                    auto& queue_waiters = queue->waiters;
+                    queue_waiters.erase(std::find(queue_waiters.begin(), queue_waiters.end(), &waiter));
+                }
+                registered = false;
+            }
+
+            /* start from a random case so that no channel is starved */
+            u64 count = cases.size();
+            u64 offset = count ? random() % count : 0;
+            for (u64 i = 0; i < count; ++i) {
+                u64 index = (offset + i) % count;
+                auto& select_case = cases[index];
+                BlockingQueue* queue = select_case.queue;
+                if (select_case.is_send && (queue->closed || queue->can_push())) {
+                    if (queue->closed) {
+                        for (BlockingQueue* locked_queue : queues) {
+                            locked_queue->mutex.unlock();
+                        }
+                        finish(-1);
+                        throw std::runtime_error("send on closed channel");
+                    }
+                    queue->content.push_back(select_case.item);
+                } else if (!select_case.is_send && queue->can_pop()) {
+                    select_case.item = queue->content.front();
+                    queue->content.pop_front();
+                } else if (!select_case.is_send && queue->closed) {
+                    select_case.ok = false;
+                    for (BlockingQueue* locked_queue : queues) {
+                        locked_queue->mutex.unlock();
+                    }
+                    return finish(static_cast<i64>(index));
+                } else {
+                    continue;
+                }
+                queue->notify_waiters();
+                for (BlockingQueue* locked_queue : queues) {
+                    locked_queue->mutex.unlock();
+                }
+                if (select_case.is_send) {
+                    queue->not_empty.notify_one();
+                } else {
+                    queue->not_full.notify_one();
+                }
+                return finish(static_cast<i64>(index));
+            }
+
+            if (!blocking) {
+                for (BlockingQueue* queue : queues) {
+                    queue->mutex.unlock();
+                }
+                return finish(-1);
+            }
+
+            waiter.signaled = false;
+            for (BlockingQueue* queue : queues) {
+                queue->waiters.push_back(&waiter);
+            }
+            registered = true;
+            if (listener && !waited) {
+                listener->on_wait();
+            }
+            waited = true;
+            for (BlockingQueue* queue : queues) {
+                queue->mutex.unlock();
+            }
+
+            std::unique_lock lock{waiter.mutex};
+            waiter.ready.wait(lock, [&waiter]() { return waiter.signaled; });
+        }
+    }
 };
 
 #endif /* BLOCKING_QUEUE_HPP */
@@ -1,7 +1,11 @@
 #ifndef CALL_STACK_HPP
 #define CALL_STACK_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <compare>
 #include <memory>
+#include <stdexcept>
 
 #include "Code.hpp"
 
@@ -12,6 +16,15 @@ struct FrameData
     u64 program_counter;
 };
 
+/* an instruction of a function, where a frame is executing */
+struct CodeLocation
+{
+    u64 function_index;
+    u64 program_counter;
+
+    auto operator<=>(const CodeLocation&) const = default;
+};
+
 class CallStack
 {
 public:
@@ -21,17 +34,21 @@ public:
     CallStack& operator=(const CallStack&) = delete;
     CallStack& operator=(CallStack&&) = default;
 
-    CallStack(u64 stack_size) : managed_memory{std::make_unique<std::byte[]>(stack_size)},
-                                memory{managed_memory.get()},
-                                top{0},
-                                size{stack_size},
-                                frame_pointer{0}
+    CallStack(u64 initial_size, u64 max_size) : managed_memory{std::make_unique<std::byte[]>(initial_size)},
+                                                memory{managed_memory.get()},
+                                                top{0},
+                                                size{initial_size},
+                                                initial_size{initial_size},
+                                                max_size{max_size},
+                                                frame_pointer{0}
     {
     }
 
     bool empty() const { return top == 0; }
     u64 get_size() const { return size; }
+    u64 get_max_size() const { return max_size; }
     u64 get_frame_pointer() const { return frame_pointer; }
+    u64 get_top() const { return top; }
 
     template <typename T>
     T read_local(u64 frame_address, u64 index)
@@ -64,6 +81,9 @@ public:
         FrameData frame_data = read<FrameData>(memory, frame_pointer);
         top = frame_pointer;
         frame_pointer = frame_data.frame_pointer;
+        if (top < size / 4 && size > initial_size) {
+            shrink();
+        }
         return frame_data.program_counter;
     }
 
@@ -75,12 +95,59 @@ public:
             frame_pointer,
             program_counter,
         };
-        write(memory, top, frame_data);
         u64 frame_size = sizeof(FrameData) + sizeof(Word) * function.varc;
+        if (top + frame_size > size) {
+            grow(top + frame_size);
+        }
+        write(memory, top, frame_data);
         frame_pointer = top;
         top += frame_size;
     }
 
+    /* the top frame becomes a frame of function, returning where the one it replaces would have */
+    void replace_frame(const Function& function)
+    {
+        u64 frame_size = sizeof(FrameData) + sizeof(Word) * function.varc;
+        if (frame_pointer + frame_size > size) {
+            grow(frame_pointer + frame_size);
+        }
+        FrameData frame_data = read<FrameData>(memory, frame_pointer);
+        frame_data.function_index = function.index;
+        write(memory, frame_pointer, frame_data);
+        top = frame_pointer + frame_size;
+    }
+
+    /*
+     * Frames refer to each other by offset, so the stack can be moved to a
+     * larger buffer wholesale. Doubling keeps the cost of copying amortized
+     * constant per push.
+     */
+    void grow(u64 required_size)
+    {
+        if (required_size > max_size) {
+            throw std::runtime_error("call stack overflow!");
+        }
+        resize(std::min(std::max(size * 2, required_size), max_size));
+    }
+
+    /* halves a mostly unused stack, never below its initial size */
+    void shrink()
+    {
+        u64 new_size = std::max(size / 2, initial_size);
+        if (top <= new_size) {
+            resize(new_size);
+        }
+    }
+
+    void reset()
+    {
+        top = 0;
+        frame_pointer = 0;
+        if (size != initial_size) {
+            resize(initial_size);
+        }
+    }
+
     const FrameData& read_frame_data(u64 frame_address)
     {
         return read<FrameData>(memory, frame_address);
@@ -92,10 +159,23 @@ public:
     }
 
 private:
+    void resize(u64 new_size)
+    {
+        auto new_memory = std::make_unique<std::byte[]>(new_size);
+        std::memcpy(new_memory.get(), memory, top);
+        /* the profiler may walk the stack from a signal handler at any point */
+        memory = new_memory.get();
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        managed_memory = std::move(new_memory);
+        size = new_size;
+    }
+
     std::unique_ptr<std::byte[]> managed_memory;
     std::byte* memory;
     u64 top;
     u64 size;
+    u64 initial_size;
+    u64 max_size;
     u64 frame_pointer;
 };
 
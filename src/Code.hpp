@@ -1,6 +1,10 @@
 #ifndef CODE_HPP
 #define CODE_HPP
 
+#include <algorithm>
+#include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include "BitSet.hpp"
@@ -10,6 +14,7 @@ enum class Opcode
 {
     // MISC
     nop,
+    safepoint,
     // LOAD LOCAL VARIABLE
     load,
     // STORE LOCAL VARIABLE
@@ -19,12 +24,26 @@ enum class Opcode
     pop,
     dup,
     swap,
+    // PUSH THE ADDRESS OF A STRING LITERAL
+    ldstr,
     // LOAD ADDRESS
     wload,
     bload,
+    // COPY THE STRUCT AT AN ADDRESS TO A NEW BLOCK
+    mload,
     // STORE ADDRESS
     wstore,
     bstore,
+    // COPY A STRUCT TO AN ADDRESS
+    mstore,
+    // SLICE ELEMENT ACCESS
+    slen,
+    scap,
+    sload,
+    sstore,
+    // SLICE ELEMENT ACCESS, THE INDEX PROVEN IN RANGE BY THE COMPILER
+    uload,
+    ustore,
     // CAST
     i2f,
     f2i,
@@ -70,15 +89,41 @@ enum class Opcode
     goto_,
     if_t,
     if_f,
+    // COMPARE AND BRANCH, JUMPING WHEN THE COMPARISON HOLDS
+    if_ieq,
+    if_ilt,
+    if_igt,
+    if_ine,
+    if_ile,
+    if_ige,
+    if_feq,
+    if_flt,
+    if_fgt,
+    if_fne,
+    if_fle,
+    if_fge,
+    // COMPARE AND BRANCH, JUMPING WHEN THE COMPARISON FAILS, AS IT DOES FOR NAN
+    if_fnlt,
+    if_fngt,
+    if_fnle,
+    if_fnge,
     // FUNCTION INVOCATION
     invoke_static,
     invoke_dynamic,
     invoke_native,
+    // CALL OF A TYPED NATIVE, ITS ARGUMENTS READ WHERE THEY LIE
+    invoke_typed,
+    // CALL IN TAIL POSITION, REUSING THE FRAME OF THE CALLER
+    tailcall,
+    tailcall_dynamic,
     ret,
     // MEMORY ALLOCATION
     new_,
 };
 
+/* follows the last opcode */
+inline constexpr u64 opcode_count = static_cast<u64>(Opcode::new_) + 1;
+
 struct Instruction
 {
     Opcode opcode;
@@ -92,6 +137,8 @@ struct Instruction
 class Runtime;
 class Thread;
 using NativeFunction = void (*)(Runtime&, Thread&);
+/* a typed native, given its arguments in order and giving its result */
+using TypedNativeFunction = Word (*)(Runtime&, const Word*);
 
 class Type
 {
@@ -101,6 +148,7 @@ public:
 
     Type() = delete;
     Type(u64 size) : size{size} {}
+    virtual ~Type() = default;
 
     virtual std::string get_name() const = 0;
 };
@@ -237,14 +285,135 @@ public:
     }
 };
 
+/* offset counts words from the start of the struct */
+/* a map value is the address of its table, see HashMap.hpp */
+class MapType : public Type
+{
+public:
+    Type* key_type;
+    Type* value_type;
+
+    MapType(Type* key_type, Type* value_type) : Type{8}, key_type{key_type}, value_type{value_type} {}
+
+    virtual std::string get_name() const override
+    {
+        std::string name = "map[";
+        name += key_type ? key_type->get_name() : "?";
+        name += "]";
+        name += value_type ? value_type->get_name() : "?";
+        return name;
+    }
+};
+
+struct StructField
+{
+    std::string name;
+    Type* type;
+    u64 offset;
+};
+
+/*
+ * A struct value is a block of one word per field, the fields of a struct
+ * field laid out inline among them, so that any field is a constant offset
+ * from the block. The pointer map marks the words holding heap addresses.
+ */
+class StructType : public Type
+{
+public:
+    std::vector<StructField> fields;
+    std::vector<bool> pointer_map;
+
+    /* the field types may be linked afterwards, followed by a call to lay_out */
+    StructType(std::vector<StructField> fields) : Type{0}, fields{std::move(fields)}
+    {
+        lay_out();
+    }
+
+    void lay_out()
+    {
+        u64 offset = 0;
+        pointer_map.clear();
+        for (auto& field : fields) {
+            field.offset = offset;
+            if (auto struct_type = dynamic_cast<const StructType*>(field.type)) {
+                pointer_map.insert(pointer_map.end(), struct_type->pointer_map.begin(), struct_type->pointer_map.end());
+                offset += struct_type->pointer_map.size();
+            } else {
+                pointer_map.push_back(holds_address(field.type));
+                offset += 1;
+            }
+        }
+        size = offset * sizeof(Word);
+    }
+
+    const StructField* find_field(std::string_view name) const
+    {
+        for (const auto& field : fields) {
+            if (field.name == name) {
+                return &field;
+            }
+        }
+        return nullptr;
+    }
+
+    virtual std::string get_name() const override
+    {
+        std::string name = "struct {";
+        const char* separator = " ";
+        for (const auto& field : fields) {
+            name += separator;
+            name += field.name;
+            name += " ";
+            name += field.type ? field.type->get_name() : "?";
+            separator = "; ";
+        }
+        name += " }";
+        return name;
+    }
+
+private:
+    static bool holds_address(const Type* type)
+    {
+        return dynamic_cast<const StringType*>(type) || dynamic_cast<const ChannelType*>(type) ||
+               dynamic_cast<const SliceType*>(type) || dynamic_cast<const ClosureType*>(type) ||
+               dynamic_cast<const CallableType*>(type) || dynamic_cast<const MapType*>(type);
+    }
+};
+
+/* the instructions from offset up to the next entry were compiled from line */
+struct LineEntry
+{
+    u64 offset;
+    u64 line;
+};
+
 struct Function
 {
+    std::string name;
     u16 capc = 0;
     u16 argc = 0;
     u16 varc = 0;
     u64 index = 0;
     BitSet pointer_map;
     std::vector<Instruction> code;
+    /* set instead of code when the function was loaded from a mapped image */
+    std::span<const Instruction> mapped_code;
+    /* ordered by offset, one entry wherever the line changes */
+    std::vector<LineEntry> lines;
+
+    std::span<const Instruction> get_code() const
+    {
+        return mapped_code.empty() ? std::span<const Instruction>{code} : mapped_code;
+    }
+
+    /* the source line of the instruction at program_counter, 0 if unknown */
+    u64 get_line(u64 program_counter) const
+    {
+        auto it = std::upper_bound(lines.begin(), lines.end(), program_counter, [](u64 offset, const LineEntry& entry) {
+            return offset < entry.offset;
+        });
+        return it == lines.begin() ? 0 : std::prev(it)->line;
+    }
 };
 
 struct ClosureHeader
@@ -257,9 +426,16 @@ struct NativeChannel
     u64 index;
 };
 
-struct NativeString
+/*
+ * What a slice points at. Slicing and appending make a new header rather
+ * than change one, so copies of a slice keep their length; the elements
+ * are shared. The zero slice is address 0 and has no header.
+ */
+struct SliceHeader
 {
-    u64 index;
+    u64 data;
+    u64 length;
+    u64 capacity;
 };
 
 #endif /* CODE_HPP */
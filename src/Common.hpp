@@ -4,6 +4,8 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <stdexcept>
+#include <string>
 
 static_assert(sizeof(float) == 4, "float should be 32-bit");
 static_assert(sizeof(double) == 8, "double should be 64-bit");
@@ -51,4 +53,13 @@ R bitcast(const T& value)
     return result;
 }
 
+/* an error in the program compiled, reported at a line of its source */
+class SourceError : public std::runtime_error
+{
+public:
+    u32 line;
+
+    SourceError(u32 line, const std::string& message) : std::runtime_error{message}, line{line} {}
+};
+
 #endif /* COMMON_HPP */
@@ -0,0 +1,353 @@
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CompilationCache.hpp"
+#include "Image.hpp"
+#include "Native.hpp"
+
+static constexpr char cache_magic[8] = {'G', 'O', 'A', 'T', 'C', 'C', 'H', '\n'};
+
+CompilationCache::CompilationCache(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat file_status;
+    if (::fstat(fd, &file_status) < 0 || file_status.st_size == 0) {
+        ::close(fd);
+        return;
+    }
+    mapping_size = file_status.st_size;
+    mapping = ::mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        return;
+    }
+    try {
+        load();
+    } catch (const std::runtime_error&) {
+        declarations.clear();
+    }
+}
+
+CompilationCache::~CompilationCache()
+{
+    if (mapping) {
+        ::munmap(mapping, mapping_size);
+    }
+}
+
+static void read_declaration(ImageReader& reader, CachedDeclaration& declaration)
+{
+    u64 dependency_count = reader.get();
+    for (u64 i = 0; i < dependency_count; ++i) {
+        auto& dependency = declaration.dependencies.emplace_back();
+        dependency.name = reader.get_string();
+        dependency.signature = reader.get_string();
+    }
+
+    declaration.functions.resize(reader.get());
+    for (auto& function : declaration.functions) {
+        function.name = reader.get_string_view();
+        function.capc = reader.get();
+        function.argc = reader.get();
+        function.varc = reader.get();
+        u64 code_size = reader.get();
+        function.relocations.resize(reader.get());
+        for (auto& relocation : function.relocations) {
+            relocation.kind = static_cast<RelocationKind>(reader.get());
+            relocation.offset = reader.get();
+            relocation.symbol = reader.get_string_view();
+            if (relocation.kind > RelocationKind::native || relocation.offset >= code_size) {
+                throw std::runtime_error("malformed cache!");
+            }
+        }
+        u64 line_count = reader.get();
+        if (line_count > code_size + 1) {
+            throw std::runtime_error("malformed cache!");
+        }
+        function.lines.resize(line_count);
+        for (auto& entry : function.lines) {
+            entry.offset = reader.get();
+            entry.line = reader.get();
+        }
+        reader.align(alignof(Instruction));
+        if (code_size > ~u64{0} / sizeof(Instruction)) {
+            throw std::runtime_error("malformed cache!");
+        }
+        auto code = reinterpret_cast<const Instruction*>(reader.get_bytes(code_size * sizeof(Instruction)));
+        function.code = std::span<const Instruction>{code, code_size};
+    }
+}
+
+void CompilationCache::load()
+{
+    ImageReader reader{static_cast<const std::byte*>(mapping), mapping_size};
+    if (std::memcmp(reader.get_bytes(sizeof(cache_magic)), cache_magic, sizeof(cache_magic)) != 0) {
+        return;
+    }
+    /* the code is only valid for the instruction set it was compiled to */
+    if (reader.get() != version || reader.get() != Image::version || reader.get() != sizeof(Instruction)) {
+        return;
+    }
+
+    u64 declaration_count = reader.get();
+    for (u64 i = 0; i < declaration_count; ++i) {
+        u64 size = reader.get();
+        reader.align(alignof(Instruction));
+        auto bytes = reader.get_bytes(size);
+        ImageReader declaration_reader{bytes, size};
+        auto name = declaration_reader.get_string_view();
+        CachedDeclaration declaration{.hash = declaration_reader.get(), .bytes = {bytes, size}};
+        read_declaration(declaration_reader, declaration);
+        declarations.insert_or_assign(name, std::move(declaration));
+    }
+}
+
+/* types are written out structurally, so an entry does not depend on any type table */
+static void write_type_structure(ImageWriter& writer, const Type* type)
+{
+    if (!type) {
+        writer.put(no_type);
+    } else if (dynamic_cast<const IntType*>(type)) {
+        writer.put(static_cast<u64>(TypeKind::int_));
+    } else if (dynamic_cast<const FloatType*>(type)) {
+        writer.put(static_cast<u64>(TypeKind::float_));
+    } else if (dynamic_cast<const BoolType*>(type)) {
+        writer.put(static_cast<u64>(TypeKind::bool_));
+    } else if (dynamic_cast<const StringType*>(type)) {
+        writer.put(static_cast<u64>(TypeKind::string));
+    } else if (auto function_type = dynamic_cast<const FunctionType*>(type)) {
+        writer.put(static_cast<u64>(TypeKind::function));
+        write_type_structure(writer, function_type->return_type);
+        writer.put(function_type->arg_types.size());
+        for (Type* arg_type : function_type->arg_types) {
+            write_type_structure(writer, arg_type);
+        }
+    } else if (auto closure_type = dynamic_cast<const ClosureType*>(type)) {
+        writer.put(static_cast<u64>(TypeKind::closure));
+        write_type_structure(writer, closure_type->function_type);
+        writer.put(closure_type->capc);
+    } else if (auto callable_type = dynamic_cast<const CallableType*>(type)) {
+        writer.put(static_cast<u64>(TypeKind::callable));
+        write_type_structure(writer, callable_type->function_type);
+    } else if (auto channel_type = dynamic_cast<const ChannelType*>(type)) {
+        writer.put(static_cast<u64>(TypeKind::channel));
+        write_type_structure(writer, channel_type->element_type);
+    } else if (auto slice_type = dynamic_cast<const SliceType*>(type)) {
+        writer.put(static_cast<u64>(TypeKind::slice));
+        write_type_structure(writer, slice_type->element_type);
+    } else if (auto map_type = dynamic_cast<const MapType*>(type)) {
+        writer.put(static_cast<u64>(TypeKind::map));
+        write_type_structure(writer, map_type->key_type);
+        write_type_structure(writer, map_type->value_type);
+    } else if (auto struct_type = dynamic_cast<const StructType*>(type)) {
+        writer.put(static_cast<u64>(TypeKind::struct_));
+        writer.put(struct_type->fields.size());
+        for (const auto& field : struct_type->fields) {
+            writer.put_string(field.name);
+            write_type_structure(writer, field.type);
+        }
+    } else {
+        throw std::runtime_error("cannot write type '" + type->get_name() + "' to a cache!");
+    }
+}
+
+static FunctionType* as_function_type(Type* type)
+{
+    auto function_type = dynamic_cast<FunctionType*>(type);
+    if (!function_type) {
+        throw std::runtime_error("malformed cache!");
+    }
+    return function_type;
+}
+
+static Type* read_type_structure(ImageReader& reader, std::vector<std::unique_ptr<Type>>& scratch)
+{
+    u64 kind = reader.get();
+    if (kind == no_type) {
+        return nullptr;
+    }
+    std::unique_ptr<Type> type;
+    switch (static_cast<TypeKind>(kind)) {
+        case TypeKind::int_:
+            type = std::make_unique<IntType>();
+            break;
+        case TypeKind::float_:
+            type = std::make_unique<FloatType>();
+            break;
+        case TypeKind::bool_:
+            type = std::make_unique<BoolType>();
+            break;
+        case TypeKind::string:
+            type = std::make_unique<StringType>();
+            break;
+        case TypeKind::function: {
+            Type* return_type = read_type_structure(reader, scratch);
+            std::vector<Type*> arg_types(reader.get());
+            for (Type*& arg_type : arg_types) {
+                arg_type = read_type_structure(reader, scratch);
+            }
+            type = std::make_unique<FunctionType>(arg_types, return_type);
+            break;
+        }
+        case TypeKind::closure: {
+            auto function_type = as_function_type(read_type_structure(reader, scratch));
+            type = std::make_unique<ClosureType>(function_type, reader.get());
+            break;
+        }
+        case TypeKind::callable:
+            type = std::make_unique<CallableType>(as_function_type(read_type_structure(reader, scratch)));
+            break;
+        case TypeKind::channel:
+            type = std::make_unique<ChannelType>(read_type_structure(reader, scratch));
+            break;
+        case TypeKind::slice:
+            type = std::make_unique<SliceType>(read_type_structure(reader, scratch));
+            break;
+        case TypeKind::map: {
+            auto key_type = read_type_structure(reader, scratch);
+            type = std::make_unique<MapType>(key_type, read_type_structure(reader, scratch));
+            break;
+        }
+        case TypeKind::struct_: {
+            std::vector<StructField> fields(reader.get());
+            for (auto& field : fields) {
+                field.name = reader.get_string();
+                field.type = read_type_structure(reader, scratch);
+            }
+            type = std::make_unique<StructType>(std::move(fields));
+            break;
+        }
+        default:
+            throw std::runtime_error("malformed cache!");
+    }
+    return scratch.emplace_back(std::move(type)).get();
+}
+
+const Type* CompilationCache::read_type(std::string_view encoding, std::vector<std::unique_ptr<Type>>& scratch)
+{
+    ImageReader reader{reinterpret_cast<const std::byte*>(encoding.data()), encoding.size()};
+    return read_type_structure(reader, scratch);
+}
+
+static void write_declaration(
+    ImageWriter& writer,
+    const DeclarationRecord& record,
+    const std::vector<std::vector<Relocation>>& function_relocations,
+    const std::vector<Function>& function_table,
+    const std::vector<std::unique_ptr<Type>>& type_table,
+    const StringPool& string_pool,
+    const std::vector<NativeFunction>& native_function_table)
+{
+    writer.put_string(record.name);
+    writer.put(record.hash);
+
+    writer.put(record.dependencies.size());
+    for (const auto& dependency : record.dependencies) {
+        writer.put_string(dependency.name);
+        writer.put_string(dependency.signature);
+    }
+
+    writer.put(record.function_count);
+    for (u64 i = record.first_function; i < record.first_function + record.function_count; ++i) {
+        const auto& function = function_table[i];
+        auto code = function.get_code();
+        writer.put_string(function.name);
+        writer.put(function.capc);
+        writer.put(function.argc);
+        writer.put(function.varc);
+        writer.put(code.size());
+
+        const auto& relocations = function_relocations[i];
+        writer.put(relocations.size());
+        for (const auto& relocation : relocations) {
+            u64 operand = code[relocation.offset].index;
+            writer.put(static_cast<u64>(relocation.kind));
+            writer.put(relocation.offset);
+            switch (relocation.kind) {
+                case RelocationKind::function:
+                    writer.put_string(function_table[operand].name);
+                    break;
+                case RelocationKind::type: {
+                    ImageWriter type_writer;
+                    write_type_structure(type_writer, type_table[operand].get());
+                    writer.put_string(type_writer.bytes);
+                    break;
+                }
+                case RelocationKind::string:
+                    writer.put_string(string_pool.get(operand));
+                    break;
+                case RelocationKind::native:
+                    writer.put_string(get_native_function_name(native_function_table[operand]));
+                    break;
+            }
+        }
+        writer.put(function.lines.size());
+        for (const auto& entry : function.lines) {
+            writer.put(entry.offset);
+            writer.put(entry.line - record.line);
+        }
+        writer.align(alignof(Instruction));
+        writer.put_instructions(code);
+    }
+}
+
+void CompilationCache::write(
+    const std::string& path,
+    const std::vector<DeclarationRecord>& declaration_records,
+    const std::vector<std::vector<Relocation>>& function_relocations,
+    const std::vector<Function>& function_table,
+    const std::vector<std::unique_ptr<Type>>& type_table,
+    const StringPool& string_pool,
+    const std::vector<NativeFunction>& native_function_table) const
+{
+    /* the old file may still be mapped by this cache, so it is replaced rather than overwritten */
+    auto temporary_path = path + ".tmp";
+    std::ofstream stream{temporary_path, std::ios::binary | std::ios::trunc};
+
+    /* reused entries go from the mapping straight to the file, only new ones are encoded */
+    ImageWriter writer;
+    u64 written = 0;
+    auto flush = [&](const void* data, u64 size) {
+        stream.write(writer.bytes.data(), writer.bytes.size());
+        stream.write(static_cast<const char*>(data), size);
+        written += writer.bytes.size() + size;
+        writer.bytes.clear();
+    };
+
+    writer.bytes.append(cache_magic, sizeof(cache_magic));
+    writer.put(version);
+    writer.put(Image::version);
+    writer.put(sizeof(Instruction));
+
+    writer.put(declaration_records.size());
+    for (const auto& record : declaration_records) {
+        std::span<const std::byte> bytes;
+        ImageWriter declaration_writer;
+        if (auto cached = record.cached; cached) {
+            bytes = cached->bytes;
+        } else {
+            write_declaration(declaration_writer, record, function_relocations, function_table, type_table, string_pool, native_function_table);
+            bytes = std::as_bytes(std::span{declaration_writer.bytes});
+        }
+        writer.put(bytes.size());
+        u64 padding = (alignof(Instruction) - (written + writer.bytes.size()) % alignof(Instruction)) % alignof(Instruction);
+        writer.bytes.append(padding, '\0');
+        flush(bytes.data(), bytes.size());
+    }
+    flush(nullptr, 0);
+
+    stream.close();
+    if (!stream || std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("cannot write cache '" + path + "'!");
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef COMPILATION_CACHE_HPP
+#define COMPILATION_CACHE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Code.hpp"
+#include "Common.hpp"
+#include "StringPool.hpp"
+
+enum class RelocationKind : u64
+{
+    function,
+    type,
+    string,
+    native,
+};
+
+/* an instruction whose operand indexes a table that is rebuilt by every compilation */
+struct Relocation
+{
+    RelocationKind kind;
+    u64 offset;
+};
+
+/* a name a declaration refers to and its signature, empty when it must not name a function */
+struct Dependency
+{
+    std::string name;
+    std::string signature;
+};
+
+struct CachedDeclaration;
+
+/* a compiled top-level declaration: its function and the literals in it, in table order */
+struct DeclarationRecord
+{
+    std::string name;
+    u64 hash;
+    /* the cached line tables count from the line of the declaration */
+    u64 line;
+    std::vector<Dependency> dependencies;
+    u64 first_function;
+    u64 function_count;
+    /* set when the code was taken from the cache */
+    const CachedDeclaration* cached = nullptr;
+};
+
+/* a relocation read back from the cache, the operand named instead of indexed */
+struct CachedRelocation
+{
+    RelocationKind kind;
+    u64 offset;
+    /* the function name, the string, the encoded type or the native name */
+    std::string_view symbol;
+};
+
+struct CachedFunction
+{
+    std::string_view name;
+    u16 capc;
+    u16 argc;
+    u16 varc;
+    std::span<const Instruction> code;
+    std::vector<CachedRelocation> relocations;
+    std::vector<LineEntry> lines;
+};
+
+struct CachedDeclaration
+{
+    u64 hash;
+    std::vector<Dependency> dependencies;
+    std::vector<CachedFunction> functions;
+    /* the whole entry, copied as it is when the declaration is written again */
+    std::span<const std::byte> bytes;
+};
+
+/*
+ * The code of every top-level declaration of a source file from its last
+ * compilation, keyed by name and by a hash of the declaration's tree. The
+ * compiler reuses an entry when the hash matches and every dependency still
+ * holds, and relinks the function, type, string and typed native operands, which are kept
+ * by name, against the current tables. Entries are self-contained so the
+ * reused ones are written back unchanged, and their code is used from the
+ * mapped file like the code of an image. A missing, outdated or malformed
+ * cache file reads as an empty cache, since it only saves work.
+ */
+class CompilationCache
+{
+public:
+    static constexpr u64 version = 5;
+
+    CompilationCache() = delete;
+    CompilationCache(const CompilationCache&) = delete;
+    CompilationCache(CompilationCache&&) = delete;
+    CompilationCache& operator=(const CompilationCache&) = delete;
+    CompilationCache& operator=(CompilationCache&&) = delete;
+
+    CompilationCache(const std::string& path);
+    ~CompilationCache();
+
+    /* replaces the file with the declarations of a compilation, which may refer into this cache */
+    void write(
+        const std::string& path,
+        const std::vector<DeclarationRecord>& declaration_records,
+        const std::vector<std::vector<Relocation>>& function_relocations,
+        const std::vector<Function>& function_table,
+        const std::vector<std::unique_ptr<Type>>& type_table,
+        const StringPool& string_pool,
+        const std::vector<NativeFunction>& native_function_table) const;
+
+    const CachedDeclaration* find(const std::string& name, u64 hash) const
+    {
+        auto it = declarations.find(name);
+        return it != declarations.end() && it->second.hash == hash ? &it->second : nullptr;
+    }
+
+    /* the types decoded from a type relocation, owned by scratch */
+    static const Type* read_type(std::string_view encoding, std::vector<std::unique_ptr<Type>>& scratch);
+
+private:
+    void load();
+
+    void* mapping = nullptr;
+    u64 mapping_size = 0;
+    std::unordered_map<std::string_view, CachedDeclaration> declarations;
+};
+
+#endif /* COMPILATION_CACHE_HPP */
@@ -1,70 +1,84 @@
 #ifndef COMPILER_HPP
 #define COMPILER_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <functional>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "Ast.hpp"
 #include "Code.hpp"
+#include "CompilationCache.hpp"
 #include "Native.hpp"
+#include "NativeRegistry.hpp"
 #include "StringPool.hpp"
 
-#include "GOatLANGBaseVisitor.h"
-
-class FunctionScanner : public GOatLANGBaseVisitor
+class FunctionScanner : public AstVisitor
 {
 public:
     std::vector<Function>& function_table;
     std::unordered_map<std::string, u64>& function_indices;
-    std::unordered_map<void*, u64>& node_functions;
+    NodeTable<u64>& node_functions;
 
     u64 current_function_index;
+    /* function literals are named after their declaration, as main.func1 */
+    std::string current_declaration_name;
+    u64 literal_count;
 
     FunctionScanner(
         std::vector<Function>& function_table,
         std::unordered_map<std::string, u64>& function_indices,
-        std::unordered_map<void*, u64>& node_functions) : function_table{function_table},
+        NodeTable<u64>& node_functions) : function_table{function_table},
                                                           function_indices{function_indices},
                                                           node_functions{node_functions},
-                                                          current_function_index{}
+                                                          current_function_index{},
+                                                          literal_count{}
     {
     }
 
-    virtual std::any visitTopLevelDecl(GOatLANGParser::TopLevelDeclContext* ctx) override
+    virtual void visitSourceFile(SourceFileNode* node) override
     {
-        if (auto function_decl = ctx->functionDecl(); function_decl) {
-            visitFunctionDecl(function_decl);
+        for (auto declaration : node->declarations) {
+            if (auto function_decl = node_cast<FunctionDeclNode>(declaration); function_decl) {
+                visitFunctionDecl(function_decl);
+            }
         }
-        return {};
     }
 
-    virtual std::any visitFunctionDecl(GOatLANGParser::FunctionDeclContext* ctx) override
+    virtual void visitFunctionDecl(FunctionDeclNode* node) override
     {
         current_function_index = function_table.size();
-        function_table.emplace_back(Function{.index = current_function_index});
-        function_indices.try_emplace(ctx->IDENTIFIER()->getText(), current_function_index);
-        node_functions.try_emplace(ctx, current_function_index);
-        visitFunction(ctx->function());
-        return {};
+        current_declaration_name = std::string{node->name};
+        literal_count = 0;
+        function_table.emplace_back(Function{.name = current_declaration_name, .index = current_function_index});
+        function_indices.try_emplace(current_declaration_name, current_function_index);
+        node_functions[node] = current_function_index;
+        visitFunction(node->function);
     }
 
-    virtual std::any visitFunctionLit(GOatLANGParser::FunctionLitContext* ctx) override
+    virtual void visitFunctionLit(FunctionLitNode* node) override
     {
         current_function_index = function_table.size();
-        function_table.emplace_back(Function{.index = current_function_index});
-        node_functions.try_emplace(ctx, current_function_index);
-        visitFunction(ctx->function());
-        return {};
+        function_table.emplace_back(Function{
+            .name = current_declaration_name + ".func" + std::to_string(++literal_count),
+            .index = current_function_index,
+        });
+        node_functions[node] = current_function_index;
+        visitFunction(node->function);
     }
 
-    virtual std::any visitFunction(GOatLANGParser::FunctionContext* ctx) override
+    virtual void visitFunction(FunctionNode* node) override
     {
-        node_functions.try_emplace(ctx, current_function_index);
-        return visitChildren(ctx);
+        node_functions[node] = current_function_index;
+        visitChildren(node);
     }
 };
 
@@ -88,24 +102,104 @@ struct VariableFrame
     std::vector<variable_map::value_type*> locals;
     std::vector<variable_map::value_type*> captures;
     variable_map variables;
+    /* the defer statements of the function, in source order */
+    std::vector<DeferStmtNode*> defers;
+    /* whether the deferred calls are linked in the heap rather than kept in the frame */
+    bool chains_defers = false;
+};
+
+/* the hidden local holding the iterator of a range loop */
+inline std::string range_iterator_name(RangeClauseNode* node)
+{
+    return "range " + std::to_string(node->id);
+}
+
+/* the hidden local holding the mask of the deferred calls to run, or the head of their chain */
+inline const std::string defer_state_name = "defer";
+
+/* the hidden local holding a callee or argument value of a deferred call */
+inline std::string defer_value_name(DeferStmtNode* node, u64 value)
+{
+    return "defer " + std::to_string(node->id) + " " + std::to_string(value);
+}
+
+/* at most one bit of the mask for each defer statement */
+inline constexpr u64 max_open_coded_defers = 64;
+
+/*
+ * The defer statements of a function body, leaving out those of function
+ * literals. A defer statement that can run more than once, in a loop or
+ * after a label a goto jumps back to, needs a record for every time it
+ * runs, so every deferred call of such a function is chained.
+ */
+class DeferScanner : public AstVisitor
+{
+public:
+    std::vector<DeferStmtNode*> defers;
+    bool repeats = false;
+    u64 loop_depth = 0;
+
+    virtual void visitDeferStmt(DeferStmtNode* node) override
+    {
+        defers.push_back(node);
+        repeats = repeats || loop_depth > 0;
+    }
+
+    virtual void visitForStmt(ForStmtNode* node) override
+    {
+        ++loop_depth;
+        visitChildren(node);
+        --loop_depth;
+    }
+
+    virtual void visitLabeledStmt(LabeledStmtNode* node) override
+    {
+        repeats = true;
+        visitChildren(node);
+    }
+
+    virtual void visitFunctionLit(FunctionLitNode* node) override
+    {
+    }
 };
 
-class VariableAnalyzer : public GOatLANGBaseVisitor
+/* builtins compiled to an instruction of their own instead of a call */
+inline bool is_builtin_operation(std::string_view name)
+{
+    return name == "len" || name == "cap";
+}
+
+/* builtins running a native over whole slices, one for int and one for float elements */
+inline bool is_bulk_slice_builtin(std::string_view name)
+{
+    return name == "vsum" || name == "vmin" || name == "vmax" || name == "vdot" || name == "vadd" ||
+           name == "vmul" || name == "vindex" || name == "vfill";
+}
+
+/* builtins typed by their arguments instead of declared with a function type */
+inline bool is_generic_builtin(std::string_view name)
+{
+    return is_builtin_operation(name) || name == "append" || name == "copy" || name == "delete" || is_bulk_slice_builtin(name);
+}
+
+class VariableAnalyzer : public AstVisitor
 {
 public:
     std::vector<Function>& function_table;
     std::unordered_map<std::string, u64>& function_indices;
-    std::unordered_map<void*, u64>& node_functions;
+    NodeTable<u64>& node_functions;
     std::unordered_map<std::string, u64>& native_function_indices;
-    std::unordered_map<void*, VariableFrame>& variable_frames;
+    std::vector<VariableFrame>& variable_frames;
     VariableFrame* current_frame;
+    /* the frames of the functions the current one is nested in, innermost last */
+    std::vector<VariableFrame*> enclosing_frames;
 
     VariableAnalyzer(
         std::vector<Function>& function_table,
         std::unordered_map<std::string, u64>& function_indices,
-        std::unordered_map<void*, u64>& node_functions,
+        NodeTable<u64>& node_functions,
         std::unordered_map<std::string, u64>& native_function_indices,
-        std::unordered_map<void*, VariableFrame>& variable_frames)
+        std::vector<VariableFrame>& variable_frames)
         : function_table{function_table},
           function_indices{function_indices},
           node_functions{node_functions},
@@ -115,10 +209,25 @@ public:
     {
     }
 
-    void analyze_reference(antlr4::tree::TerminalNode* identifier)
+    /* a variable of the current function or of one it is nested in */
+    bool is_variable(const std::string& name) const
+    {
+        if (current_frame->variables.contains(name)) {
+            return true;
+        }
+        return std::any_of(enclosing_frames.begin(), enclosing_frames.end(), [&](VariableFrame* frame) {
+            return frame->variables.contains(name);
+        });
+    }
+
+    /* a variable hides the functions and natives of its name, but not the builtins */
+    void analyze_reference(std::string_view identifier)
     {
-        auto name = identifier->getText();
-        if (function_indices.contains(name) || native_function_indices.contains(name)) {
+        auto name = std::string{identifier};
+        if (is_generic_builtin(name)) {
+            return;
+        }
+        if ((function_indices.contains(name) || native_function_indices.contains(name)) && !is_variable(name)) {
             return;
         }
         auto& current_variables = current_frame->variables;
@@ -131,17 +240,46 @@ public:
         current_frame->captures.push_back(&*it);
     }
 
-    virtual std::any visitFunction(GOatLANGParser::FunctionContext* ctx) override
+    void analyze_declaration(std::string name)
     {
-        VariableFrame* enclosing_frame = current_frame;
-        VariableFrame* current_frame;
-        {
-            auto [it, _] = variable_frames.try_emplace(ctx);
-            current_frame = &it->second;
+        auto [it, inserted] = current_frame->variables.try_emplace(
+            std::move(name),
+            Variable{.category = VariableCategory::bound});
+        if (inserted) {
+            current_frame->locals.push_back(&*it);
         }
+    }
+
+    void analyze_assignment(std::string_view identifier, bool declares)
+    {
+        if (declares) {
+            analyze_declaration(std::string{identifier});
+        } else {
+            analyze_reference(identifier);
+        }
+    }
+
+    virtual void visitFunction(FunctionNode* node) override
+    {
+        VariableFrame* enclosing_frame = current_frame;
+        u64 function_index = node_functions[node];
+        VariableFrame* current_frame = &variable_frames[function_index];
         this->current_frame = current_frame;
-        visitSignature(ctx->signature());
-        visitBlock(ctx->block());
+        visitSignature(node->signature);
+        DeferScanner defer_scanner;
+        defer_scanner.visit(node->body);
+        current_frame->defers = std::move(defer_scanner.defers);
+        current_frame->chains_defers = defer_scanner.repeats || current_frame->defers.size() > max_open_coded_defers;
+        if (!current_frame->defers.empty()) {
+            analyze_declaration(defer_state_name);
+        }
+        if (enclosing_frame) {
+            enclosing_frames.push_back(enclosing_frame);
+        }
+        visitBlock(node->body);
+        if (enclosing_frame) {
+            enclosing_frames.pop_back();
+        }
 
         {
             u64 index = 0;
@@ -156,14 +294,13 @@ public:
             }
         }
 
-        u64 function_index = node_functions.at(ctx);
         Function& function = function_table[function_index];
         function.capc = current_frame->captures.size();
         function.argc = current_frame->parameters.size();
         function.varc = current_frame->variables.size();
         this->current_frame = enclosing_frame;
         if (!enclosing_frame) {
-            return {};
+            return;
         }
 
         auto& current_variables = current_frame->variables;
@@ -186,61 +323,107 @@ public:
                 enclosing_variable.category = VariableCategory::escaped;
             }
         }
-        return {};
     }
 
-    virtual std::any visitSignature(GOatLANGParser::SignatureContext* ctx) override
+    virtual void visitSignature(SignatureNode* node) override
     {
-        visitParameters(ctx->parameters());
-        return {};
+        for (auto parameter_decl : node->parameters) {
+            visitParameterDecl(parameter_decl);
+        }
     }
 
-    virtual std::any visitParameterDecl(GOatLANGParser::ParameterDeclContext* ctx) override
+    virtual void visitParameterDecl(ParameterDeclNode* node) override
     {
-        if (auto identifier = ctx->IDENTIFIER(); identifier) {
+        if (!node->name.empty()) {
             auto [it, _] = current_frame->variables.try_emplace(
-                identifier->getText(),
+                std::string{node->name},
                 Variable{.category = VariableCategory::bound});
             current_frame->parameters.push_back(&*it);
         }
-        return {};
     }
 
-    virtual std::any visitVarSpec(GOatLANGParser::VarSpecContext* ctx) override
+    /* the parameter names of a function type are not variables */
+    virtual void visitFunctionType(FunctionTypeNode* node) override
+    {
+    }
+
+    virtual void visitVarDecl(VarDeclNode* node) override
     {
-        auto identifier = ctx->IDENTIFIER();
+        if (!current_frame) {
+            throw std::runtime_error("var decl: package level variables are not supported");
+        }
         auto [it, _] = current_frame->variables.try_emplace(
-            identifier->getText(),
+            std::string{node->name},
             Variable{.category = VariableCategory::bound});
         current_frame->locals.push_back(&*it);
-        return visitChildren(ctx);
+        visitChildren(node);
+    }
+
+    virtual void visitSendStmt(SendStmtNode* node) override
+    {
+        analyze_reference(node->channel);
+        visitChildren(node);
+    }
+
+    /* an open-coded deferred call keeps its values in locals of its own */
+    virtual void visitDeferStmt(DeferStmtNode* node) override
+    {
+        visitChildren(node);
+        auto call_expr = node_cast<CallExprNode>(node->expression);
+        if (!call_expr || current_frame->chains_defers) {
+            return;
+        }
+        /* room for the callee too, whether a name is a variable is only known once the types are */
+        u64 value_count = call_expr->arguments.size() + 1;
+        for (u64 i = 0; i < value_count; ++i) {
+            analyze_declaration(defer_value_name(node, i));
+        }
+    }
+
+    virtual void visitRecvStmt(RecvStmtNode* node) override
+    {
+        if (!node->value_name.empty()) {
+            analyze_assignment(node->value_name, node->declares);
+        }
+        if (!node->ok_name.empty()) {
+            analyze_assignment(node->ok_name, node->declares);
+        }
+        visitChildren(node);
     }
 
-    virtual std::any visitSendStmt(GOatLANGParser::SendStmtContext* ctx) override
+    virtual void visitRecvAssignStmt(RecvAssignStmtNode* node) override
     {
-        analyze_reference(ctx->IDENTIFIER());
-        return visitChildren(ctx);
+        analyze_assignment(node->value_name, node->declares);
+        analyze_assignment(node->ok_name, node->declares);
+        visitChildren(node);
     }
 
-    virtual std::any visitAssignmentStmt(GOatLANGParser::AssignmentStmtContext* ctx) override
+    virtual void visitRangeClause(RangeClauseNode* node) override
     {
-        analyze_reference(ctx->IDENTIFIER());
-        return visitChildren(ctx);
+        analyze_declaration(range_iterator_name(node));
+        analyze_assignment(node->name, node->declares);
+        visitChildren(node);
     }
 
-    virtual std::any visitOperandName(GOatLANGParser::OperandNameContext* ctx) override
+    virtual void visitAssignmentStmt(AssignmentStmtNode* node) override
     {
-        analyze_reference(ctx->IDENTIFIER());
-        return visitChildren(ctx);
+        analyze_reference(node->name);
+        visitChildren(node);
+    }
+
+    virtual void visitOperandName(OperandNameNode* node) override
+    {
+        analyze_reference(node->name);
     }
 };
 
-class TypeAnnotator : public GOatLANGBaseVisitor
+class TypeAnnotator : public AstVisitor
 {
     std::vector<std::unique_ptr<Type>>& type_table;
     std::unordered_map<std::string, Type*>& type_names;
-    std::unordered_map<void*, Type*>& node_types;
-    std::unordered_map<void*, VariableFrame>& variable_frames;
+    NodeTable<Type*>& node_types;
+    NodeTable<u64>& node_functions;
+    std::vector<VariableFrame>& variable_frames;
 
     std::vector<std::unordered_map<std::string, Type*>> type_environment;
     std::vector<Type*> arg_types;
@@ -275,6 +458,17 @@ class TypeAnnotator : public GOatLANGBaseVisitor
         throw std::runtime_error("lookup: cannot find '" + name + "'");
     }
 
+    /* a function or closure is held as a callable */
+    static bool is_assignable(Type* target, Type* value)
+    {
+        auto callable_type = dynamic_cast<CallableType*>(target);
+        if (value == target || !callable_type) {
+            return value == target;
+        }
+        auto closure_type = dynamic_cast<ClosureType*>(value);
+        return value == callable_type->function_type || (closure_type && closure_type->function_type == callable_type->function_type);
+    }
+
     Type* wrap_callable_type(Type* type)
     {
         auto function_type = dynamic_cast<FunctionType*>(type);
@@ -288,11 +482,13 @@ public:
     TypeAnnotator(
         std::vector<std::unique_ptr<Type>>& type_table,
         std::unordered_map<std::string, Type*>& type_names,
-        std::unordered_map<void*, Type*>& node_types,
-        std::unordered_map<void*, VariableFrame>& variable_frames)
+        NodeTable<Type*>& node_types,
+        NodeTable<u64>& node_functions,
+        std::vector<VariableFrame>& variable_frames)
         : type_table{type_table},
           type_names{type_names},
           node_types{node_types},
+          node_functions{node_functions},
           variable_frames{variable_frames},
           type_environment{},
           arg_types{},
@@ -300,298 +496,457 @@ public:
     {
         auto& top_level_frame = type_environment.emplace_back();
         auto new_chan_type = register_type(FunctionType{{type_names.at("int")}, type_names.at("chan")});
-        auto sprint_type = register_type(FunctionType{{type_names.at("string")}, nullptr});
-        auto iprint_type = register_type(FunctionType{{type_names.at("int")}, nullptr});
-        auto fprint_type = register_type(FunctionType{{type_names.at("float")}, nullptr});
+        auto close_type = register_type(FunctionType{{type_names.at("chan")}, nullptr});
+        auto intern_type = register_type(FunctionType{{type_names.at("string")}, type_names.at("string")});
         top_level_frame.try_emplace("make", new_chan_type);
-        top_level_frame.try_emplace("sprint", sprint_type);
-        top_level_frame.try_emplace("iprint", iprint_type);
-        top_level_frame.try_emplace("fprint", fprint_type);
+        top_level_frame.try_emplace("close", close_type);
+        top_level_frame.try_emplace("intern", intern_type);
+        for (const auto& native : get_native_registry().get_natives()) {
+            top_level_frame.try_emplace(native.name, register_native_type(native));
+        }
     }
 
-    std::any visitExpression(GOatLANGParser::ExpressionContext* ctx)
+    /* the function type of a typed native, from the names of its parameter and result types */
+    Type* register_native_type(const TypedNative& native)
     {
-        return ctx->accept(this);
+        std::vector<Type*> parameter_types;
+        for (auto type_name : native.parameter_types) {
+            parameter_types.push_back(type_names.at(std::string{type_name}));
+        }
+        auto result_type = native.result_type.empty() ? nullptr : type_names.at(std::string{native.result_type});
+        return register_type(FunctionType{std::move(parameter_types), result_type});
     }
 
-    std::any visitPrimaryExpr(GOatLANGParser::PrimaryExprContext* ctx)
+    virtual void visitFunctionDecl(FunctionDeclNode* node) override
     {
-        return ctx->accept(this);
+        auto name = std::string{node->name};
+        function_name = &name;
+        auto function = node->function;
+        visitFunction(function);
+        auto type = node_types[function];
+        node_types[node] = type;
     }
 
-    virtual std::any visitPrimaryExpr_(GOatLANGParser::PrimaryExpr_Context* ctx) override
+    /* a declaration compiled from the cache only needs its type in scope */
+    void annotate_declaration_signature(FunctionDeclNode* node)
     {
-        auto primary_expr = ctx->primaryExpr();
-        visitPrimaryExpr(primary_expr);
-        auto type = node_types.at(primary_expr);
-        node_types.try_emplace(ctx, type);
-        return {};
+        auto function = node->function;
+        type_environment.emplace_back();
+        visitSignature(function->signature);
+        type_environment.pop_back();
+        auto type = node_types[function->signature];
+        node_types[function] = type;
+        node_types[node] = type;
+        type_environment.front().try_emplace(std::string{node->name}, type);
     }
 
-    virtual std::any visitFunctionDecl(GOatLANGParser::FunctionDeclContext* ctx) override
+    /* the native is replaced by the function everywhere, also in the functions declared before it */
+    void shadow_native(FunctionDeclNode* node)
     {
-        auto name = ctx->IDENTIFIER()->getText();
-        function_name = &name;
-        auto function = ctx->function();
-        visitFunction(function);
-        auto type = node_types.at(function);
-        node_types.try_emplace(ctx, type);
-        return {};
+        type_environment.front().erase(std::string{node->name});
+        annotate_declaration_signature(node);
     }
 
-    virtual std::any visitFunction(GOatLANGParser::FunctionContext* ctx) override
+    /* the type of a top-level function declared so far, or null */
+    Type* lookup_declaration(const std::string& name)
+    {
+        auto& top_level_frame = type_environment.front();
+        auto it = top_level_frame.find(name);
+        return it != top_level_frame.end() ? it->second : nullptr;
+    }
+
+    virtual void visitFunction(FunctionNode* node) override
     {
         auto env_index = type_environment.size() - 1;
         type_environment.emplace_back();
-        auto signature = ctx->signature();
+        auto signature = node->signature;
         visitSignature(signature);
-        auto type = node_types.at(signature);
+        auto type = node_types[signature];
         if (function_name) {
             type_environment.at(env_index).try_emplace(*function_name, type);
         }
-        node_types.try_emplace(ctx, type);
-        visitBlock(ctx->block());
+        node_types[node] = type;
+        visitBlock(node->body);
         type_environment.pop_back();
-        return {};
     }
 
-    virtual std::any visitSignature(GOatLANGParser::SignatureContext* ctx) override
+    virtual void visitSignature(SignatureNode* node) override
     {
         arg_types.clear();
-        visitParameters(ctx->parameters());
+        for (auto parameter_decl : node->parameters) {
+            visitParameterDecl(parameter_decl);
+        }
         Type* result_type = nullptr;
-        if (auto result = ctx->result(); result) {
-            visitResult(result);
-            result_type = node_types.at(result);
+        if (auto result = node->result; result) {
+            visit(result);
+            result_type = wrap_callable_type(node_types[result]);
         }
         auto function_type = FunctionType{arg_types, result_type};
         auto type = register_type(function_type);
-        node_types.try_emplace(ctx, type);
-        return {};
+        node_types[node] = type;
     }
 
-    virtual std::any visitParameterDecl(GOatLANGParser::ParameterDeclContext* ctx) override
+    virtual void visitParameterDecl(ParameterDeclNode* node) override
     {
-        auto go_type = ctx->goType();
-        visitGoType(go_type);
-        auto type = wrap_callable_type(node_types.at(go_type));
+        visit(node->type);
+        auto type = wrap_callable_type(node_types[node->type]);
         arg_types.push_back(type);
-        node_types.try_emplace(ctx, type);
+        node_types[node] = type;
         if (in_function_type) {
-            return {};
+            return;
         }
-        if (auto identifier = ctx->IDENTIFIER(); identifier) {
+        if (!node->name.empty()) {
             auto& type_frame = type_environment[type_environment.size() - 1];
-            auto name = identifier->getText();
-            type_frame.try_emplace(name, type);
+            type_frame.try_emplace(std::string{node->name}, type);
         }
-        return {};
     }
 
-    virtual std::any visitResult(GOatLANGParser::ResultContext* ctx) override
+    virtual void visitPointerType(PointerTypeNode* node) override
     {
-        auto go_type = ctx->goType();
-        visitGoType(go_type);
-        auto type = wrap_callable_type(node_types.at(go_type));
-        node_types.try_emplace(ctx, type);
-        return {};
+        node_types[node] = nullptr;
     }
 
-    virtual std::any visitGoType(GOatLANGParser::GoTypeContext* ctx) override
+    virtual void visitStructType(StructTypeNode* node) override
     {
-        Type* type = nullptr;
-        if (auto type_name = ctx->typeName(); type_name) {
-            visitTypeName(type_name);
-            type = node_types.at(type_name);
-        } else if (auto type_lit = ctx->typeLit(); type_lit) {
-            visitTypeLit(type_lit);
-            type = node_types.at(type_lit);
-        } else if (auto go_type = ctx->goType(); go_type) {
-            visitGoType(go_type);
-            type = node_types.at(go_type);
+        std::vector<StructField> fields;
+        for (auto field_decl : node->fields) {
+            visit(field_decl->type);
+            auto type = wrap_callable_type(node_types[field_decl->type]);
+            if (!type) {
+                throw std::runtime_error("struct type: field '" + std::string{field_decl->name} + "' has no type");
+            }
+            for (const auto& field : fields) {
+                if (field.name == field_decl->name) {
+                    throw std::runtime_error("struct type: duplicate field '" + field.name + "'");
+                }
+            }
+            fields.push_back(StructField{.name = std::string{field_decl->name}, .type = type});
+            node_types[field_decl] = type;
         }
-        node_types.try_emplace(ctx, type);
-        return {};
+        node_types[node] = register_type(StructType{std::move(fields)});
     }
 
-    virtual std::any visitTypeLit(GOatLANGParser::TypeLitContext* ctx) override
+    const StructField& find_field(Type* type, std::string_view name, const std::string& rule)
     {
-        Type* type = nullptr;
-        if (auto struct_type = ctx->structType(); struct_type) {
-        } else if (auto pointer_type = ctx->pointerType(); pointer_type) {
-        } else if (auto function_type = ctx->functionType(); function_type) {
-            visitFunctionType(function_type);
-            type = node_types.at(function_type);
-        } else if (auto slice_type = ctx->sliceType(); slice_type) {
-        } else if (auto channel_type = ctx->channelType(); channel_type) {
-            visitChannelType(channel_type);
-            type = node_types.at(channel_type);
+        auto struct_type = dynamic_cast<StructType*>(type);
+        if (!struct_type) {
+            throw std::runtime_error(rule + ": operand is not a struct");
+        }
+        auto field = struct_type->find_field(name);
+        if (!field) {
+            throw std::runtime_error(rule + ": no field '" + std::string{name} + "' in " + struct_type->get_name());
+        }
+        return *field;
+    }
+
+    virtual void visitFieldExpr(FieldExprNode* node) override
+    {
+        visit(node->operand);
+        node_types[node] = find_field(node_types[node->operand], node->field, "field expr").type;
+    }
+
+    /* the elements give every field in order or none of them, a nested literal value a struct field */
+    void annotate_literal_value(LiteralValueNode* node, StructType* struct_type)
+    {
+        node_types[node] = struct_type;
+        auto& elements = node->elements;
+        if (!elements.empty() && elements.size() != struct_type->fields.size()) {
+            throw std::runtime_error("composite lit: " + std::to_string(elements.size()) + " values for " + struct_type->get_name());
+        }
+        for (u64 i = 0; i < elements.size(); ++i) {
+            const auto& field = struct_type->fields[i];
+            if (auto literal_value = node_cast<LiteralValueNode>(elements[i]); literal_value) {
+                auto field_struct_type = dynamic_cast<StructType*>(field.type);
+                if (!field_struct_type) {
+                    throw std::runtime_error("composite lit: field '" + field.name + "' is not a struct");
+                }
+                annotate_literal_value(literal_value, field_struct_type);
+                continue;
+            }
+            visit(elements[i]);
+            if (!is_assignable(field.type, node_types[elements[i]])) {
+                throw std::runtime_error("composite lit: value of field '" + field.name + "' is not a " + field.type->get_name());
+            }
+        }
+    }
+
+    virtual void visitCompositeLit(CompositeLitNode* node) override
+    {
+        visit(node->type);
+        auto struct_type = dynamic_cast<StructType*>(node_types[node->type]);
+        if (!struct_type) {
+            throw std::runtime_error("composite lit: only struct literals are supported");
         }
-        node_types.try_emplace(ctx, type);
-        return {};
+        annotate_literal_value(node->value, struct_type);
+        node_types[node] = struct_type;
     }
 
-    virtual std::any visitFunctionType(GOatLANGParser::FunctionTypeContext* ctx) override
+    virtual void visitFunctionType(FunctionTypeNode* node) override
     {
         in_function_type = true;
-        auto signature = ctx->signature();
+        auto signature = node->signature;
         visitSignature(signature);
-        auto type = node_types.at(signature);
-        node_types.try_emplace(ctx, type);
+        auto type = node_types[signature];
+        node_types[node] = type;
         in_function_type = false;
-        return {};
     }
 
-    virtual std::any visitChannelType(GOatLANGParser::ChannelTypeContext* ctx)
+    virtual void visitChannelType(ChannelTypeNode* node) override
     {
-        auto go_type = ctx->goType();
-        visitGoType(go_type);
-        auto element_type = node_types.at(go_type);
+        visit(node->element_type);
+        auto element_type = node_types[node->element_type];
         auto channel_type = ChannelType{element_type};
         auto type = register_type(channel_type);
-        node_types.try_emplace(ctx, type);
-        return {};
+        node_types[node] = type;
     }
 
-    virtual std::any visitSliceType(GOatLANGParser::SliceTypeContext* ctx) override
+    virtual void visitSliceType(SliceTypeNode* node) override
     {
-        auto go_type = ctx->goType();
-        visitGoType(go_type);
-        auto element_type = node_types.at(go_type);
-        auto channel_type = SliceType{element_type};
-        auto type = register_type(channel_type);
-        node_types.try_emplace(ctx, type);
-        return {};
+        visit(node->element_type);
+        auto element_type = node_types[node->element_type];
+        auto slice_type = SliceType{element_type};
+        auto type = register_type(slice_type);
+        node_types[node] = type;
+    }
+
+    /* keys are compared by value, so only basic types are keys */
+    virtual void visitMapType(MapTypeNode* node) override
+    {
+        visit(node->key_type);
+        visit(node->value_type);
+        auto key_type = node_types[node->key_type];
+        bool comparable = dynamic_cast<IntType*>(key_type) || dynamic_cast<FloatType*>(key_type) ||
+                          dynamic_cast<BoolType*>(key_type) || dynamic_cast<StringType*>(key_type);
+        if (!comparable) {
+            throw std::runtime_error("map type: key type is not int, float, bool or string");
+        }
+        node_types[node] = register_type(MapType{key_type, node_types[node->value_type]});
+    }
+
+    void annotate_map_key(MapType* map_type, Node* key, const std::string& rule)
+    {
+        visit(key);
+        if (node_types[key] != map_type->key_type) {
+            throw std::runtime_error(rule + ": key is not a " + map_type->key_type->get_name());
+        }
     }
 
-    virtual std::any visitIndexExpr(GOatLANGParser::IndexExprContext* ctx) override
+    virtual void visitIndexExpr(IndexExprNode* node) override
     {
-        auto primary_expr = ctx->primaryExpr();
-        visitPrimaryExpr(primary_expr);
-        auto slice_type = dynamic_cast<SliceType*>(node_types.at(primary_expr));
-        if (!slice_type) {
-            throw std::runtime_error("index expr: first operand is not a slice type");
+        visit(node->operand);
+        if (auto map_type = dynamic_cast<MapType*>(node_types[node->operand]); map_type) {
+            annotate_map_key(map_type, node->index, "index expr");
+            node_types[node] = map_type->value_type;
+            return;
+        }
+        /* a string indexes to a byte, as an int */
+        auto string_type = dynamic_cast<StringType*>(node_types[node->operand]);
+        auto slice_type = dynamic_cast<SliceType*>(node_types[node->operand]);
+        if (!slice_type && !string_type) {
+            throw std::runtime_error("index expr: first operand is not a slice, string or map type");
         }
-        auto expression = ctx->expression();
-        visitExpression(expression);
-        auto index_type = dynamic_cast<IntType*>(node_types.at(expression));
+        visit(node->index);
+        auto index_type = dynamic_cast<IntType*>(node_types[node->index]);
         if (!index_type) {
             throw std::runtime_error("index expr: second operand is not an integer");
         }
-        auto type = slice_type->element_type;
-        node_types.try_emplace(ctx, type);
-        return {};
+        auto type = string_type ? type_names.at("int") : slice_type->element_type;
+        node_types[node] = type;
+    }
+
+    virtual void visitSliceExpr(SliceExprNode* node) override
+    {
+        visit(node->operand);
+        auto operand_type = node_types[node->operand];
+        if (!dynamic_cast<SliceType*>(operand_type) && !dynamic_cast<StringType*>(operand_type)) {
+            throw std::runtime_error("slice expr: operand is not a slice or string type");
+        }
+        for (auto bound : {node->low, node->high}) {
+            if (!bound) {
+                continue;
+            }
+            visit(bound);
+            if (!dynamic_cast<IntType*>(node_types[bound])) {
+                throw std::runtime_error("slice expr: bound is not an integer");
+            }
+        }
+        node_types[node] = operand_type;
     }
 
-    virtual std::any visitTypeName(GOatLANGParser::TypeNameContext* ctx) override
+    virtual void visitTypeName(TypeNameNode* node) override
     {
-        auto name = ctx->IDENTIFIER()->getText();
+        auto name = std::string{node->name};
         auto type = type_names.at(name);
-        node_types.try_emplace(ctx, type);
-        return {};
+        node_types[node] = type;
     }
 
-    virtual std::any visitVarSpec(GOatLANGParser::VarSpecContext* ctx) override
+    /* the assignment is typed with the map it indexes or what its fields are selected from */
+    virtual void visitAssignmentStmt(AssignmentStmtNode* node) override
     {
-        auto name = ctx->IDENTIFIER()->getText();
-        auto go_type = ctx->goType();
-        visitGoType(go_type);
-        auto type = wrap_callable_type(node_types.at(go_type));
-        node_types.try_emplace(ctx, type);
-        type_environment[type_environment.size() - 1].try_emplace(name, type);
-        if (auto expression = ctx->expression(); expression) {
-            visitExpression(expression);
+        auto type = lookup(std::string{node->name});
+        node_types[node] = type;
+        if (auto map_type = dynamic_cast<MapType*>(type); map_type && node->index) {
+            if (!node->fields.empty()) {
+                throw std::runtime_error("assignment stmt: cannot assign a field of a map value");
+            }
+            annotate_map_key(map_type, node->index, "assignment stmt");
+            type = map_type->value_type;
+        } else if (auto index = node->index; index) {
+            auto slice_type = dynamic_cast<SliceType*>(type);
+            if (!slice_type) {
+                throw std::runtime_error("assignment stmt: indexed variable is not a slice or map");
+            }
+            visit(index);
+            if (!dynamic_cast<IntType*>(node_types[index])) {
+                throw std::runtime_error("assignment stmt: index is not an integer");
+            }
+            type = slice_type->element_type;
+            node_types[node] = type;
+        }
+        for (auto field : node->fields) {
+            type = find_field(type, field, "assignment stmt").type;
+        }
+        visit(node->value);
+        bool checked = dynamic_cast<StructType*>(type) || !node->fields.empty();
+        if (checked && !is_assignable(type, node_types[node->value])) {
+            throw std::runtime_error("assignment stmt: value is not a " + type->get_name());
         }
-        return {};
     }
 
-    virtual std::any visitLiteral(GOatLANGParser::LiteralContext* ctx) override
+    virtual void visitVarDecl(VarDeclNode* node) override
     {
-        Type* type = nullptr;
-        if (auto basic_lit = ctx->basicLit(); basic_lit) {
-            visitBasicLit(basic_lit);
-            type = node_types.at(basic_lit);
-        } else if (auto composite_lit = ctx->compositeLit(); composite_lit) {
-            visitCompositeLit(composite_lit);
-            type = node_types.at(composite_lit);
-        } else if (auto function_lit = ctx->functionLit(); function_lit) {
-            visitFunctionLit(function_lit);
-            type = node_types.at(function_lit);
+        auto name = std::string{node->name};
+        visit(node->type);
+        auto type = wrap_callable_type(node_types[node->type]);
+        node_types[node] = type;
+        type_environment[type_environment.size() - 1].try_emplace(name, type);
+        if (auto value = node->value; value) {
+            visit(value);
         }
-        node_types.try_emplace(ctx, type);
-        return {};
     }
 
-    virtual std::any visitBasicLit(GOatLANGParser::BasicLitContext* ctx) override
+    virtual void visitBasicLit(BasicLitNode* node) override
     {
         Type* type = nullptr;
-        if (auto int_lit = ctx->INT_LIT(); int_lit) {
+        if (node->literal_kind == LiteralKind::int_) {
             type = type_names.at("int");
-        } else if (auto float_lit = ctx->FLOAT_LIT(); float_lit) {
+        } else if (node->literal_kind == LiteralKind::float_) {
             type = type_names.at("float");
-        } else if (auto string_lit = ctx->STRING_LIT(); string_lit) {
+        } else if (node->literal_kind == LiteralKind::string) {
             type = type_names.at("string");
         }
-        node_types.try_emplace(ctx, type);
-        return {};
+        node_types[node] = type;
     }
 
-    virtual std::any visitFunctionLit(GOatLANGParser::FunctionLitContext* ctx) override
+    virtual void visitFunctionLit(FunctionLitNode* node) override
     {
         function_name = nullptr;
-        auto function = ctx->function();
+        auto function = node->function;
         visitFunction(function);
-        auto function_type = dynamic_cast<FunctionType*>(node_types.at(function));
+        auto function_type = dynamic_cast<FunctionType*>(node_types[function]);
         if (!function_type) {
             throw std::runtime_error("function lit: is not function type");
         }
-        auto& variable_frame = variable_frames.at(function);
+        auto& variable_frame = variable_frames[node_functions[function]];
         u64 capc = variable_frame.captures.size();
         auto closure_type = ClosureType{function_type, capc};
         auto type = register_type(closure_type);
-        node_types.try_emplace(ctx, type);
-        return {};
+        node_types[node] = type;
     }
 
-    virtual std::any visitOperand(GOatLANGParser::OperandContext* ctx) override
+    virtual void visitOperandName(OperandNameNode* node) override
     {
-        Type* type;
-        if (auto literal = ctx->literal(); literal) {
-            visitLiteral(literal);
-            type = node_types.at(literal);
-        } else if (auto operand_name = ctx->operandName(); operand_name) {
-            visitOperandName(operand_name);
-            type = node_types.at(operand_name);
-        } else if (auto expression = ctx->expression(); expression) {
-            visitExpression(expression);
-            type = node_types.at(expression);
-        }
-        node_types.try_emplace(ctx, type);
-        return {};
+        auto name = std::string{node->name};
+        auto type = lookup(name);
+        node_types[node] = type;
     }
 
-    virtual std::any visitOperandName(GOatLANGParser::OperandNameContext* ctx) override
+    virtual void visitCastExpr(CastExprNode* node) override
     {
-        auto name = ctx->IDENTIFIER()->getText();
-        auto type = lookup(name);
-        node_types.try_emplace(ctx, type);
-        return {};
+        visitChildren(node);
+        node_types[node] = node_types[node->type];
+    }
+
+    /*
+     * vsum(s), vmin(s) and vmax(s) reduce a slice, vdot(x, y) two of them and
+     * vadd(z, x, y) and vmul(z, x, y) write z; all of them take ints or floats.
+     * vindex(s, v) and vfill(s, v) take any element type but strings.
+     */
+    void annotate_bulk_slice_builtin(std::string_view name, CallExprNode* node)
+    {
+        auto& arguments = node->arguments;
+        u64 slice_count = name == "vdot" ? 2 : name == "vadd" || name == "vmul" ? 3 : 1;
+        u64 argument_count = name == "vindex" || name == "vfill" ? 2 : slice_count;
+        if (arguments.size() != argument_count) {
+            throw std::runtime_error("call expr: wrong number of arguments to " + std::string{name});
+        }
+        auto slice_type = dynamic_cast<SliceType*>(node_types[arguments[0]]);
+        for (u64 i = 0; i < slice_count; ++i) {
+            if (!slice_type || node_types[arguments[i]] != slice_type) {
+                throw std::runtime_error("call expr: arguments of " + std::string{name} + " are not slices of one type");
+            }
+        }
+        auto element_type = slice_type->element_type;
+        bool numeric = dynamic_cast<IntType*>(element_type) || dynamic_cast<FloatType*>(element_type);
+        if (argument_count == slice_count ? !numeric : dynamic_cast<StringType*>(element_type) != nullptr) {
+            throw std::runtime_error("call expr: " + std::string{name} + " does not take slices of " + element_type->get_name());
+        }
+        if (argument_count > slice_count && node_types[arguments[1]] != element_type) {
+            throw std::runtime_error("call expr: value of " + std::string{name} + " is not of the element type");
+        }
+        if (name == "vfill") {
+            node_types[node] = nullptr;
+        } else if (name == "vindex" || name == "vadd" || name == "vmul") {
+            node_types[node] = type_names.at("int");
+        } else {
+            node_types[node] = element_type;
+        }
     }
 
-    virtual std::any visitOperand_(GOatLANGParser::Operand_Context* ctx) override
+    /* len(s), cap(s), append(s, x...) and copy(dst, src) take slices of any element type */
+    void annotate_generic_builtin(std::string_view name, CallExprNode* node)
     {
-        auto operand = ctx->operand();
-        visitOperand(operand);
-        auto type = node_types.at(operand);
-        node_types.try_emplace(ctx, type);
-        return {};
+        auto& arguments = node->arguments;
+        for (auto argument : arguments) {
+            visit(argument);
+        }
+        if (is_bulk_slice_builtin(name)) {
+            return annotate_bulk_slice_builtin(name, node);
+        }
+        bool arity_matches = name == "append" ? !arguments.empty() : arguments.size() == (name == "copy" || name == "delete" ? 2 : 1);
+        if (!arity_matches) {
+            throw std::runtime_error("call expr: wrong number of arguments to " + std::string{name});
+        }
+        if (auto map_type = dynamic_cast<MapType*>(node_types[arguments[0]]); map_type && (name == "len" || name == "delete")) {
+            if (name == "delete") {
+                annotate_map_key(map_type, arguments[1], "call expr");
+            }
+            node_types[node] = name == "len" ? type_names.at("int") : nullptr;
+            return;
+        }
+        if (name == "delete") {
+            throw std::runtime_error("call expr: argument of delete is not a map");
+        }
+        if (name == "len" && dynamic_cast<StringType*>(node_types[arguments[0]])) {
+            node_types[node] = type_names.at("int");
+            return;
+        }
+        for (u64 i = 0; i < (name == "copy" ? 2 : 1); ++i) {
+            if (!dynamic_cast<SliceType*>(node_types[arguments[i]])) {
+                throw std::runtime_error("call expr: argument of " + std::string{name} + " is not a slice");
+            }
+        }
+        node_types[node] = name == "append" ? node_types[arguments[0]] : type_names.at("int");
     }
 
-    virtual std::any visitCallExpr(GOatLANGParser::CallExprContext* ctx) override
+    virtual void visitCallExpr(CallExprNode* node) override
     {
-        auto primary_expr = ctx->primaryExpr();
-        visitPrimaryExpr(primary_expr);
-        auto type = node_types.at(primary_expr);
+        auto callee = node->callee;
+        if (auto operand_name = node_cast<OperandNameNode>(callee); operand_name && is_generic_builtin(operand_name->name)) {
+            return annotate_generic_builtin(operand_name->name, node);
+        }
+        visit(callee);
+        auto type = node_types[callee];
         FunctionType* function_type = nullptr;
         if (auto closure_type = dynamic_cast<ClosureType*>(type); closure_type) {
             function_type = closure_type->function_type;
@@ -604,25 +959,63 @@ public:
             throw std::runtime_error("call expr: operand is not a callable");
         }
         type = function_type->return_type;
-        node_types.try_emplace(ctx, type);
-        if (auto arguments = ctx->arguments(); arguments) {
-            visitArguments(ctx->arguments());
+        node_types[node] = type;
+        if (auto type_argument = node->type_argument; type_argument) {
+            visit(type_argument);
+            /* make([]T, n[, capacity]) makes the slice type it is given, make is declared with channels */
+            if (auto slice_type = dynamic_cast<SliceType*>(node_types[type_argument]); slice_type) {
+                if (node->arguments.empty() || node->arguments.size() > 2) {
+                    throw std::runtime_error("call expr: make of a slice takes a length and a capacity");
+                }
+                node_types[node] = slice_type;
+            }
+            /* make(map[K]V[, hint]) */
+            if (auto map_type = dynamic_cast<MapType*>(node_types[type_argument]); map_type) {
+                if (node->arguments.size() > 1) {
+                    throw std::runtime_error("call expr: make of a map takes at most a size hint");
+                }
+                node_types[node] = map_type;
+            }
+        }
+        for (auto argument : node->arguments) {
+            visit(argument);
         }
-        return {};
     }
 
-    virtual std::any visitBinaryExpr(GOatLANGParser::BinaryExprContext* ctx) override
+    /* the builtins that only give a value cannot be deferred, their value would be lost */
+    virtual void visitDeferStmt(DeferStmtNode* node) override
     {
-        auto binary_op = ctx->binary_op->getText();
-        auto left = ctx->expression(0);
-        auto right = ctx->expression(1);
+        auto call_expr = node_cast<CallExprNode>(node->expression);
+        if (!call_expr) {
+            throw std::runtime_error("defer stmt: expression is not a call expression");
+        }
+        if (auto callee = node_cast<OperandNameNode>(call_expr->callee); callee) {
+            auto name = callee->name;
+            if (is_builtin_operation(name) || name == "make" || name == "new" || name == "append") {
+                throw std::runtime_error("defer stmt: cannot defer " + std::string{name});
+            }
+        }
+        visit(call_expr);
+    }
+
+    virtual void visitBinaryExpr(BinaryExprNode* node) override
+    {
+        auto binary_op = node->op;
+        auto left = node->left;
+        auto right = node->right;
 
-        visitExpression(left);
-        visitExpression(right);
+        visit(left);
+        visit(right);
 
-        auto left_type = node_types.at(left);
-        auto right_type = node_types.at(right);
+        auto left_type = node_types[left];
+        auto right_type = node_types[right];
 
+        if (dynamic_cast<StructType*>(left_type)) {
+            throw std::runtime_error("binary expr: structs are not operands");
+        }
+        if (dynamic_cast<MapType*>(left_type)) {
+            throw std::runtime_error("binary expr: maps are not operands");
+        }
         if (left_type != right_type) {
             std::string error_msg = "binary expr: operands have different types";
             error_msg += "\n    left type: " + (left_type ? left_type->get_name() : "void");
@@ -630,296 +1023,453 @@ public:
             throw std::runtime_error(std::move(error_msg));
         }
 
+        bool string_operator = binary_op == Operator::add || (binary_op >= Operator::eq && binary_op <= Operator::ge);
+        if (dynamic_cast<StringType*>(left_type) && !string_operator) {
+            throw std::runtime_error("binary expr: strings only concatenate and compare");
+        }
+
         Type* type = nullptr;
-        if (binary_op == "||") {
-            type = type_names.at("bool");
-        } else if (binary_op == "&&") {
-            type = type_names.at("bool");
-        } else if (binary_op == "==") {
-            type = type_names.at("bool");
-        } else if (binary_op == "!=") {
-            type = type_names.at("bool");
-        } else if (binary_op == "<") {
-            type = type_names.at("bool");
-        } else if (binary_op == "<=") {
-            type = type_names.at("bool");
-        } else if (binary_op == ">") {
-            type = type_names.at("bool");
-        } else if (binary_op == ">=") {
-            type = type_names.at("bool");
-        } else if (binary_op == "|") {
-            type = left_type;
-        } else if (binary_op == "^") {
-            type = left_type;
-        } else if (binary_op == "%") {
-            type = type_names.at("int");
-        } else if (binary_op == "<<") {
-            type = type_names.at("int");
-        } else if (binary_op == ">>") {
-            type = type_names.at("int");
-        } else if (binary_op == "&") {
-            type = left_type;
-        } else if (binary_op == "+") {
-            type = left_type;
-        } else if (binary_op == "-") {
-            type = left_type;
-        } else if (binary_op == "*") {
-            type = left_type;
-        } else if (binary_op == "/") {
-            type = left_type;
-        } else {
+        switch (binary_op) {
+            case Operator::lor:
+            case Operator::land:
+            case Operator::eq:
+            case Operator::ne:
+            case Operator::lt:
+            case Operator::le:
+            case Operator::gt:
+            case Operator::ge:
+                type = type_names.at("bool");
+                break;
+            case Operator::rem:
+            case Operator::shl:
+            case Operator::shr:
+                type = type_names.at("int");
+                break;
+            default:
+                type = left_type;
+                break;
+        }
+        node_types[node] = type;
+    }
+
+    ChannelType* annotate_channel_operand(Node* expression, const std::string& rule)
+    {
+        visit(expression);
+        auto channel_type = dynamic_cast<ChannelType*>(node_types[expression]);
+        if (!channel_type) {
+            throw std::runtime_error(rule + ": operand is not a channel");
+        }
+        return channel_type;
+    }
+
+    void annotate_recv(
+        std::string_view value_name,
+        std::string_view ok_name,
+        bool declares,
+        ChannelType* channel_type)
+    {
+        if (!declares) {
+            return;
         }
-        node_types.try_emplace(ctx, type);
-        return {};
+        auto& type_frame = type_environment[type_environment.size() - 1];
+        type_frame.try_emplace(std::string{value_name}, channel_type->element_type);
+        if (!ok_name.empty()) {
+            type_frame.try_emplace(std::string{ok_name}, type_names.at("bool"));
+        }
+    }
+
+    virtual void visitRecvStmt(RecvStmtNode* node) override
+    {
+        auto channel_type = annotate_channel_operand(node->channel, "recv stmt");
+        annotate_recv(node->value_name, node->ok_name, node->declares, channel_type);
+    }
+
+    virtual void visitRecvAssignStmt(RecvAssignStmtNode* node) override
+    {
+        auto channel_type = annotate_channel_operand(node->channel, "recv assign stmt");
+        annotate_recv(node->value_name, node->ok_name, node->declares, channel_type);
+    }
+
+    /* a range over a map gives its keys */
+    virtual void visitRangeClause(RangeClauseNode* node) override
+    {
+        visit(node->channel);
+        if (auto map_type = dynamic_cast<MapType*>(node_types[node->channel]); map_type) {
+            if (node->declares) {
+                type_environment[type_environment.size() - 1].try_emplace(std::string{node->name}, map_type->key_type);
+            }
+            return;
+        }
+        auto channel_type = dynamic_cast<ChannelType*>(node_types[node->channel]);
+        if (!channel_type) {
+            throw std::runtime_error("range clause: operand is not a channel or map");
+        }
+        annotate_recv(node->name, {}, node->declares, channel_type);
     }
 
-    virtual std::any visitUnaryExpr(GOatLANGParser::UnaryExprContext* ctx) override
+    virtual void visitUnaryExpr(UnaryExprNode* node) override
     {
-        auto unary_op = ctx->unary_op->getText();
-        if (unary_op == "&") {
+        auto unary_op = node->op;
+        if (unary_op == Operator::address) {
             // special case, special visitor
-            return {};
+            return;
         }
 
-        auto expression = ctx->expression();
-        visitExpression(expression);
-        auto expression_type = node_types.at(expression);
+        auto expression = node->operand;
+        visit(expression);
+        auto expression_type = node_types[expression];
 
         Type* type = nullptr;
-        if (unary_op == "<-") {
+        if (unary_op == Operator::recv) {
             auto channel_type = dynamic_cast<ChannelType*>(expression_type);
             if (!channel_type) {
-                throw new std::runtime_error("unary expr: operand is not a channel");
+                throw std::runtime_error("unary expr: operand is not a channel");
             }
             type = channel_type->element_type;
-        } else if (unary_op == "&") {
-        } else if (unary_op == "*") {
-        } else if (unary_op == "+") {
+        } else if (unary_op == Operator::deref) {
+        } else if (unary_op == Operator::plus) {
             type = expression_type;
-        } else if (unary_op == "-") {
+        } else if (unary_op == Operator::neg) {
             type = expression_type;
-        } else if (unary_op == "!") {
+        } else if (unary_op == Operator::not_) {
             type = type_names.at("bool");
-        } else if (unary_op == "^") {
+        } else if (unary_op == Operator::complement) {
             type = type_names.at("int");
-        } else {
-            // error
         }
-        node_types.try_emplace(ctx, type);
-        return {};
+        node_types[node] = type;
     }
 };
 
-class FunctionResolver : public GOatLANGBaseVisitor
+struct UnresolvedGoto
 {
-    std::vector<Function>& function_table;
-    std::unordered_map<std::string, u64>& function_indices;
-    std::unordered_map<void*, u64>& node_functions;
-    std::unordered_map<std::string, u64>& native_function_indices;
-    std::unordered_map<void*, u64>& node_native_functions;
+    std::string label;
+    u64 index;
+};
+
+struct FunctionContext
+{
+    bool has_return_stmt = false;
+    std::unordered_map<std::string, u64> label_locations;
+    std::vector<UnresolvedGoto> unresolved_gotos;
+    VariableFrame& variable_frame;
+};
+/* an operand of a declaration's code that indexes one of the strings or types it added */
+struct OutputOperand
+{
+    u64 function_index;
+    u64 offset;
+};
+
+/* what the code of a declaration adds to the tables shared by all declarations */
+struct DeclarationOutput
+{
+    /* the string operands index these until they are added to the string pool */
+    std::vector<std::string> strings;
+    std::vector<OutputOperand> string_operands;
+    /* the types the type table did not have yet, in the order they were needed */
+    std::vector<std::unique_ptr<Type>> types;
+    std::unordered_map<std::string, u64> type_indices;
+    std::vector<OutputOperand> type_operands;
+    std::exception_ptr error;
+};
 
+/*
+ * Looks through the body of a loop counting index_name up to the length of
+ * slice_name for anything that writes either variable and for the accesses
+ * of the slice at the index. A label in the body disqualifies it too, since
+ * a goto to it would enter the loop without checking the condition. Function
+ * literals are not entered, their variables are their own.
+ */
+class CountedLoopScanner : public AstVisitor
+{
 public:
-    FunctionResolver(
-        std::vector<Function>& function_table,
-        std::unordered_map<std::string, u64>& function_indices,
-        std::unordered_map<void*, u64>& node_functions,
-        std::unordered_map<std::string, u64>& native_function_indices,
-        std::unordered_map<void*, u64>& node_native_functions)
-        : function_table{function_table},
-          function_indices{function_indices},
-          node_functions{node_functions},
-          native_function_indices{native_function_indices},
-          node_native_functions{node_native_functions}
+    std::string_view index_name;
+    std::string_view slice_name;
+    bool disqualified = false;
+    /* the index operands of the accesses */
+    std::vector<const Node*> accesses;
+
+    CountedLoopScanner(std::string_view index_name, std::string_view slice_name) :
+        index_name{index_name},
+        slice_name{slice_name}
     {
     }
 
-    std::any visitPrimaryExpr(GOatLANGParser::PrimaryExprContext* ctx)
+    void check_write(std::string_view name)
     {
-        return ctx->accept(this);
+        if (name == index_name || name == slice_name) {
+            disqualified = true;
+        }
     }
 
-    virtual std::any visitOperand_(GOatLANGParser::Operand_Context* ctx) override
+    void check_access(std::string_view name, const Node* index)
     {
-        auto operand = ctx->operand();
-        visitOperand(operand);
-        if (node_functions.contains(operand)) {
-            node_functions.try_emplace(ctx, node_functions.at(operand));
-        } else if (node_native_functions.contains(operand)) {
-            node_native_functions.try_emplace(ctx, node_native_functions.at(operand));
+        auto operand_name = node_cast<OperandNameNode>(index);
+        if (name == slice_name && operand_name && operand_name->name == index_name) {
+            accesses.push_back(index);
         }
-        return {};
     }
 
-    virtual std::any visitOperand(GOatLANGParser::OperandContext* ctx) override
+    virtual void visitVarDecl(VarDeclNode* node) override
     {
-        if (auto operand_name = ctx->operandName(); operand_name) {
-            visitOperandName(operand_name);
-            if (node_functions.contains(operand_name)) {
-                node_functions.try_emplace(ctx, node_functions.at(operand_name));
-            } else if (node_native_functions.contains(operand_name)) {
-                node_native_functions.try_emplace(ctx, node_native_functions.at(operand_name));
-            }
-        }
-        return {};
+        check_write(node->name);
+        visitChildren(node);
     }
 
-    virtual std::any visitOperandName(GOatLANGParser::OperandNameContext* ctx) override
+    virtual void visitAssignmentStmt(AssignmentStmtNode* node) override
     {
-        auto name = ctx->IDENTIFIER()->getText();
-        if (function_indices.contains(name)) {
-            u64 function_index = function_indices.at(name);
-            node_functions.try_emplace(ctx, function_index);
-        } else if (native_function_indices.contains(name)) {
-            u64 native_function_index = native_function_indices.at(name);
-            node_native_functions.try_emplace(ctx, native_function_index);
+        if (node->index) {
+            check_access(node->name, node->index);
+        } else {
+            check_write(node->name);
         }
-        return {};
+        visitChildren(node);
     }
-};
 
-struct UnresolvedGoto
-{
-    std::string label;
-    u64 index;
-};
+    virtual void visitRecvAssignStmt(RecvAssignStmtNode* node) override
+    {
+        check_write(node->value_name);
+        check_write(node->ok_name);
+        visitChildren(node);
+    }
 
-struct FunctionContext
-{
-    bool has_return_stmt = false;
-    std::unordered_map<std::string, u64> label_locations;
-    std::vector<UnresolvedGoto> unresolved_gotos;
-    VariableFrame& variable_frame;
+    virtual void visitRecvStmt(RecvStmtNode* node) override
+    {
+        check_write(node->value_name);
+        check_write(node->ok_name);
+        visitChildren(node);
+    }
+
+    virtual void visitRangeClause(RangeClauseNode* node) override
+    {
+        check_write(node->name);
+        visitChildren(node);
+    }
+
+    virtual void visitLabeledStmt(LabeledStmtNode* node) override
+    {
+        disqualified = true;
+    }
+
+    virtual void visitFunctionLit(FunctionLitNode* node) override
+    {
+    }
+
+    virtual void visitIndexExpr(IndexExprNode* node) override
+    {
+        if (auto operand_name = node_cast<OperandNameNode>(node->operand); operand_name) {
+            check_access(operand_name->name, node->index);
+        }
+        visitChildren(node);
+    }
 };
 
-class Compiler : public GOatLANGBaseVisitor
+/*
+ * Generates the code of top-level declarations. It only writes the functions
+ * of the declaration it compiles and keeps what it would add to the shared
+ * tables in a DeclarationOutput, so declarations can be compiled on several
+ * threads at once and merged in order afterwards.
+ */
+class CodeGenerator : public AstVisitor
 {
 public:
     static constexpr u64 new_thread_index = 0;
     static constexpr u64 new_chan_index = 1;
     static constexpr u64 chan_send_index = 2;
     static constexpr u64 chan_recv_index = 3;
-    static constexpr u64 sprint_index = 4;
-    static constexpr u64 iprint_index = 5;
-    static constexpr u64 fprint_index = 6;
-    static constexpr u64 new_slice_index = 7;
+    static constexpr u64 new_slice_index = 4;
+    static constexpr u64 chan_select_index = 5;
+    static constexpr u64 chan_close_index = 6;
+    static constexpr u64 chan_recv_ok_index = 7;
+    static constexpr u64 chan_range_index = 8;
+    static constexpr u64 chan_range_next_index = 9;
+    static constexpr u64 slice_append_index = 10;
+    static constexpr u64 slice_copy_index = 11;
+    static constexpr u64 slice_slice_index = 12;
+    /* the bulk slice natives for floats follow those for ints */
+    static constexpr u64 slice_sum_index = 13;
+    static constexpr u64 slice_min_index = 15;
+    static constexpr u64 slice_max_index = 17;
+    static constexpr u64 slice_dot_index = 19;
+    static constexpr u64 slice_add_index = 21;
+    static constexpr u64 slice_mul_index = 23;
+    static constexpr u64 slice_index_index = 25;
+    static constexpr u64 slice_fill_index = 27;
+    static constexpr u64 new_struct_slice_index = 28;
+    static constexpr u64 new_map_index = 29;
+    static constexpr u64 map_get_index = 30;
+    static constexpr u64 map_set_index = 31;
+    static constexpr u64 map_delete_index = 32;
+    static constexpr u64 map_range_index = 33;
+    static constexpr u64 map_range_next_index = 34;
+    static constexpr u64 string_concat_index = 35;
+    static constexpr u64 string_equal_index = 36;
+    static constexpr u64 string_compare_index = 37;
+    static constexpr u64 string_index_index = 38;
+    static constexpr u64 string_slice_index = 39;
+    static constexpr u64 string_intern_index = 40;
+    static constexpr u64 new_defer_record_index = 41;
+    static constexpr u64 release_defer_record_index = 42;
+
+    std::vector<Function>& function_table;
+    const std::unordered_map<std::string, u64>& function_indices;
+    const NodeTable<u64>& node_functions;
+    const std::unordered_map<std::string, u64>& native_function_indices;
+    std::vector<VariableFrame>& variable_frames;
+    const std::unordered_map<std::string, Type*>& type_names;
+    const NodeTable<Type*>& node_types;
+    std::vector<std::vector<Relocation>>& function_relocations;
 
-    std::vector<Function> function_table;
-    std::unordered_map<std::string, u64> function_indices;
-    std::unordered_map<void*, u64> node_functions;
     Function* current_function = nullptr;
     FunctionContext* current_function_context = nullptr;
+    DeclarationRecord* current_record = nullptr;
+    DeclarationOutput* output = nullptr;
+    /* the statement compiled before the current one in its list, null for the first */
+    Node* previous_statement = nullptr;
+    /* the index operands of slice accesses that cannot be out of range */
+    std::unordered_set<const Node*> proven_indices;
+
+    CodeGenerator(
+        std::vector<Function>& function_table,
+        const std::unordered_map<std::string, u64>& function_indices,
+        const NodeTable<u64>& node_functions,
+        const std::unordered_map<std::string, u64>& native_function_indices,
+        std::vector<VariableFrame>& variable_frames,
+        const std::unordered_map<std::string, Type*>& type_names,
+        const NodeTable<Type*>& node_types,
+        std::vector<std::vector<Relocation>>& function_relocations) :
+        function_table{function_table},
+        function_indices{function_indices},
+        node_functions{node_functions},
+        native_function_indices{native_function_indices},
+        variable_frames{variable_frames},
+        type_names{type_names},
+        node_types{node_types},
+        function_relocations{function_relocations}
+    {
+    }
+
+    /* compiles a declaration, recording its dependencies when it has a record */
+    void compile_declaration(FunctionDeclNode* node, DeclarationRecord* record, DeclarationOutput& declaration_output)
+    {
+        current_record = record;
+        output = &declaration_output;
+        try {
+            visitFunctionDecl(node);
+            if (current_record) {
+                record_variable_dependencies(*current_record);
+            }
+        } catch (...) {
+            declaration_output.error = std::current_exception();
+        }
+        current_record = nullptr;
+        output = nullptr;
+        proven_indices.clear();
+    }
 
-    std::vector<NativeFunction> native_function_table;
-    std::unordered_map<std::string, u64> native_function_indices;
-    std::unordered_map<void*, u64> node_native_functions;
-
-    std::unordered_map<void*, VariableFrame> variable_frames;
-    std::vector<std::unique_ptr<Type>> type_table;
-    std::unordered_map<std::string, Type*> type_names;
-    std::unordered_map<void*, Type*> node_types;
-
-    StringPool string_pool;
-
+    /* the index of a type and whether it is one of the output's, still to be added to the type table */
     template <typename T>
-    Type* register_type(const T& type)
+    std::pair<u64, bool> intern_type(const T& type)
     {
         std::string name = type.get_name();
-        auto it = type_names.find(name);
-        if (it != type_names.end()) {
-            return it->second;
+        if (auto it = type_names.find(name); it != type_names.end()) {
+            return {it->second->index, false};
         }
-        u64 type_index = type_table.size();
-        auto smart_ptr = std::unique_ptr<Type>(new T{type});
-        auto raw_ptr = smart_ptr.get();
-        raw_ptr->index = type_index;
-        type_table.push_back(std::move(smart_ptr));
-        type_names.try_emplace(name, raw_ptr);
-        return raw_ptr;
+        auto [it, inserted] = output->type_indices.try_emplace(std::move(name), output->types.size());
+        if (inserted) {
+            output->types.push_back(std::make_unique<T>(type));
+        }
+        return {it->second, true};
     }
 
-    Compiler()
+    /* the operand of the last instruction indexes a table that changes between compilations */
+    void relocate(RelocationKind kind)
     {
-        register_type(IntType{});
-        register_type(FloatType{});
-        register_type(BoolType{});
-        register_type(StringType{});
-        register_type(ChannelType{nullptr});
-        register_type(SliceType{nullptr});
-
-        native_function_table.push_back(new_thread);
-        native_function_table.push_back(new_chan);
-        native_function_table.push_back(chan_send);
-        native_function_table.push_back(chan_recv);
-        native_function_table.push_back(sprint);
-        native_function_table.push_back(iprint);
-        native_function_table.push_back(fprint);
-        native_function_table.push_back(new_slice);
-
-        native_function_indices.try_emplace("make", new_chan_index);
-        native_function_indices.try_emplace("sprint", sprint_index);
-        native_function_indices.try_emplace("iprint", iprint_index);
-        native_function_indices.try_emplace("fprint", fprint_index);
-        native_function_indices.try_emplace("new", new_slice_index);
+        function_relocations[current_function->index].push_back(Relocation{
+            .kind = kind,
+            .offset = current_function->code.size() - 1,
+        });
     }
 
-    std::any visitExpression(GOatLANGParser::ExpressionContext* ctx)
+    /* the operand of the last instruction indexes the output instead of a table */
+    void add_output_operand(std::vector<OutputOperand>& operands)
     {
-        return ctx->accept(this);
+        operands.push_back(OutputOperand{
+            .function_index = current_function->index,
+            .offset = current_function->code.size() - 1,
+        });
     }
 
-    std::any visitPrimaryExpr(GOatLANGParser::PrimaryExprContext* ctx)
+    /* the instructions emitted from here on were compiled from the line of node */
+    void mark_line(const Node* node)
     {
-        return ctx->accept(this);
+        auto& lines = current_function->lines;
+        u64 offset = current_function->code.size();
+        if (!lines.empty() && lines.back().offset == offset) {
+            lines.pop_back();
+        }
+        if (lines.empty() || lines.back().line != node->line) {
+            lines.push_back(LineEntry{.offset = offset, .line = node->line});
+        }
     }
 
-    virtual std::any visitSourceFile(GOatLANGParser::SourceFileContext* ctx) override
+    void record_dependency(const std::string& name, std::string signature)
     {
-        FunctionScanner scanner{function_table, function_indices, node_functions};
-        scanner.visitSourceFile(ctx);
-        VariableAnalyzer analyzer{
-            function_table,
-            function_indices,
-            node_functions,
-            native_function_indices,
-            variable_frames};
-        analyzer.visitSourceFile(ctx);
-        TypeAnnotator annotator{type_table, type_names, node_types, variable_frames};
-        annotator.visitSourceFile(ctx);
-        return visitChildren(ctx);
+        if (current_record) {
+            current_record->dependencies.push_back(Dependency{.name = name, .signature = std::move(signature)});
+        }
     }
 
-    virtual std::any visitTopLevelDecl(GOatLANGParser::TopLevelDeclContext* ctx) override
+    /* the variables of a declaration would change meaning if a function took their name */
+    void record_variable_dependencies(DeclarationRecord& record)
     {
-        if (auto function_decl = ctx->functionDecl(); function_decl) {
-            visitFunctionDecl(function_decl);
+        for (u64 i = record.first_function; i < record.first_function + record.function_count; ++i) {
+            for (const auto& [name, _] : variable_frames[i].variables) {
+                record.dependencies.push_back(Dependency{.name = name});
+            }
         }
-        return {};
+        auto& dependencies = record.dependencies;
+        std::sort(dependencies.begin(), dependencies.end(), [](const Dependency& a, const Dependency& b) {
+            return std::tie(a.name, a.signature) < std::tie(b.name, b.signature);
+        });
+        auto last = std::unique(dependencies.begin(), dependencies.end(), [](const Dependency& a, const Dependency& b) {
+            return a.name == b.name && a.signature == b.signature;
+        });
+        dependencies.erase(last, dependencies.end());
     }
 
-    virtual std::any visitFunctionDecl(GOatLANGParser::FunctionDeclContext* ctx) override
+
+    virtual void visitFunctionDecl(FunctionDeclNode* node) override
     {
         Function* saved_function = current_function;
-        u64 function_index = function_indices.at(ctx->IDENTIFIER()->getText());
-        current_function = &function_table[function_index];
-        visitFunction(ctx->function());
+        current_function = &function_table[node_functions[node]];
+        visitFunction(node->function);
         current_function = saved_function;
-        return {};
     }
 
-    virtual std::any visitFunction(GOatLANGParser::FunctionContext* ctx) override
+    virtual void visitFunction(FunctionNode* node) override
     {
         FunctionContext* saved_function_context = current_function_context;
         FunctionContext new_function_context{
             .has_return_stmt = false,
-            .variable_frame = variable_frames.at(ctx),
+            .variable_frame = variable_frames[node_functions[node]],
         };
         current_function_context = &new_function_context;
 
-        visitSignature(ctx->signature());
-        visitBlock(ctx->block());
-
         auto& code = current_function->code;
+        mark_line(node);
+        /* function entries and loop back-edges are where threads yield */
+        code.push_back(Instruction{.opcode = Opcode::safepoint});
+        visitSignature(node->signature);
+        /* frames are not zeroed, no call is deferred yet */
+        if (!new_function_context.variable_frame.defers.empty()) {
+            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(0)});
+            compile_store(defer_state_name);
+        }
+        visitBlock(node->body);
+
         if (!new_function_context.has_return_stmt) {
+            compile_deferred_calls();
             code.push_back(Instruction{.opcode = Opcode::ret});
         }
         for (const auto& goto_ : new_function_context.unresolved_gotos) {
@@ -927,26 +1477,47 @@ public:
         }
 
         current_function_context = saved_function_context;
-        return {};
     }
 
-    virtual std::any visitVarSpec(GOatLANGParser::VarSpecContext* ctx) override
+    void compile_statements(std::span<Node*> statements)
     {
-        auto expression = ctx->expression();
-        if (!expression) {
-            return {};
+        previous_statement = nullptr;
+        for (auto statement : statements) {
+            mark_line(statement);
+            visit(statement);
+            previous_statement = statement;
         }
-        auto name = ctx->IDENTIFIER()->getText();
+        previous_statement = nullptr;
+    }
+
+    virtual void visitBlock(BlockNode* node) override
+    {
+        compile_statements(node->statements);
+    }
+
+    /* a declaration without a value stores the zero word, a nil slice or channel among them, or a zeroed struct */
+    virtual void visitVarDecl(VarDeclNode* node) override
+    {
+        auto expression = node->value;
+        auto name = std::string{node->name};
         auto& variable = current_function_context->variable_frame.variables.at(name);
         auto& code = current_function->code;
 
         if (variable.category != VariableCategory::bound) {
-            auto type = node_types.at(ctx);
+            auto type = node_types[node];
             code.push_back(Instruction{.opcode = Opcode::new_, .index = type->index});
+            relocate(RelocationKind::type);
             code.push_back(Instruction{.opcode = Opcode::dup});
         }
 
-        visitExpression(expression);
+        if (expression) {
+            visit(expression);
+        } else if (auto struct_type = dynamic_cast<StructType*>(node_types[node]); struct_type) {
+            code.push_back(Instruction{.opcode = Opcode::new_, .index = struct_type->index});
+            relocate(RelocationKind::type);
+        } else {
+            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(0)});
+        }
 
         if (variable.category == VariableCategory::bound) {
             code.push_back(Instruction{.opcode = Opcode::store, .index = variable.index});
@@ -954,23 +1525,22 @@ public:
             code.push_back(Instruction{.opcode = Opcode::wstore, .index = 0});
             code.push_back(Instruction{.opcode = Opcode::store, .index = variable.index});
         }
-        return {};
     }
 
-    virtual std::any visitExpressionStmt(GOatLANGParser::ExpressionStmtContext* ctx) override
+    virtual void visitExpressionStmt(ExpressionStmtNode* node) override
     {
-        auto expression = ctx->expression();
-        visitExpression(expression);
-        auto type = node_types.at(expression);
+        auto expression = node->expression;
+        visit(expression);
+        auto type = node_types[expression];
         if (type) {
             current_function->code.push_back(Instruction{.opcode = Opcode::pop});
         }
-        return {};
     }
 
-    virtual std::any visitSendStmt(GOatLANGParser::SendStmtContext* ctx) override
+    /* pushes the channel and the boxed item of a send */
+    void compile_send_operands(SendStmtNode* node)
     {
-        auto name = ctx->IDENTIFIER()->getText();
+        auto name = std::string{node->channel};
         auto& variable = current_function_context->variable_frame.variables.at(name);
         auto& code = current_function->code;
 
@@ -983,248 +1553,787 @@ public:
 
         code.push_back(Instruction{.opcode = Opcode::new_, .index = 0});
         code.push_back(Instruction{.opcode = Opcode::dup});
-        visitExpression(ctx->expression());
+        visit(node->value);
         code.push_back(Instruction{.opcode = Opcode::wstore, .index = 0});
-        code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = chan_send_index});
-        return {};
     }
 
-    virtual std::any visitAssignmentStmt(GOatLANGParser::AssignmentStmtContext* ctx) override
+    /* pops the value on top of the operand stack into a variable */
+    void compile_store(const std::string& name)
+    {
+        auto& variable = current_function_context->variable_frame.variables.at(name);
+        auto& code = current_function->code;
+
+        if (variable.category == VariableCategory::bound) {
+            code.push_back(Instruction{.opcode = Opcode::store, .index = variable.index});
+        } else {
+            code.push_back(Instruction{.opcode = Opcode::load, .index = variable.index});
+            code.push_back(Instruction{.opcode = Opcode::swap});
+            code.push_back(Instruction{.opcode = Opcode::wstore, .index = 0});
+        }
+    }
+
+    virtual void visitSendStmt(SendStmtNode* node) override
+    {
+        compile_send_operands(node);
+        current_function->code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = chan_send_index});
+    }
+
+    virtual void visitRecvAssignStmt(RecvAssignStmtNode* node) override
+    {
+        auto& code = current_function->code;
+        visit(node->channel);
+        code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = chan_recv_ok_index});
+        compile_store(std::string{node->ok_name});
+        compile_received_item(node->channel);
+        compile_store(std::string{node->value_name});
+    }
+
+    virtual void visitSelectStmt(SelectStmtNode* node) override
+    {
+        auto& code = current_function->code;
+        std::vector<CommClauseNode*> cases;
+        CommClauseNode* default_clause = nullptr;
+
+        for (auto comm_clause : node->clauses) {
+            if (auto send_stmt = comm_clause->send; send_stmt) {
+                compile_send_operands(send_stmt);
+                code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(1)});
+            } else if (auto recv_stmt = comm_clause->recv; recv_stmt) {
+                visit(recv_stmt->channel);
+                code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(0)});
+                code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(0)});
+            } else {
+                default_clause = comm_clause;
+                continue;
+            }
+            cases.push_back(comm_clause);
+        }
+        code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(cases.size())});
+        code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(default_clause != nullptr)});
+        code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = chan_select_index});
+
+        /* the received item and its ok flag lie below the index of the chosen case */
+        std::vector<u64> if_t_indices;
+        for (u64 i = 0; i < cases.size(); ++i) {
+            code.push_back(Instruction{.opcode = Opcode::dup});
+            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(i)});
+            code.push_back(Instruction{.opcode = Opcode::ieq});
+            if_t_indices.push_back(code.size());
+            code.push_back(Instruction{.opcode = Opcode::if_t});
+        }
+
+        std::vector<u64> goto_indices;
+        code.push_back(Instruction{.opcode = Opcode::pop});
+        code.push_back(Instruction{.opcode = Opcode::pop});
+        code.push_back(Instruction{.opcode = Opcode::pop});
+        if (default_clause) {
+            compile_statements(default_clause->statements);
+        }
+        goto_indices.push_back(code.size());
+        code.push_back(Instruction{.opcode = Opcode::goto_});
+
+        for (u64 i = 0; i < cases.size(); ++i) {
+            code[if_t_indices[i]].index = code.size();
+            code.push_back(Instruction{.opcode = Opcode::pop});
+            auto recv_stmt = cases[i]->recv;
+            if (recv_stmt && !recv_stmt->ok_name.empty()) {
+                compile_store(std::string{recv_stmt->ok_name});
+            } else {
+                code.push_back(Instruction{.opcode = Opcode::pop});
+            }
+            if (recv_stmt && !recv_stmt->value_name.empty()) {
+                compile_received_item(recv_stmt->channel);
+                compile_store(std::string{recv_stmt->value_name});
+            } else {
+                code.push_back(Instruction{.opcode = Opcode::pop});
+            }
+            compile_statements(cases[i]->statements);
+            goto_indices.push_back(code.size());
+            code.push_back(Instruction{.opcode = Opcode::goto_});
+        }
+
+        for (u64 goto_index : goto_indices) {
+            code[goto_index].index = code.size();
+        }
+    }
+
+    virtual void visitAssignmentStmt(AssignmentStmtNode* node) override
     {
-        auto name = ctx->IDENTIFIER()->getText();
+        auto name = std::string{node->name};
         auto& variable = current_function_context->variable_frame.variables.at(name);
         auto& code = current_function->code;
 
+        if (!node->fields.empty()) {
+            compile_variable_value(variable);
+            if (auto index = node->index; index) {
+                visit(index);
+                code.push_back(Instruction{.opcode = proven_indices.contains(index) ? Opcode::uload : Opcode::sload});
+            }
+            auto type = node_types[node];
+            u64 offset = 0;
+            for (auto field_name : node->fields) {
+                const auto& field = *static_cast<StructType*>(type)->find_field(field_name);
+                offset += field.offset;
+                type = field.type;
+            }
+            compile_field_store(type, offset, node->value);
+            return;
+        }
+
+        if (auto index = node->index; index) {
+            compile_variable_value(variable);
+            visit(index);
+            visit(node->value);
+            if (dynamic_cast<MapType*>(node_types[node])) {
+                code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = map_set_index});
+                return;
+            }
+            code.push_back(Instruction{.opcode = proven_indices.contains(index) ? Opcode::ustore : Opcode::sstore});
+            return;
+        }
+
         if (variable.category != VariableCategory::bound) {
             code.push_back(Instruction{.opcode = Opcode::load, .index = variable.index});
         }
 
-        visitExpression(ctx->expression());
+        visit(node->value);
 
         if (variable.category == VariableCategory::bound) {
             code.push_back(Instruction{.opcode = Opcode::store, .index = variable.index});
         } else {
             code.push_back(Instruction{.opcode = Opcode::wstore, .index = 0});
         }
-        return {};
     }
 
-    virtual std::any visitReturnStmt(GOatLANGParser::ReturnStmtContext* ctx) override
+    /* the word a variable holds, its struct as an address without a copy */
+    void compile_variable_value(const Variable& variable)
+    {
+        auto& code = current_function->code;
+        code.push_back(Instruction{.opcode = Opcode::load, .index = variable.index});
+        if (variable.category != VariableCategory::bound) {
+            code.push_back(Instruction{.opcode = Opcode::wload, .index = 0});
+        }
+    }
+
+    /* stores the value into the field at a word offset of the struct on top, a struct field in place */
+    void compile_field_store(Type* type, u64 offset, Node* value)
+    {
+        auto& code = current_function->code;
+        auto struct_type = dynamic_cast<StructType*>(type);
+        if (!struct_type) {
+            visit(value);
+            code.push_back(Instruction{.opcode = Opcode::wstore, .index = offset});
+            return;
+        }
+        if (offset != 0) {
+            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(sizeof(Word) * offset)});
+            code.push_back(Instruction{.opcode = Opcode::iadd});
+        }
+        visit(value);
+        code.push_back(Instruction{.opcode = Opcode::mstore, .index = struct_type->index});
+        relocate(RelocationKind::type);
+    }
+
+    /* a copy of the struct at the address on top, so structs are values */
+    void copy_struct(Type* type)
+    {
+        if (auto struct_type = dynamic_cast<StructType*>(type); struct_type) {
+            current_function->code.push_back(Instruction{.opcode = Opcode::mload, .index = struct_type->index});
+            relocate(RelocationKind::type);
+        }
+    }
+
+    /*
+     * Loads the item out of the box received from a channel. A closed channel
+     * gives a box of the zero word, which for a struct is a new zeroed struct.
+     */
+    void compile_received_item(Node* channel)
+    {
+        auto& code = current_function->code;
+        code.push_back(Instruction{.opcode = Opcode::wload, .index = 0});
+        auto channel_type = static_cast<ChannelType*>(node_types[channel]);
+        if (auto struct_type = dynamic_cast<StructType*>(channel_type->element_type); struct_type) {
+            code.push_back(Instruction{.opcode = Opcode::dup});
+            u64 if_t_index = code.size();
+            code.push_back(Instruction{.opcode = Opcode::if_t});
+            code.push_back(Instruction{.opcode = Opcode::pop});
+            code.push_back(Instruction{.opcode = Opcode::new_, .index = struct_type->index});
+            relocate(RelocationKind::type);
+            code[if_t_index].index = code.size();
+        }
+    }
+
+    /*
+     * A call whose result is returned as it is reuses the frame of the
+     * caller, unless calls deferred by the caller still have to run after
+     * it. Natives and the builtins are not called through frames.
+     */
+    bool compile_tail_call(Node* value)
+    {
+        auto call_expr = node_cast<CallExprNode>(value);
+        if (!call_expr || !current_function_context->variable_frame.defers.empty()) {
+            return false;
+        }
+        auto& code = current_function->code;
+        if (auto operand_name = node_cast<OperandNameNode>(call_expr->callee); operand_name && !names_variable(operand_name)) {
+            auto name = std::string{operand_name->name};
+            if (is_builtin_operation(name)) {
+                return false;
+            }
+            if (auto it = function_indices.find(name); it != function_indices.end()) {
+                compile_arguments(call_expr);
+                record_dependency(name, node_types[operand_name]->get_name());
+                code.push_back(Instruction{.opcode = Opcode::tailcall, .index = it->second});
+                relocate(RelocationKind::function);
+                return true;
+            }
+            if (native_function_indices.contains(name) || is_generic_builtin(name)) {
+                return false;
+            }
+        }
+        compile_arguments(call_expr);
+        visit(call_expr->callee);
+        code.push_back(Instruction{.opcode = Opcode::tailcall_dynamic});
+        return true;
+    }
+
+    virtual void visitReturnStmt(ReturnStmtNode* node) override
     {
-        visitExpression(ctx->expression());
+        if (compile_tail_call(node->value)) {
+            current_function_context->has_return_stmt = true;
+            return;
+        }
+        if (node->value) {
+            visit(node->value);
+        }
+        /* the deferred calls run after the result is computed, under it on the stack */
+        compile_deferred_calls();
         current_function->code.push_back(Instruction{.opcode = Opcode::ret});
         current_function_context->has_return_stmt = true;
-        return {};
     }
 
-    virtual std::any visitIfStmt(GOatLANGParser::IfStmtContext* ctx) override
+    virtual void visitIfStmt(IfStmtNode* node) override
     {
-        visitExpression(ctx->expression());
+        /* an else if is not a statement of a block */
+        mark_line(node);
+        std::vector<u64> else_jumps;
+        compile_branch(node->condition, false, else_jumps);
 
         auto& code = current_function->code;
-        u64 if_f_index = code.size();
-        code.push_back(Instruction{.opcode = Opcode::if_f});
+        visitBlock(node->then_block);
 
-        visitBlock(ctx->block(0));
-
-        auto block = ctx->block(1);
-        auto if_stmt = ctx->ifStmt();
+        auto else_branch = node->else_branch;
         u64 goto_index;
 
-        if (block || if_stmt) {
+        if (else_branch) {
             goto_index = code.size();
             code.push_back(Instruction{.opcode = Opcode::goto_});
         }
-        code[if_f_index].index = code.size();
+        patch_jumps(else_jumps, code.size());
 
-        if (block) {
-            visitBlock(block);
-        } else if (if_stmt) {
-            visitIfStmt(if_stmt);
+        if (else_branch) {
+            visit(else_branch);
+            code[goto_index].index = code.size();
         }
+    }
 
-        if (block || if_stmt) {
-            code[goto_index].index = code.size();
+    /* whether node is a local of the current function that no closure captures */
+    bool is_bound_variable(const Node* node)
+    {
+        auto operand_name = node_cast<OperandNameNode>(node);
+        if (!operand_name) {
+            return false;
+        }
+        auto& variables = current_function_context->variable_frame.variables;
+        auto it = variables.find(std::string{operand_name->name});
+        return it != variables.end() && it->second.category == VariableCategory::bound;
+    }
+
+    /* whether node is "name = <int literal>" or "var name int = <int literal>", which is never negative */
+    static bool is_counter_start(const Node* node, std::string_view name)
+    {
+        const Node* value = nullptr;
+        if (auto var_decl = node_cast<VarDeclNode>(node); var_decl && var_decl->name == name) {
+            value = var_decl->value;
+        } else if (auto assignment_stmt = node_cast<AssignmentStmtNode>(node);
+                   assignment_stmt && assignment_stmt->name == name && !assignment_stmt->index) {
+            value = assignment_stmt->value;
+        }
+        auto literal = node_cast<BasicLitNode>(value);
+        return literal && literal->literal_kind == LiteralKind::int_;
+    }
+
+    /* whether node is "name = name + <literal>" with a step small enough never to overflow */
+    static bool is_counter_step(const Node* node, std::string_view name)
+    {
+        auto assignment_stmt = node_cast<AssignmentStmtNode>(node);
+        if (!assignment_stmt || assignment_stmt->name != name || assignment_stmt->index) {
+            return false;
+        }
+        auto binary_expr = node_cast<BinaryExprNode>(assignment_stmt->value);
+        if (!binary_expr || binary_expr->op != Operator::add) {
+            return false;
+        }
+        auto left = node_cast<OperandNameNode>(binary_expr->left);
+        auto right = node_cast<BasicLitNode>(binary_expr->right);
+        if (!left || left->name != name || !right || right->literal_kind != LiteralKind::int_) {
+            return false;
+        }
+        u64 step = std::stoull(std::string{right->text});
+        return step >= 1 && step <= u64{1} << 32;
+    }
+
+    /*
+     * Proves the accesses s[i] in range in a loop of the form
+     *     var i int = 0
+     *     for i < len(s) {
+     *         ...
+     *         i = i + 1
+     *     }
+     * where i and s are uncaptured locals and the body writes neither before
+     * the final step: i starts at no less than zero and only grows, and s
+     * keeps its length, so the condition bounds i wherever s[i] is reached.
+     * The accesses then compile without a bounds check.
+     */
+    void prove_counted_loop(ForStmtNode* node)
+    {
+        auto condition = node_cast<BinaryExprNode>(node->condition);
+        if (!condition || condition->op != Operator::lt || !is_bound_variable(condition->left)) {
+            return;
+        }
+        auto call_expr = node_cast<CallExprNode>(condition->right);
+        if (!call_expr || call_expr->arguments.size() != 1 || !is_bound_variable(call_expr->arguments[0])) {
+            return;
+        }
+        auto callee = node_cast<OperandNameNode>(call_expr->callee);
+        if (!callee || callee->name != "len") {
+            return;
+        }
+        auto index_name = node_cast<OperandNameNode>(condition->left)->name;
+        auto slice_name = node_cast<OperandNameNode>(call_expr->arguments[0])->name;
+        auto& statements = node->body->statements;
+        if (!previous_statement || !is_counter_start(previous_statement, index_name) ||
+            statements.empty() || !is_counter_step(statements.back(), index_name)) {
+            return;
+        }
+        CountedLoopScanner scanner{index_name, slice_name};
+        for (auto statement : statements.first(statements.size() - 1)) {
+            scanner.visit(statement);
+        }
+        if (!scanner.disqualified) {
+            proven_indices.insert(scanner.accesses.begin(), scanner.accesses.end());
         }
-        return {};
     }
 
-    virtual std::any visitForStmt(GOatLANGParser::ForStmtContext* ctx) override
+    virtual void visitForStmt(ForStmtNode* node) override
     {
+        if (auto range_clause = node->range; range_clause) {
+            return compile_range_loop(range_clause, node->body);
+        }
+        prove_counted_loop(node);
         auto& code = current_function->code;
-        auto expression = ctx->expression();
+        auto expression = node->condition;
         u64 for_index = code.size();
-        u64 if_f_index;
+        std::vector<u64> exit_jumps;
 
         if (expression) {
-            visitExpression(expression);
-            if_f_index = code.size();
-            code.push_back(Instruction{.opcode = Opcode::if_f});
+            compile_branch(expression, false, exit_jumps);
         }
 
-        visitBlock(ctx->block());
+        visitBlock(node->body);
 
+        mark_line(node);
+        code.push_back(Instruction{.opcode = Opcode::safepoint});
         code.push_back(Instruction{.opcode = Opcode::goto_, .index = for_index});
-        if (expression) {
-            code[if_f_index].index = code.size();
+        patch_jumps(exit_jumps, code.size());
+    }
+
+    /* a channel gives boxed items, a map its keys */
+    void compile_range_loop(RangeClauseNode* node, BlockNode* block)
+    {
+        auto& code = current_function->code;
+        auto iterator_name = range_iterator_name(node);
+        bool over_map = dynamic_cast<MapType*>(node_types[node->channel]);
+        visit(node->channel);
+        code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = over_map ? map_range_index : chan_range_index});
+        compile_store(iterator_name);
+
+        u64 for_index = code.size();
+        auto& iterator = current_function_context->variable_frame.variables.at(iterator_name);
+        code.push_back(Instruction{.opcode = Opcode::load, .index = iterator.index});
+        code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = over_map ? map_range_next_index : chan_range_next_index});
+        u64 if_f_index = code.size();
+        code.push_back(Instruction{.opcode = Opcode::if_f});
+        if (!over_map) {
+            compile_received_item(node->channel);
         }
-        return {};
+        compile_store(std::string{node->name});
+
+        visitBlock(block);
+
+        mark_line(node);
+        code.push_back(Instruction{.opcode = Opcode::safepoint});
+        code.push_back(Instruction{.opcode = Opcode::goto_, .index = for_index});
+        code[if_f_index].index = code.size();
+        /* the zero item left by the exhausted iterator */
+        code.push_back(Instruction{.opcode = Opcode::pop});
     }
 
-    virtual std::any visitParameterList(GOatLANGParser::ParameterListContext* ctx) override
+    virtual void visitSignature(SignatureNode* node) override
     {
-        auto parameter_decls = ctx->parameterDecl();
+        auto& parameter_decls = node->parameters;
         /* the parameters are visited in reverse order */
         for (auto it = parameter_decls.rbegin(); it != parameter_decls.rend(); ++it) {
             visitParameterDecl(*it);
         }
-        return {};
     }
 
-    virtual std::any visitGotoStmt(GOatLANGParser::GotoStmtContext* ctx) override
+    virtual void visitGotoStmt(GotoStmtNode* node) override
     {
+        auto label = std::string{node->label};
+        /* a label that is already placed makes this a backward jump */
+        if (current_function_context->label_locations.contains(label)) {
+            current_function->code.push_back(Instruction{.opcode = Opcode::safepoint});
+        }
         current_function_context->unresolved_gotos.emplace_back(UnresolvedGoto{
-            .label = ctx->IDENTIFIER()->getText(),
+            .label = label,
             .index = current_function->code.size(),
         });
         current_function->code.push_back(Instruction{.opcode = Opcode::goto_});
-        return {};
     }
 
-    virtual std::any visitLabeledStmt(GOatLANGParser::LabeledStmtContext* ctx) override
+    virtual void visitLabeledStmt(LabeledStmtNode* node) override
     {
+        /* a goto can reach the statement without passing the one before it */
+        previous_statement = nullptr;
         current_function_context->label_locations.try_emplace(
-            ctx->IDENTIFIER()->getText(),
+            std::string{node->label},
             current_function->code.size());
-        return visitChildren(ctx);
+        visitChildren(node);
     }
 
-    virtual std::any visitParameterDecl(GOatLANGParser::ParameterDeclContext* ctx) override
+    virtual void visitParameterDecl(ParameterDeclNode* node) override
     {
-        auto identifier = ctx->IDENTIFIER();
         auto& code = current_function->code;
-        if (!identifier) {
+        if (node->name.empty()) {
             code.push_back(Instruction{.opcode = Opcode::pop});
-            return {};
+            return;
         }
-        auto name = identifier->getText();
+        auto name = std::string{node->name};
         auto& variable = current_function_context->variable_frame.variables.at(name);
 
         if (variable.category == VariableCategory::bound) {
             code.push_back(Instruction{.opcode = Opcode::store, .index = variable.index});
         } else { /* escaped */
-            auto type = node_types.at(ctx);
+            auto type = node_types[node];
             code.push_back(Instruction{.opcode = Opcode::new_, .index = type->index});
+            relocate(RelocationKind::type);
             code.push_back(Instruction{.opcode = Opcode::dup});
             code.push_back(Instruction{.opcode = Opcode::store, .index = variable.index});
             code.push_back(Instruction{.opcode = Opcode::swap});
             code.push_back(Instruction{.opcode = Opcode::wstore, .index = 0});
         }
-        return {};
     }
 
-    virtual std::any visitGoType(GOatLANGParser::GoTypeContext* ctx) override
+    /* types produce no code, only the operands of these are compiled */
+    virtual void visitCastExpr(CastExprNode* node) override
+    {
+        visit(node->operand);
+    }
+
+    /* fills the fields of the new struct on top, keeping it there */
+    void compile_literal_value(LiteralValueNode* node, StructType* struct_type, u64 offset)
+    {
+        auto& code = current_function->code;
+        for (u64 i = 0; i < node->elements.size(); ++i) {
+            const auto& field = struct_type->fields[i];
+            if (auto literal_value = node_cast<LiteralValueNode>(node->elements[i]); literal_value) {
+                compile_literal_value(literal_value, static_cast<StructType*>(field.type), offset + field.offset);
+                continue;
+            }
+            code.push_back(Instruction{.opcode = Opcode::dup});
+            compile_field_store(field.type, offset + field.offset, node->elements[i]);
+        }
+    }
+
+    virtual void visitCompositeLit(CompositeLitNode* node) override
+    {
+        auto struct_type = static_cast<StructType*>(node_types[node]);
+        current_function->code.push_back(Instruction{.opcode = Opcode::new_, .index = struct_type->index});
+        relocate(RelocationKind::type);
+        compile_literal_value(node->value, struct_type, 0);
+    }
+
+    /* a chain of field selections loads at the sum of their offsets */
+    virtual void visitFieldExpr(FieldExprNode* node) override
+    {
+        auto& code = current_function->code;
+        Node* operand = node;
+        u64 offset = 0;
+        while (auto field_expr = node_cast<FieldExprNode>(operand)) {
+            auto struct_type = static_cast<StructType*>(node_types[field_expr->operand]);
+            offset += struct_type->find_field(field_expr->field)->offset;
+            operand = field_expr->operand;
+        }
+        compile_struct_address(operand);
+        auto type = node_types[node];
+        if (!dynamic_cast<StructType*>(type)) {
+            code.push_back(Instruction{.opcode = Opcode::wload, .index = offset});
+            return;
+        }
+        if (offset != 0) {
+            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(sizeof(Word) * offset)});
+            code.push_back(Instruction{.opcode = Opcode::iadd});
+        }
+        copy_struct(type);
+    }
+
+    /* the address of a struct operand, only read from so not copied */
+    void compile_struct_address(Node* node)
     {
-        return {};
+        if (auto operand_name = node_cast<OperandNameNode>(node); operand_name) {
+            compile_variable_value(current_function_context->variable_frame.variables.at(std::string{operand_name->name}));
+        } else if (auto index_expr = node_cast<IndexExprNode>(node); index_expr && !dynamic_cast<MapType*>(node_types[index_expr->operand])) {
+            compile_element(index_expr);
+        } else {
+            visit(node);
+        }
     }
 
-    virtual std::any visitBasicLit(GOatLANGParser::BasicLitContext* ctx) override
+    virtual void visitBasicLit(BasicLitNode* node) override
     {
         Word word;
         auto& code = current_function->code;
-        if (auto int_lit = ctx->INT_LIT(); int_lit) {
-            auto text = int_lit->getText();
+        if (node->literal_kind == LiteralKind::int_) {
+            auto text = std::string{node->text};
             u64 value = std::stoull(text);
             word = bitcast<u64, Word>(value);
             code.push_back(Instruction{.opcode = Opcode::push, .value = word});
-        } else if (auto float_lit = ctx->FLOAT_LIT(); float_lit) {
-            auto text = float_lit->getText();
+        } else if (node->literal_kind == LiteralKind::float_) {
+            auto text = std::string{node->text};
             f64 value = std::stod(text);
             word = bitcast<f64, Word>(value);
             code.push_back(Instruction{.opcode = Opcode::push, .value = word});
-        } else if (auto string_lit = ctx->STRING_LIT(); string_lit) {
-            auto text = string_lit->getText();
-            auto type = type_names.at("string");
-            u64 string_index = string_pool.new_string(std::move(text));
-            code.push_back(Instruction{.opcode = Opcode::new_, .index = type->index});
-            code.push_back(Instruction{.opcode = Opcode::dup});
-            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(string_index)});
-            code.push_back(Instruction{.opcode = Opcode::wstore});
-        } else {
+        } else if (node->literal_kind == LiteralKind::string) {
+            auto text = std::string{node->text};
+            u64 string_index = output->strings.size();
+            output->strings.push_back(std::move(text));
+            code.push_back(Instruction{.opcode = Opcode::ldstr, .index = string_index});
+            relocate(RelocationKind::string);
+            add_output_operand(output->string_operands);
         }
-        return {};
     }
 
-    virtual std::any visitOperandName(GOatLANGParser::OperandNameContext* ctx) override
+    virtual void visitOperandName(OperandNameNode* node) override
     {
         auto& code = current_function->code;
-        auto name = ctx->IDENTIFIER()->getText();
-        auto type = node_types.at(ctx);
+        auto name = std::string{node->name};
+        auto type = node_types[node];
         if (auto function_type = dynamic_cast<FunctionType*>(type); function_type) {
             u64 function_index = function_indices.at(name);
-            auto callable_type = register_type(CallableType{function_type});
-            auto closure_type = register_type(ClosureType{function_type, 0});
-            (void) callable_type;
-            code.push_back(Instruction{.opcode = Opcode::new_, .index = closure_type->index});
+            intern_type(CallableType{function_type});
+            auto [closure_type_index, pending] = intern_type(ClosureType{function_type, 0});
+            record_dependency(name, function_type->get_name());
+            code.push_back(Instruction{.opcode = Opcode::new_, .index = closure_type_index});
+            relocate(RelocationKind::type);
+            if (pending) {
+                add_output_operand(output->type_operands);
+            }
             code.push_back(Instruction{.opcode = Opcode::dup});
             code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(function_index)});
+            relocate(RelocationKind::function);
             code.push_back(Instruction{.opcode = Opcode::wstore, .index = 0});
-            return {};
+            return;
         }
-        auto& variable = current_function_context->variable_frame.variables.at(name);
-        if (variable.category == VariableCategory::bound) {
-            code.push_back(Instruction{.opcode = Opcode::load, .index = variable.index});
-        } else {
-            code.push_back(Instruction{.opcode = Opcode::load, .index = variable.index});
-            code.push_back(Instruction{.opcode = Opcode::wload, .index = 0});
-        }
-        return {};
+        compile_variable_value(current_function_context->variable_frame.variables.at(name));
+        copy_struct(type);
     }
 
-    virtual std::any visitArguments(GOatLANGParser::ArgumentsContext* ctx) override
+    /* a variable holding a function is typed as a callable or a closure, a function or native by name as a function type */
+    bool names_variable(OperandNameNode* node)
     {
-        if (auto go_type = ctx->goType(); go_type) {
+        auto type = node_types[node];
+        return type && !dynamic_cast<FunctionType*>(type);
+    }
+
+    void compile_arguments(CallExprNode* node)
+    {
+        for (auto argument : node->arguments) {
+            visit(argument);
         }
-        if (auto expression_list = ctx->expressionList(); expression_list) {
-            visitExpressionList(expression_list);
+    }
+
+    u64 get_bulk_slice_native_index(std::string_view name, CallExprNode* node)
+    {
+        if (name == "vfill") {
+            return slice_fill_index;
         }
-        return {};
+        u64 index = name == "vsum"   ? slice_sum_index
+                    : name == "vmin" ? slice_min_index
+                    : name == "vmax" ? slice_max_index
+                    : name == "vdot" ? slice_dot_index
+                    : name == "vadd" ? slice_add_index
+                    : name == "vmul" ? slice_mul_index
+                                     : slice_index_index;
+        auto slice_type = static_cast<SliceType*>(node_types[node->arguments[0]]);
+        return dynamic_cast<FloatType*>(slice_type->element_type) ? index + 1 : index;
     }
 
-    virtual std::any visitGoStmt(GOatLANGParser::GoStmtContext* ctx) override
+    virtual void visitGoStmt(GoStmtNode* node) override
     {
-        auto primary_expr = dynamic_cast<GOatLANGParser::PrimaryExpr_Context*>(ctx->expression());
-        auto call_expr = dynamic_cast<GOatLANGParser::CallExprContext*>(primary_expr->primaryExpr());
+        auto call_expr = node_cast<CallExprNode>(node->expression);
         if (!call_expr) {
-            throw new std::runtime_error("go stmt: expression is not a call expression");
+            throw std::runtime_error("go stmt: expression is not a call expression");
         }
         auto& code = current_function->code;
-        if (auto arguments = call_expr->arguments(); arguments) {
-            visitArguments(arguments);
-        }
-        visitPrimaryExpr(call_expr->primaryExpr());
+        compile_arguments(call_expr);
+        visit(call_expr->callee);
         code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = new_thread_index});
-        return {};
     }
 
-    virtual std::any visitFunctionLit(GOatLANGParser::FunctionLitContext* ctx) override
+    /*
+     * A deferred call takes its callee and arguments where it is deferred.
+     * Open-coded, they are stored in locals of their own and a bit of the
+     * mask marks the call deferred; chained, they go into a record linked
+     * in front of the others.
+     */
+    virtual void visitDeferStmt(DeferStmtNode* node) override
+    {
+        auto& code = current_function->code;
+        auto call_expr = static_cast<CallExprNode*>(node->expression);
+        auto& frame = current_function_context->variable_frame;
+        u64 site = std::find(frame.defers.begin(), frame.defers.end(), node) - frame.defers.begin();
+        u64 state_index = frame.variables.at(defer_state_name).index;
+        bool by_name = is_deferred_by_name(call_expr);
+        u64 value_count = call_expr->arguments.size() + (by_name ? 0 : 1);
+
+        if (frame.chains_defers) {
+            code.push_back(Instruction{.opcode = Opcode::load, .index = state_index});
+            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(site)});
+        }
+        compile_arguments(call_expr);
+        if (!by_name) {
+            visit(call_expr->callee);
+        }
+        if (frame.chains_defers) {
+            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(value_count)});
+            code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = new_defer_record_index});
+            code.push_back(Instruction{.opcode = Opcode::store, .index = state_index});
+            return;
+        }
+        for (u64 i = value_count; i-- > 0;) {
+            code.push_back(Instruction{.opcode = Opcode::store, .index = frame.variables.at(defer_value_name(node, i)).index});
+        }
+        code.push_back(Instruction{.opcode = Opcode::load, .index = state_index});
+        code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(u64{1} << site)});
+        code.push_back(Instruction{.opcode = Opcode::ior});
+        code.push_back(Instruction{.opcode = Opcode::store, .index = state_index});
+    }
+
+    bool is_deferred_by_name(CallExprNode* call_expr)
+    {
+        auto callee = node_cast<OperandNameNode>(call_expr->callee);
+        if (!callee || names_variable(callee)) {
+            return false;
+        }
+        auto name = std::string{callee->name};
+        return function_indices.contains(name) || native_function_indices.contains(name) || is_generic_builtin(name);
+    }
+
+    /* the deferred call with its values on the stack, dropping what it returns */
+    void compile_deferred_call(DeferStmtNode* node)
+    {
+        auto& code = current_function->code;
+        auto call_expr = static_cast<CallExprNode*>(node->expression);
+        if (!compile_call_by_name(call_expr)) {
+            code.push_back(Instruction{.opcode = Opcode::invoke_dynamic});
+        }
+        if (node_types[call_expr]) {
+            code.push_back(Instruction{.opcode = Opcode::pop});
+        }
+    }
+
+    /* the deferred calls, last deferred first, before a return */
+    void compile_deferred_calls()
+    {
+        auto& frame = current_function_context->variable_frame;
+        if (frame.defers.empty()) {
+            return;
+        }
+        auto& code = current_function->code;
+        u64 state_index = frame.variables.at(defer_state_name).index;
+        if (frame.chains_defers) {
+            return compile_chained_deferred_calls(state_index);
+        }
+        for (u64 site = frame.defers.size(); site-- > 0;) {
+            auto node = frame.defers[site];
+            auto call_expr = static_cast<CallExprNode*>(node->expression);
+            code.push_back(Instruction{.opcode = Opcode::load, .index = state_index});
+            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(u64{1} << site)});
+            code.push_back(Instruction{.opcode = Opcode::iand});
+            u64 if_f_index = code.size();
+            code.push_back(Instruction{.opcode = Opcode::if_f});
+            u64 value_count = call_expr->arguments.size() + (is_deferred_by_name(call_expr) ? 0 : 1);
+            for (u64 i = 0; i < value_count; ++i) {
+                code.push_back(Instruction{.opcode = Opcode::load, .index = frame.variables.at(defer_value_name(node, i)).index});
+            }
+            compile_deferred_call(node);
+            code[if_f_index].index = code.size();
+        }
+    }
+
+    /* a record is the next record, the defer statement and the values, released before its call */
+    void compile_chained_deferred_calls(u64 state_index)
+    {
+        auto& code = current_function->code;
+        auto& defers = current_function_context->variable_frame.defers;
+        u64 loop_index = code.size();
+        code.push_back(Instruction{.opcode = Opcode::load, .index = state_index});
+        u64 done_index = code.size();
+        code.push_back(Instruction{.opcode = Opcode::if_f});
+        for (u64 site = 0; site < defers.size(); ++site) {
+            auto call_expr = static_cast<CallExprNode*>(defers[site]->expression);
+            code.push_back(Instruction{.opcode = Opcode::load, .index = state_index});
+            code.push_back(Instruction{.opcode = Opcode::wload, .index = 1});
+            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(site)});
+            code.push_back(Instruction{.opcode = Opcode::ieq});
+            u64 if_f_index = code.size();
+            code.push_back(Instruction{.opcode = Opcode::if_f});
+            u64 value_count = call_expr->arguments.size() + (is_deferred_by_name(call_expr) ? 0 : 1);
+            for (u64 i = 0; i < value_count; ++i) {
+                code.push_back(Instruction{.opcode = Opcode::load, .index = state_index});
+                code.push_back(Instruction{.opcode = Opcode::wload, .index = 2 + i});
+            }
+            code.push_back(Instruction{.opcode = Opcode::load, .index = state_index});
+            code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = release_defer_record_index});
+            code.push_back(Instruction{.opcode = Opcode::store, .index = state_index});
+            compile_deferred_call(defers[site]);
+            code.push_back(Instruction{.opcode = Opcode::goto_, .index = loop_index});
+            code[if_f_index].index = code.size();
+        }
+        code[done_index].index = code.size();
+    }
+
+    virtual void visitFunctionLit(FunctionLitNode* node) override
     {
         Function* saved_function = current_function;
-        current_function = &function_table[node_functions.at(ctx)];
+        current_function = &function_table[node_functions[node]];
         u64 function_index = current_function->index;
-        auto function_ctx = ctx->function();
-        visitFunction(function_ctx);
+        auto function = node->function;
+        visitFunction(function);
         current_function = saved_function;
 
         auto& code = current_function->code;
-        auto type = node_types.at(ctx);
+        auto type = node_types[node];
         code.push_back(Instruction{.opcode = Opcode::new_, .index = type->index});
+        relocate(RelocationKind::type);
         code.push_back(Instruction{.opcode = Opcode::dup});
         code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(function_index)});
+        relocate(RelocationKind::function);
         code.push_back(Instruction{.opcode = Opcode::wstore, .index = 0});
         u64 slot = 1;
 
-        auto& captures = variable_frames.at(function_ctx).captures;
+        auto& captures = variable_frames[function_index].captures;
         auto& current_variables = current_function_context->variable_frame.variables;
         for (auto ptr : captures) {
             u64 index = current_variables.at(ptr->first).index;
@@ -1233,148 +2342,788 @@ public:
             code.push_back(Instruction{.opcode = Opcode::wstore, .index = slot});
             slot++;
         }
-        return {};
     }
 
-    virtual std::any visitUnaryExpr(GOatLANGParser::UnaryExprContext* ctx) override
+    virtual void visitUnaryExpr(UnaryExprNode* node) override
     {
-        auto unary_op = ctx->unary_op->getText();
+        auto unary_op = node->op;
         auto& code = current_function->code;
-        if (unary_op == "&") {
+        if (unary_op == Operator::address) {
             // special case, special visitor
-            return {};
+            return;
         }
 
-        auto expression = ctx->expression();
-        visitExpression(expression);
-        if (unary_op == "<-") {
+        auto expression = node->operand;
+        visit(expression);
+        if (unary_op == Operator::recv) {
             code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = chan_recv_index});
-            code.push_back(Instruction{.opcode = Opcode::wload, .index = 0});
-            return {};
+            compile_received_item(expression);
+            return;
         }
-        if (unary_op == "*") {
+        if (unary_op == Operator::deref) {
             code.push_back(Instruction{.opcode = Opcode::wload, .index = 0});
-            return {};
+            return;
         }
-        if (unary_op == "+") {
-            return {};
+        if (unary_op == Operator::plus) {
+            return;
         }
         Opcode opcode;
-        auto expression_type = node_types.at(expression);
-        if (unary_op == "-") {
+        auto expression_type = node_types[expression];
+        if (unary_op == Operator::neg) {
             opcode = expression_type == type_names.at("int") ? Opcode::ineg : Opcode::fneg;
-        } else if (unary_op == "!") {
+        } else if (unary_op == Operator::not_) {
             opcode = Opcode::lnot;
-        } else if (unary_op == "^") {
-            opcode = Opcode::inot;
         } else {
-            // error
+            opcode = Opcode::inot;
         }
         code.push_back(Instruction{.opcode = opcode});
-        return {};
     }
 
-    virtual std::any visitBinaryExpr(GOatLANGParser::BinaryExprContext* ctx) override
+    virtual void visitBinaryExpr(BinaryExprNode* node) override
     {
-        auto binary_op = ctx->binary_op->getText();
+        auto binary_op = node->op;
         auto& code = current_function->code;
-        auto left = ctx->expression(0);
-        auto right = ctx->expression(1);
-        if (binary_op == "||") {
-            visitExpression(left);
-            code.push_back(Instruction{.opcode = Opcode::dup});
-            u64 if_t_index = code.size();
-            code.push_back(Instruction{.opcode = Opcode::if_t});
-            code.push_back(Instruction{.opcode = Opcode::pop});
-            visitExpression(right);
-            code[if_t_index].index = code.size();
-            return {};
+        auto left = node->left;
+        auto right = node->right;
+        /* the bool of a short-circuit expression is only pushed once its branches have decided it */
+        if (binary_op == Operator::lor || binary_op == Operator::land) {
+            std::vector<u64> false_jumps;
+            compile_branch(node, false, false_jumps);
+            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(1)});
+            u64 goto_index = code.size();
+            code.push_back(Instruction{.opcode = Opcode::goto_});
+            patch_jumps(false_jumps, code.size());
+            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(0)});
+            code[goto_index].index = code.size();
+            return;
         }
-        if (binary_op == "&&") {
-            visitExpression(left);
-            code.push_back(Instruction{.opcode = Opcode::dup});
-            u64 if_f_index = code.size();
-            code.push_back(Instruction{.opcode = Opcode::if_f});
-            code.push_back(Instruction{.opcode = Opcode::pop});
-            visitExpression(right);
-            code[if_f_index].index = code.size();
-            return {};
+        visit(left);
+        visit(right);
+        if (dynamic_cast<StringType*>(node_types[left])) {
+            return compile_string_operator(binary_op);
         }
-        visitExpression(ctx->expression(0));
-        visitExpression(ctx->expression(1));
         Opcode opcode;
-        auto left_type = node_types.at(left);
+        auto left_type = node_types[left];
         auto int_type = type_names.at("int");
-        if (binary_op == "==") {
-            opcode = left_type == int_type ? Opcode::ieq : Opcode::feq;
-        } else if (binary_op == "!=") {
-            opcode = left_type == int_type ? Opcode::ine : Opcode::fne;
-        } else if (binary_op == "<") {
-            opcode = left_type == int_type ? Opcode::ilt : Opcode::flt;
-        } else if (binary_op == "<=") {
-            opcode = left_type == int_type ? Opcode::ile : Opcode::fle;
-        } else if (binary_op == ">") {
-            opcode = left_type == int_type ? Opcode::igt : Opcode::fgt;
-        } else if (binary_op == ">=") {
-            opcode = left_type == int_type ? Opcode::ige : Opcode::fge;
-        } else if (binary_op == "+") {
-            opcode = left_type == int_type ? Opcode::iadd : Opcode::fadd;
-        } else if (binary_op == "-") {
-            opcode = left_type == int_type ? Opcode::isub : Opcode::fsub;
-        } else if (binary_op == "|") {
-            opcode = Opcode::ior;
-        } else if (binary_op == "^") {
-            opcode = Opcode::ixor;
-        } else if (binary_op == "*") {
-            opcode = left_type == int_type ? Opcode::imul : Opcode::fmul;
-        } else if (binary_op == "/") {
-            opcode = left_type == int_type ? Opcode::idiv : Opcode::fdiv;
-        } else if (binary_op == "%") {
-            opcode = Opcode::irem;
-        } else if (binary_op == "<<") {
-            opcode = Opcode::ishl;
-        } else if (binary_op == ">>") {
-            opcode = Opcode::ishr;
-        } else if (binary_op == "&") {
-            opcode = Opcode::iand;
-        } else {
+        /* bools, channels and the other words compare as integers */
+        bool of_floats = dynamic_cast<FloatType*>(left_type) != nullptr;
+        switch (binary_op) {
+            case Operator::eq:
+                opcode = of_floats ? Opcode::feq : Opcode::ieq;
+                break;
+            case Operator::ne:
+                opcode = of_floats ? Opcode::fne : Opcode::ine;
+                break;
+            case Operator::lt:
+                opcode = of_floats ? Opcode::flt : Opcode::ilt;
+                break;
+            case Operator::le:
+                opcode = of_floats ? Opcode::fle : Opcode::ile;
+                break;
+            case Operator::gt:
+                opcode = of_floats ? Opcode::fgt : Opcode::igt;
+                break;
+            case Operator::ge:
+                opcode = of_floats ? Opcode::fge : Opcode::ige;
+                break;
+            case Operator::add:
+                opcode = left_type == int_type ? Opcode::iadd : Opcode::fadd;
+                break;
+            case Operator::sub:
+                opcode = left_type == int_type ? Opcode::isub : Opcode::fsub;
+                break;
+            case Operator::or_:
+                opcode = Opcode::ior;
+                break;
+            case Operator::xor_:
+                opcode = Opcode::ixor;
+                break;
+            case Operator::mul:
+                opcode = left_type == int_type ? Opcode::imul : Opcode::fmul;
+                break;
+            case Operator::div:
+                opcode = left_type == int_type ? Opcode::idiv : Opcode::fdiv;
+                break;
+            case Operator::rem:
+                opcode = Opcode::irem;
+                break;
+            case Operator::shl:
+                opcode = Opcode::ishl;
+                break;
+            case Operator::shr:
+                opcode = Opcode::ishr;
+                break;
+            default:
+                opcode = Opcode::iand;
+                break;
         }
         code.push_back(Instruction{.opcode = opcode});
-        return {};
     }
 
-    virtual std::any visitCallExpr(GOatLANGParser::CallExprContext* ctx) override
+    static bool is_comparison(Operator op)
+    {
+        return op >= Operator::eq && op <= Operator::ge;
+    }
+
+    /*
+     * The compare-and-branch opcode jumping when the comparison is when.
+     * An integer comparison fails when its opposite holds; a float one
+     * fails for NaN too, so its failure has opcodes of its own.
+     */
+    static Opcode get_branch_opcode(Operator op, bool of_floats, bool when)
+    {
+        if (!when && !of_floats) {
+            op = op == Operator::eq   ? Operator::ne
+                 : op == Operator::ne ? Operator::eq
+                 : op == Operator::lt ? Operator::ge
+                 : op == Operator::ge ? Operator::lt
+                 : op == Operator::gt ? Operator::le
+                                      : Operator::gt;
+        }
+        switch (op) {
+            case Operator::eq:
+                return of_floats ? (when ? Opcode::if_feq : Opcode::if_fne) : Opcode::if_ieq;
+            case Operator::ne:
+                return of_floats ? (when ? Opcode::if_fne : Opcode::if_feq) : Opcode::if_ine;
+            case Operator::lt:
+                return of_floats ? (when ? Opcode::if_flt : Opcode::if_fnlt) : Opcode::if_ilt;
+            case Operator::le:
+                return of_floats ? (when ? Opcode::if_fle : Opcode::if_fnle) : Opcode::if_ile;
+            case Operator::gt:
+                return of_floats ? (when ? Opcode::if_fgt : Opcode::if_fngt) : Opcode::if_igt;
+            default:
+                return of_floats ? (when ? Opcode::if_fge : Opcode::if_fnge) : Opcode::if_ige;
+        }
+    }
+
+    void patch_jumps(const std::vector<u64>& jumps, u64 target)
+    {
+        for (u64 jump : jumps) {
+            current_function->code[jump].index = target;
+        }
+    }
+
+    /*
+     * Jumps when the condition is when, adding the jumps to be patched, and
+     * falls through otherwise. Comparisons branch without pushing a bool,
+     * ! swaps the outcomes and && and || become chains of branches.
+     */
+    void compile_branch(Node* condition, bool when, std::vector<u64>& jumps)
+    {
+        auto& code = current_function->code;
+        if (auto unary_expr = node_cast<UnaryExprNode>(condition); unary_expr && unary_expr->op == Operator::not_) {
+            return compile_branch(unary_expr->operand, !when, jumps);
+        }
+        auto binary_expr = node_cast<BinaryExprNode>(condition);
+        auto binary_op = binary_expr ? binary_expr->op : Operator::plus;
+        if (binary_op == Operator::land || binary_op == Operator::lor) {
+            /* the left operand alone decides an && that is false and an || that is true */
+            bool decided = binary_op == Operator::lor;
+            if (when == decided) {
+                compile_branch(binary_expr->left, when, jumps);
+                compile_branch(binary_expr->right, when, jumps);
+                return;
+            }
+            std::vector<u64> decided_jumps;
+            compile_branch(binary_expr->left, decided, decided_jumps);
+            compile_branch(binary_expr->right, when, jumps);
+            patch_jumps(decided_jumps, code.size());
+            return;
+        }
+        if (is_comparison(binary_op) && !dynamic_cast<StringType*>(node_types[binary_expr->left])) {
+            visit(binary_expr->left);
+            visit(binary_expr->right);
+            bool of_floats = dynamic_cast<FloatType*>(node_types[binary_expr->left]) != nullptr;
+            jumps.push_back(code.size());
+            code.push_back(Instruction{.opcode = get_branch_opcode(binary_op, of_floats, when)});
+            return;
+        }
+        visit(condition);
+        jumps.push_back(code.size());
+        code.push_back(Instruction{.opcode = when ? Opcode::if_t : Opcode::if_f});
+    }
+
+    /* an ordering compares the result of string_compare with 0 */
+    void compile_string_operator(Operator binary_op)
     {
-        auto primary_expr = ctx->primaryExpr();
         auto& code = current_function->code;
+        if (binary_op == Operator::add) {
+            code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = string_concat_index});
+            return;
+        }
+        if (binary_op == Operator::eq || binary_op == Operator::ne) {
+            code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = string_equal_index});
+            if (binary_op == Operator::ne) {
+                code.push_back(Instruction{.opcode = Opcode::lnot});
+            }
+            return;
+        }
+        code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = string_compare_index});
+        code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(0)});
+        switch (binary_op) {
+            case Operator::lt:
+                code.push_back(Instruction{.opcode = Opcode::ilt});
+                break;
+            case Operator::le:
+                code.push_back(Instruction{.opcode = Opcode::ile});
+                break;
+            case Operator::gt:
+                code.push_back(Instruction{.opcode = Opcode::igt});
+                break;
+            default:
+                code.push_back(Instruction{.opcode = Opcode::ige});
+                break;
+        }
+    }
 
-        FunctionResolver resolver{
+    void compile_element(IndexExprNode* node)
+    {
+        visit(node->operand);
+        visit(node->index);
+        auto opcode = proven_indices.contains(node->index) ? Opcode::uload : Opcode::sload;
+        current_function->code.push_back(Instruction{.opcode = opcode});
+    }
+
+    virtual void visitIndexExpr(IndexExprNode* node) override
+    {
+        if (dynamic_cast<MapType*>(node_types[node->operand])) {
+            return compile_map_get(node);
+        }
+        if (dynamic_cast<StringType*>(node_types[node->operand])) {
+            visit(node->operand);
+            visit(node->index);
+            current_function->code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = string_index_index});
+            return;
+        }
+        compile_element(node);
+        copy_struct(node_types[node]);
+    }
+
+    /* a missing struct value is a new zeroed struct rather than nil */
+    void compile_map_get(IndexExprNode* node)
+    {
+        auto& code = current_function->code;
+        visit(node->operand);
+        visit(node->index);
+        code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = map_get_index});
+        auto struct_type = dynamic_cast<StructType*>(node_types[node]);
+        if (!struct_type) {
+            return;
+        }
+        code.push_back(Instruction{.opcode = Opcode::dup});
+        u64 if_f_index = code.size();
+        code.push_back(Instruction{.opcode = Opcode::if_f});
+        copy_struct(struct_type);
+        u64 goto_index = code.size();
+        code.push_back(Instruction{.opcode = Opcode::goto_});
+        code[if_f_index].index = code.size();
+        code.push_back(Instruction{.opcode = Opcode::pop});
+        code.push_back(Instruction{.opcode = Opcode::new_, .index = struct_type->index});
+        relocate(RelocationKind::type);
+        code[goto_index].index = code.size();
+    }
+
+    /* the bounds go on the stack as low then high, a missing high being the length */
+    virtual void visitSliceExpr(SliceExprNode* node) override
+    {
+        auto& code = current_function->code;
+        visit(node->operand);
+        if (!node->high) {
+            code.push_back(Instruction{.opcode = Opcode::dup});
+            code.push_back(Instruction{.opcode = Opcode::slen});
+        }
+        if (node->low) {
+            visit(node->low);
+        } else {
+            code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(0)});
+        }
+        if (node->high) {
+            visit(node->high);
+        } else {
+            code.push_back(Instruction{.opcode = Opcode::swap});
+        }
+        bool of_string = dynamic_cast<StringType*>(node_types[node]) != nullptr;
+        code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = of_string ? string_slice_index : slice_slice_index});
+    }
+
+    virtual void visitCallExpr(CallExprNode* node) override
+    {
+        compile_arguments(node);
+        if (!compile_call_by_name(node)) {
+            visit(node->callee);
+            current_function->code.push_back(Instruction{.opcode = Opcode::invoke_dynamic});
+        }
+    }
+
+    /* a call by name goes straight to the function, anything else through a closure */
+    bool compile_call_by_name(CallExprNode* node)
+    {
+        auto callee = node->callee;
+        auto& code = current_function->code;
+
+        if (auto operand_name = node_cast<OperandNameNode>(callee); operand_name) {
+            auto name = std::string{operand_name->name};
+            if (is_builtin_operation(name)) {
+                code.push_back(Instruction{.opcode = name == "len" ? Opcode::slen : Opcode::scap});
+                return true;
+            }
+            if (names_variable(operand_name)) {
+                return false;
+            }
+            if (auto it = function_indices.find(name); it != function_indices.end()) {
+                record_dependency(name, node_types[operand_name]->get_name());
+                code.push_back(Instruction{.opcode = Opcode::invoke_static, .index = it->second});
+                relocate(RelocationKind::function);
+                return true;
+            }
+            /* make is declared with channels, it makes a slice when given a slice type */
+            if (name == "make" && dynamic_cast<SliceType*>(node_types[node])) {
+                record_dependency(name, {});
+                if (node->arguments.size() == 1) {
+                    code.push_back(Instruction{.opcode = Opcode::dup});
+                }
+                auto slice_type = static_cast<SliceType*>(node_types[node]);
+                if (auto struct_type = dynamic_cast<StructType*>(slice_type->element_type); struct_type) {
+                    code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(struct_type->index)});
+                    relocate(RelocationKind::type);
+                    code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = new_struct_slice_index});
+                    return true;
+                }
+                code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = new_slice_index});
+                return true;
+            }
+            if (auto map_type = dynamic_cast<MapType*>(node_types[node]); name == "make" && map_type) {
+                record_dependency(name, {});
+                if (node->arguments.empty()) {
+                    code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(0)});
+                }
+                code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(map_type->index)});
+                relocate(RelocationKind::type);
+                code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = new_map_index});
+                return true;
+            }
+            if (is_bulk_slice_builtin(name)) {
+                record_dependency(name, {});
+                code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = get_bulk_slice_native_index(name, node)});
+                return true;
+            }
+            /* the values appended are counted on the stack */
+            if (name == "append") {
+                record_dependency(name, {});
+                u64 count = node->arguments.size() - 1;
+                code.push_back(Instruction{.opcode = Opcode::push, .value = bitcast<u64, Word>(count)});
+                code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = slice_append_index});
+                return true;
+            }
+            /* typed natives are depended on like functions, by their signature */
+            if (get_native_registry().find(name)) {
+                record_dependency(name, "native " + node_types[operand_name]->get_name());
+                code.push_back(Instruction{.opcode = Opcode::invoke_typed, .index = native_function_indices.at(name)});
+                relocate(RelocationKind::native);
+                return true;
+            }
+            if (auto it = native_function_indices.find(name); it != native_function_indices.end()) {
+                record_dependency(name, {});
+                code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = it->second});
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+class Compiler : public AstVisitor
+{
+public:
+    std::vector<Function> function_table;
+    std::unordered_map<std::string, u64> function_indices;
+    NodeTable<u64> node_functions;
+
+    std::vector<NativeFunction> native_function_table;
+    std::unordered_map<std::string, u64> native_function_indices;
+
+    std::vector<VariableFrame> variable_frames;
+    std::vector<std::unique_ptr<Type>> type_table;
+    std::unordered_map<std::string, Type*> type_names;
+    NodeTable<Type*> node_types;
+
+    StringPool string_pool;
+
+    /* set to reuse the code of declarations that did not change since it was written */
+    const CompilationCache* cache = nullptr;
+    /* what is written back to the cache, recorded for every function */
+    std::vector<std::vector<Relocation>> function_relocations;
+    std::vector<DeclarationRecord> declaration_records;
+    u64 cached_declaration_count = 0;
+    /* by their encoding in the cache */
+    std::unordered_map<std::string_view, Type*> imported_types;
+
+    /* the threads generating code, the output is the same for any number */
+    u64 thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+    template <typename T>
+    Type* register_type(const T& type)
+    {
+        std::string name = type.get_name();
+        auto it = type_names.find(name);
+        if (it != type_names.end()) {
+            return it->second;
+        }
+        u64 type_index = type_table.size();
+        auto smart_ptr = std::unique_ptr<Type>(new T{type});
+        auto raw_ptr = smart_ptr.get();
+        raw_ptr->index = type_index;
+        type_table.push_back(std::move(smart_ptr));
+        type_names.try_emplace(name, raw_ptr);
+        return raw_ptr;
+    }
+
+    Compiler()
+    {
+        register_type(IntType{});
+        register_type(FloatType{});
+        register_type(BoolType{});
+        register_type(StringType{});
+        register_type(ChannelType{nullptr});
+        register_type(SliceType{nullptr});
+
+        native_function_table.push_back(new_thread);
+        native_function_table.push_back(new_chan);
+        native_function_table.push_back(chan_send);
+        native_function_table.push_back(chan_recv);
+        native_function_table.push_back(new_slice);
+        native_function_table.push_back(chan_select);
+        native_function_table.push_back(chan_close);
+        native_function_table.push_back(chan_recv_ok);
+        native_function_table.push_back(chan_range);
+        native_function_table.push_back(chan_range_next);
+        native_function_table.push_back(slice_append);
+        native_function_table.push_back(slice_copy);
+        native_function_table.push_back(slice_slice);
+        native_function_table.push_back(slice_sum_int);
+        native_function_table.push_back(slice_sum_float);
+        native_function_table.push_back(slice_min_int);
+        native_function_table.push_back(slice_min_float);
+        native_function_table.push_back(slice_max_int);
+        native_function_table.push_back(slice_max_float);
+        native_function_table.push_back(slice_dot_int);
+        native_function_table.push_back(slice_dot_float);
+        native_function_table.push_back(slice_add_int);
+        native_function_table.push_back(slice_add_float);
+        native_function_table.push_back(slice_mul_int);
+        native_function_table.push_back(slice_mul_float);
+        native_function_table.push_back(slice_index_int);
+        native_function_table.push_back(slice_index_float);
+        native_function_table.push_back(slice_fill);
+        native_function_table.push_back(new_struct_slice);
+        native_function_table.push_back(new_map);
+        native_function_table.push_back(map_get);
+        native_function_table.push_back(map_set);
+        native_function_table.push_back(map_delete);
+        native_function_table.push_back(map_range);
+        native_function_table.push_back(map_range_next);
+        native_function_table.push_back(string_concat);
+        native_function_table.push_back(string_equal);
+        native_function_table.push_back(string_compare);
+        native_function_table.push_back(string_index);
+        native_function_table.push_back(string_slice);
+        native_function_table.push_back(string_intern);
+        native_function_table.push_back(new_defer_record);
+        native_function_table.push_back(release_defer_record);
+        /* the typed natives follow, in the order they were registered */
+        for (const auto& native : get_native_registry().get_natives()) {
+            native_function_indices.try_emplace(native.name, native_function_table.size());
+            native_function_table.push_back(native.function);
+        }
+
+        native_function_indices.try_emplace("make", CodeGenerator::new_chan_index);
+        native_function_indices.try_emplace("close", CodeGenerator::chan_close_index);
+        native_function_indices.try_emplace("new", CodeGenerator::new_slice_index);
+        native_function_indices.try_emplace("append", CodeGenerator::slice_append_index);
+        native_function_indices.try_emplace("copy", CodeGenerator::slice_copy_index);
+        native_function_indices.try_emplace("delete", CodeGenerator::map_delete_index);
+        native_function_indices.try_emplace("intern", CodeGenerator::string_intern_index);
+    }
+
+    virtual void visitSourceFile(SourceFileNode* node) override
+    {
+        node_functions.resize(node->node_count);
+        node_types.resize(node->node_count);
+        FunctionScanner scanner{function_table, function_indices, node_functions};
+        scanner.visitSourceFile(node);
+        variable_frames.resize(function_table.size());
+        function_relocations.resize(function_table.size());
+        VariableAnalyzer analyzer{
             function_table,
             function_indices,
             node_functions,
             native_function_indices,
-            node_native_functions};
-        resolver.visitPrimaryExpr(primary_expr);
+            variable_frames};
+        TypeAnnotator annotator{type_table, type_names, node_types, node_functions, variable_frames};
+        /* a top-level function shadows the native of its name before any body is annotated */
+        for (auto declaration : node->declarations) {
+            auto function_decl = node_cast<FunctionDeclNode>(declaration);
+            if (function_decl && annotator.lookup_declaration(std::string{function_decl->name})) {
+                annotator.shadow_native(function_decl);
+            }
+        }
+
+        /* declarations are analyzed one at a time so the cached ones can skip it */
+        std::vector<FunctionDeclNode*> function_decls;
+        std::vector<const CachedDeclaration*> cached_declarations;
+        for (auto declaration : node->declarations) {
+            auto function_decl = node_cast<FunctionDeclNode>(declaration);
+            if (!function_decl) {
+                analyzer.visit(declaration);
+                annotator.visit(declaration);
+                continue;
+            }
+            auto cached_declaration = find_cached_declaration(function_decl, annotator);
+            if (!cached_declaration) {
+                analyzer.visitFunctionDecl(function_decl);
+                annotator.visitFunctionDecl(function_decl);
+            }
+            function_decls.push_back(function_decl);
+            cached_declarations.push_back(cached_declaration);
+        }
+
+        std::vector<u64> fresh_declarations;
+        for (u64 i = 0; i < function_decls.size(); ++i) {
+            if (!cached_declarations[i]) {
+                fresh_declarations.push_back(i);
+            }
+        }
+        std::vector<DeclarationOutput> outputs(function_decls.size());
+        generate_code(function_decls, fresh_declarations, outputs);
+
+        /* merged in declaration order, so the tables come out as if compiled one by one */
+        for (u64 i = 0; i < function_decls.size(); ++i) {
+            if (cached_declarations[i]) {
+                load_cached_declaration(declaration_records[i], *cached_declarations[i]);
+                ++cached_declaration_count;
+                continue;
+            }
+            if (outputs[i].error) {
+                std::rethrow_exception(outputs[i].error);
+            }
+            merge_declaration_output(outputs[i]);
+        }
+    }
+
+    /* the record the dependencies of a declaration go to, when they are cached */
+    DeclarationRecord* declaration_record(u64 i)
+    {
+        return cache ? &declaration_records[i] : nullptr;
+    }
+
+    void generate_code(
+        const std::vector<FunctionDeclNode*>& function_decls,
+        const std::vector<u64>& fresh_declarations,
+        std::vector<DeclarationOutput>& outputs)
+    {
+        auto make_generator = [this]() {
+            return CodeGenerator{
+                function_table,
+                function_indices,
+                node_functions,
+                native_function_indices,
+                variable_frames,
+                type_names,
+                node_types,
+                function_relocations};
+        };
+        u64 worker_count = std::min<u64>(thread_count, fresh_declarations.size());
+        if (worker_count <= 1) {
+            auto generator = make_generator();
+            for (u64 i : fresh_declarations) {
+                generator.compile_declaration(function_decls[i], declaration_record(i), outputs[i]);
+            }
+            return;
+        }
 
-        if (auto arguments = ctx->arguments(); arguments) {
-            visitArguments(arguments);
+        /* the shared tables are only read until the outputs are merged */
+        std::atomic<u64> next{0};
+        auto work = [&]() {
+            auto generator = make_generator();
+            for (u64 j = next++; j < fresh_declarations.size(); j = next++) {
+                u64 i = fresh_declarations[j];
+                generator.compile_declaration(function_decls[i], declaration_record(i), outputs[i]);
+            }
+        };
+        std::vector<std::thread> workers;
+        for (u64 i = 1; i < worker_count; ++i) {
+            workers.emplace_back(work);
         }
+        work();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
 
-        if (node_functions.contains(primary_expr)) {
-            u64 function_index = node_functions.at(primary_expr);
-            code.push_back(Instruction{.opcode = Opcode::invoke_static, .index = function_index});
-            return {};
+    /* adds the strings and types of a declaration to the tables and points its code at them */
+    void merge_declaration_output(DeclarationOutput& output)
+    {
+        u64 first_string = string_pool.size();
+        for (auto& string : output.strings) {
+            string_pool.new_string(std::move(string));
+        }
+        for (const auto& operand : output.string_operands) {
+            function_table[operand.function_index].code[operand.offset].index += first_string;
+        }
+        std::vector<u64> type_indices;
+        for (const auto& type : output.types) {
+            type_indices.push_back(import_type(type.get())->index);
+        }
+        for (const auto& operand : output.type_operands) {
+            auto& index = function_table[operand.function_index].code[operand.offset].index;
+            index = type_indices[index];
         }
+    }
 
-        if (node_native_functions.contains(primary_expr)) {
-            auto native_function_index = node_native_functions.at(primary_expr);
-            code.push_back(Instruction{.opcode = Opcode::invoke_native, .index = native_function_index});
-            return {};
+    /*
+     * The cached code of a declaration whose tree is unchanged and whose
+     * names still resolve as they did: to a function or a typed native with
+     * the same signature, or to neither.
+     */
+    const CachedDeclaration* find_cached_declaration(FunctionDeclNode* node, TypeAnnotator& annotator)
+    {
+        if (!cache) {
+            return nullptr;
         }
+        auto name = std::string{node->name};
+        u64 first_function = node_functions[node];
+        u64 function_count = 1;
+        /* the literals of a declaration follow it and are named after it */
+        while (first_function + function_count < function_table.size()
+               && function_table[first_function + function_count].name.starts_with(name + ".")) {
+            ++function_count;
+        }
+        auto& record = declaration_records.emplace_back(DeclarationRecord{
+            .name = name,
+            .hash = hash_ast(node),
+            .line = node->line,
+            .first_function = first_function,
+            .function_count = function_count,
+        });
 
-        visitPrimaryExpr(primary_expr);
-        code.push_back(Instruction{.opcode = Opcode::invoke_dynamic});
-        return {};
+        auto cached_declaration = cache->find(record.name, record.hash);
+        if (!cached_declaration || cached_declaration->functions.size() != function_count) {
+            return nullptr;
+        }
+        annotator.annotate_declaration_signature(node);
+        for (const auto& dependency : cached_declaration->dependencies) {
+            bool is_function = function_indices.contains(dependency.name);
+            bool is_native = !is_function && get_native_registry().find(dependency.name);
+            if ((is_function || is_native) == dependency.signature.empty()) {
+                return nullptr;
+            }
+            if (is_function || is_native) {
+                auto type = annotator.lookup_declaration(dependency.name);
+                if (!type || (is_native ? "native " : "") + type->get_name() != dependency.signature) {
+                    return nullptr;
+                }
+            }
+        }
+        record.dependencies = cached_declaration->dependencies;
+        record.cached = cached_declaration;
+        return cached_declaration;
+    }
+
+    void load_cached_declaration(const DeclarationRecord& record, const CachedDeclaration& cached_declaration)
+    {
+        for (u64 i = 0; i < record.function_count; ++i) {
+            auto& function = function_table[record.first_function + i];
+            const auto& cached_function = cached_declaration.functions[i];
+            function.capc = cached_function.capc;
+            function.argc = cached_function.argc;
+            function.varc = cached_function.varc;
+            function.code.assign(cached_function.code.begin(), cached_function.code.end());
+            for (const auto& entry : cached_function.lines) {
+                function.lines.push_back(LineEntry{.offset = entry.offset, .line = record.line + entry.line});
+            }
+            auto& relocations = function_relocations[function.index];
+            for (const auto& relocation : cached_function.relocations) {
+                auto& operand = function.code[relocation.offset].index;
+                switch (relocation.kind) {
+                    case RelocationKind::function:
+                        operand = resolve_cached_function(record, relocation.symbol);
+                        break;
+                    case RelocationKind::type: {
+                        auto& imported_type = imported_types[relocation.symbol];
+                        if (!imported_type) {
+                            std::vector<std::unique_ptr<Type>> scratch;
+                            imported_type = import_type(CompilationCache::read_type(relocation.symbol, scratch));
+                        }
+                        operand = imported_type->index;
+                        break;
+                    }
+                    case RelocationKind::string:
+                        operand = string_pool.new_string(std::string{relocation.symbol});
+                        break;
+                    case RelocationKind::native:
+                        operand = native_function_indices.at(std::string{relocation.symbol});
+                        break;
+                }
+                relocations.push_back(Relocation{relocation.kind, relocation.offset});
+            }
+        }
+    }
+
+    /* a top-level function or one of the literals of the declaration */
+    u64 resolve_cached_function(const DeclarationRecord& record, std::string_view name)
+    {
+        if (auto it = function_indices.find(std::string{name}); it != function_indices.end()) {
+            return it->second;
+        }
+        for (u64 i = record.first_function; i < record.first_function + record.function_count; ++i) {
+            if (function_table[i].name == name) {
+                return i;
+            }
+        }
+        throw std::runtime_error("cache: cannot resolve function '" + std::string{name} + "'");
+    }
+
+    /* the type of this compilation equal to one from another type table */
+    Type* import_type(const Type* type)
+    {
+        if (!type) {
+            return nullptr;
+        }
+        if (auto it = type_names.find(type->get_name()); it != type_names.end()) {
+            return it->second;
+        }
+        if (auto function_type = dynamic_cast<const FunctionType*>(type); function_type) {
+            std::vector<Type*> arg_types;
+            for (Type* arg_type : function_type->arg_types) {
+                arg_types.push_back(import_type(arg_type));
+            }
+            return register_type(FunctionType{arg_types, import_type(function_type->return_type)});
+        }
+        if (auto closure_type = dynamic_cast<const ClosureType*>(type); closure_type) {
+            auto function_type = static_cast<FunctionType*>(import_type(closure_type->function_type));
+            return register_type(ClosureType{function_type, closure_type->capc});
+        }
+        if (auto callable_type = dynamic_cast<const CallableType*>(type); callable_type) {
+            auto function_type = static_cast<FunctionType*>(import_type(callable_type->function_type));
+            return register_type(CallableType{function_type});
+        }
+        if (auto channel_type = dynamic_cast<const ChannelType*>(type); channel_type) {
+            return register_type(ChannelType{import_type(channel_type->element_type)});
+        }
+        if (auto slice_type = dynamic_cast<const SliceType*>(type); slice_type) {
+            return register_type(SliceType{import_type(slice_type->element_type)});
+        }
+        if (auto map_type = dynamic_cast<const MapType*>(type); map_type) {
+            return register_type(MapType{import_type(map_type->key_type), import_type(map_type->value_type)});
+        }
+        if (auto struct_type = dynamic_cast<const StructType*>(type); struct_type) {
+            std::vector<StructField> fields;
+            for (const auto& field : struct_type->fields) {
+                fields.push_back(StructField{.name = field.name, .type = import_type(field.type)});
+            }
+            return register_type(StructType{std::move(fields)});
+        }
+        throw std::runtime_error("cache: cannot import type '" + type->get_name() + "'");
     }
 };
 
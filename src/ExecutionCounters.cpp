@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <array>
+#include <tuple>
+#include <type_traits>
+
+#include "ExecutionCounters.hpp"
+#include "Native.hpp"
+
+static constexpr std::array<std::string_view, opcode_count> opcode_names = {
+    "nop",
+    "safepoint",
+    "load",
+    "store",
+    "push",
+    "pop",
+    "dup",
+    "swap",
+    "ldstr",
+    "wload",
+    "bload",
+    "mload",
+    "wstore",
+    "bstore",
+    "mstore",
+    "slen",
+    "scap",
+    "sload",
+    "sstore",
+    "uload",
+    "ustore",
+    "i2f",
+    "f2i",
+    "iadd",
+    "isub",
+    "imul",
+    "idiv",
+    "irem",
+    "ineg",
+    "iinc",
+    "idec",
+    "ishl",
+    "ishr",
+    "ixor",
+    "ior",
+    "iand",
+    "inot",
+    "fadd",
+    "fsub",
+    "fmul",
+    "fdiv",
+    "fneg",
+    "ieq",
+    "ilt",
+    "igt",
+    "ine",
+    "ile",
+    "ige",
+    "feq",
+    "flt",
+    "fgt",
+    "fne",
+    "fle",
+    "fge",
+    "lnot",
+    "goto",
+    "if_t",
+    "if_f",
+    "if_ieq",
+    "if_ilt",
+    "if_igt",
+    "if_ine",
+    "if_ile",
+    "if_ige",
+    "if_feq",
+    "if_flt",
+    "if_fgt",
+    "if_fne",
+    "if_fle",
+    "if_fge",
+    "if_fnlt",
+    "if_fngt",
+    "if_fnle",
+    "if_fnge",
+    "invoke_static",
+    "invoke_dynamic",
+    "invoke_native",
+    "invoke_typed",
+    "tailcall",
+    "tailcall_dynamic",
+    "ret",
+    "new",
+};
+static_assert(!opcode_names.back().empty(), "every opcode needs a name");
+
+std::string_view get_opcode_name(Opcode opcode)
+{
+    return opcode_names[static_cast<u64>(opcode)];
+}
+
+template <typename T>
+static void add_counts(std::vector<T>& counts, const std::vector<T>& other_counts)
+{
+    if (counts.size() < other_counts.size()) {
+        counts.resize(other_counts.size());
+    }
+    for (u64 i = 0; i < other_counts.size(); ++i) {
+        if constexpr (std::is_same_v<T, u64>) {
+            counts[i] += other_counts[i];
+        } else {
+            add_counts(counts[i], other_counts[i]);
+        }
+    }
+}
+
+void ExecutionCounters::merge(const ExecutionCounters& other)
+{
+    add_counts(opcodes, other.opcodes);
+    add_counts(opcode_pairs, other.opcode_pairs);
+    add_counts(invocations, other.invocations);
+    add_counts(back_edges, other.back_edges);
+    add_counts(native_calls, other.native_calls);
+}
+
+static void write_json_string(std::ostream& stream, std::string_view string)
+{
+    stream << '"';
+    for (char c : string) {
+        if (c == '"' || c == '\\') {
+            stream << '\\';
+        }
+        stream << c;
+    }
+    stream << '"';
+}
+
+/* the indices of the nonzero counts, the largest first */
+static std::vector<u64> sorted_nonzero(const std::vector<u64>& counts)
+{
+    std::vector<u64> indices;
+    for (u64 i = 0; i < counts.size(); ++i) {
+        if (counts[i] != 0) {
+            indices.push_back(i);
+        }
+    }
+    std::stable_sort(indices.begin(), indices.end(), [&counts](u64 x, u64 y) {
+        return counts[x] > counts[y];
+    });
+    return indices;
+}
+
+void ExecutionCounters::write_json(
+    std::ostream& stream,
+    const std::vector<Function>& function_table,
+    const std::vector<NativeFunction>& native_function_table) const
+{
+    u64 instruction_count = 0;
+    for (u64 count : opcodes) {
+        instruction_count += count;
+    }
+    stream << "{\n  \"instructions\": " << instruction_count << ",\n";
+    stream << "  \"allocations\": " << allocations << ",\n";
+    stream << "  \"allocated_bytes\": " << allocated_bytes << ",\n";
+
+    const char* separator = "";
+    stream << "  \"opcodes\": [";
+    for (u64 i : sorted_nonzero(opcodes)) {
+        stream << separator << "\n    {\"opcode\": ";
+        write_json_string(stream, opcode_names[i]);
+        stream << ", \"count\": " << opcodes[i] << "}";
+        separator = ",";
+    }
+    stream << "\n  ],\n";
+
+    separator = "";
+    stream << "  \"opcode_pairs\": [";
+    for (u64 i : sorted_nonzero(opcode_pairs)) {
+        stream << separator << "\n    {\"first\": ";
+        write_json_string(stream, opcode_names[i / opcode_count]);
+        stream << ", \"second\": ";
+        write_json_string(stream, opcode_names[i % opcode_count]);
+        stream << ", \"count\": " << opcode_pairs[i] << "}";
+        separator = ",";
+    }
+    stream << "\n  ],\n";
+
+    separator = "";
+    stream << "  \"functions\": [";
+    for (u64 i : sorted_nonzero(invocations)) {
+        stream << separator << "\n    {\"function\": ";
+        write_json_string(stream, function_table[i].name);
+        stream << ", \"invocations\": " << invocations[i] << "}";
+        separator = ",";
+    }
+    stream << "\n  ],\n";
+
+    std::vector<std::tuple<u64, u64, u64>> loops;
+    for (u64 i = 0; i < back_edges.size(); ++i) {
+        for (u64 target = 0; target < back_edges[i].size(); ++target) {
+            if (back_edges[i][target] != 0) {
+                loops.emplace_back(back_edges[i][target], i, target);
+            }
+        }
+    }
+    std::stable_sort(loops.begin(), loops.end(), [](const auto& x, const auto& y) {
+        return std::get<0>(x) > std::get<0>(y);
+    });
+    separator = "";
+    stream << "  \"loops\": [";
+    for (const auto& [count, function_index, target] : loops) {
+        const auto& function = function_table[function_index];
+        stream << separator << "\n    {\"function\": ";
+        write_json_string(stream, function.name);
+        stream << ", \"offset\": " << target << ", \"line\": " << function.get_line(target)
+               << ", \"back_edges\": " << count << "}";
+        separator = ",";
+    }
+    stream << "\n  ],\n";
+
+    separator = "";
+    stream << "  \"natives\": [";
+    for (u64 i : sorted_nonzero(native_calls)) {
+        stream << separator << "\n    {\"native\": ";
+        write_json_string(stream, get_native_function_name(native_function_table[i]));
+        stream << ", \"calls\": " << native_calls[i] << "}";
+        separator = ",";
+    }
+    stream << "\n  ]\n}\n";
+}
@@ -0,0 +1,97 @@
+#ifndef EXECUTION_COUNTERS_HPP
+#define EXECUTION_COUNTERS_HPP
+
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include "Code.hpp"
+#include "Common.hpp"
+
+std::string_view get_opcode_name(Opcode opcode);
+
+/*
+ * What the interpreter executed, counted by a build configured with
+ * GOATLANG_INSTRUMENT. Every goroutine counts into its own counters
+ * without synchronization and the runtime merges them when the program
+ * ends. A loop is counted by its back-edges and named by the offset the
+ * back-edge jumps to.
+ */
+class ExecutionCounters
+{
+public:
+    ExecutionCounters() = default;
+    ExecutionCounters(u64 function_count, u64 native_function_count) :
+        opcodes(opcode_count),
+        opcode_pairs(opcode_count * opcode_count),
+        invocations(function_count),
+        back_edges(function_count),
+        native_calls(native_function_count)
+    {
+    }
+
+    void count_instruction(Opcode opcode)
+    {
+        u64 index = static_cast<u64>(opcode);
+        ++opcodes[index];
+        ++opcode_pairs[previous_opcode * opcode_count + index];
+        previous_opcode = index;
+    }
+
+    void count_invocation(u64 function_index)
+    {
+        ++invocations[function_index];
+    }
+
+    /* a goroutine starts in its function as if after a nop */
+    void count_goroutine(u64 function_index)
+    {
+        ++invocations[function_index];
+        previous_opcode = static_cast<u64>(Opcode::nop);
+    }
+
+    void count_jump(u64 function_index, u64 program_counter, u64 target)
+    {
+        if (target >= program_counter) {
+            return;
+        }
+        auto& function_back_edges = back_edges[function_index];
+        if (target >= function_back_edges.size()) {
+            function_back_edges.resize(target + 1);
+        }
+        ++function_back_edges[target];
+    }
+
+    void count_native_call(u64 native_function_index)
+    {
+        ++native_calls[native_function_index];
+    }
+
+    /* the heap is shared, so it is counted once for the whole program */
+    void set_heap_usage(u64 allocation_count, u64 allocated_bytes)
+    {
+        allocations = allocation_count;
+        this->allocated_bytes = allocated_bytes;
+    }
+
+    void merge(const ExecutionCounters& other);
+
+    void write_json(
+        std::ostream& stream,
+        const std::vector<Function>& function_table,
+        const std::vector<NativeFunction>& native_function_table) const;
+
+private:
+    std::vector<u64> opcodes;
+    /* by the opcode executed before times opcode_count plus the opcode */
+    std::vector<u64> opcode_pairs;
+    std::vector<u64> invocations;
+    /* by function, then by the offset jumped back to */
+    std::vector<std::vector<u64>> back_edges;
+    std::vector<u64> native_calls;
+    u64 allocations = 0;
+    u64 allocated_bytes = 0;
+    u64 previous_opcode = static_cast<u64>(Opcode::nop);
+};
+
+#endif /* EXECUTION_COUNTERS_HPP */
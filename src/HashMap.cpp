@@ -0,0 +1,243 @@
+#include <bit>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "HashMap.hpp"
+#include "Strings.hpp"
+
+static constexpr u8 empty_control = 0x80;
+static constexpr u8 deleted_control = 0xFE;
+static constexpr u64 slot_words = 2;
+
+/* the bits of a group whose control bytes equal the byte, the first slot in bit 0 */
+static u32 match_byte(const u8* group, u8 byte)
+{
+#if defined(__SSE2__)
+    __m128i controls = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    return static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(controls, _mm_set1_epi8(static_cast<char>(byte)))));
+#else
+    u32 bits = 0;
+    for (u64 i = 0; i < HashMap::group_size; ++i) {
+        bits |= static_cast<u32>(group[i] == byte) << i;
+    }
+    return bits;
+#endif
+}
+
+/* empty and deleted are the control bytes with the high bit set */
+static u32 match_empty_or_deleted(const u8* group)
+{
+#if defined(__SSE2__)
+    __m128i controls = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    return static_cast<u32>(_mm_movemask_epi8(controls));
+#else
+    u32 bits = 0;
+    for (u64 i = 0; i < HashMap::group_size; ++i) {
+        bits |= static_cast<u32>(group[i] >> 7) << i;
+    }
+    return bits;
+#endif
+}
+
+/* the finalizer of MurmurHash3, so that nearby integers spread over the table */
+static u64 mix(u64 x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+static u8 control_of(u64 hash)
+{
+    return static_cast<u8>(hash & 0x7F);
+}
+
+static u64 capacity_for(u64 count)
+{
+    u64 capacity = HashMap::group_size;
+    while (capacity / 8 * 7 < count) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+u64 HashMap::hash(u64 key) const
+{
+    switch (header.key_kind) {
+        case MapKeyKind::float_: {
+            /* 0.0 and -0.0 are equal keys */
+            f64 value = bitcast<u64, f64>(key);
+            return mix(value == 0 ? 0 : key);
+        }
+        case MapKeyKind::string:
+            return mix(hash_string(heap, key));
+        default:
+            return mix(key);
+    }
+}
+
+bool HashMap::equal(u64 key, u64 other_key) const
+{
+    switch (header.key_kind) {
+        case MapKeyKind::float_:
+            /* NaN is no key's equal, so every NaN inserted is a key of its own */
+            return bitcast<u64, f64>(key) == bitcast<u64, f64>(other_key);
+        case MapKeyKind::string:
+            return strings_equal(heap, key, other_key);
+        default:
+            return key == other_key;
+    }
+}
+
+/* the groups are probed in triangular steps, which visit each once when their number is a power of two */
+u64 HashMap::find_slot(u64 key, u64 hash) const
+{
+    if (header.capacity == 0) {
+        return 0;
+    }
+    u64 group_mask = header.capacity / group_size - 1;
+    u64 group = (hash >> 7) & group_mask;
+    u8 control = control_of(hash);
+    for (u64 step = 1;; ++step) {
+        const u8* controls = &heap.access<u8>(header.controls + group * group_size);
+        for (u32 bits = match_byte(controls, control); bits != 0; bits &= bits - 1) {
+            u64 slot = group * group_size + std::countr_zero(bits);
+            if (equal(heap.load<u64>(header.slots + sizeof(Word) * slot_words * slot), key)) {
+                return slot;
+            }
+        }
+        if (match_byte(controls, empty_control) != 0) {
+            return header.capacity;
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+void HashMap::place(u64 key, u64 value, u64 hash)
+{
+    u64 group_mask = header.capacity / group_size - 1;
+    u64 group = (hash >> 7) & group_mask;
+    for (u64 step = 1;; ++step) {
+        u8* controls = &heap.access<u8>(header.controls + group * group_size);
+        if (u32 bits = match_empty_or_deleted(controls); bits != 0) {
+            u64 index = std::countr_zero(bits);
+            if (controls[index] == empty_control) {
+                --header.growth_left;
+            }
+            controls[index] = control_of(hash);
+            u64 slot_address = header.slots + sizeof(Word) * slot_words * (group * group_size + index);
+            heap.store(slot_address, key);
+            heap.store(slot_address + sizeof(Word), value);
+            return;
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+/* empty arrays for the slots, as many as a power of two of groups */
+static void allocate_table(Heap& heap, const Type& word_type, MapHeader& header, u64 capacity)
+{
+    header.controls = heap.allocate(word_type, capacity / sizeof(Word));
+    std::memset(&heap.access<u8>(header.controls), empty_control, capacity);
+    header.slots = heap.allocate(word_type, slot_words * capacity);
+    header.capacity = capacity;
+    header.growth_left = capacity / 8 * 7;
+}
+
+/* new arrays, since the heap gives nothing back, with the deleted slots left behind */
+void HashMap::resize(u64 capacity)
+{
+    MapCursor cursor{
+        .controls = header.controls,
+        .slots = header.slots,
+        .capacity = header.capacity,
+        .position = 0,
+    };
+    allocate_table(heap, word_type, header, capacity);
+    u64 key;
+    u64 value;
+    while (cursor.next(heap, key, value)) {
+        place(key, value, hash(key));
+    }
+}
+
+u64 HashMap::make(Heap& heap, const Type& word_type, const Type& map_type, MapKeyKind key_kind, u64 hint)
+{
+    MapHeader header{.key_kind = key_kind, .type_index = map_type.index};
+    if (hint > 0) {
+        allocate_table(heap, word_type, header, capacity_for(hint));
+    }
+    u64 address = heap.allocate(word_type, sizeof(MapHeader) / sizeof(Word));
+    heap.store(address, header);
+    return address;
+}
+
+bool HashMap::find(u64 key, u64& value) const
+{
+    u64 slot = find_slot(key, hash(key));
+    if (slot == header.capacity) {
+        return false;
+    }
+    value = heap.load<u64>(header.slots + sizeof(Word) * (slot_words * slot + 1));
+    return true;
+}
+
+void HashMap::insert(u64 key, u64 value)
+{
+    u64 key_hash = hash(key);
+    u64 slot = find_slot(key, key_hash);
+    if (slot != header.capacity) {
+        heap.store(header.slots + sizeof(Word) * (slot_words * slot + 1), value);
+        return;
+    }
+    if (header.growth_left == 0) {
+        /* a table full of deleted slots more than of keys is rebuilt at its capacity */
+        if (header.capacity == 0) {
+            resize(group_size);
+        } else {
+            resize(header.count * 32 <= header.capacity * 25 ? header.capacity : header.capacity * 2);
+        }
+    }
+    place(key, value, key_hash);
+    ++header.count;
+    heap.store(address, header);
+}
+
+/* a slot goes back to empty when its group has an empty slot, since then no probe went on past it */
+void HashMap::erase(u64 key)
+{
+    u64 slot = find_slot(key, hash(key));
+    if (slot == header.capacity) {
+        return;
+    }
+    u8* controls = &heap.access<u8>(header.controls + slot / group_size * group_size);
+    u8& control = controls[slot % group_size];
+    if (match_byte(controls, empty_control) != 0) {
+        control = empty_control;
+        ++header.growth_left;
+    } else {
+        control = deleted_control;
+    }
+    --header.count;
+    heap.store(address, header);
+}
+
+bool MapCursor::next(Heap& heap, u64& key, u64& value)
+{
+    for (; position < capacity; ++position) {
+        if ((heap.load<u8>(controls + position) & 0x80) == 0) {
+            u64 slot_address = slots + sizeof(Word) * slot_words * position;
+            key = heap.load<u64>(slot_address);
+            value = heap.load<u64>(slot_address + sizeof(Word));
+            ++position;
+            return true;
+        }
+    }
+    return false;
+}
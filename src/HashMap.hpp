@@ -0,0 +1,100 @@
+#ifndef HASH_MAP_HPP
+#define HASH_MAP_HPP
+
+#include <cstddef>
+
+#include "Heap.hpp"
+
+/*
+ * The table behind a map value, an open addressing hash table in the
+ * style of a Swiss table, kept in the GOatLANG heap. Every slot has a
+ * control byte: empty, deleted, or the low 7 bits of the hash of its key.
+ * The slots are probed a group of 16 control bytes at a time, and one SSE2
+ * comparison finds the slots of a group that may hold the key, so most
+ * lookups read a single group and compare a single key. Slots are a key
+ * word and a value word, side by side.
+ *
+ * A map value is the address of its header, 0 for the nil map. The header
+ * is mutable and shared by every copy of the map. The table grows by
+ * moving to arrays of twice the capacity once 7/8 of its slots have been
+ * used. The blocks are words, the header naming the MapType that tells
+ * which of the key and value words are addresses.
+ */
+
+enum class MapKeyKind : u64
+{
+    word, /* int and bool keys, compared bit for bit */
+    float_,
+    string,
+};
+
+struct MapHeader
+{
+    u64 slots;
+    u64 count; /* where a slice has its length, so len is slen */
+    u64 capacity;
+    u64 controls;
+    u64 growth_left; /* the empty slots that can be filled before the table grows */
+    MapKeyKind key_kind;
+    u64 type_index;
+};
+
+static_assert(offsetof(MapHeader, count) == offsetof(SliceHeader, length), "len compiles to slen for maps too");
+
+class HashMap
+{
+    Heap& heap;
+    const Type& word_type;
+    u64 address;
+    MapHeader header;
+
+    u64 hash(u64 key) const;
+    bool equal(u64 key, u64 other_key) const;
+    /* the slot holding the key, or the capacity without one */
+    u64 find_slot(u64 key, u64 hash) const;
+    void resize(u64 capacity);
+    /* fills an empty or deleted slot with a key not in the table */
+    void place(u64 key, u64 value, u64 hash);
+
+public:
+    static constexpr u64 group_size = 16;
+
+    HashMap(Heap& heap, const Type& word_type, u64 address) :
+        heap{heap},
+        word_type{word_type},
+        address{address},
+        header{heap.load<MapHeader>(address)}
+    {
+    }
+
+    /* a map of the MapType with room for hint keys before it grows */
+    static u64 make(Heap& heap, const Type& word_type, const Type& map_type, MapKeyKind key_kind, u64 hint);
+
+    const MapHeader& get_header() const
+    {
+        return header;
+    }
+
+    bool find(u64 key, u64& value) const;
+    void insert(u64 key, u64 value);
+    void erase(u64 key);
+    bool contains(u64 key) const
+    {
+        u64 value;
+        return find(key, value);
+    }
+};
+
+/* the full slots of a table from a position on, in slot order */
+struct MapCursor
+{
+    u64 controls;
+    u64 slots;
+    u64 capacity;
+    u64 position;
+
+    /* the key and value words of the next full slot, false past the last */
+    bool next(Heap& heap, u64& key, u64& value);
+};
+
+#endif /* HASH_MAP_HPP */
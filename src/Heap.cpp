@@ -5,20 +5,21 @@
 u64 Heap::new_block(const Type& type, u64 count)
 {
     u64 block_size = sizeof(BlockHeader) + type.size * count;
-    if (!enough_space(block_size)) {
-        throw std::runtime_error{"out of memory!"};
-    }
-    u64 address = top + sizeof(BlockHeader);
     BlockHeader block_header = {
         .control_bits = 0,
         .type_index = type.index,
         .count = count,
     };
-    {
-        std::lock_guard lock{mutex};
-        write(this_half, top, block_header);
-        top += block_size;
+    std::lock_guard lock{mutex};
+    if (!enough_space(block_size)) {
+        throw std::runtime_error{"out of memory!"};
     }
+    u64 address = top + sizeof(BlockHeader);
+    write(this_half, top, block_header);
+    top += block_size;
+#ifdef GOATLANG_INSTRUMENT
+    ++allocation_count;
+#endif
     return address;
 }
 
@@ -21,6 +21,9 @@ class Heap
     std::byte* that_half;
     u64 size;
     u64 top;
+#ifdef GOATLANG_INSTRUMENT
+    u64 allocation_count = 0;
+#endif
 
     bool enough_space(u64 block_size)
     {
@@ -57,12 +60,42 @@ public:
         write(this_half, address, value);
     }
 
+    template <typename T>
+    T& access(u64 address)
+    {
+        return read<T>(this_half, address);
+    }
+
+    /* the two ranges may overlap */
+    void copy(u64 destination, u64 source, u64 size)
+    {
+        std::memmove(this_half + destination, this_half + source, size);
+    }
+
+    SliceHeader load_slice_header(u64 address)
+    {
+        return address == 0 ? SliceHeader{} : load<SliceHeader>(address);
+    }
+
     BlockHeader& access_block_header(u64 address)
     {
         return read<BlockHeader>(this_half, address - sizeof(BlockHeader));
     }
 
     u64 allocate(const Type& type, u64 count);
+
+    /* headers included, there is no collector to give any back */
+    u64 get_allocated_bytes() const
+    {
+        return top;
+    }
+
+#ifdef GOATLANG_INSTRUMENT
+    u64 get_allocation_count() const
+    {
+        return allocation_count;
+    }
+#endif
 };
 
 #endif
@@ -0,0 +1,422 @@
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Image.hpp"
+#include "Native.hpp"
+
+static constexpr char image_magic[8] = {'G', 'O', 'A', 'T', 'I', 'M', 'G', '\n'};
+
+struct ImageHeader
+{
+    char magic[8];
+    u64 version;
+    u64 instruction_size;
+    u64 code_offset;
+    u64 code_count;
+    u64 metadata_offset;
+    u64 metadata_size;
+};
+
+static_assert(sizeof(ImageHeader) % alignof(Instruction) == 0, "code must be aligned after the header");
+static_assert(sizeof(Instruction) == 16 && offsetof(Instruction, index) == 8, "unexpected instruction layout");
+
+void write_type(ImageWriter& writer, const Type& type)
+{
+    auto put_header = [&](TypeKind kind) {
+        writer.put(static_cast<u64>(kind));
+        writer.put(type.index);
+        writer.put(type.size);
+    };
+    if (dynamic_cast<const IntType*>(&type)) {
+        put_header(TypeKind::int_);
+    } else if (dynamic_cast<const FloatType*>(&type)) {
+        put_header(TypeKind::float_);
+    } else if (dynamic_cast<const BoolType*>(&type)) {
+        put_header(TypeKind::bool_);
+    } else if (dynamic_cast<const StringType*>(&type)) {
+        put_header(TypeKind::string);
+    } else if (auto function_type = dynamic_cast<const FunctionType*>(&type)) {
+        put_header(TypeKind::function);
+        writer.put_type(function_type->return_type);
+        writer.put(function_type->arg_types.size());
+        for (Type* arg_type : function_type->arg_types) {
+            writer.put_type(arg_type);
+        }
+    } else if (auto closure_type = dynamic_cast<const ClosureType*>(&type)) {
+        put_header(TypeKind::closure);
+        writer.put_type(closure_type->function_type);
+        writer.put(closure_type->capc);
+    } else if (auto callable_type = dynamic_cast<const CallableType*>(&type)) {
+        put_header(TypeKind::callable);
+        writer.put_type(callable_type->function_type);
+    } else if (auto channel_type = dynamic_cast<const ChannelType*>(&type)) {
+        put_header(TypeKind::channel);
+        writer.put_type(channel_type->element_type);
+    } else if (auto slice_type = dynamic_cast<const SliceType*>(&type)) {
+        put_header(TypeKind::slice);
+        writer.put_type(slice_type->element_type);
+    } else if (auto map_type = dynamic_cast<const MapType*>(&type)) {
+        put_header(TypeKind::map);
+        writer.put_type(map_type->key_type);
+        writer.put_type(map_type->value_type);
+    } else if (auto struct_type = dynamic_cast<const StructType*>(&type)) {
+        put_header(TypeKind::struct_);
+        writer.put(struct_type->fields.size());
+        for (const auto& field : struct_type->fields) {
+            writer.put_string(field.name);
+            writer.put_type(field.type);
+        }
+    } else {
+        throw std::runtime_error("cannot write type '" + type.get_name() + "' to an image!");
+    }
+}
+
+static FunctionType* as_function_type(Type* type)
+{
+    auto function_type = dynamic_cast<FunctionType*>(type);
+    if (!function_type) {
+        throw std::runtime_error("malformed image!");
+    }
+    return function_type;
+}
+
+/* the struct fields of a struct are laid out before it, they cannot contain it */
+static void lay_out_linked(StructType* struct_type, u64 depth = 0)
+{
+    if (depth > 1000) {
+        throw std::runtime_error("malformed image!");
+    }
+    for (const auto& field : struct_type->fields) {
+        if (auto field_struct_type = dynamic_cast<StructType*>(field.type)) {
+            lay_out_linked(field_struct_type, depth + 1);
+        }
+    }
+    struct_type->lay_out();
+}
+
+/*
+ * Types refer to each other in any order, so they are created with null
+ * references first and linked up once the whole table exists.
+ */
+void read_types(ImageReader& reader, std::vector<std::unique_ptr<Type>>& type_table)
+{
+    struct Link
+    {
+        std::function<void(Type*)> set;
+        u64 index;
+    };
+    std::vector<Link> links;
+    std::vector<StructType*> struct_types;
+
+    u64 type_count = reader.get();
+    for (u64 i = 0; i < type_count; ++i) {
+        auto kind = static_cast<TypeKind>(reader.get());
+        u64 index = reader.get();
+        u64 size = reader.get();
+        std::unique_ptr<Type> type;
+        switch (kind) {
+            case TypeKind::int_:
+                type = std::make_unique<IntType>();
+                break;
+            case TypeKind::float_:
+                type = std::make_unique<FloatType>();
+                break;
+            case TypeKind::bool_:
+                type = std::make_unique<BoolType>();
+                break;
+            case TypeKind::string:
+                type = std::make_unique<StringType>();
+                break;
+            case TypeKind::function: {
+                u64 return_type = reader.get();
+                auto function_type = std::make_unique<FunctionType>(std::vector<Type*>(reader.get()), nullptr);
+                auto raw_function_type = function_type.get();
+                links.push_back(Link{[=](Type* linked) { raw_function_type->return_type = linked; }, return_type});
+                for (Type*& arg_type : function_type->arg_types) {
+                    links.push_back(Link{[&arg_type](Type* linked) { arg_type = linked; }, reader.get()});
+                }
+                type = std::move(function_type);
+                break;
+            }
+            case TypeKind::closure: {
+                u64 function_type = reader.get();
+                auto closure_type = std::make_unique<ClosureType>(nullptr, reader.get());
+                auto raw_closure_type = closure_type.get();
+                links.push_back(Link{[=](Type* linked) { raw_closure_type->function_type = as_function_type(linked); }, function_type});
+                type = std::move(closure_type);
+                break;
+            }
+            case TypeKind::callable: {
+                auto callable_type = std::make_unique<CallableType>(nullptr);
+                auto raw_callable_type = callable_type.get();
+                links.push_back(Link{[=](Type* linked) { raw_callable_type->function_type = as_function_type(linked); }, reader.get()});
+                type = std::move(callable_type);
+                break;
+            }
+            case TypeKind::channel: {
+                auto channel_type = std::make_unique<ChannelType>(nullptr);
+                auto raw_channel_type = channel_type.get();
+                links.push_back(Link{[=](Type* linked) { raw_channel_type->element_type = linked; }, reader.get()});
+                type = std::move(channel_type);
+                break;
+            }
+            case TypeKind::slice: {
+                auto slice_type = std::make_unique<SliceType>(nullptr);
+                auto raw_slice_type = slice_type.get();
+                links.push_back(Link{[=](Type* linked) { raw_slice_type->element_type = linked; }, reader.get()});
+                type = std::move(slice_type);
+                break;
+            }
+            case TypeKind::map: {
+                auto map_type = std::make_unique<MapType>(nullptr, nullptr);
+                auto raw_map_type = map_type.get();
+                links.push_back(Link{[=](Type* linked) { raw_map_type->key_type = linked; }, reader.get()});
+                links.push_back(Link{[=](Type* linked) { raw_map_type->value_type = linked; }, reader.get()});
+                type = std::move(map_type);
+                break;
+            }
+            case TypeKind::struct_: {
+                auto struct_type = std::make_unique<StructType>(std::vector<StructField>(reader.get()));
+                for (auto& field : struct_type->fields) {
+                    field.name = reader.get_string();
+                    links.push_back(Link{[&field](Type* linked) { field.type = linked; }, reader.get()});
+                }
+                struct_types.push_back(struct_type.get());
+                type = std::move(struct_type);
+                break;
+            }
+            default:
+                throw std::runtime_error("malformed image!");
+        }
+        type->index = index;
+        type->size = size;
+        type_table.push_back(std::move(type));
+    }
+
+    for (const auto& link : links) {
+        if (link.index == no_type) {
+            continue;
+        }
+        if (link.index >= type_table.size()) {
+            throw std::runtime_error("malformed image!");
+        }
+        link.set(type_table[link.index].get());
+    }
+    for (auto struct_type : struct_types) {
+        lay_out_linked(struct_type);
+    }
+}
+
+static Type* read_type_reference(ImageReader& reader, std::vector<std::unique_ptr<Type>>& type_table)
+{
+    u64 index = reader.get();
+    if (index == no_type) {
+        return nullptr;
+    }
+    if (index >= type_table.size()) {
+        throw std::runtime_error("malformed image!");
+    }
+    return type_table[index].get();
+}
+
+void Image::write(
+    const std::string& path,
+    const Configuration& configuration,
+    const std::vector<Function>& function_table,
+    const std::vector<NativeFunction>& native_function_table,
+    const std::vector<std::unique_ptr<Type>>& type_table,
+    const StringPool& string_pool)
+{
+    ImageWriter code;
+    ImageWriter metadata;
+
+    metadata.put(type_table.size());
+    for (const auto& type : type_table) {
+        write_type(metadata, *type);
+    }
+
+    metadata.put(configuration.heap_size);
+    metadata.put(configuration.initial_call_stack_size);
+    metadata.put(configuration.max_call_stack_size);
+    metadata.put(configuration.initial_operand_stack_size);
+    metadata.put(configuration.max_operand_stack_size);
+    metadata.put(configuration.output_batch_size);
+    metadata.put(configuration.output_flush_interval);
+    metadata.put(configuration.time_slice);
+    metadata.put(configuration.deadlock_grace_period);
+    metadata.put(configuration.main_function_index);
+    metadata.put_type(configuration.channel_type);
+    metadata.put_type(configuration.slice_type);
+    metadata.put_type(configuration.string_type);
+
+    metadata.put(string_pool.size());
+    for (u64 i = 0; i < string_pool.size(); ++i) {
+        metadata.put_string(string_pool.get(i));
+    }
+
+    metadata.put(native_function_table.size());
+    for (NativeFunction native_function : native_function_table) {
+        metadata.put_string(get_native_function_name(native_function));
+    }
+
+    u64 code_count = 0;
+    metadata.put(function_table.size());
+    for (const auto& function : function_table) {
+        auto function_code = function.get_code();
+        metadata.put_string(function.name);
+        metadata.put(function.capc);
+        metadata.put(function.argc);
+        metadata.put(function.varc);
+        metadata.put(function.index);
+        metadata.put(code_count);
+        metadata.put(function_code.size());
+        metadata.put(function.lines.size());
+        for (const auto& entry : function.lines) {
+            metadata.put(entry.offset);
+            metadata.put(entry.line);
+        }
+        code.put_instructions(function_code);
+        code_count += function_code.size();
+    }
+
+    ImageHeader header{};
+    std::memcpy(header.magic, image_magic, sizeof(image_magic));
+    header.version = version;
+    header.instruction_size = sizeof(Instruction);
+    header.code_offset = sizeof(ImageHeader);
+    header.code_count = code_count;
+    header.metadata_offset = header.code_offset + code.bytes.size();
+    header.metadata_size = metadata.bytes.size();
+
+    std::ofstream stream{path, std::ios::binary | std::ios::trunc};
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(code.bytes.data(), code.bytes.size());
+    stream.write(metadata.bytes.data(), metadata.bytes.size());
+    if (!stream) {
+        throw std::runtime_error("cannot write image '" + path + "'!");
+    }
+}
+
+bool Image::is_image(const std::string& path)
+{
+    char magic[sizeof(image_magic)] = {};
+    std::ifstream stream{path, std::ios::binary};
+    stream.read(magic, sizeof(magic));
+    return stream && std::memcmp(magic, image_magic, sizeof(magic)) == 0;
+}
+
+Image::Image(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open image '" + path + "'!");
+    }
+    struct stat file_status;
+    if (::fstat(fd, &file_status) < 0 || static_cast<u64>(file_status.st_size) < sizeof(ImageHeader)) {
+        ::close(fd);
+        throw std::runtime_error("malformed image!");
+    }
+    mapping_size = file_status.st_size;
+    mapping = ::mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        throw std::runtime_error("cannot map image '" + path + "'!");
+    }
+    try {
+        load(path);
+    } catch (...) {
+        ::munmap(mapping, mapping_size);
+        throw;
+    }
+}
+
+void Image::load(const std::string& path)
+{
+    auto bytes = static_cast<const std::byte*>(mapping);
+    ImageHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, image_magic, sizeof(image_magic)) != 0) {
+        throw std::runtime_error("'" + path + "' is not an image!");
+    }
+    if (header.version != version || header.instruction_size != sizeof(Instruction)) {
+        throw std::runtime_error("image '" + path + "' was written by another version!");
+    }
+    if (header.code_offset != sizeof(ImageHeader)
+        || header.code_count > (mapping_size - header.code_offset) / sizeof(Instruction)
+        || header.metadata_offset != header.code_offset + header.code_count * sizeof(Instruction)
+        || header.metadata_size != mapping_size - header.metadata_offset) {
+        throw std::runtime_error("malformed image!");
+    }
+    auto code = reinterpret_cast<const Instruction*>(bytes + header.code_offset);
+    ImageReader reader{bytes + header.metadata_offset, header.metadata_size};
+
+    read_types(reader, type_table);
+
+    configuration.heap_size = reader.get();
+    configuration.initial_call_stack_size = reader.get();
+    configuration.max_call_stack_size = reader.get();
+    configuration.initial_operand_stack_size = reader.get();
+    configuration.max_operand_stack_size = reader.get();
+    configuration.output_batch_size = reader.get();
+    configuration.output_flush_interval = reader.get();
+    configuration.time_slice = reader.get();
+    configuration.deadlock_grace_period = reader.get();
+    configuration.main_function_index = reader.get();
+    configuration.channel_type = read_type_reference(reader, type_table);
+    configuration.slice_type = read_type_reference(reader, type_table);
+    configuration.string_type = read_type_reference(reader, type_table);
+
+    u64 string_count = reader.get();
+    for (u64 i = 0; i < string_count; ++i) {
+        string_pool.new_string(reader.get_string());
+    }
+
+    u64 native_function_count = reader.get();
+    for (u64 i = 0; i < native_function_count; ++i) {
+        native_function_table.push_back(find_native_function(reader.get_string()));
+    }
+
+    u64 function_count = reader.get();
+    for (u64 i = 0; i < function_count; ++i) {
+        auto& function = function_table.emplace_back();
+        function.name = reader.get_string();
+        function.capc = reader.get();
+        function.argc = reader.get();
+        function.varc = reader.get();
+        function.index = reader.get();
+        u64 code_begin = reader.get();
+        u64 code_size = reader.get();
+        if (code_begin > header.code_count || code_size > header.code_count - code_begin) {
+            throw std::runtime_error("malformed image!");
+        }
+        function.mapped_code = std::span<const Instruction>{code + code_begin, code_size};
+        /* at most one entry per offset, the end of the code included */
+        u64 line_count = reader.get();
+        if (line_count > code_size + 1) {
+            throw std::runtime_error("malformed image!");
+        }
+        function.lines.resize(line_count);
+        for (auto& entry : function.lines) {
+            entry.offset = reader.get();
+            entry.line = reader.get();
+        }
+    }
+    if (configuration.main_function_index >= function_table.size()) {
+        throw std::runtime_error("malformed image!");
+    }
+}
+
+Image::~Image()
+{
+    if (mapping) {
+        ::munmap(mapping, mapping_size);
+    }
+}
@@ -0,0 +1,182 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Code.hpp"
+#include "Common.hpp"
+#include "Runtime.hpp"
+#include "StringPool.hpp"
+
+/*
+ * A compiled program on disk. The header is followed by the code of every
+ * function as one array of instructions, laid out exactly as in memory, and
+ * then by the metadata: configuration, types, strings, native bindings by
+ * name and functions with their line tables. Loading maps the file and
+ * points the functions at their code in the mapping, so instructions are
+ * never copied; only the metadata is decoded. An image is only valid for
+ * the version of the runtime that wrote it.
+ */
+class Image
+{
+public:
+    static constexpr u64 version = 11;
+
+    Image() = delete;
+    Image(const Image&) = delete;
+    Image(Image&&) = delete;
+    Image& operator=(const Image&) = delete;
+    Image& operator=(Image&&) = delete;
+
+    /* the functions refer into the mapping, so the image must outlive them */
+    Image(const std::string& path);
+    ~Image();
+
+    static bool is_image(const std::string& path);
+
+    static void write(
+        const std::string& path,
+        const Configuration& configuration,
+        const std::vector<Function>& function_table,
+        const std::vector<NativeFunction>& native_function_table,
+        const std::vector<std::unique_ptr<Type>>& type_table,
+        const StringPool& string_pool);
+
+    Configuration configuration;
+    std::vector<Function> function_table;
+    std::vector<NativeFunction> native_function_table;
+    std::vector<std::unique_ptr<Type>> type_table;
+    StringPool string_pool;
+
+private:
+    void load(const std::string& path);
+
+    void* mapping = nullptr;
+    u64 mapping_size = 0;
+};
+
+/* the encoding of images, also used by the compilation cache */
+inline constexpr u64 no_type = ~u64{0};
+
+enum class TypeKind : u64
+{
+    int_,
+    float_,
+    bool_,
+    function,
+    closure,
+    callable,
+    string,
+    channel,
+    slice,
+    struct_,
+    map,
+};
+
+class ImageWriter
+{
+public:
+    std::string bytes;
+
+    void put(u64 value)
+    {
+        bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void put_string(std::string_view string)
+    {
+        put(string.size());
+        bytes.append(string);
+    }
+
+    void put_type(const Type* type)
+    {
+        put(type ? type->index : no_type);
+    }
+
+    void align(u64 alignment)
+    {
+        bytes.resize((bytes.size() + alignment - 1) / alignment * alignment);
+    }
+
+    /* padding bytes are zeroed so the same program gives the same image */
+    void put_instructions(std::span<const Instruction> instructions)
+    {
+        u64 offset = bytes.size();
+        bytes.resize(offset + instructions.size_bytes());
+        for (const auto& instruction : instructions) {
+            std::memcpy(bytes.data() + offset, &instruction.opcode, sizeof(Opcode));
+            std::memcpy(bytes.data() + offset + offsetof(Instruction, index), &instruction.index, sizeof(u64));
+            offset += sizeof(Instruction);
+        }
+    }
+};
+
+class ImageReader
+{
+public:
+    ImageReader(const std::byte* data, u64 size) : data{data}, size{size}, offset{0} {}
+
+    u64 get()
+    {
+        check(sizeof(u64));
+        u64 value;
+        std::memcpy(&value, data + offset, sizeof(value));
+        offset += sizeof(value);
+        return value;
+    }
+
+    std::string get_string()
+    {
+        u64 length = get();
+        check(length);
+        std::string string{reinterpret_cast<const char*>(data + offset), length};
+        offset += length;
+        return string;
+    }
+
+    /* for data that stays in the buffer, as code that is used in place */
+    const std::byte* get_bytes(u64 length)
+    {
+        check(length);
+        auto bytes = data + offset;
+        offset += length;
+        return bytes;
+    }
+
+    std::string_view get_string_view()
+    {
+        u64 length = get();
+        return {reinterpret_cast<const char*>(get_bytes(length)), length};
+    }
+
+    void align(u64 alignment)
+    {
+        u64 padding = (alignment - offset % alignment) % alignment;
+        get_bytes(padding);
+    }
+
+private:
+    void check(u64 length)
+    {
+        if (length > size - offset) {
+            throw std::runtime_error("malformed image!");
+        }
+    }
+
+    const std::byte* data;
+    u64 size;
+    u64 offset;
+};
+
+void write_type(ImageWriter& writer, const Type& type);
+void read_types(ImageReader& reader, std::vector<std::unique_ptr<Type>>& type_table);
+
+#endif /* IMAGE_HPP */
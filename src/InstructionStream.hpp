@@ -10,15 +10,17 @@ class InstructionStream
 public:
     const Instruction* next()
     {
-        if (program_counter >= code->size()) {
+        if (program_counter >= code_size) {
             return nullptr;
         }
-        return &(*code)[program_counter++];
+        return &code[program_counter++];
     }
 
     void jump_to(const Function& function, u64 new_program_counter = 0)
     {
-        code = &function.code;
+        auto function_code = function.get_code();
+        code = function_code.data();
+        code_size = function_code.size();
         program_counter = new_program_counter;
     }
 
@@ -33,7 +35,8 @@ public:
     }
 
 private:
-    const std::vector<Instruction>* code;
+    const Instruction* code;
+    u64 code_size;
     u64 program_counter;
 };
 
@@ -0,0 +1,374 @@
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "Lexer.hpp"
+
+const char* get_token_kind_name(TokenKind kind)
+{
+    switch (kind) {
+        case TokenKind::end:
+            return "end of file";
+        case TokenKind::identifier:
+            return "identifier";
+        case TokenKind::int_lit:
+            return "integer literal";
+        case TokenKind::float_lit:
+            return "float literal";
+        case TokenKind::string_lit:
+            return "string literal";
+        case TokenKind::func_:
+            return "'func'";
+        case TokenKind::var_:
+            return "'var'";
+        case TokenKind::return_:
+            return "'return'";
+        case TokenKind::goto_:
+            return "'goto'";
+        case TokenKind::defer_:
+            return "'defer'";
+        case TokenKind::if_:
+            return "'if'";
+        case TokenKind::else_:
+            return "'else'";
+        case TokenKind::for_:
+            return "'for'";
+        case TokenKind::range_:
+            return "'range'";
+        case TokenKind::select_:
+            return "'select'";
+        case TokenKind::case_:
+            return "'case'";
+        case TokenKind::default_:
+            return "'default'";
+        case TokenKind::go_:
+            return "'go'";
+        case TokenKind::chan_:
+            return "'chan'";
+        case TokenKind::struct_:
+            return "'struct'";
+        case TokenKind::map_:
+            return "'map'";
+        case TokenKind::lor:
+            return "'||'";
+        case TokenKind::land:
+            return "'&&'";
+        case TokenKind::eq:
+            return "'=='";
+        case TokenKind::ne:
+            return "'!='";
+        case TokenKind::lt:
+            return "'<'";
+        case TokenKind::le:
+            return "'<='";
+        case TokenKind::gt:
+            return "'>'";
+        case TokenKind::ge:
+            return "'>='";
+        case TokenKind::add:
+            return "'+'";
+        case TokenKind::sub:
+            return "'-'";
+        case TokenKind::or_:
+            return "'|'";
+        case TokenKind::xor_:
+            return "'^'";
+        case TokenKind::mul:
+            return "'*'";
+        case TokenKind::div:
+            return "'/'";
+        case TokenKind::rem:
+            return "'%'";
+        case TokenKind::shl:
+            return "'<<'";
+        case TokenKind::shr:
+            return "'>>'";
+        case TokenKind::and_:
+            return "'&'";
+        case TokenKind::not_:
+            return "'!'";
+        case TokenKind::arrow:
+            return "'<-'";
+        case TokenKind::assign:
+            return "'='";
+        case TokenKind::define:
+            return "':='";
+        case TokenKind::lparen:
+            return "'('";
+        case TokenKind::rparen:
+            return "')'";
+        case TokenKind::lbracket:
+            return "'['";
+        case TokenKind::rbracket:
+            return "']'";
+        case TokenKind::lbrace:
+            return "'{'";
+        case TokenKind::rbrace:
+            return "'}'";
+        case TokenKind::comma:
+            return "','";
+        case TokenKind::semicolon:
+            return "';'";
+        case TokenKind::colon:
+            return "':'";
+        case TokenKind::dot:
+            return "'.'";
+    }
+    return "?";
+}
+
+static constexpr std::pair<std::string_view, TokenKind> keywords[] = {
+    {"func", TokenKind::func_},
+    {"var", TokenKind::var_},
+    {"return", TokenKind::return_},
+    {"goto", TokenKind::goto_},
+    {"defer", TokenKind::defer_},
+    {"if", TokenKind::if_},
+    {"else", TokenKind::else_},
+    {"for", TokenKind::for_},
+    {"range", TokenKind::range_},
+    {"select", TokenKind::select_},
+    {"case", TokenKind::case_},
+    {"default", TokenKind::default_},
+    {"go", TokenKind::go_},
+    {"chan", TokenKind::chan_},
+    {"struct", TokenKind::struct_},
+    {"map", TokenKind::map_},
+};
+
+static bool is_letter(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || static_cast<u8>(c) >= 0x80;
+}
+
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+Lexer::Lexer(std::string_view source) : cursor{source.data()},
+                                        limit{source.data() + source.size()}
+{
+}
+
+void Lexer::error(const char* message)
+{
+    throw SourceError(line, std::string{"lexer: "} + message);
+}
+
+void Lexer::skip_whitespace_and_comments()
+{
+    while (cursor != limit) {
+        char c = *cursor;
+        if (c == '\n') {
+            ++line;
+            ++cursor;
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            ++cursor;
+        } else if (c == '/' && cursor + 1 != limit && cursor[1] == '/') {
+            while (cursor != limit && *cursor != '\n') {
+                ++cursor;
+            }
+        } else if (c == '/' && cursor + 1 != limit && cursor[1] == '*') {
+            cursor += 2;
+            while (true) {
+                if (cursor == limit) {
+                    error("comment not terminated");
+                }
+                if (*cursor == '*' && cursor + 1 != limit && cursor[1] == '/') {
+                    cursor += 2;
+                    break;
+                }
+                if (*cursor == '\n') {
+                    ++line;
+                }
+                ++cursor;
+            }
+        } else {
+            return;
+        }
+    }
+}
+
+Token Lexer::make_token(TokenKind kind, const char* start)
+{
+    return Token{.kind = kind, .line = line, .text = std::string_view{start, static_cast<std::size_t>(cursor - start)}};
+}
+
+Token Lexer::lex_word(const char* start)
+{
+    while (cursor != limit && (is_letter(*cursor) || is_digit(*cursor))) {
+        ++cursor;
+    }
+    auto token = make_token(TokenKind::identifier, start);
+    for (const auto& [keyword, kind] : keywords) {
+        if (keyword == token.text) {
+            token.kind = kind;
+            break;
+        }
+    }
+    return token;
+}
+
+Token Lexer::lex_number(const char* start)
+{
+    auto skip_digits = [this]() {
+        while (cursor != limit && is_digit(*cursor)) {
+            ++cursor;
+        }
+    };
+    /* an exponent is only taken when digits follow, 1e stays 1 and e */
+    auto skip_exponent = [this, &skip_digits]() {
+        if (cursor == limit || (*cursor != 'e' && *cursor != 'E')) {
+            return false;
+        }
+        const char* digits = cursor + 1;
+        if (digits != limit && (*digits == '+' || *digits == '-')) {
+            ++digits;
+        }
+        if (digits == limit || !is_digit(*digits)) {
+            return false;
+        }
+        cursor = digits;
+        skip_digits();
+        return true;
+    };
+
+    bool is_float = false;
+    if (*start == '.') {
+        ++cursor;
+        skip_digits();
+        skip_exponent();
+        is_float = true;
+    } else {
+        skip_digits();
+        if (cursor != limit && *cursor == '.') {
+            ++cursor;
+            skip_digits();
+            skip_exponent();
+            is_float = true;
+        } else {
+            is_float = skip_exponent();
+        }
+    }
+    if (!is_float && *start == '0' && cursor - start > 1) {
+        error("integer literal with a leading zero");
+    }
+    return make_token(is_float ? TokenKind::float_lit : TokenKind::int_lit, start);
+}
+
+Token Lexer::lex_string(const char* start)
+{
+    char quote = *cursor++;
+    u32 start_line = line;
+    while (true) {
+        if (cursor == limit) {
+            error("string literal not terminated");
+        }
+        char c = *cursor++;
+        if (c == quote) {
+            break;
+        }
+        if (c == '\n') {
+            if (quote == '"') {
+                error("newline in string literal");
+            }
+            ++line;
+        } else if (c == '\\' && quote == '"' && cursor != limit && *cursor != '\n') {
+            ++cursor;
+        }
+    }
+    auto token = make_token(TokenKind::string_lit, start);
+    token.line = start_line;
+    return token;
+}
+
+Token Lexer::next()
+{
+    skip_whitespace_and_comments();
+    const char* start = cursor;
+    if (cursor == limit) {
+        return make_token(TokenKind::end, start);
+    }
+    char c = *cursor;
+    if (is_letter(c)) {
+        return lex_word(start);
+    }
+    if (is_digit(c) || (c == '.' && cursor + 1 != limit && is_digit(cursor[1]))) {
+        return lex_number(start);
+    }
+    if (c == '"' || c == '`') {
+        return lex_string(start);
+    }
+
+    ++cursor;
+    char n = cursor != limit ? *cursor : '\0';
+    /* two character operators first, the grammar's lexer takes the longest match */
+    auto pair = [this, start](TokenKind kind) {
+        ++cursor;
+        return make_token(kind, start);
+    };
+    switch (c) {
+        case '|':
+            return n == '|' ? pair(TokenKind::lor) : make_token(TokenKind::or_, start);
+        case '&':
+            return n == '&' ? pair(TokenKind::land) : make_token(TokenKind::and_, start);
+        case '=':
+            return n == '=' ? pair(TokenKind::eq) : make_token(TokenKind::assign, start);
+        case '!':
+            return n == '=' ? pair(TokenKind::ne) : make_token(TokenKind::not_, start);
+        case '<':
+            if (n == '=') {
+                return pair(TokenKind::le);
+            }
+            if (n == '<') {
+                return pair(TokenKind::shl);
+            }
+            if (n == '-') {
+                return pair(TokenKind::arrow);
+            }
+            return make_token(TokenKind::lt, start);
+        case '>':
+            if (n == '=') {
+                return pair(TokenKind::ge);
+            }
+            if (n == '>') {
+                return pair(TokenKind::shr);
+            }
+            return make_token(TokenKind::gt, start);
+        case ':':
+            return n == '=' ? pair(TokenKind::define) : make_token(TokenKind::colon, start);
+        case '+':
+            return make_token(TokenKind::add, start);
+        case '-':
+            return make_token(TokenKind::sub, start);
+        case '^':
+            return make_token(TokenKind::xor_, start);
+        case '*':
+            return make_token(TokenKind::mul, start);
+        case '/':
+            return make_token(TokenKind::div, start);
+        case '%':
+            return make_token(TokenKind::rem, start);
+        case '(':
+            return make_token(TokenKind::lparen, start);
+        case ')':
+            return make_token(TokenKind::rparen, start);
+        case '[':
+            return make_token(TokenKind::lbracket, start);
+        case ']':
+            return make_token(TokenKind::rbracket, start);
+        case '{':
+            return make_token(TokenKind::lbrace, start);
+        case '}':
+            return make_token(TokenKind::rbrace, start);
+        case ',':
+            return make_token(TokenKind::comma, start);
+        case ';':
+            return make_token(TokenKind::semicolon, start);
+        case '.':
+            return make_token(TokenKind::dot, start);
+        default:
+            error("unexpected character");
+    }
+}
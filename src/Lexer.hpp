@@ -0,0 +1,106 @@
+#ifndef LEXER_HPP
+#define LEXER_HPP
+
+#include <string_view>
+
+#include "Common.hpp"
+
+enum class TokenKind : u8
+{
+    end,
+    identifier,
+    int_lit,
+    float_lit,
+    string_lit,
+    // KEYWORDS
+    func_,
+    var_,
+    return_,
+    goto_,
+    defer_,
+    if_,
+    else_,
+    for_,
+    range_,
+    select_,
+    case_,
+    default_,
+    go_,
+    chan_,
+    struct_,
+    map_,
+    // OPERATORS
+    lor,
+    land,
+    eq,
+    ne,
+    lt,
+    le,
+    gt,
+    ge,
+    add,
+    sub,
+    or_,
+    xor_,
+    mul,
+    div,
+    rem,
+    shl,
+    shr,
+    and_,
+    not_,
+    arrow,
+    assign,
+    define,
+    // PUNCTUATION
+    lparen,
+    rparen,
+    lbracket,
+    rbracket,
+    lbrace,
+    rbrace,
+    comma,
+    semicolon,
+    colon,
+    dot,
+};
+
+const char* get_token_kind_name(TokenKind kind);
+
+struct Token
+{
+    TokenKind kind;
+    u32 line;
+    std::string_view text;
+};
+
+/*
+ * Splits source text into the tokens of GOatLANG.g4, one at a time.
+ * Whitespace, newlines and comments are skipped as the grammar sends them
+ * to the hidden channel. Only the words the parser rules spell out are
+ * keywords; the other reserved words of the grammar's KEYWORD rule lose to
+ * IDENTIFIER in ANTLR and are identifiers here as well. Bytes outside ASCII
+ * are taken as letters instead of being checked against the Unicode
+ * tables. Token texts point into the source, which must outlive them.
+ */
+class Lexer
+{
+public:
+    Lexer(std::string_view source);
+
+    Token next();
+
+private:
+    [[noreturn]] void error(const char* message);
+    void skip_whitespace_and_comments();
+    Token make_token(TokenKind kind, const char* start);
+    Token lex_word(const char* start);
+    Token lex_number(const char* start);
+    Token lex_string(const char* start);
+
+    const char* cursor;
+    const char* limit;
+    u32 line = 1;
+};
+
+#endif /* LEXER_HPP */
@@ -1,24 +1,25 @@
-#include <iostream>
-#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
 
 #include "BlockingQueue.hpp"
 #include "ChannelManager.hpp"
+#include "HashMap.hpp"
 #include "Native.hpp"
+#include "NativeRegistry.hpp"
+#include "Output.hpp"
 #include "Runtime.hpp"
-#include "StringPool.hpp"
+#include "SliceKernels.hpp"
+#include "Strings.hpp"
 #include "Thread.hpp"
 
-static std::mutex io_mutex{};
-
 void new_thread(Runtime& runtime, Thread& thread)
 {
-    // {
-    //     std::lock_guard{io_mutex};
-    //     std::cerr << "new thread!" << std::endl;
-    // }
     auto& cur_operand_stack = thread.get_operand_stack();
 
-    Thread new_thread{runtime};
+    Thread& new_thread = runtime.acquire_thread();
     auto& new_call_stack = new_thread.get_call_stack();
     auto& new_operand_stack = new_thread.get_operand_stack();
     auto& new_instruction_stream = new_thread.get_instruction_stream();
@@ -30,25 +31,12 @@ void new_thread(Runtime& runtime, Thread& thread)
 
     new_call_stack.push_frame(function, 0);
     new_instruction_stream.jump_to(function);
-
-    std::deque<Word> stack;
-    for (u16 i = 0; i < function.argc; ++i) {
-        Word word = cur_operand_stack.pop<Word>();
-        stack.push_back(word);
-    }
-    for (u16 i = 0; i < function.argc; ++i) {
-        Word word = stack.back();
-        new_operand_stack.push(word);
-        stack.pop_back();
-    }
+    new_operand_stack.transfer(cur_operand_stack, function.argc);
     for (u16 i = 0; i < function.capc; ++i) {
         u64 cap_address = heap.load<u64>(closure_address + sizeof(ClosureHeader) + sizeof(u64) * i);
         new_call_stack.store_local(i, cap_address);
     }
-    std::thread platform_thread{[new_thread = std::move(new_thread)]() mutable {
-        new_thread.start();
-    }};
-    platform_thread.detach();
+    runtime.spawn(new_thread);
 }
 
 void new_chan(Runtime& runtime, Thread& thread)
@@ -86,7 +74,7 @@ void chan_send(Runtime& runtime, Thread& thread)
     //     std::cerr << "chan send " << chan_index << std::endl;
     // }
     auto& blocking_queue = channel_manager.get(chan_index);
-    blocking_queue.push(item_address);
+    blocking_queue.push(item_address, &thread);
 }
 
 void chan_recv(Runtime& runtime, Thread& thread)
@@ -105,48 +93,768 @@ void chan_recv(Runtime& runtime, Thread& thread)
     auto& blocking_queue = channel_manager.get(chan_index);
 
     u64 item_address;
-    blocking_queue.pop(item_address);
+    if (!blocking_queue.pop(item_address, &thread)) {
+        item_address = runtime.get_zero_address();
+    }
     operand_stack.push(item_address);
 }
 
-void sprint(Runtime& runtime, Thread& thread)
+void chan_recv_ok(Runtime& runtime, Thread& thread)
 {
-    u64 string_address = thread.get_operand_stack().pop<u64>();
-    const auto& string = runtime.get_heap().load<NativeString>(string_address);
-    const auto& native_string = runtime.get_string_pool().get(string.index);
-    {
-        std::lock_guard{io_mutex};
-        std::cout << native_string << std::endl;
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+    auto& channel_manager = runtime.get_channel_manager();
+
+    u64 chan_address = operand_stack.pop<u64>();
+    u64 chan_index = heap.load<u64>(chan_address);
+    auto& blocking_queue = channel_manager.get(chan_index);
+
+    u64 item_address;
+    bool ok = blocking_queue.pop(item_address, &thread);
+    if (!ok) {
+        item_address = runtime.get_zero_address();
     }
+    operand_stack.push(item_address);
+    operand_stack.push(static_cast<i64>(ok));
+}
+
+void chan_close(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+    auto& channel_manager = runtime.get_channel_manager();
+
+    u64 chan_address = operand_stack.pop<u64>();
+    u64 chan_index = heap.load<u64>(chan_address);
+    channel_manager.get(chan_index).close();
+}
+
+/*
+ * The iterator of a range loop over a channel is the channel index. Each
+ * iteration receives a single item, so the items the loop does not get to
+ * stay in the channel for other receivers.
+ */
+void chan_range(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+
+    u64 chan_address = operand_stack.pop<u64>();
+    operand_stack.push(heap.load<u64>(chan_address));
 }
 
-void iprint(Runtime& runtime, Thread& thread)
+void chan_range_next(Runtime& runtime, Thread& thread)
 {
-    (void) runtime;
-    i64 i = thread.get_operand_stack().pop<i64>();
-    {
-        std::lock_guard{io_mutex};
-        std::cout << i << std::endl;
+    auto& operand_stack = thread.get_operand_stack();
+
+    u64 chan_index = operand_stack.pop<u64>();
+    auto& blocking_queue = runtime.get_channel_manager().get(chan_index);
+
+    u64 item_address;
+    bool ok = blocking_queue.pop(item_address, &thread);
+    if (!ok) {
+        item_address = runtime.get_zero_address();
     }
+    operand_stack.push(item_address);
+    operand_stack.push(static_cast<i64>(ok));
 }
 
-void fprint(Runtime& runtime, Thread& thread)
+void chan_select(Runtime& runtime, Thread& thread)
 {
-    (void) runtime;
-    f64 f = thread.get_operand_stack().pop<f64>();
-    {
-        std::lock_guard{io_mutex};
-        std::cout << f << std::endl;
+    // the operand stack holds a (channel, item, is_send) triple per case,
+    // followed by the number of cases and whether there is a default case
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+    auto& channel_manager = runtime.get_channel_manager();
+
+    bool has_default = operand_stack.pop<u64>() != 0;
+    u64 case_count = operand_stack.pop<u64>();
+    std::vector<SelectCase> cases(case_count);
+    for (u64 i = case_count; i-- > 0;) {
+        bool is_send = operand_stack.pop<u64>() != 0;
+        u64 item_address = operand_stack.pop<u64>();
+        u64 chan_address = operand_stack.pop<u64>();
+        u64 chan_index = heap.load<u64>(chan_address);
+        cases[i] = SelectCase{
+            .queue = &channel_manager.get(chan_index),
+            .is_send = is_send,
+            .item = item_address,
+        };
+    }
+
+    i64 case_index = BlockingQueue::select(cases, !has_default, &thread);
+    u64 item_address = runtime.get_zero_address();
+    i64 ok = 0;
+    if (case_index >= 0 && !cases[case_index].is_send) {
+        ok = cases[case_index].ok;
+        if (ok) {
+            item_address = cases[case_index].item;
+        }
     }
+    operand_stack.push(item_address);
+    operand_stack.push(ok);
+    operand_stack.push(case_index);
+}
+
+static void sprint(Runtime& runtime, std::string_view line)
+{
+    runtime.get_output().write_line(line);
+}
+
+static void iprint(Runtime& runtime, i64 i)
+{
+    runtime.get_output().write_integer(i);
+}
+
+static void fprint(Runtime& runtime, f64 f)
+{
+    runtime.get_output().write_float(f);
+}
+
+static std::string itoa(i64 i)
+{
+    return std::to_string(i);
+}
+
+static f64 sqrt_native(f64 x)
+{
+    return std::sqrt(x);
+}
+
+static f64 floor_native(f64 x)
+{
+    return std::floor(x);
+}
+
+static f64 ceil_native(f64 x)
+{
+    return std::ceil(x);
+}
+
+static f64 fabs_native(f64 x)
+{
+    return std::fabs(x);
+}
+
+static f64 pow_native(f64 x, f64 y)
+{
+    return std::pow(x, y);
+}
+
+static f64 exp_native(f64 x)
+{
+    return std::exp(x);
+}
+
+static f64 log_native(f64 x)
+{
+    return std::log(x);
+}
+
+static f64 sin_native(f64 x)
+{
+    return std::sin(x);
+}
+
+static f64 cos_native(f64 x)
+{
+    return std::cos(x);
+}
+
+static i64 iabs(i64 i)
+{
+    return i < 0 ? -i : i;
+}
+
+static i64 imin(i64 x, i64 y)
+{
+    return std::min(x, y);
+}
+
+static i64 imax(i64 x, i64 y)
+{
+    return std::max(x, y);
+}
+
+void register_builtin_natives(NativeRegistry& registry)
+{
+    registry.add<sprint>("sprint");
+    registry.add<iprint>("iprint");
+    registry.add<fprint>("fprint");
+    registry.add<itoa>("itoa");
+    registry.add<sqrt_native>("sqrt");
+    registry.add<floor_native>("floor");
+    registry.add<ceil_native>("ceil");
+    registry.add<fabs_native>("fabs");
+    registry.add<pow_native>("pow");
+    registry.add<exp_native>("exp");
+    registry.add<log_native>("log");
+    registry.add<sin_native>("sin");
+    registry.add<cos_native>("cos");
+    registry.add<iabs>("iabs");
+    registry.add<imin>("imin");
+    registry.add<imax>("imax");
+}
+
+/* headers and element arrays are both blocks of words */
+static u64 new_slice_header(Runtime& runtime, const SliceHeader& header)
+{
+    auto& heap = runtime.get_heap();
+    const auto& slice_type = *runtime.get_configuration().slice_type;
+    u64 header_address = heap.allocate(slice_type, sizeof(SliceHeader) / sizeof(Word));
+    heap.store(header_address, header);
+    return header_address;
+}
+
+static u64 new_slice_data(Runtime& runtime, u64 capacity)
+{
+    const auto& slice_type = *runtime.get_configuration().slice_type;
+    return capacity == 0 ? 0 : runtime.get_heap().allocate(slice_type, capacity);
 }
 
 void new_slice(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+
+    i64 capacity = operand_stack.pop<i64>();
+    i64 length = operand_stack.pop<i64>();
+    if (length < 0 || length > capacity) {
+        throw std::runtime_error(
+            "slice length " + std::to_string(length) + " out of range for capacity " +
+            std::to_string(capacity) + "!");
+    }
+    SliceHeader header{
+        .data = new_slice_data(runtime, capacity),
+        .length = static_cast<u64>(length),
+        .capacity = static_cast<u64>(capacity),
+    };
+    operand_stack.push(new_slice_header(runtime, header));
+}
+
+/* like new_slice, each element up to the capacity a zeroed struct of the type index on top */
+void new_struct_slice(Runtime& runtime, Thread& thread)
 {
     auto& operand_stack = thread.get_operand_stack();
     auto& heap = runtime.get_heap();
 
-    u64 slice_length = operand_stack.pop<u64>();
-    const auto& slice_type = *runtime.get_configuration().slice_type;
-    u64 slice_address = heap.allocate(slice_type, slice_length);
-    operand_stack.push(slice_address);
+    const auto& struct_type = *runtime.get_type_table()[operand_stack.pop<u64>()];
+    new_slice(runtime, thread);
+    SliceHeader header = heap.load_slice_header(operand_stack.peek<u64>(0));
+    for (u64 i = 0; i < header.capacity; ++i) {
+        u64 address = heap.allocate(struct_type, 1);
+        heap.store(header.data + sizeof(Word) * i, address);
+    }
+}
+
+/*
+ * The operand stack holds the slice, the values to append and their count.
+ * A full slice moves to an array of twice its capacity, so appending n
+ * values one at a time copies O(n) elements in all.
+ */
+void slice_append(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+
+    u64 count = operand_stack.pop<u64>();
+    u64 slice_address = operand_stack.peek<u64>(count);
+    if (count == 0) {
+        return;
+    }
+    SliceHeader header = heap.load_slice_header(slice_address);
+    u64 length = header.length + count;
+    if (length > header.capacity) {
+        u64 capacity = std::max({header.capacity * 2, length, u64{4}});
+        u64 data = new_slice_data(runtime, capacity);
+        if (header.length > 0) {
+            std::memmove(&heap.access<Word>(data), &heap.access<Word>(header.data), sizeof(Word) * header.length);
+        }
+        header.data = data;
+        header.capacity = capacity;
+    }
+    operand_stack.pop_into(&heap.access<Word>(header.data + sizeof(Word) * header.length), count);
+    operand_stack.pop<u64>();
+    header.length = length;
+    operand_stack.push(new_slice_header(runtime, header));
+}
+
+/* copies as many elements as the shorter slice has, the two may overlap */
+void slice_copy(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+
+    SliceHeader source = heap.load_slice_header(operand_stack.pop<u64>());
+    SliceHeader destination = heap.load_slice_header(operand_stack.pop<u64>());
+    u64 count = std::min(source.length, destination.length);
+    if (count > 0) {
+        std::memmove(&heap.access<Word>(destination.data), &heap.access<Word>(source.data), sizeof(Word) * count);
+    }
+    operand_stack.push(count);
+}
+
+/* s[low:high] shares the elements of s, high may reach up to its capacity */
+void slice_slice(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+
+    u64 high = operand_stack.pop<u64>();
+    u64 low = operand_stack.pop<u64>();
+    u64 slice_address = operand_stack.pop<u64>();
+    SliceHeader header = heap.load_slice_header(slice_address);
+    /* negative bounds are large unsigned ones */
+    if (low > high || high > header.capacity) {
+        throw std::runtime_error(
+            "slice bounds [" + std::to_string(static_cast<i64>(low)) + ":" +
+            std::to_string(static_cast<i64>(high)) + "] out of range for capacity " +
+            std::to_string(header.capacity) + "!");
+    }
+    if (slice_address == 0) {
+        operand_stack.push(u64{0});
+        return;
+    }
+    SliceHeader subslice{
+        .data = header.data + sizeof(Word) * low,
+        .length = high - low,
+        .capacity = header.capacity - low,
+    };
+    operand_stack.push(new_slice_header(runtime, subslice));
+}
+
+/* the elements of a slice as an array, null when it has none */
+template <typename T>
+static T* slice_elements(Heap& heap, const SliceHeader& header)
+{
+    return header.length == 0 ? nullptr : &heap.access<T>(header.data);
+}
+
+/* the reductions pop the slice and push the result, min and max of no elements are errors */
+template <typename T>
+static void reduce_slice(Runtime& runtime, Thread& thread, T (*kernel)(const T*, u64), const char* empty_error)
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+
+    SliceHeader header = heap.load_slice_header(operand_stack.pop<u64>());
+    if (header.length == 0 && empty_error) {
+        throw std::runtime_error(empty_error);
+    }
+    operand_stack.push(kernel(slice_elements<T>(heap, header), header.length));
+}
+
+/* dot(x, y) goes as far as the shorter slice */
+template <typename T>
+static void dot_slices(Runtime& runtime, Thread& thread, T (*kernel)(const T*, const T*, u64))
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+
+    SliceHeader y = heap.load_slice_header(operand_stack.pop<u64>());
+    SliceHeader x = heap.load_slice_header(operand_stack.pop<u64>());
+    u64 count = std::min(x.length, y.length);
+    operand_stack.push(kernel(slice_elements<T>(heap, x), slice_elements<T>(heap, y), count));
+}
+
+/* op(z, x, y) writes as many elements as the shortest slice has and pushes the count, like copy */
+template <typename T>
+static void combine_slices(Runtime& runtime, Thread& thread, void (*kernel)(T*, const T*, const T*, u64))
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+
+    SliceHeader y = heap.load_slice_header(operand_stack.pop<u64>());
+    SliceHeader x = heap.load_slice_header(operand_stack.pop<u64>());
+    SliceHeader z = heap.load_slice_header(operand_stack.pop<u64>());
+    u64 count = std::min({x.length, y.length, z.length});
+    if (count > 0) {
+        kernel(slice_elements<T>(heap, z), slice_elements<T>(heap, x), slice_elements<T>(heap, y), count);
+    }
+    operand_stack.push(count);
+}
+
+template <typename T>
+static void search_slice(Runtime& runtime, Thread& thread, i64 (*kernel)(const T*, u64, T))
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+
+    T value = operand_stack.pop<T>();
+    SliceHeader header = heap.load_slice_header(operand_stack.pop<u64>());
+    operand_stack.push(kernel(slice_elements<T>(heap, header), header.length, value));
+}
+
+void slice_sum_int(Runtime& runtime, Thread& thread)
+{
+    reduce_slice(runtime, thread, get_slice_kernels().sum_int, nullptr);
+}
+
+void slice_sum_float(Runtime& runtime, Thread& thread)
+{
+    reduce_slice(runtime, thread, get_slice_kernels().sum_float, nullptr);
+}
+
+void slice_min_int(Runtime& runtime, Thread& thread)
+{
+    reduce_slice(runtime, thread, get_slice_kernels().min_int, "vmin of an empty slice!");
+}
+
+void slice_min_float(Runtime& runtime, Thread& thread)
+{
+    reduce_slice(runtime, thread, get_slice_kernels().min_float, "vmin of an empty slice!");
+}
+
+void slice_max_int(Runtime& runtime, Thread& thread)
+{
+    reduce_slice(runtime, thread, get_slice_kernels().max_int, "vmax of an empty slice!");
+}
+
+void slice_max_float(Runtime& runtime, Thread& thread)
+{
+    reduce_slice(runtime, thread, get_slice_kernels().max_float, "vmax of an empty slice!");
+}
+
+void slice_dot_int(Runtime& runtime, Thread& thread)
+{
+    dot_slices(runtime, thread, get_slice_kernels().dot_int);
+}
+
+void slice_dot_float(Runtime& runtime, Thread& thread)
+{
+    dot_slices(runtime, thread, get_slice_kernels().dot_float);
+}
+
+void slice_add_int(Runtime& runtime, Thread& thread)
+{
+    combine_slices(runtime, thread, get_slice_kernels().add_int);
+}
+
+void slice_add_float(Runtime& runtime, Thread& thread)
+{
+    combine_slices(runtime, thread, get_slice_kernels().add_float);
+}
+
+void slice_mul_int(Runtime& runtime, Thread& thread)
+{
+    combine_slices(runtime, thread, get_slice_kernels().mul_int);
+}
+
+void slice_mul_float(Runtime& runtime, Thread& thread)
+{
+    combine_slices(runtime, thread, get_slice_kernels().mul_float);
+}
+
+/* slices of anything but floats are searched for the same word */
+void slice_index_int(Runtime& runtime, Thread& thread)
+{
+    search_slice(runtime, thread, get_slice_kernels().index_int);
+}
+
+void slice_index_float(Runtime& runtime, Thread& thread)
+{
+    search_slice(runtime, thread, get_slice_kernels().index_float);
+}
+
+void slice_fill(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+
+    u64 value = operand_stack.pop<u64>();
+    SliceHeader header = heap.load_slice_header(operand_stack.pop<u64>());
+    get_slice_kernels().fill(slice_elements<u64>(heap, header), header.length, value);
+}
+
+static HashMap access_map(Runtime& runtime, u64 map_address)
+{
+    return HashMap{runtime.get_heap(), *runtime.get_configuration().slice_type, map_address};
+}
+
+/* the operand stack holds the size hint and the index of the MapType on top */
+void new_map(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+
+    const auto& map_type = static_cast<const MapType&>(*runtime.get_type_table()[operand_stack.pop<u64>()]);
+    i64 hint = operand_stack.pop<i64>();
+    if (hint < 0) {
+        throw std::runtime_error("map size hint " + std::to_string(hint) + " out of range!");
+    }
+    auto key_kind = dynamic_cast<const FloatType*>(map_type.key_type)    ? MapKeyKind::float_
+                    : dynamic_cast<const StringType*>(map_type.key_type) ? MapKeyKind::string
+                                                                         : MapKeyKind::word;
+    const auto& word_type = *runtime.get_configuration().slice_type;
+    operand_stack.push(HashMap::make(runtime.get_heap(), word_type, map_type, key_kind, static_cast<u64>(hint)));
+}
+
+/* a missing key, or any key of the nil map, has the zero value */
+void map_get(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+
+    u64 key = operand_stack.pop<u64>();
+    u64 map_address = operand_stack.pop<u64>();
+    u64 value = 0;
+    if (map_address != 0) {
+        access_map(runtime, map_address).find(key, value);
+    }
+    operand_stack.push(value);
+}
+
+void map_set(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+
+    u64 value = operand_stack.pop<u64>();
+    u64 key = operand_stack.pop<u64>();
+    u64 map_address = operand_stack.pop<u64>();
+    if (map_address == 0) {
+        throw std::runtime_error("assignment to an entry of a nil map!");
+    }
+    access_map(runtime, map_address).insert(key, value);
+}
+
+void map_delete(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+
+    u64 key = operand_stack.pop<u64>();
+    u64 map_address = operand_stack.pop<u64>();
+    if (map_address != 0) {
+        access_map(runtime, map_address).erase(key);
+    }
+}
+
+struct MapIterator
+{
+    u64 map_address;
+    MapCursor cursor;
+};
+
+void map_range(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+
+    u64 map_address = operand_stack.pop<u64>();
+    MapIterator iterator{.map_address = map_address};
+    if (map_address != 0) {
+        const auto& header = heap.load<MapHeader>(map_address);
+        iterator.cursor = MapCursor{.controls = header.controls, .slots = header.slots, .capacity = header.capacity};
+    }
+    u64 iterator_address = heap.allocate(*runtime.get_configuration().slice_type, sizeof(MapIterator) / sizeof(Word));
+    heap.store(iterator_address, iterator);
+    operand_stack.push(iterator_address);
+}
+
+/*
+ * Pushes the next key and whether there was one. The keys are those of
+ * the table when the range began; once the map has grown into new arrays,
+ * the keys deleted since are skipped by looking each one up.
+ */
+void map_range_next(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+
+    u64 iterator_address = operand_stack.pop<u64>();
+    auto iterator = heap.load<MapIterator>(iterator_address);
+    u64 key;
+    u64 value;
+    bool found = false;
+    while (!found && iterator.cursor.next(heap, key, value)) {
+        auto map = access_map(runtime, iterator.map_address);
+        found = map.get_header().controls == iterator.cursor.controls || map.contains(key);
+    }
+    heap.store(iterator_address, iterator);
+    operand_stack.push(found ? key : u64{0});
+    operand_stack.push(static_cast<i64>(found));
+}
+
+void string_concat(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+
+    u64 y = operand_stack.pop<u64>();
+    u64 x = operand_stack.pop<u64>();
+    operand_stack.push(concat_strings(runtime.get_heap(), *runtime.get_configuration().string_type, x, y));
+}
+
+void string_equal(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+
+    u64 y = operand_stack.pop<u64>();
+    u64 x = operand_stack.pop<u64>();
+    operand_stack.push(static_cast<i64>(strings_equal(runtime.get_heap(), x, y)));
+}
+
+/* pushes a negative, zero or positive int for the integer comparisons to test */
+void string_compare(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+
+    u64 y = operand_stack.pop<u64>();
+    u64 x = operand_stack.pop<u64>();
+    i64 order = compare_strings(runtime.get_heap(), x, y);
+    operand_stack.push(static_cast<i64>((order > 0) - (order < 0)));
+}
+
+/* a string indexes to the int value of a byte */
+void string_index(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+
+    i64 index = operand_stack.pop<i64>();
+    auto bytes = view_string(runtime.get_heap(), operand_stack.pop<u64>());
+    if (index < 0 || static_cast<u64>(index) >= bytes.size()) {
+        throw std::runtime_error(
+            "index " + std::to_string(index) + " out of range for length " + std::to_string(bytes.size()) + "!");
+    }
+    operand_stack.push(static_cast<i64>(static_cast<u8>(bytes[index])));
+}
+
+/* the operand stack holds the string, then the low and the high bound */
+void string_slice(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+
+    i64 high = operand_stack.pop<i64>();
+    i64 low = operand_stack.pop<i64>();
+    u64 address = operand_stack.pop<u64>();
+    operand_stack.push(substring(runtime.get_heap(), *runtime.get_configuration().string_type, address, low, high));
+}
+
+void string_intern(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+
+    u64 address = operand_stack.pop<u64>();
+    const auto& string_type = *runtime.get_configuration().string_type;
+    operand_stack.push(runtime.get_string_interner().intern(runtime.get_heap(), string_type, address));
+}
+
+/*
+ * A deferred call of a function whose defer statements can run more than
+ * once. The operand stack holds the record it is linked in front of, the
+ * defer statement, its values and their count on top.
+ */
+void new_defer_record(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+    auto& free_records = thread.get_free_defer_records();
+
+    u64 count = operand_stack.pop<u64>();
+    u64 record_address;
+    if (count + 2 < free_records.size() && free_records[count + 2] != 0) {
+        record_address = free_records[count + 2];
+        free_records[count + 2] = heap.load<u64>(record_address);
+    } else {
+        record_address = heap.allocate(*runtime.get_configuration().slice_type, count + 2);
+    }
+    for (u64 i = count + 2; i-- > 0;) {
+        heap.store(record_address + sizeof(Word) * i, operand_stack.pop<u64>());
+    }
+    operand_stack.push(record_address);
+}
+
+/*
+ * Unlinks the record on top before its call runs, leaving the next one.
+ * Its values are already on the operand stack, so the record is kept for
+ * the next defer statement of the goroutine with as many values.
+ */
+void release_defer_record(Runtime& runtime, Thread& thread)
+{
+    auto& operand_stack = thread.get_operand_stack();
+    auto& heap = runtime.get_heap();
+    auto& free_records = thread.get_free_defer_records();
+
+    u64 record_address = operand_stack.pop<u64>();
+    u64 next_address = heap.load<u64>(record_address);
+    u64 word_count = heap.access_block_header(record_address).count;
+    if (word_count >= free_records.size()) {
+        free_records.resize(word_count + 1, 0);
+    }
+    heap.store(record_address, free_records[word_count]);
+    free_records[word_count] = record_address;
+    operand_stack.push(next_address);
+}
+
+struct NativeBinding
+{
+    std::string_view name;
+    NativeFunction function;
+};
+
+static const NativeBinding native_bindings[] = {
+    {"new_thread", new_thread},
+    {"new_chan", new_chan},
+    {"chan_send", chan_send},
+    {"chan_recv", chan_recv},
+    {"chan_select", chan_select},
+    {"chan_close", chan_close},
+    {"chan_recv_ok", chan_recv_ok},
+    {"chan_range", chan_range},
+    {"chan_range_next", chan_range_next},
+    {"new_slice", new_slice},
+    {"slice_append", slice_append},
+    {"slice_copy", slice_copy},
+    {"slice_slice", slice_slice},
+    {"slice_sum_int", slice_sum_int},
+    {"slice_sum_float", slice_sum_float},
+    {"slice_min_int", slice_min_int},
+    {"slice_min_float", slice_min_float},
+    {"slice_max_int", slice_max_int},
+    {"slice_max_float", slice_max_float},
+    {"slice_dot_int", slice_dot_int},
+    {"slice_dot_float", slice_dot_float},
+    {"slice_add_int", slice_add_int},
+    {"slice_add_float", slice_add_float},
+    {"slice_mul_int", slice_mul_int},
+    {"slice_mul_float", slice_mul_float},
+    {"slice_index_int", slice_index_int},
+    {"slice_index_float", slice_index_float},
+    {"slice_fill", slice_fill},
+    {"new_struct_slice", new_struct_slice},
+    {"new_map", new_map},
+    {"map_get", map_get},
+    {"map_set", map_set},
+    {"map_delete", map_delete},
+    {"map_range", map_range},
+    {"map_range_next", map_range_next},
+    {"string_concat", string_concat},
+    {"string_equal", string_equal},
+    {"string_compare", string_compare},
+    {"string_index", string_index},
+    {"string_slice", string_slice},
+    {"string_intern", string_intern},
+    {"new_defer_record", new_defer_record},
+    {"release_defer_record", release_defer_record},
+};
+
+NativeFunction find_native_function(std::string_view name)
+{
+    for (const auto& binding : native_bindings) {
+        if (binding.name == name) {
+            return binding.function;
+        }
+    }
+    if (auto native = get_native_registry().find(name); native) {
+        return native->function;
+    }
+    throw std::runtime_error("unknown native function '" + std::string{name} + "'!");
+}
+
+std::string_view get_native_function_name(NativeFunction function)
+{
+    for (const auto& binding : native_bindings) {
+        if (binding.function == function) {
+            return binding.name;
+        }
+    }
+    if (auto native = get_native_registry().find(function); native) {
+        return native->name;
+    }
+    throw std::runtime_error("native function has no name!");
 }
@@ -1,6 +1,11 @@
 #ifndef NATIVE_HPP
 #define NATIVE_HPP
 
+#include <string_view>
+
+#include "Code.hpp"
+
+class NativeRegistry;
 class Runtime;
 class Thread;
 
@@ -8,9 +13,51 @@ void new_thread(Runtime& runtime, Thread& thread);
 void new_chan(Runtime& runtime, Thread& thread);
 void chan_send(Runtime& runtime, Thread& thread);
 void chan_recv(Runtime& runtime, Thread& thread);
-void sprint(Runtime& runtime, Thread& thread);
-void iprint(Runtime& runtime, Thread& thread);
-void fprint(Runtime& runtime, Thread& thread);
+void chan_select(Runtime& runtime, Thread& thread);
+void chan_close(Runtime& runtime, Thread& thread);
+void chan_recv_ok(Runtime& runtime, Thread& thread);
+void chan_range(Runtime& runtime, Thread& thread);
+void chan_range_next(Runtime& runtime, Thread& thread);
 void new_slice(Runtime& runtime, Thread& thread);
+void new_struct_slice(Runtime& runtime, Thread& thread);
+void slice_append(Runtime& runtime, Thread& thread);
+void slice_copy(Runtime& runtime, Thread& thread);
+void slice_slice(Runtime& runtime, Thread& thread);
+void slice_sum_int(Runtime& runtime, Thread& thread);
+void slice_sum_float(Runtime& runtime, Thread& thread);
+void slice_min_int(Runtime& runtime, Thread& thread);
+void slice_min_float(Runtime& runtime, Thread& thread);
+void slice_max_int(Runtime& runtime, Thread& thread);
+void slice_max_float(Runtime& runtime, Thread& thread);
+void slice_dot_int(Runtime& runtime, Thread& thread);
+void slice_dot_float(Runtime& runtime, Thread& thread);
+void slice_add_int(Runtime& runtime, Thread& thread);
+void slice_add_float(Runtime& runtime, Thread& thread);
+void slice_mul_int(Runtime& runtime, Thread& thread);
+void slice_mul_float(Runtime& runtime, Thread& thread);
+void slice_index_int(Runtime& runtime, Thread& thread);
+void slice_index_float(Runtime& runtime, Thread& thread);
+void slice_fill(Runtime& runtime, Thread& thread);
+void new_map(Runtime& runtime, Thread& thread);
+void map_get(Runtime& runtime, Thread& thread);
+void map_set(Runtime& runtime, Thread& thread);
+void map_delete(Runtime& runtime, Thread& thread);
+void map_range(Runtime& runtime, Thread& thread);
+void map_range_next(Runtime& runtime, Thread& thread);
+void string_concat(Runtime& runtime, Thread& thread);
+void string_equal(Runtime& runtime, Thread& thread);
+void string_compare(Runtime& runtime, Thread& thread);
+void string_index(Runtime& runtime, Thread& thread);
+void string_slice(Runtime& runtime, Thread& thread);
+void string_intern(Runtime& runtime, Thread& thread);
+void new_defer_record(Runtime& runtime, Thread& thread);
+void release_defer_record(Runtime& runtime, Thread& thread);
+
+/* sprint, iprint, fprint, itoa and the math natives */
+void register_builtin_natives(NativeRegistry& registry);
+
+/* natives are stored by name in images, typed natives by the name they were registered under */
+NativeFunction find_native_function(std::string_view name);
+std::string_view get_native_function_name(NativeFunction function);
 
 #endif
@@ -0,0 +1,55 @@
+#include "Native.hpp"
+#include "NativeRegistry.hpp"
+#include "Runtime.hpp"
+#include "Strings.hpp"
+#include "Thread.hpp"
+
+std::string_view view_native_string(Runtime& runtime, Word word)
+{
+    return view_string(runtime.get_heap(), bitcast<Word, u64>(word));
+}
+
+Word new_native_string(Runtime& runtime, std::string_view bytes)
+{
+    return bitcast<u64, Word>(new_string(runtime.get_heap(), *runtime.get_configuration().string_type, bytes));
+}
+
+const Word* pop_native_arguments(Thread& thread, u64 count)
+{
+    return thread.get_operand_stack().pop_words(count);
+}
+
+void push_native_result(Thread& thread, Word result)
+{
+    thread.get_operand_stack().push(result);
+}
+
+const TypedNative* NativeRegistry::find(std::string_view name) const
+{
+    for (const auto& native : natives) {
+        if (native.name == name) {
+            return &native;
+        }
+    }
+    return nullptr;
+}
+
+const TypedNative* NativeRegistry::find(NativeFunction function) const
+{
+    for (const auto& native : natives) {
+        if (native.function == function) {
+            return &native;
+        }
+    }
+    return nullptr;
+}
+
+NativeRegistry& get_native_registry()
+{
+    static NativeRegistry registry = [] {
+        NativeRegistry builtin_registry;
+        register_builtin_natives(builtin_registry);
+        return builtin_registry;
+    }();
+    return registry;
+}
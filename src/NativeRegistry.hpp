@@ -0,0 +1,208 @@
+#ifndef NATIVE_REGISTRY_HPP
+#define NATIVE_REGISTRY_HPP
+
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Code.hpp"
+#include "Common.hpp"
+
+/*
+ * Natives written as plain C++ functions, such as f64(f64) or
+ * void(Runtime&, i64). The marshalling between words and the parameter and
+ * result types is generated from the signature, which the type annotator
+ * also sees as the function type of the native. A call compiles to
+ * invoke_typed, which hands the typed native its arguments where they lie
+ * on the operand stack; the native behind invoke_native, which images and
+ * counters know the native by, pops them and calls the same code.
+ *
+ * Embedders register natives before compiling or loading an image:
+ *
+ *     get_native_registry().add<my_function>("name");
+ *
+ * A function may take the Runtime first. int, float, bool and
+ * std::string_view parameters are supported, and int, float, bool and
+ * std::string results, a string result copied into a new string.
+ */
+
+template <typename T>
+struct NativeValue;
+
+template <>
+struct NativeValue<i64>
+{
+    static constexpr std::string_view type_name = "int";
+    static i64 from_word(Runtime&, Word word) { return bitcast<Word, i64>(word); }
+    static Word to_word(Runtime&, i64 value) { return bitcast<i64, Word>(value); }
+};
+
+template <>
+struct NativeValue<f64>
+{
+    static constexpr std::string_view type_name = "float";
+    static f64 from_word(Runtime&, Word word) { return bitcast<Word, f64>(word); }
+    static Word to_word(Runtime&, f64 value) { return bitcast<f64, Word>(value); }
+};
+
+/* bools are the words 0 and 1 */
+template <>
+struct NativeValue<bool>
+{
+    static constexpr std::string_view type_name = "bool";
+    static bool from_word(Runtime&, Word word) { return bitcast<Word, u64>(word) != 0; }
+    static Word to_word(Runtime&, bool value) { return bitcast<u64, Word>(value); }
+};
+
+/* the bytes stay valid, strings are immutable and never moved */
+std::string_view view_native_string(Runtime& runtime, Word word);
+Word new_native_string(Runtime& runtime, std::string_view bytes);
+
+template <>
+struct NativeValue<std::string_view>
+{
+    static constexpr std::string_view type_name = "string";
+    static std::string_view from_word(Runtime& runtime, Word word) { return view_native_string(runtime, word); }
+};
+
+template <>
+struct NativeValue<std::string>
+{
+    static constexpr std::string_view type_name = "string";
+    static Word to_word(Runtime& runtime, const std::string& value) { return new_native_string(runtime, value); }
+};
+
+template <typename F>
+struct NativeTraits;
+
+template <typename R, typename... Args>
+struct NativeTraits<R (*)(Args...)>
+{
+    static constexpr u64 argc = sizeof...(Args);
+    static constexpr bool returns = !std::is_void_v<R>;
+
+    template <auto function, u64... I>
+    static Word call(Runtime& runtime, const Word* arguments, std::index_sequence<I...>)
+    {
+        if constexpr (returns) {
+            return NativeValue<R>::to_word(runtime, function(NativeValue<std::decay_t<Args>>::from_word(runtime, arguments[I])...));
+        } else {
+            function(NativeValue<std::decay_t<Args>>::from_word(runtime, arguments[I])...);
+            return Word{};
+        }
+    }
+
+    static std::vector<std::string_view> parameter_types()
+    {
+        return {NativeValue<std::decay_t<Args>>::type_name...};
+    }
+
+    static std::string_view result_type()
+    {
+        if constexpr (returns) {
+            return NativeValue<R>::type_name;
+        } else {
+            return {};
+        }
+    }
+};
+
+/* the Runtime is passed through, it is no parameter of the GOatLANG function */
+template <typename R, typename... Args>
+struct NativeTraits<R (*)(Runtime&, Args...)> : NativeTraits<R (*)(Args...)>
+{
+    template <auto function, u64... I>
+    static Word call(Runtime& runtime, const Word* arguments, std::index_sequence<I...>)
+    {
+        if constexpr (!std::is_void_v<R>) {
+            return NativeValue<R>::to_word(runtime, function(runtime, NativeValue<std::decay_t<Args>>::from_word(runtime, arguments[I])...));
+        } else {
+            function(runtime, NativeValue<std::decay_t<Args>>::from_word(runtime, arguments[I])...);
+            return Word{};
+        }
+    }
+};
+
+template <auto function>
+Word call_typed_native(Runtime& runtime, const Word* arguments)
+{
+    using Traits = NativeTraits<decltype(function)>;
+    return Traits::template call<function>(runtime, arguments, std::make_index_sequence<Traits::argc>{});
+}
+
+/* the arguments popped, readable in place until the next push */
+const Word* pop_native_arguments(Thread& thread, u64 count);
+void push_native_result(Thread& thread, Word result);
+
+template <auto function>
+void call_native_from_stack(Runtime& runtime, Thread& thread)
+{
+    using Traits = NativeTraits<decltype(function)>;
+    Word result = call_typed_native<function>(runtime, pop_native_arguments(thread, Traits::argc));
+    if constexpr (Traits::returns) {
+        push_native_result(thread, result);
+    }
+}
+
+/* what invoke_typed needs of a typed native */
+struct TypedNativeCall
+{
+    TypedNativeFunction function = nullptr;
+    u64 argc = 0;
+    bool returns = false;
+};
+
+struct TypedNative
+{
+    std::string name;
+    std::vector<std::string_view> parameter_types;
+    /* empty when the native returns nothing */
+    std::string_view result_type;
+    NativeFunction function;
+    TypedNativeCall call;
+};
+
+class NativeRegistry
+{
+    /* a deque, so the natives found stay where they are while more are added */
+    std::deque<TypedNative> natives;
+
+public:
+    template <auto function>
+    void add(std::string name)
+    {
+        using Traits = NativeTraits<decltype(function)>;
+        if (find(name)) {
+            throw std::runtime_error("native function '" + name + "' is already registered!");
+        }
+        natives.push_back(TypedNative{
+            .name = std::move(name),
+            .parameter_types = Traits::parameter_types(),
+            .result_type = Traits::result_type(),
+            .function = call_native_from_stack<function>,
+            .call = TypedNativeCall{
+                .function = call_typed_native<function>,
+                .argc = Traits::argc,
+                .returns = Traits::returns,
+            },
+        });
+    }
+
+    const std::deque<TypedNative>& get_natives() const
+    {
+        return natives;
+    }
+
+    /* null when there is no typed native of the name */
+    const TypedNative* find(std::string_view name) const;
+    const TypedNative* find(NativeFunction function) const;
+};
+
+/* the natives of every compilation and image, the builtin ones registered first */
+NativeRegistry& get_native_registry();
+
+#endif /* NATIVE_REGISTRY_HPP */
@@ -1,6 +1,7 @@
 #ifndef OPERAND_STACK_HPP
 #define OPERAND_STACK_HPP
 
+#include <algorithm>
 #include <memory>
 #include <stdexcept>
 
@@ -15,14 +16,17 @@ public:
     OperandStack& operator=(const OperandStack&) = delete;
     OperandStack& operator=(OperandStack&&) = default;
 
-    OperandStack(u64 stack_size) : managed_memory{std::make_unique<std::byte[]>(stack_size)},
-                                   memory{managed_memory.get()},
-                                   size{stack_size},
-                                   top{0}
+    OperandStack(u64 initial_size, u64 max_size) : managed_memory{std::make_unique<std::byte[]>(initial_size)},
+                                                   memory{managed_memory.get()},
+                                                   size{initial_size},
+                                                   initial_size{initial_size},
+                                                   max_size{max_size},
+                                                   top{0}
     {
     }
 
     u64 get_size() const { return size; }
+    u64 get_max_size() const { return max_size; }
 
     template <typename T>
     T pop()
@@ -35,14 +39,15 @@ public:
         return read<T>(memory, top);
     }
 
+    /* the word depth words below the top */
     template <typename T>
-    T peek()
+    T peek(u64 depth = 0)
     {
         static_assert(sizeof(T) == sizeof(Word), "T must have the same size as Word");
-        if (top == 0) {
+        if (top < sizeof(Word) * (depth + 1)) {
             throw std::runtime_error("operand stack underflow!");
         }
-        return read<T>(memory, top - sizeof(T));
+        return read<T>(memory, top - sizeof(Word) * (depth + 1));
     }
 
     template <typename T>
@@ -50,16 +55,80 @@ public:
     {
         static_assert(sizeof(T) == sizeof(Word), "T must have the same size as Word");
         if (top >= size) {
-            throw std::runtime_error("operand stack overflow!");
+            grow();
         }
         write(memory, top, value);
         top += sizeof(T);
     }
 
+    /* moves the top count words of source onto this stack, preserving their order */
+    void transfer(OperandStack& source, u64 count)
+    {
+        u64 transfer_size = sizeof(Word) * count;
+        if (source.top < transfer_size) {
+            throw std::runtime_error("operand stack underflow!");
+        }
+        while (top + transfer_size > size) {
+            grow();
+        }
+        source.top -= transfer_size;
+        std::memcpy(memory + top, source.memory + source.top, transfer_size);
+        top += transfer_size;
+    }
+
+    /* pops the top count words into destination, preserving their order */
+    void pop_into(Word* destination, u64 count)
+    {
+        u64 pop_size = sizeof(Word) * count;
+        if (top < pop_size) {
+            throw std::runtime_error("operand stack underflow!");
+        }
+        top -= pop_size;
+        std::memcpy(destination, memory + top, pop_size);
+    }
+
+    /* pops the top count words, which stay where they are until the next push */
+    const Word* pop_words(u64 count)
+    {
+        u64 pop_size = sizeof(Word) * count;
+        if (top < pop_size) {
+            throw std::runtime_error("operand stack underflow!");
+        }
+        top -= pop_size;
+        return reinterpret_cast<const Word*>(memory + top);
+    }
+
+    void reset()
+    {
+        top = 0;
+        if (size != initial_size) {
+            resize(initial_size);
+        }
+    }
+
 private:
+    void grow()
+    {
+        if (size >= max_size) {
+            throw std::runtime_error("operand stack overflow!");
+        }
+        resize(std::min(size * 2, max_size));
+    }
+
+    void resize(u64 new_size)
+    {
+        auto new_memory = std::make_unique<std::byte[]>(new_size);
+        std::memcpy(new_memory.get(), memory, top);
+        managed_memory = std::move(new_memory);
+        memory = managed_memory.get();
+        size = new_size;
+    }
+
     std::unique_ptr<std::byte[]> managed_memory;
     std::byte* memory;
     u64 size;
+    u64 initial_size;
+    u64 max_size;
     u64 top;
 };
 
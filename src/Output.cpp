@@ -0,0 +1,130 @@
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "Output.hpp"
+
+Output::Output(int fd, u64 batch_size, u64 flush_interval) : fd{fd},
+                                                             batch_size{batch_size},
+                                                             max_pending{batch_size * 16},
+                                                             flush_interval{flush_interval}
+{
+    pending.reserve(batch_size);
+    writing.reserve(batch_size);
+}
+
+Output::~Output()
+{
+    stop();
+}
+
+void Output::start()
+{
+    {
+        std::lock_guard lock{mutex};
+        flushing = true;
+        stopping = false;
+    }
+    flusher = std::thread{[this]() { run_flusher(); }};
+}
+
+void Output::stop()
+{
+    if (flusher.joinable()) {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        flush_condition.notify_one();
+        flusher.join();
+        {
+            std::lock_guard lock{mutex};
+            flushing = false;
+        }
+        drained_condition.notify_all();
+    }
+    flush();
+}
+
+void Output::flush()
+{
+    std::lock_guard write_lock{write_mutex};
+    {
+        std::lock_guard lock{mutex};
+        writing.swap(pending);
+    }
+    drained_condition.notify_all();
+    write_all(writing);
+    writing.clear();
+}
+
+void Output::write_line(std::string_view line)
+{
+    bool full;
+    {
+        std::unique_lock lock{mutex};
+        if (flushing) {
+            drained_condition.wait(lock, [this]() { return pending.size() < max_pending || !flushing; });
+        }
+        bool was_empty = pending.empty();
+        pending.append(line);
+        pending.push_back('\n');
+        /* the first line starts the flush interval, a full batch cuts it short */
+        full = was_empty || pending.size() >= batch_size;
+    }
+    if (full) {
+        flush_condition.notify_one();
+    }
+}
+
+void Output::write_integer(i64 value)
+{
+    char buffer[24];
+    auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    write_line(std::string_view{buffer, static_cast<std::size_t>(end - buffer)});
+}
+
+/* same digits as printing a double to an iostream with default flags */
+void Output::write_float(f64 value)
+{
+    char buffer[32];
+    auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::general, 6);
+    write_line(std::string_view{buffer, static_cast<std::size_t>(end - buffer)});
+}
+
+void Output::run_flusher()
+{
+    auto interval = std::chrono::microseconds{flush_interval};
+    std::unique_lock lock{mutex};
+    while (true) {
+        flush_condition.wait(lock, [this]() { return !pending.empty() || stopping; });
+        if (stopping) {
+            return;
+        }
+        /* give the batch time to fill up unless it already has */
+        flush_condition.wait_for(lock, interval, [this]() { return pending.size() >= batch_size || stopping; });
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+void Output::write_all(const std::string& bytes)
+{
+    const char* data = bytes.data();
+    u64 remaining = bytes.size();
+    while (remaining != 0) {
+        ssize_t written = ::write(fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("failed to write output!");
+        }
+        data += written;
+        remaining -= written;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "Common.hpp"
+
+/*
+ * Buffered standard output shared by all goroutines. A print formats its
+ * line on the printing thread, then appends the whole line to the pending
+ * buffer under a short lock, so lines from different goroutines never
+ * interleave and a goroutine's lines keep their order. A flusher thread
+ * hands the pending bytes to write(2) in large batches: once batch_size
+ * bytes have piled up, or flush_interval microseconds after the first one.
+ * Writers wait for the flusher when the backlog grows past max_pending.
+ */
+class Output
+{
+public:
+    Output() = default;
+    Output(const Output&) = delete;
+    Output(Output&&) = delete;
+    Output& operator=(const Output&) = delete;
+    Output& operator=(Output&&) = delete;
+
+    Output(int fd, u64 batch_size, u64 flush_interval);
+    ~Output();
+
+    void start();
+    /* flushes everything and joins the flusher */
+    void stop();
+    /* writes out everything appended so far before returning */
+    void flush();
+
+    void write_line(std::string_view line);
+    void write_integer(i64 value);
+    void write_float(f64 value);
+
+private:
+    void run_flusher();
+    void write_all(const std::string& bytes);
+
+    int fd = 1;
+    u64 batch_size = 0;
+    u64 max_pending = 0;
+    u64 flush_interval = 0;
+
+    std::mutex mutex;
+    std::condition_variable flush_condition;
+    std::condition_variable drained_condition;
+    std::string pending;
+    bool flushing = false;
+    bool stopping = false;
+
+    /* held while writing so a synchronous flush can't overtake the flusher */
+    std::mutex write_mutex;
+    std::string writing;
+    std::thread flusher;
+};
+
+#endif /* OUTPUT_HPP */
@@ -0,0 +1,830 @@
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Parser.hpp"
+
+static int get_binary_precedence(TokenKind kind)
+{
+    switch (kind) {
+        case TokenKind::lor:
+            return 1;
+        case TokenKind::land:
+            return 2;
+        case TokenKind::eq:
+        case TokenKind::ne:
+        case TokenKind::lt:
+        case TokenKind::le:
+        case TokenKind::gt:
+        case TokenKind::ge:
+            return 3;
+        case TokenKind::add:
+        case TokenKind::sub:
+        case TokenKind::or_:
+        case TokenKind::xor_:
+            return 4;
+        case TokenKind::mul:
+        case TokenKind::div:
+        case TokenKind::rem:
+        case TokenKind::shl:
+        case TokenKind::shr:
+        case TokenKind::and_:
+            return 5;
+        default:
+            return 0;
+    }
+}
+
+static Operator get_binary_operator(TokenKind kind)
+{
+    switch (kind) {
+        case TokenKind::lor:
+            return Operator::lor;
+        case TokenKind::land:
+            return Operator::land;
+        case TokenKind::eq:
+            return Operator::eq;
+        case TokenKind::ne:
+            return Operator::ne;
+        case TokenKind::lt:
+            return Operator::lt;
+        case TokenKind::le:
+            return Operator::le;
+        case TokenKind::gt:
+            return Operator::gt;
+        case TokenKind::ge:
+            return Operator::ge;
+        case TokenKind::add:
+            return Operator::add;
+        case TokenKind::sub:
+            return Operator::sub;
+        case TokenKind::or_:
+            return Operator::or_;
+        case TokenKind::xor_:
+            return Operator::xor_;
+        case TokenKind::mul:
+            return Operator::mul;
+        case TokenKind::div:
+            return Operator::div;
+        case TokenKind::rem:
+            return Operator::rem;
+        case TokenKind::shl:
+            return Operator::shl;
+        case TokenKind::shr:
+            return Operator::shr;
+        default:
+            return Operator::and_;
+    }
+}
+
+Parser::Parser(std::string_view source, AstArena& arena) : lexer{source},
+                                                          arena{arena}
+{
+    token = lexer.next();
+    lookahead = lexer.next();
+}
+
+void Parser::error(const char* expected)
+{
+    std::string message = std::string{"parser: expected "} + expected + ", found ";
+    if (token.kind == TokenKind::end) {
+        message += get_token_kind_name(token.kind);
+    } else {
+        message += "'";
+        message += token.text;
+        message += "'";
+    }
+    throw SourceError(token.line, message);
+}
+
+void Parser::advance()
+{
+    token = lookahead;
+    if (token.kind != TokenKind::end) {
+        lookahead = lexer.next();
+    }
+}
+
+Token Parser::expect(TokenKind kind)
+{
+    if (token.kind != kind) {
+        error(get_token_kind_name(kind));
+    }
+    Token result = token;
+    advance();
+    return result;
+}
+
+bool Parser::accept(TokenKind kind)
+{
+    if (token.kind != kind) {
+        return false;
+    }
+    advance();
+    return true;
+}
+
+bool Parser::starts_expression() const
+{
+    switch (token.kind) {
+        case TokenKind::identifier:
+        case TokenKind::int_lit:
+        case TokenKind::float_lit:
+        case TokenKind::string_lit:
+        case TokenKind::lparen:
+        case TokenKind::lbracket:
+        case TokenKind::func_:
+        case TokenKind::struct_:
+        case TokenKind::map_:
+        case TokenKind::chan_:
+        case TokenKind::add:
+        case TokenKind::sub:
+        case TokenKind::not_:
+        case TokenKind::xor_:
+        case TokenKind::mul:
+        case TokenKind::and_:
+        case TokenKind::arrow:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* '<-' only starts a type when 'chan' follows, which callers check if they can */
+bool Parser::starts_type(TokenKind kind) const
+{
+    switch (kind) {
+        case TokenKind::identifier:
+        case TokenKind::lparen:
+        case TokenKind::mul:
+        case TokenKind::lbracket:
+        case TokenKind::chan_:
+        case TokenKind::arrow:
+        case TokenKind::func_:
+        case TokenKind::struct_:
+        case TokenKind::map_:
+            return true;
+        default:
+            return false;
+    }
+}
+
+SourceFileNode* Parser::parse_source_file()
+{
+    auto source_file = arena.make<SourceFileNode>(token.line);
+    std::vector<Node*> declarations;
+    while (token.kind != TokenKind::end) {
+        if (token.kind == TokenKind::var_) {
+            declarations.push_back(parse_var_decl());
+        } else if (token.kind == TokenKind::func_) {
+            declarations.push_back(parse_function_decl());
+        } else {
+            error("'func' or 'var'");
+        }
+    }
+    source_file->declarations = arena.copy(declarations);
+    source_file->node_count = arena.get_node_count();
+    return source_file;
+}
+
+FunctionDeclNode* Parser::parse_function_decl()
+{
+    auto function_decl = arena.make<FunctionDeclNode>(token.line);
+    expect(TokenKind::func_);
+    function_decl->name = arena.copy(expect(TokenKind::identifier).text);
+    function_decl->function = parse_function(parse_signature());
+    return function_decl;
+}
+
+VarDeclNode* Parser::parse_var_decl()
+{
+    auto var_decl = arena.make<VarDeclNode>(token.line);
+    expect(TokenKind::var_);
+    var_decl->name = arena.copy(expect(TokenKind::identifier).text);
+    var_decl->type = parse_type();
+    if (accept(TokenKind::assign)) {
+        var_decl->value = parse_expression();
+    }
+    return var_decl;
+}
+
+FunctionNode* Parser::parse_function(SignatureNode* signature)
+{
+    auto function = arena.make<FunctionNode>(signature->line);
+    function->signature = signature;
+    function->body = parse_block();
+    return function;
+}
+
+SignatureNode* Parser::parse_signature()
+{
+    auto signature = arena.make<SignatureNode>(token.line);
+    expect(TokenKind::lparen);
+    std::vector<ParameterDeclNode*> parameters;
+    if (token.kind != TokenKind::rparen) {
+        do {
+            parameters.push_back(parse_parameter_decl());
+        } while (accept(TokenKind::comma));
+    }
+    expect(TokenKind::rparen);
+    signature->parameters = arena.copy(parameters);
+    if (starts_type(token.kind) && (token.kind != TokenKind::arrow || lookahead.kind == TokenKind::chan_)) {
+        signature->result = parse_type();
+    }
+    return signature;
+}
+
+ParameterDeclNode* Parser::parse_parameter_decl()
+{
+    auto parameter_decl = arena.make<ParameterDeclNode>(token.line);
+    /* a name is only a name when a type follows it, otherwise it is the type */
+    if (token.kind == TokenKind::identifier && starts_type(lookahead.kind)) {
+        parameter_decl->name = arena.copy(token.text);
+        advance();
+    }
+    parameter_decl->type = parse_type();
+    return parameter_decl;
+}
+
+BlockNode* Parser::parse_block()
+{
+    auto block = arena.make<BlockNode>(token.line);
+    bool saved_composite_allowed = composite_allowed;
+    composite_allowed = true;
+    expect(TokenKind::lbrace);
+    block->statements = parse_statement_list();
+    expect(TokenKind::rbrace);
+    composite_allowed = saved_composite_allowed;
+    return block;
+}
+
+std::span<Node*> Parser::parse_statement_list()
+{
+    std::vector<Node*> statements;
+    while (token.kind != TokenKind::rbrace && token.kind != TokenKind::case_ &&
+           token.kind != TokenKind::default_ && token.kind != TokenKind::end) {
+        statements.push_back(parse_statement());
+    }
+    return arena.copy(statements);
+}
+
+Node* Parser::parse_statement()
+{
+    u32 line = token.line;
+    switch (token.kind) {
+        case TokenKind::var_:
+            return parse_var_decl();
+        case TokenKind::go_: {
+            auto go_stmt = arena.make<GoStmtNode>(line);
+            advance();
+            go_stmt->expression = parse_expression();
+            return go_stmt;
+        }
+        case TokenKind::return_: {
+            auto return_stmt = arena.make<ReturnStmtNode>(line);
+            advance();
+            /* an identifier that starts the next statement is not returned */
+            bool starts_statement = token.kind == TokenKind::identifier &&
+                                    (lookahead.kind == TokenKind::assign ||
+                                     lookahead.kind == TokenKind::colon ||
+                                     lookahead.kind == TokenKind::comma);
+            if (starts_expression() && !starts_statement) {
+                return_stmt->value = parse_expression();
+            }
+            return return_stmt;
+        }
+        case TokenKind::goto_: {
+            auto goto_stmt = arena.make<GotoStmtNode>(line);
+            advance();
+            goto_stmt->label = arena.copy(expect(TokenKind::identifier).text);
+            return goto_stmt;
+        }
+        case TokenKind::defer_: {
+            auto defer_stmt = arena.make<DeferStmtNode>(line);
+            advance();
+            defer_stmt->expression = parse_expression();
+            return defer_stmt;
+        }
+        case TokenKind::lbrace:
+            return parse_block();
+        case TokenKind::if_:
+            return parse_if_stmt();
+        case TokenKind::for_:
+            return parse_for_stmt();
+        case TokenKind::select_:
+            return parse_select_stmt();
+        case TokenKind::semicolon:
+            advance();
+            return arena.make<EmptyStmtNode>(line);
+        default:
+            return parse_simple_stmt();
+    }
+}
+
+Node* Parser::parse_simple_stmt()
+{
+    u32 line = token.line;
+    if (token.kind == TokenKind::identifier) {
+        std::string_view name = token.text;
+        switch (lookahead.kind) {
+            case TokenKind::colon: {
+                auto labeled_stmt = arena.make<LabeledStmtNode>(line);
+                labeled_stmt->label = arena.copy(name);
+                advance();
+                advance();
+                labeled_stmt->statement = parse_statement();
+                return labeled_stmt;
+            }
+            case TokenKind::arrow: {
+                auto send_stmt = arena.make<SendStmtNode>(line);
+                send_stmt->channel = arena.copy(name);
+                advance();
+                advance();
+                send_stmt->value = parse_expression();
+                return send_stmt;
+            }
+            case TokenKind::assign: {
+                auto assignment_stmt = arena.make<AssignmentStmtNode>(line);
+                assignment_stmt->name = arena.copy(name);
+                advance();
+                advance();
+                assignment_stmt->value = parse_expression();
+                return assignment_stmt;
+            }
+            case TokenKind::comma: {
+                auto recv_assign_stmt = arena.make<RecvAssignStmtNode>(line);
+                recv_assign_stmt->value_name = arena.copy(name);
+                advance();
+                advance();
+                recv_assign_stmt->ok_name = arena.copy(expect(TokenKind::identifier).text);
+                if (accept(TokenKind::define)) {
+                    recv_assign_stmt->declares = true;
+                } else {
+                    expect(TokenKind::assign);
+                }
+                expect(TokenKind::arrow);
+                recv_assign_stmt->channel = parse_expression();
+                return recv_assign_stmt;
+            }
+            default:
+                break;
+        }
+    }
+    if (!starts_expression()) {
+        error("statement");
+    }
+    auto expression = parse_expression();
+    /* only known to be an element or field assignment once the operand is parsed */
+    if (token.kind == TokenKind::assign && expression->kind != NodeKind::operand_name) {
+        auto assignment_stmt = arena.make<AssignmentStmtNode>(line);
+        std::vector<std::string_view> fields;
+        while (auto field_expr = node_cast<FieldExprNode>(expression)) {
+            fields.insert(fields.begin(), field_expr->field);
+            expression = field_expr->operand;
+        }
+        if (auto index_expr = node_cast<IndexExprNode>(expression); index_expr) {
+            assignment_stmt->index = index_expr->index;
+            expression = index_expr->operand;
+        }
+        auto operand_name = node_cast<OperandNameNode>(expression);
+        if (!operand_name) {
+            error("slice or struct name");
+        }
+        assignment_stmt->name = operand_name->name;
+        assignment_stmt->fields = arena.copy(fields);
+        advance();
+        assignment_stmt->value = parse_expression();
+        return assignment_stmt;
+    }
+    auto expression_stmt = arena.make<ExpressionStmtNode>(line);
+    expression_stmt->expression = expression;
+    return expression_stmt;
+}
+
+IfStmtNode* Parser::parse_if_stmt()
+{
+    auto if_stmt = arena.make<IfStmtNode>(token.line);
+    expect(TokenKind::if_);
+    bool saved_composite_allowed = composite_allowed;
+    composite_allowed = false;
+    if_stmt->condition = parse_expression();
+    composite_allowed = saved_composite_allowed;
+    if_stmt->then_block = parse_block();
+    if (accept(TokenKind::else_)) {
+        if (token.kind == TokenKind::if_) {
+            if_stmt->else_branch = parse_if_stmt();
+        } else {
+            if_stmt->else_branch = parse_block();
+        }
+    }
+    return if_stmt;
+}
+
+ForStmtNode* Parser::parse_for_stmt()
+{
+    auto for_stmt = arena.make<ForStmtNode>(token.line);
+    expect(TokenKind::for_);
+    bool saved_composite_allowed = composite_allowed;
+    composite_allowed = false;
+    if (token.kind == TokenKind::identifier &&
+        (lookahead.kind == TokenKind::assign || lookahead.kind == TokenKind::define)) {
+        auto range_clause = arena.make<RangeClauseNode>(token.line);
+        range_clause->name = arena.copy(token.text);
+        advance();
+        range_clause->declares = token.kind == TokenKind::define;
+        advance();
+        expect(TokenKind::range_);
+        range_clause->channel = parse_expression();
+        for_stmt->range = range_clause;
+    } else if (token.kind != TokenKind::lbrace) {
+        for_stmt->condition = parse_expression();
+    }
+    composite_allowed = saved_composite_allowed;
+    for_stmt->body = parse_block();
+    return for_stmt;
+}
+
+SelectStmtNode* Parser::parse_select_stmt()
+{
+    auto select_stmt = arena.make<SelectStmtNode>(token.line);
+    expect(TokenKind::select_);
+    expect(TokenKind::lbrace);
+    std::vector<CommClauseNode*> clauses;
+    while (token.kind != TokenKind::rbrace) {
+        clauses.push_back(parse_comm_clause());
+    }
+    expect(TokenKind::rbrace);
+    select_stmt->clauses = arena.copy(clauses);
+    return select_stmt;
+}
+
+CommClauseNode* Parser::parse_comm_clause()
+{
+    auto comm_clause = arena.make<CommClauseNode>(token.line);
+    if (!accept(TokenKind::default_)) {
+        if (token.kind != TokenKind::case_) {
+            error("'case' or 'default'");
+        }
+        advance();
+        u32 line = token.line;
+        if (token.kind == TokenKind::identifier && lookahead.kind == TokenKind::arrow) {
+            auto send_stmt = arena.make<SendStmtNode>(line);
+            send_stmt->channel = arena.copy(token.text);
+            advance();
+            advance();
+            send_stmt->value = parse_expression();
+            comm_clause->send = send_stmt;
+        } else {
+            auto recv_stmt = arena.make<RecvStmtNode>(line);
+            if (token.kind == TokenKind::identifier) {
+                recv_stmt->value_name = arena.copy(token.text);
+                advance();
+                if (accept(TokenKind::comma)) {
+                    recv_stmt->ok_name = arena.copy(expect(TokenKind::identifier).text);
+                }
+                if (accept(TokenKind::define)) {
+                    recv_stmt->declares = true;
+                } else {
+                    expect(TokenKind::assign);
+                }
+            }
+            expect(TokenKind::arrow);
+            recv_stmt->channel = parse_expression();
+            comm_clause->recv = recv_stmt;
+        }
+    }
+    expect(TokenKind::colon);
+    comm_clause->statements = parse_statement_list();
+    return comm_clause;
+}
+
+Node* Parser::parse_type()
+{
+    u32 line = token.line;
+    switch (token.kind) {
+        case TokenKind::identifier: {
+            auto type_name = arena.make<TypeNameNode>(line);
+            type_name->name = arena.copy(token.text);
+            advance();
+            return type_name;
+        }
+        case TokenKind::lparen: {
+            advance();
+            auto type = parse_type();
+            expect(TokenKind::rparen);
+            return type;
+        }
+        case TokenKind::mul: {
+            auto pointer_type = arena.make<PointerTypeNode>(line);
+            advance();
+            pointer_type->element_type = parse_type();
+            return pointer_type;
+        }
+        case TokenKind::lbracket: {
+            auto slice_type = arena.make<SliceTypeNode>(line);
+            advance();
+            expect(TokenKind::rbracket);
+            slice_type->element_type = parse_type();
+            return slice_type;
+        }
+        case TokenKind::chan_: {
+            auto channel_type = arena.make<ChannelTypeNode>(line);
+            advance();
+            if (accept(TokenKind::arrow)) {
+                channel_type->direction = ChannelDirection::send;
+            }
+            channel_type->element_type = parse_type();
+            return channel_type;
+        }
+        case TokenKind::arrow: {
+            auto channel_type = arena.make<ChannelTypeNode>(line);
+            advance();
+            expect(TokenKind::chan_);
+            channel_type->direction = ChannelDirection::recv;
+            channel_type->element_type = parse_type();
+            return channel_type;
+        }
+        case TokenKind::func_: {
+            auto function_type = arena.make<FunctionTypeNode>(line);
+            advance();
+            function_type->signature = parse_signature();
+            return function_type;
+        }
+        case TokenKind::struct_:
+            return parse_struct_type();
+        case TokenKind::map_: {
+            auto map_type = arena.make<MapTypeNode>(line);
+            advance();
+            expect(TokenKind::lbracket);
+            map_type->key_type = parse_type();
+            expect(TokenKind::rbracket);
+            map_type->value_type = parse_type();
+            return map_type;
+        }
+        default:
+            error("type");
+    }
+}
+
+StructTypeNode* Parser::parse_struct_type()
+{
+    auto struct_type = arena.make<StructTypeNode>(token.line);
+    expect(TokenKind::struct_);
+    expect(TokenKind::lbrace);
+    std::vector<FieldDeclNode*> fields;
+    while (token.kind != TokenKind::rbrace) {
+        auto field_decl = arena.make<FieldDeclNode>(token.line);
+        field_decl->name = arena.copy(expect(TokenKind::identifier).text);
+        field_decl->type = parse_type();
+        fields.push_back(field_decl);
+        if (token.kind == TokenKind::semicolon) {
+            advance();
+        }
+    }
+    expect(TokenKind::rbrace);
+    struct_type->fields = arena.copy(fields);
+    return struct_type;
+}
+
+Node* Parser::parse_expression()
+{
+    return parse_binary_expr(1);
+}
+
+Node* Parser::parse_binary_expr(int min_precedence)
+{
+    u32 line = token.line;
+    return parse_binary_rest(parse_unary_expr(), line, min_precedence);
+}
+
+/* precedence climbing, every binary operator is left associative */
+Node* Parser::parse_binary_rest(Node* left, u32 line, int min_precedence)
+{
+    while (true) {
+        int precedence = get_binary_precedence(token.kind);
+        if (precedence == 0 || precedence < min_precedence) {
+            return left;
+        }
+        auto binary_expr = arena.make<BinaryExprNode>(line);
+        binary_expr->op = get_binary_operator(token.kind);
+        advance();
+        binary_expr->left = left;
+        binary_expr->right = parse_binary_expr(precedence + 1);
+        left = binary_expr;
+    }
+}
+
+Node* Parser::parse_unary_expr()
+{
+    Operator op;
+    switch (token.kind) {
+        case TokenKind::add:
+            op = Operator::plus;
+            break;
+        case TokenKind::sub:
+            op = Operator::neg;
+            break;
+        case TokenKind::not_:
+            op = Operator::not_;
+            break;
+        case TokenKind::xor_:
+            op = Operator::complement;
+            break;
+        case TokenKind::mul:
+            op = Operator::deref;
+            break;
+        case TokenKind::and_:
+            op = Operator::address;
+            break;
+        case TokenKind::arrow:
+            if (lookahead.kind == TokenKind::chan_) {
+                return parse_primary_expr();
+            }
+            op = Operator::recv;
+            break;
+        default:
+            return parse_primary_expr();
+    }
+    auto unary_expr = arena.make<UnaryExprNode>(token.line);
+    advance();
+    unary_expr->op = op;
+    unary_expr->operand = parse_unary_expr();
+    return unary_expr;
+}
+
+Node* Parser::parse_primary_expr()
+{
+    u32 line = token.line;
+    return parse_postfix(parse_operand(), line);
+}
+
+Node* Parser::parse_postfix(Node* operand, u32 line)
+{
+    while (true) {
+        if (token.kind == TokenKind::dot) {
+            advance();
+            auto field_expr = arena.make<FieldExprNode>(line);
+            field_expr->operand = operand;
+            field_expr->field = arena.copy(expect(TokenKind::identifier).text);
+            operand = field_expr;
+        } else if (token.kind == TokenKind::lbracket) {
+            advance();
+            bool saved_composite_allowed = composite_allowed;
+            composite_allowed = true;
+            Node* index = token.kind != TokenKind::colon ? parse_expression() : nullptr;
+            if (accept(TokenKind::colon)) {
+                auto slice_expr = arena.make<SliceExprNode>(line);
+                slice_expr->operand = operand;
+                slice_expr->low = index;
+                if (token.kind != TokenKind::rbracket) {
+                    slice_expr->high = parse_expression();
+                }
+                operand = slice_expr;
+            } else {
+                auto index_expr = arena.make<IndexExprNode>(line);
+                index_expr->operand = operand;
+                index_expr->index = index;
+                operand = index_expr;
+            }
+            composite_allowed = saved_composite_allowed;
+            expect(TokenKind::rbracket);
+        } else if (token.kind == TokenKind::lparen) {
+            operand = parse_call(operand, line);
+        } else {
+            return operand;
+        }
+    }
+}
+
+Node* Parser::parse_operand()
+{
+    u32 line = token.line;
+    switch (token.kind) {
+        case TokenKind::int_lit:
+        case TokenKind::float_lit:
+        case TokenKind::string_lit: {
+            auto basic_lit = arena.make<BasicLitNode>(line);
+            basic_lit->literal_kind = token.kind == TokenKind::int_lit     ? LiteralKind::int_
+                                      : token.kind == TokenKind::float_lit ? LiteralKind::float_
+                                                                           : LiteralKind::string;
+            basic_lit->text = arena.copy(token.text);
+            advance();
+            return basic_lit;
+        }
+        case TokenKind::identifier: {
+            if (lookahead.kind == TokenKind::lbrace && composite_allowed) {
+                return parse_type_led_operand(parse_type(), line);
+            }
+            auto operand_name = arena.make<OperandNameNode>(line);
+            operand_name->name = arena.copy(token.text);
+            advance();
+            return operand_name;
+        }
+        case TokenKind::lparen: {
+            advance();
+            bool saved_composite_allowed = composite_allowed;
+            composite_allowed = true;
+            auto expression = parse_expression();
+            composite_allowed = saved_composite_allowed;
+            expect(TokenKind::rparen);
+            return expression;
+        }
+        case TokenKind::lbracket:
+        case TokenKind::chan_:
+        case TokenKind::arrow:
+        case TokenKind::func_:
+        case TokenKind::struct_:
+        case TokenKind::map_:
+            return parse_type_led_operand(parse_type(), line);
+        default:
+            error("expression");
+    }
+}
+
+/* an operand spelled with a type: function literal, composite literal or cast */
+Node* Parser::parse_type_led_operand(Node* type, u32 line)
+{
+    if (token.kind == TokenKind::lbrace) {
+        if (auto function_type = node_cast<FunctionTypeNode>(type); function_type) {
+            auto function_lit = arena.make<FunctionLitNode>(line);
+            function_lit->function = parse_function(function_type->signature);
+            return function_lit;
+        }
+        if (composite_allowed || type->kind != NodeKind::type_name) {
+            auto composite_lit = arena.make<CompositeLitNode>(line);
+            composite_lit->type = type;
+            composite_lit->value = parse_literal_value();
+            return composite_lit;
+        }
+    }
+    if (token.kind == TokenKind::lparen) {
+        auto cast_expr = arena.make<CastExprNode>(line);
+        advance();
+        bool saved_composite_allowed = composite_allowed;
+        composite_allowed = true;
+        cast_expr->type = type;
+        cast_expr->operand = parse_expression();
+        composite_allowed = saved_composite_allowed;
+        expect(TokenKind::rparen);
+        return cast_expr;
+    }
+    error("'(' or '{' after type");
+}
+
+CallExprNode* Parser::parse_call(Node* callee, u32 line)
+{
+    auto call_expr = arena.make<CallExprNode>(line);
+    call_expr->callee = callee;
+    expect(TokenKind::lparen);
+    bool saved_composite_allowed = composite_allowed;
+    composite_allowed = true;
+    std::vector<Node*> arguments;
+    if (token.kind != TokenKind::rparen) {
+        bool first = true;
+        do {
+            u32 argument_line = token.line;
+            bool type_literal = token.kind == TokenKind::lbracket || token.kind == TokenKind::chan_ ||
+                                token.kind == TokenKind::func_ || token.kind == TokenKind::struct_ ||
+                                token.kind == TokenKind::map_ ||
+                                (token.kind == TokenKind::arrow && lookahead.kind == TokenKind::chan_);
+            if (first && type_literal) {
+                /* a type argument unless it turns out to start an expression */
+                auto type = parse_type();
+                if (token.kind == TokenKind::comma || token.kind == TokenKind::rparen) {
+                    call_expr->type_argument = type;
+                } else {
+                    auto operand = parse_postfix(parse_type_led_operand(type, argument_line), argument_line);
+                    arguments.push_back(parse_binary_rest(operand, argument_line, 1));
+                }
+            } else {
+                arguments.push_back(parse_expression());
+            }
+            first = false;
+        } while (accept(TokenKind::comma));
+    }
+    composite_allowed = saved_composite_allowed;
+    expect(TokenKind::rparen);
+    call_expr->arguments = arena.copy(arguments);
+    return call_expr;
+}
+
+LiteralValueNode* Parser::parse_literal_value()
+{
+    auto literal_value = arena.make<LiteralValueNode>(token.line);
+    expect(TokenKind::lbrace);
+    bool saved_composite_allowed = composite_allowed;
+    composite_allowed = true;
+    std::vector<Node*> elements;
+    while (token.kind != TokenKind::rbrace) {
+        if (token.kind == TokenKind::lbrace) {
+            elements.push_back(parse_literal_value());
+        } else {
+            elements.push_back(parse_expression());
+        }
+        accept(TokenKind::comma);
+    }
+    composite_allowed = saved_composite_allowed;
+    expect(TokenKind::rbrace);
+    literal_value->elements = arena.copy(elements);
+    return literal_value;
+}
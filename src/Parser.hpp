@@ -0,0 +1,72 @@
+#ifndef PARSER_HPP
+#define PARSER_HPP
+
+#include <string_view>
+
+#include "Ast.hpp"
+#include "Common.hpp"
+#include "Lexer.hpp"
+
+/*
+ * Recursive descent parser for GOatLANG.g4, building the tree in an arena.
+ * Where the grammar is ambiguous it picks what the ANTLR parser picks:
+ * a statement starting with an identifier is told apart by the token after
+ * it, unary operators bind tighter than any binary one, and an argument or
+ * operand is only read as a type when it starts with a type literal, so
+ * make(chan int, 1) has a type argument but int(x) is a call. As in Go, a
+ * composite literal of a bare type name is not allowed in the header of an
+ * if or for statement, where its brace would open the block.
+ */
+class Parser
+{
+public:
+    Parser(std::string_view source, AstArena& arena);
+
+    SourceFileNode* parse_source_file();
+
+private:
+    [[noreturn]] void error(const char* expected);
+    void advance();
+    Token expect(TokenKind kind);
+    bool accept(TokenKind kind);
+    bool starts_expression() const;
+    bool starts_type(TokenKind kind) const;
+
+    FunctionDeclNode* parse_function_decl();
+    VarDeclNode* parse_var_decl();
+    FunctionNode* parse_function(SignatureNode* signature);
+    SignatureNode* parse_signature();
+    ParameterDeclNode* parse_parameter_decl();
+
+    BlockNode* parse_block();
+    std::span<Node*> parse_statement_list();
+    Node* parse_statement();
+    Node* parse_simple_stmt();
+    IfStmtNode* parse_if_stmt();
+    ForStmtNode* parse_for_stmt();
+    SelectStmtNode* parse_select_stmt();
+    CommClauseNode* parse_comm_clause();
+
+    Node* parse_type();
+    StructTypeNode* parse_struct_type();
+
+    Node* parse_expression();
+    Node* parse_binary_expr(int min_precedence);
+    Node* parse_binary_rest(Node* left, u32 line, int min_precedence);
+    Node* parse_unary_expr();
+    Node* parse_primary_expr();
+    Node* parse_postfix(Node* operand, u32 line);
+    Node* parse_operand();
+    Node* parse_type_led_operand(Node* type, u32 line);
+    CallExprNode* parse_call(Node* callee, u32 line);
+    LiteralValueNode* parse_literal_value();
+
+    Lexer lexer;
+    AstArena& arena;
+    Token token;
+    Token lookahead;
+    /* cleared in if and for headers, set again inside brackets */
+    bool composite_allowed = true;
+};
+
+#endif /* PARSER_HPP */
@@ -0,0 +1,261 @@
+#include <cerrno>
+#include <csignal>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+#include <sys/time.h>
+
+#include "Profiler.hpp"
+#include "Thread.hpp"
+
+static_assert(std::atomic<u32>::is_always_lock_free, "slots are claimed in a signal handler");
+static_assert(std::atomic<u64>::is_always_lock_free, "slots are claimed in a signal handler");
+
+static std::atomic<Profiler*> active_profiler{nullptr};
+static thread_local Thread* running_thread = nullptr;
+
+static void on_profiling_signal(int)
+{
+    int saved_errno = errno;
+    Thread* thread = running_thread;
+    Profiler* profiler = active_profiler.load(std::memory_order_acquire);
+    if (thread && profiler) {
+        profiler->record(*thread);
+    }
+    errno = saved_errno;
+}
+
+static void set_profiling_timer(u64 interval)
+{
+    itimerval timer{};
+    timer.it_interval.tv_sec = interval / 1000000;
+    timer.it_interval.tv_usec = interval % 1000000;
+    timer.it_value = timer.it_interval;
+    ::setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+Profiler::Profiler(u64 rate) : interval{1000000 / std::max<u64>(std::min<u64>(rate, 1000000), 1)},
+                               slots{std::make_unique<Slot[]>(slot_count)}
+{
+}
+
+Profiler::~Profiler()
+{
+    stop();
+}
+
+void Profiler::set_running_thread(Thread* thread)
+{
+    running_thread = thread;
+}
+
+void Profiler::start(const std::vector<Function>& new_function_table)
+{
+    Profiler* expected = nullptr;
+    if (!active_profiler.compare_exchange_strong(expected, this)) {
+        throw std::runtime_error("a profiler is already running!");
+    }
+    function_table = &new_function_table;
+    start_time = std::chrono::system_clock::now();
+    steady_start_time = std::chrono::steady_clock::now();
+    collector_stopping = false;
+    collector = std::thread{[this]() { run_collector(); }};
+
+    struct sigaction action{};
+    action.sa_handler = on_profiling_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    ::sigaction(SIGPROF, &action, nullptr);
+    set_profiling_timer(interval);
+}
+
+void Profiler::stop()
+{
+    if (!collector.joinable()) {
+        return;
+    }
+    set_profiling_timer(0);
+    /* a signal still pending would otherwise end the process */
+    std::signal(SIGPROF, SIG_IGN);
+    active_profiler.store(nullptr, std::memory_order_release);
+    duration = std::chrono::steady_clock::now() - steady_start_time;
+    {
+        std::lock_guard lock{collector_mutex};
+        collector_stopping = true;
+    }
+    collector_condition.notify_all();
+    collector.join();
+    collect();
+}
+
+void Profiler::record(Thread& thread)
+{
+    auto& slot = slots[next_slot.fetch_add(1, std::memory_order_relaxed) % slot_count];
+    u32 expected = empty;
+    if (!slot.state.compare_exchange_strong(expected, writing, std::memory_order_acquire)) {
+        return;
+    }
+    slot.depth = thread.capture_stack(slot.locations, max_depth, function_table->size());
+    slot.state.store(slot.depth > 0 ? full : empty, std::memory_order_release);
+}
+
+void Profiler::run_collector()
+{
+    /* slots are emptied ten times faster than one thread can fill them */
+    auto period = std::chrono::microseconds{interval * slot_count / 10};
+    std::unique_lock lock{collector_mutex};
+    while (!collector_condition.wait_for(lock, period, [this]() { return collector_stopping; })) {
+        collect();
+    }
+}
+
+void Profiler::collect()
+{
+    for (u64 i = 0; i < slot_count; ++i) {
+        auto& slot = slots[i];
+        if (slot.state.load(std::memory_order_acquire) != full) {
+            continue;
+        }
+        ++stacks[std::vector<CodeLocation>{slot.locations, slot.locations + slot.depth}];
+        slot.state.store(empty, std::memory_order_release);
+    }
+}
+
+void Profiler::write_folded(std::ostream& stream) const
+{
+    std::map<std::string, u64> folded_stacks;
+    for (const auto& [stack, count] : stacks) {
+        std::string folded_stack;
+        for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+            if (!folded_stack.empty()) {
+                folded_stack += ';';
+            }
+            folded_stack += (*function_table)[it->function_index].name;
+        }
+        folded_stacks[folded_stack] += count;
+    }
+    for (const auto& [folded_stack, count] : folded_stacks) {
+        stream << folded_stack << ' ' << count << '\n';
+    }
+}
+
+/* the protobuf wire format, only what profile.proto needs */
+class ProtoWriter
+{
+public:
+    std::string bytes;
+
+    void put_varint(u64 value)
+    {
+        while (value >= 0x80) {
+            bytes.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<char>(value));
+    }
+
+    void put_uint(u64 field, u64 value)
+    {
+        put_varint(field << 3);
+        put_varint(value);
+    }
+
+    void put_bytes(u64 field, std::string_view value)
+    {
+        put_varint(field << 3 | 2);
+        put_varint(value.size());
+        bytes.append(value);
+    }
+
+    void put_packed(u64 field, const std::vector<u64>& values)
+    {
+        ProtoWriter packed;
+        for (u64 value : values) {
+            packed.put_varint(value);
+        }
+        put_bytes(field, packed.bytes);
+    }
+};
+
+/*
+ * Locations are a function and a line, without addresses. Functions and
+ * locations are numbered from 1 in the order samples first refer to them.
+ */
+void Profiler::write_pprof(std::ostream& stream, const std::string& source_path) const
+{
+    ProtoWriter profile;
+    std::vector<std::string_view> strings;
+    std::unordered_map<std::string_view, u64> string_indices;
+    auto intern = [&](std::string_view string) {
+        auto [it, inserted] = string_indices.try_emplace(string, strings.size());
+        if (inserted) {
+            strings.push_back(string);
+        }
+        return it->second;
+    };
+    intern("");
+
+    auto put_value_type = [&](u64 field, std::string_view type, std::string_view unit) {
+        ProtoWriter value_type;
+        value_type.put_uint(1, intern(type));
+        value_type.put_uint(2, intern(unit));
+        profile.put_bytes(field, value_type.bytes);
+    };
+    put_value_type(1, "samples", "count");
+    put_value_type(1, "cpu", "nanoseconds");
+
+    u64 period = interval * 1000;
+    std::map<u64, u64> function_ids;
+    std::map<std::pair<u64, u64>, u64> location_ids;
+    for (const auto& [stack, count] : stacks) {
+        std::vector<u64> sample_location_ids;
+        for (const auto& location : stack) {
+            const auto& function = (*function_table)[location.function_index];
+            auto key = std::pair{location.function_index, function.get_line(location.program_counter)};
+            auto [it, inserted] = location_ids.try_emplace(key, location_ids.size() + 1);
+            sample_location_ids.push_back(it->second);
+            function_ids.try_emplace(location.function_index, function_ids.size() + 1);
+        }
+        ProtoWriter sample;
+        sample.put_packed(1, sample_location_ids);
+        sample.put_packed(2, {count, count * period});
+        profile.put_bytes(2, sample.bytes);
+    }
+
+    for (const auto& [key, id] : location_ids) {
+        const auto& [function_index, line_number] = key;
+        ProtoWriter line;
+        line.put_uint(1, function_ids.at(function_index));
+        line.put_uint(2, line_number);
+        ProtoWriter location;
+        location.put_uint(1, id);
+        location.put_bytes(4, line.bytes);
+        profile.put_bytes(4, location.bytes);
+    }
+
+    for (const auto& [function_index, id] : function_ids) {
+        const auto& function = (*function_table)[function_index];
+        ProtoWriter function_message;
+        function_message.put_uint(1, id);
+        function_message.put_uint(2, intern(function.name));
+        function_message.put_uint(3, intern(function.name));
+        function_message.put_uint(4, intern(source_path));
+        function_message.put_uint(5, function.lines.empty() ? 0 : function.lines.front().line);
+        profile.put_bytes(5, function_message.bytes);
+    }
+
+    auto nanoseconds = [](auto time) {
+        return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+    };
+    profile.put_uint(9, nanoseconds(start_time.time_since_epoch()));
+    profile.put_uint(10, nanoseconds(duration));
+    put_value_type(11, "cpu", "nanoseconds");
+    profile.put_uint(12, period);
+
+    /* written last, once every string is interned */
+    for (auto string : strings) {
+        profile.put_bytes(6, string);
+    }
+    stream.write(profile.bytes.data(), profile.bytes.size());
+}
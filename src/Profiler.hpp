@@ -0,0 +1,97 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CallStack.hpp"
+#include "Code.hpp"
+#include "Common.hpp"
+
+class Thread;
+
+/*
+ * Samples the call stacks of the running threads by CPU time. A process
+ * wide profiling timer sends SIGPROF to whichever thread is running when it
+ * fires, and the handler walks the stack of the goroutine on that thread
+ * into a free slot. Slots are claimed and released with atomics only, so
+ * the handler never takes a lock or allocates; a collector thread empties
+ * them into a table of stacks with their counts. A sample that finds every
+ * slot taken is dropped.
+ */
+class Profiler
+{
+public:
+    static constexpr u64 default_rate = 100;
+    static constexpr u64 max_depth = 64;
+    static constexpr u64 slot_count = 1024;
+
+    Profiler() = delete;
+    Profiler(const Profiler&) = delete;
+    Profiler(Profiler&&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+    Profiler& operator=(Profiler&&) = delete;
+
+    /* rate is in samples per second of CPU time */
+    Profiler(u64 rate);
+    ~Profiler();
+
+    /* only one profiler can run at a time */
+    void start(const std::vector<Function>& function_table);
+    void stop();
+
+    /* called in the signal handler on the thread being sampled */
+    void record(Thread& thread);
+
+    /* the goroutine a platform thread runs, which is what a signal on it samples */
+    static void set_running_thread(Thread* thread);
+
+    /* one line per distinct stack of function names, outermost first, for flame graphs */
+    void write_folded(std::ostream& stream) const;
+    /* a profile.proto message as read by pprof, uncompressed */
+    void write_pprof(std::ostream& stream, const std::string& source_path) const;
+
+private:
+    enum SlotState : u32
+    {
+        empty,
+        writing,
+        full,
+    };
+
+    struct Slot
+    {
+        std::atomic<u32> state{empty};
+        u64 depth = 0;
+        CodeLocation locations[max_depth];
+    };
+
+    void run_collector();
+    void collect();
+
+    u64 interval;
+    const std::vector<Function>* function_table = nullptr;
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<u64> next_slot{0};
+
+    /* innermost frame first */
+    std::map<std::vector<CodeLocation>, u64> stacks;
+    std::chrono::system_clock::time_point start_time;
+    std::chrono::steady_clock::time_point steady_start_time;
+    std::chrono::steady_clock::duration duration{};
+
+    std::mutex collector_mutex;
+    std::condition_variable collector_condition;
+    std::thread collector;
+    bool collector_stopping = false;
+};
+
+#endif /* PROFILER_HPP */
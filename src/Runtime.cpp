@@ -1,5 +1,11 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 
+#include <unistd.h>
+
+#include "Profiler.hpp"
 #include "Runtime.hpp"
 
 Runtime::Runtime(
@@ -12,8 +18,19 @@ Runtime::Runtime(
                                 native_function_table{std::move(native_function_table)},
                                 type_table{std::move(type_table)},
                                 heap{configuration.heap_size},
-                                string_pool(std::move(string_pool))
+                                output{STDOUT_FILENO, configuration.output_batch_size, configuration.output_flush_interval}
 {
+    for (NativeFunction native_function : this->native_function_table) {
+        auto native = get_native_registry().find(native_function);
+        typed_native_table.push_back(native ? native->call : TypedNativeCall{});
+    }
+    zero_address = heap.allocate(*this->type_table[0], 1);
+    /* the literals are interned, so equal literals are one string */
+    string_literals.reserve(string_pool.size());
+    for (u64 i = 0; i < string_pool.size(); ++i) {
+        auto bytes = decode_string_literal(string_pool.get(i));
+        string_literals.push_back(string_interner.intern(heap, *configuration.string_type, bytes));
+    }
 }
 
 void Runtime::start()
@@ -22,7 +39,249 @@ void Runtime::start()
     auto& main_function = function_table[configuration.main_function_index];
     main_thread.get_instruction_stream().jump_to(main_function);
     main_thread.get_call_stack().push_frame(main_function, 0);
+    main_thread.initialize();
+    output.start();
+    if (profiler) {
+        profiler->start(function_table);
+    }
+    if (configuration.time_slice != 0 || configuration.deadlock_grace_period != 0) {
+        monitor = std::thread{[this]() { run_monitor(); }};
+    }
     main_thread.start();
-    std::unique_lock lock{thread_pool_mutex};
-    termination_condition.wait(lock, [this]() { return thread_pool.empty(); });
+    {
+        std::unique_lock lock{thread_pool_mutex};
+        termination_condition.wait(lock, [this]() { return thread_pool.empty(); });
+    }
+    if (profiler) {
+        profiler->stop();
+    }
+    shutdown_monitor();
+    shutdown_workers();
+    output.stop();
+#ifdef GOATLANG_INSTRUMENT
+    counters.merge(main_thread.get_counters());
+    for (const auto& thread : threads) {
+        counters.merge(thread->get_counters());
+    }
+    counters.set_heap_usage(heap.get_allocation_count(), heap.get_allocated_bytes());
+#endif
+}
+
+Thread& Runtime::acquire_thread()
+{
+    std::lock_guard lock{scheduler_mutex};
+    if (!free_threads.empty()) {
+        Thread* thread = free_threads.back();
+        free_threads.pop_back();
+        return *thread;
+    }
+    return *threads.emplace_back(std::make_unique<Thread>(*this));
+}
+
+void Runtime::spawn(Thread& thread)
+{
+    thread.initialize();
+    std::lock_guard lock{scheduler_mutex};
+    run_queue.push_back(&thread);
+    if (idle_workers > 0) {
+        --idle_workers;
+        scheduler_condition.notify_one();
+    } else {
+        workers.emplace_back([this]() { run_worker(); });
+    }
+}
+
+void Runtime::run_worker()
+{
+    std::unique_lock lock{scheduler_mutex};
+    while (true) {
+        scheduler_condition.wait(lock, [this]() { return !run_queue.empty() || shutting_down; });
+        if (run_queue.empty()) {
+            return;
+        }
+        Thread* thread = run_queue.front();
+        run_queue.pop_front();
+        lock.unlock();
+        thread->start();
+        thread->reset();
+        lock.lock();
+        free_threads.push_back(thread);
+        ++idle_workers;
+    }
+}
+
+void Runtime::shutdown_workers()
+{
+    std::vector<std::thread> joinable_workers;
+    {
+        std::lock_guard lock{scheduler_mutex};
+        shutting_down = true;
+        joinable_workers = std::move(workers);
+    }
+    scheduler_condition.notify_all();
+    for (auto& worker : joinable_workers) {
+        worker.join();
+    }
+}
+
+void Runtime::run_monitor()
+{
+    u64 time_slice = configuration.time_slice;
+    u64 grace_period = configuration.deadlock_grace_period;
+    auto period = std::chrono::microseconds{time_slice != 0 ? time_slice : grace_period};
+    std::unique_lock lock{monitor_mutex};
+    while (!monitor_condition.wait_for(lock, period, [this]() { return monitor_stopping; })) {
+        if (time_slice != 0) {
+            std::lock_guard pool_lock{thread_pool_mutex};
+            for (Thread* thread : thread_pool) {
+                thread->request_safepoint();
+            }
+        }
+        if (grace_period != 0) {
+            check_deadlock();
+        }
+    }
+}
+
+void Runtime::shutdown_monitor()
+{
+    if (!monitor.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard lock{monitor_mutex};
+        monitor_stopping = true;
+    }
+    monitor_condition.notify_all();
+    monitor.join();
+}
+
+void Runtime::stop_the_world(Thread* self)
+{
+    std::unique_lock lock{safepoint_mutex};
+    world_stopped.store(true);
+    safepoint_condition.wait(lock, [this, self]() {
+        std::lock_guard pool_lock{thread_pool_mutex};
+        bool stopped = true;
+        for (Thread* thread : thread_pool) {
+            if (thread != self && thread->get_state() == ThreadState::running) {
+                thread->request_safepoint();
+                stopped = false;
+            }
+        }
+        return stopped;
+    });
+}
+
+void Runtime::resume_the_world()
+{
+    {
+        std::lock_guard lock{safepoint_mutex};
+        world_stopped.store(false);
+    }
+    safepoint_condition.notify_all();
+}
+
+void Runtime::park(Thread& thread)
+{
+    std::unique_lock lock{safepoint_mutex};
+    thread.set_state(ThreadState::parked);
+    safepoint_condition.notify_all();
+    safepoint_condition.wait(lock, [this]() { return !world_stopped.load(); });
+    thread.set_state(ThreadState::running);
+}
+
+/* wakes a pending stop_the_world after a thread stopped running */
+void Runtime::notify_safepoint()
+{
+    if (!world_stopped.load()) {
+        return;
+    }
+    std::lock_guard lock{safepoint_mutex};
+    safepoint_condition.notify_all();
+}
+
+/* must be called with thread_pool_mutex held */
+bool Runtime::all_threads_blocked()
+{
+    if (thread_pool.empty()) {
+        return false;
+    }
+    return std::all_of(thread_pool.begin(), thread_pool.end(), [](Thread* thread) {
+        return thread->get_state() == ThreadState::blocked;
+    });
+}
+
+void Runtime::check_deadlock()
+{
+    bool blocked;
+    {
+        std::lock_guard lock{thread_pool_mutex};
+        blocked = all_threads_blocked();
+    }
+    u64 epoch = progress_epoch.load();
+    if (!blocked) {
+        deadlock_suspected = false;
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (!deadlock_suspected || epoch != suspected_epoch) {
+        deadlock_suspected = true;
+        suspected_epoch = epoch;
+        suspected_since = now;
+        return;
+    }
+    if (now - suspected_since < std::chrono::microseconds{configuration.deadlock_grace_period}) {
+        return;
+    }
+
+    /* blocked threads count as stopped; this only holds back late wakeups */
+    stop_the_world();
+    bool deadlocked;
+    {
+        std::lock_guard lock{thread_pool_mutex};
+        deadlocked = all_threads_blocked() && progress_epoch.load() == suspected_epoch;
+    }
+    if (deadlocked) {
+        report_deadlock();
+    }
+    deadlock_suspected = false;
+    resume_the_world();
+}
+
+/* prints every goroutine with its traceback and exits, like Go does */
+void Runtime::report_deadlock()
+{
+    std::vector<Thread*> blocked_threads;
+    {
+        std::lock_guard lock{thread_pool_mutex};
+        blocked_threads.assign(thread_pool.begin(), thread_pool.end());
+    }
+    std::sort(blocked_threads.begin(), blocked_threads.end(), [](Thread* x, Thread* y) {
+        return x->get_id() < y->get_id();
+    });
+
+    output.flush();
+    /* the main goroutine has id 1, without it the others have leaked */
+    if (blocked_threads.front()->get_id() == 1) {
+        std::cerr << "fatal error: all goroutines are asleep - deadlock!\n";
+    } else {
+        std::cerr << "fatal error: main has returned and all goroutines are asleep - goroutine leak!\n";
+    }
+    for (Thread* thread : blocked_threads) {
+        std::cerr << "\ngoroutine " << thread->get_id() << " [chan wait]:\n";
+        thread->print_traceback(std::cerr);
+    }
+    std::cerr.flush();
+    std::_Exit(2);
+}
+
+/* a runtime error ends the program after the output printed so far */
+void Runtime::panic(Thread& thread, const std::exception& exception)
+{
+    output.flush();
+    std::cerr << "panic: " << exception.what() << "\n\ngoroutine " << thread.get_id() << " [running]:\n";
+    thread.print_traceback(std::cerr);
+    std::cerr.flush();
+    std::_Exit(2);
 }
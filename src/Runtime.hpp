@@ -1,8 +1,13 @@
 #ifndef RUNTIME_HPP
 #define RUNTIME_HPP
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -10,17 +15,29 @@
 #include "Code.hpp"
 #include "Common.hpp"
 #include "Heap.hpp"
+#include "NativeRegistry.hpp"
+#include "Output.hpp"
 #include "StringPool.hpp"
+#include "Strings.hpp"
 #include "Thread.hpp"
 
+class Profiler;
+
 struct Configuration
 {
     u64 heap_size;
-    u64 call_stack_size;
-    u64 operand_stack_size;
+    u64 initial_call_stack_size;
+    u64 max_call_stack_size;
+    u64 initial_operand_stack_size;
+    u64 max_operand_stack_size;
+    u64 output_batch_size;
+    u64 output_flush_interval;
+    u64 time_slice;
+    u64 deadlock_grace_period;
     u64 main_function_index;
     Type* channel_type;
     Type* slice_type;
+    Type* string_type;
 };
 
 class Runtime
@@ -50,6 +67,12 @@ public:
         return native_function_table;
     }
 
+    /* by native function index, empty for the natives that are not typed */
+    const std::vector<TypedNativeCall>& get_typed_native_table() const
+    {
+        return typed_native_table;
+    }
+
     std::vector<std::unique_ptr<Type>>& get_type_table()
     {
         return type_table;
@@ -85,37 +108,138 @@ public:
         return channel_manager;
     }
 
-    StringPool& get_string_pool()
+    /* the address of the string each entry of the string pool stands for */
+    u64 get_string_literal(u64 string_index) const
+    {
+        return string_literals[string_index];
+    }
+
+    StringInterner& get_string_interner()
+    {
+        return string_interner;
+    }
+
+    Output& get_output()
+    {
+        return output;
+    }
+
+    u64 get_zero_address() const
     {
-        return string_pool;
+        return zero_address;
     }
 
     void start();
 
+    Thread& acquire_thread();
+    void spawn(Thread& thread);
+
+    bool is_world_stopped() const { return world_stopped.load(); }
+    /* only one thread may stop the world at a time */
+    void stop_the_world(Thread* self = nullptr);
+    void resume_the_world();
+    void park(Thread& thread);
+    void notify_safepoint();
+
+    void record_progress() { progress_epoch.fetch_add(1, std::memory_order_relaxed); }
+
+    [[noreturn]] void panic(Thread& thread, const std::exception& exception);
+
     Configuration configuration;
     std::vector<Function> function_table;
     std::vector<NativeFunction> native_function_table;
+    std::vector<TypedNativeCall> typed_native_table;
     std::vector<std::unique_ptr<Type>> type_table;
 
     Heap heap;
     ChannelManager channel_manager;
-    StringPool string_pool;
+    std::vector<u64> string_literals;
+    StringInterner string_interner;
+    Output output;
+    /* a boxed zero word, received from closed channels */
+    u64 zero_address;
+    /* samples the program while it runs when set */
+    Profiler* profiler = nullptr;
+#ifdef GOATLANG_INSTRUMENT
+    /* the counters of every goroutine, merged once the program has ended */
+    ExecutionCounters counters;
+#endif
 
     static Configuration default_configuration()
     {
         return Configuration{
-            .heap_size = 64 * 1024 * 1024,  // 64 MB
-            .call_stack_size = 8 * 1024,    // 8 KB
-            .operand_stack_size = 1 * 1024, // 1 KB, 128 values
+            .heap_size = 64 * 1024 * 1024,             // 64 MB
+            .initial_call_stack_size = 512,            // grows on demand
+            .max_call_stack_size = 64 * 1024 * 1024,   // 64 MB
+            .initial_operand_stack_size = 256,         // 32 values
+            .max_operand_stack_size = 1 * 1024 * 1024, // 1 MB
+            .output_batch_size = 64 * 1024,            // 64 KB
+            .output_flush_interval = 1000,             // 1 ms, in microseconds
+            .time_slice = 10 * 1000,                   // 10 ms, in microseconds
+            .deadlock_grace_period = 100 * 1000,       // 100 ms, in microseconds
             .main_function_index = 0,
             .channel_type = nullptr,
             .slice_type = nullptr,
+            .string_type = nullptr,
         };
     }
 
     std::unordered_set<Thread*> thread_pool;
     std::mutex thread_pool_mutex;
     std::condition_variable termination_condition;
+    /* threads ever started, guarded by thread_pool_mutex; main is 1 */
+    u64 thread_count = 0;
+
+private:
+    void run_worker();
+    void shutdown_workers();
+    void run_monitor();
+    void shutdown_monitor();
+    bool all_threads_blocked();
+    void check_deadlock();
+    [[noreturn]] void report_deadlock();
+
+    /*
+     * Threads poll their safepoint flag at loop back-edges and function
+     * entries. The monitor raises the flag of every live thread once per
+     * time slice so long-running loops yield; stop_the_world raises it and
+     * waits until no thread is running, threads asleep on a channel count
+     * as stopped.
+     */
+    std::mutex safepoint_mutex;
+    std::condition_variable safepoint_condition;
+    std::atomic<bool> world_stopped{false};
+    std::mutex monitor_mutex;
+    std::condition_variable monitor_condition;
+    std::thread monitor;
+    bool monitor_stopping = false;
+
+    /*
+     * A thread asleep on a channel may already have been signaled without
+     * having woken up yet, so seeing every thread blocked once proves
+     * nothing. Every wakeup and exit bumps progress_epoch; a deadlock is
+     * reported only when every thread stays blocked with the epoch unchanged
+     * for a whole grace period. The monitor owns the suspicion state.
+     */
+    std::atomic<u64> progress_epoch{0};
+    bool deadlock_suspected = false;
+    u64 suspected_epoch = 0;
+    std::chrono::steady_clock::time_point suspected_since;
+
+    /*
+     * Goroutines that have finished are kept, stacks included, and handed out
+     * again by acquire_thread. Platform threads are pooled the same way: a
+     * worker that finishes a goroutine parks until the next spawn instead of
+     * exiting. idle_workers counts parked workers not yet claimed by a spawn.
+     */
+    std::mutex scheduler_mutex;
+    std::condition_variable scheduler_condition;
+    std::deque<std::unique_ptr<Thread>> threads;
+    std::vector<Thread*> free_threads;
+    std::deque<Thread*> run_queue;
+    std::vector<std::thread> workers;
+    u64 idle_workers = 0;
+    bool shutting_down = false;
 };
 
 /*
@@ -0,0 +1,607 @@
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "SliceKernels.hpp"
+
+/* whether writing z before reading further into x differs from going one element at a time */
+template <typename T>
+static bool writes_ahead(const T* z, const T* x, u64 n)
+{
+    auto z_address = reinterpret_cast<std::uintptr_t>(z);
+    auto x_address = reinterpret_cast<std::uintptr_t>(x);
+    return x_address < z_address && z_address < x_address + sizeof(T) * n;
+}
+
+/* integers are added and multiplied as unsigned to wrap */
+static i64 wrapping_add(i64 x, i64 y)
+{
+    return static_cast<i64>(static_cast<u64>(x) + static_cast<u64>(y));
+}
+
+static i64 wrapping_mul(i64 x, i64 y)
+{
+    return static_cast<i64>(static_cast<u64>(x) * static_cast<u64>(y));
+}
+
+/* NaNs lose unless they come first, the same as minpd and maxpd with the minimum so far second */
+static f64 float_min(f64 x, f64 m)
+{
+    return x < m ? x : m;
+}
+
+static f64 float_max(f64 x, f64 m)
+{
+    return x > m ? x : m;
+}
+
+static i64 sum_int_scalar(const i64* x, u64 n)
+{
+    i64 total = 0;
+    for (u64 i = 0; i < n; ++i) {
+        total = wrapping_add(total, x[i]);
+    }
+    return total;
+}
+
+static f64 sum_float_scalar(const f64* x, u64 n)
+{
+    f64 total = 0;
+    for (u64 i = 0; i < n; ++i) {
+        total += x[i];
+    }
+    return total;
+}
+
+static i64 min_int_scalar(const i64* x, u64 n)
+{
+    return *std::min_element(x, x + n);
+}
+
+static f64 min_float_scalar(const f64* x, u64 n)
+{
+    f64 m = x[0];
+    for (u64 i = 1; i < n; ++i) {
+        m = float_min(x[i], m);
+    }
+    return m;
+}
+
+static i64 max_int_scalar(const i64* x, u64 n)
+{
+    return *std::max_element(x, x + n);
+}
+
+static f64 max_float_scalar(const f64* x, u64 n)
+{
+    f64 m = x[0];
+    for (u64 i = 1; i < n; ++i) {
+        m = float_max(x[i], m);
+    }
+    return m;
+}
+
+static i64 dot_int_scalar(const i64* x, const i64* y, u64 n)
+{
+    i64 total = 0;
+    for (u64 i = 0; i < n; ++i) {
+        total = wrapping_add(total, wrapping_mul(x[i], y[i]));
+    }
+    return total;
+}
+
+static f64 dot_float_scalar(const f64* x, const f64* y, u64 n)
+{
+    f64 total = 0;
+    for (u64 i = 0; i < n; ++i) {
+        total += x[i] * y[i];
+    }
+    return total;
+}
+
+static void add_int_scalar(i64* z, const i64* x, const i64* y, u64 n)
+{
+    for (u64 i = 0; i < n; ++i) {
+        z[i] = wrapping_add(x[i], y[i]);
+    }
+}
+
+static void add_float_scalar(f64* z, const f64* x, const f64* y, u64 n)
+{
+    for (u64 i = 0; i < n; ++i) {
+        z[i] = x[i] + y[i];
+    }
+}
+
+static void mul_int_scalar(i64* z, const i64* x, const i64* y, u64 n)
+{
+    for (u64 i = 0; i < n; ++i) {
+        z[i] = wrapping_mul(x[i], y[i]);
+    }
+}
+
+static void mul_float_scalar(f64* z, const f64* x, const f64* y, u64 n)
+{
+    for (u64 i = 0; i < n; ++i) {
+        z[i] = x[i] * y[i];
+    }
+}
+
+static i64 index_int_scalar(const i64* x, u64 n, i64 value)
+{
+    for (u64 i = 0; i < n; ++i) {
+        if (x[i] == value) {
+            return static_cast<i64>(i);
+        }
+    }
+    return -1;
+}
+
+static i64 index_float_scalar(const f64* x, u64 n, f64 value)
+{
+    for (u64 i = 0; i < n; ++i) {
+        if (x[i] == value) {
+            return static_cast<i64>(i);
+        }
+    }
+    return -1;
+}
+
+static void fill_scalar(u64* x, u64 n, u64 value)
+{
+    std::fill(x, x + n, value);
+}
+
+#if defined(__x86_64__)
+
+/*
+ * SSE2 is part of x86-64, so these need no check. It has no 64-bit integer
+ * compares or multiplies; min, max, dot and mul of ints stay scalar below
+ * AVX2.
+ */
+
+static i64 sum_int_sse2(const i64* x, u64 n)
+{
+    __m128i total = _mm_setzero_si128();
+    u64 i = 0;
+    for (; i + 2 <= n; i += 2) {
+        total = _mm_add_epi64(total, _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+    }
+    alignas(16) i64 lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), total);
+    return wrapping_add(wrapping_add(lanes[0], lanes[1]), sum_int_scalar(x + i, n - i));
+}
+
+static f64 sum_float_sse2(const f64* x, u64 n)
+{
+    __m128d total0 = _mm_setzero_pd();
+    __m128d total1 = _mm_setzero_pd();
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        total0 = _mm_add_pd(total0, _mm_loadu_pd(x + i));
+        total1 = _mm_add_pd(total1, _mm_loadu_pd(x + i + 2));
+    }
+    alignas(16) f64 lanes[2];
+    _mm_store_pd(lanes, _mm_add_pd(total0, total1));
+    return lanes[0] + lanes[1] + sum_float_scalar(x + i, n - i);
+}
+
+static f64 min_float_sse2(const f64* x, u64 n)
+{
+    __m128d m = _mm_set1_pd(x[0]);
+    u64 i = 0;
+    for (; i + 2 <= n; i += 2) {
+        m = _mm_min_pd(_mm_loadu_pd(x + i), m);
+    }
+    alignas(16) f64 lanes[2];
+    _mm_store_pd(lanes, m);
+    f64 result = float_min(lanes[1], lanes[0]);
+    for (; i < n; ++i) {
+        result = float_min(x[i], result);
+    }
+    return result;
+}
+
+static f64 max_float_sse2(const f64* x, u64 n)
+{
+    __m128d m = _mm_set1_pd(x[0]);
+    u64 i = 0;
+    for (; i + 2 <= n; i += 2) {
+        m = _mm_max_pd(_mm_loadu_pd(x + i), m);
+    }
+    alignas(16) f64 lanes[2];
+    _mm_store_pd(lanes, m);
+    f64 result = float_max(lanes[1], lanes[0]);
+    for (; i < n; ++i) {
+        result = float_max(x[i], result);
+    }
+    return result;
+}
+
+static f64 dot_float_sse2(const f64* x, const f64* y, u64 n)
+{
+    __m128d total0 = _mm_setzero_pd();
+    __m128d total1 = _mm_setzero_pd();
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        total0 = _mm_add_pd(total0, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+        total1 = _mm_add_pd(total1, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2)));
+    }
+    alignas(16) f64 lanes[2];
+    _mm_store_pd(lanes, _mm_add_pd(total0, total1));
+    return lanes[0] + lanes[1] + dot_float_scalar(x + i, y + i, n - i);
+}
+
+static void add_int_sse2(i64* z, const i64* x, const i64* y, u64 n)
+{
+    if (writes_ahead(z, x, n) || writes_ahead(z, y, n)) {
+        return add_int_scalar(z, x, y, n);
+    }
+    u64 i = 0;
+    for (; i + 2 <= n; i += 2) {
+        auto sum = _mm_add_epi64(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(z + i), sum);
+    }
+    add_int_scalar(z + i, x + i, y + i, n - i);
+}
+
+static void add_float_sse2(f64* z, const f64* x, const f64* y, u64 n)
+{
+    if (writes_ahead(z, x, n) || writes_ahead(z, y, n)) {
+        return add_float_scalar(z, x, y, n);
+    }
+    u64 i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(z + i, _mm_add_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+    }
+    add_float_scalar(z + i, x + i, y + i, n - i);
+}
+
+static void mul_float_sse2(f64* z, const f64* x, const f64* y, u64 n)
+{
+    if (writes_ahead(z, x, n) || writes_ahead(z, y, n)) {
+        return mul_float_scalar(z, x, y, n);
+    }
+    u64 i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(z + i, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+    }
+    mul_float_scalar(z + i, x + i, y + i, n - i);
+}
+
+static i64 index_int_sse2(const i64* x, u64 n, i64 value)
+{
+    __m128i target = _mm_set1_epi64x(value);
+    u64 i = 0;
+    for (; i + 2 <= n; i += 2) {
+        /* both halves of a 64-bit lane have to match */
+        __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)), target);
+        equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, 0xb1));
+        if (int mask = _mm_movemask_pd(_mm_castsi128_pd(equal)); mask != 0) {
+            return static_cast<i64>(i) + __builtin_ctz(mask);
+        }
+    }
+    i64 index = index_int_scalar(x + i, n - i, value);
+    return index < 0 ? index : static_cast<i64>(i) + index;
+}
+
+static i64 index_float_sse2(const f64* x, u64 n, f64 value)
+{
+    __m128d target = _mm_set1_pd(value);
+    u64 i = 0;
+    for (; i + 2 <= n; i += 2) {
+        if (int mask = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(x + i), target)); mask != 0) {
+            return static_cast<i64>(i) + __builtin_ctz(mask);
+        }
+    }
+    i64 index = index_float_scalar(x + i, n - i, value);
+    return index < 0 ? index : static_cast<i64>(i) + index;
+}
+
+static void fill_sse2(u64* x, u64 n, u64 value)
+{
+    __m128i values = _mm_set1_epi64x(static_cast<i64>(value));
+    u64 i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(x + i), values);
+    }
+    fill_scalar(x + i, n - i, value);
+}
+
+/* compiled for AVX2 whatever the target of the rest, only called once CPUID reports it */
+#define AVX2_KERNEL __attribute__((target("avx2")))
+
+AVX2_KERNEL static __m256i load_int_avx2(const i64* x)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x));
+}
+
+/* the low 64 bits of each product from 32-bit multiplies */
+AVX2_KERNEL static __m256i mul_int_lanes_avx2(__m256i x, __m256i y)
+{
+    __m256i cross = _mm256_mullo_epi32(x, _mm256_shuffle_epi32(y, 0xb1));
+    __m256i cross_sum = _mm256_add_epi32(cross, _mm256_srli_epi64(cross, 32));
+    return _mm256_add_epi64(_mm256_mul_epu32(x, y), _mm256_slli_epi64(cross_sum, 32));
+}
+
+AVX2_KERNEL static i64 sum_int_lanes_avx2(__m256i total)
+{
+    alignas(32) i64 lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), total);
+    return sum_int_scalar(lanes, 4);
+}
+
+AVX2_KERNEL static f64 sum_float_lanes_avx2(__m256d total)
+{
+    alignas(32) f64 lanes[4];
+    _mm256_store_pd(lanes, total);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+AVX2_KERNEL static i64 sum_int_avx2(const i64* x, u64 n)
+{
+    __m256i total0 = _mm256_setzero_si256();
+    __m256i total1 = _mm256_setzero_si256();
+    u64 i = 0;
+    for (; i + 8 <= n; i += 8) {
+        total0 = _mm256_add_epi64(total0, load_int_avx2(x + i));
+        total1 = _mm256_add_epi64(total1, load_int_avx2(x + i + 4));
+    }
+    i64 total = sum_int_lanes_avx2(_mm256_add_epi64(total0, total1));
+    return wrapping_add(total, sum_int_scalar(x + i, n - i));
+}
+
+AVX2_KERNEL static f64 sum_float_avx2(const f64* x, u64 n)
+{
+    __m256d total0 = _mm256_setzero_pd();
+    __m256d total1 = _mm256_setzero_pd();
+    u64 i = 0;
+    for (; i + 8 <= n; i += 8) {
+        total0 = _mm256_add_pd(total0, _mm256_loadu_pd(x + i));
+        total1 = _mm256_add_pd(total1, _mm256_loadu_pd(x + i + 4));
+    }
+    return sum_float_lanes_avx2(_mm256_add_pd(total0, total1)) + sum_float_scalar(x + i, n - i);
+}
+
+AVX2_KERNEL static i64 min_int_avx2(const i64* x, u64 n)
+{
+    __m256i m = _mm256_set1_epi64x(x[0]);
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i values = load_int_avx2(x + i);
+        m = _mm256_blendv_epi8(m, values, _mm256_cmpgt_epi64(m, values));
+    }
+    alignas(32) i64 lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), m);
+    return std::min(min_int_scalar(lanes, 4), i < n ? min_int_scalar(x + i, n - i) : lanes[0]);
+}
+
+AVX2_KERNEL static i64 max_int_avx2(const i64* x, u64 n)
+{
+    __m256i m = _mm256_set1_epi64x(x[0]);
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i values = load_int_avx2(x + i);
+        m = _mm256_blendv_epi8(m, values, _mm256_cmpgt_epi64(values, m));
+    }
+    alignas(32) i64 lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), m);
+    return std::max(max_int_scalar(lanes, 4), i < n ? max_int_scalar(x + i, n - i) : lanes[0]);
+}
+
+AVX2_KERNEL static f64 min_float_avx2(const f64* x, u64 n)
+{
+    __m256d m = _mm256_set1_pd(x[0]);
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        m = _mm256_min_pd(_mm256_loadu_pd(x + i), m);
+    }
+    alignas(32) f64 lanes[4];
+    _mm256_store_pd(lanes, m);
+    f64 result = lanes[0];
+    for (u64 lane = 1; lane < 4; ++lane) {
+        result = float_min(lanes[lane], result);
+    }
+    for (; i < n; ++i) {
+        result = float_min(x[i], result);
+    }
+    return result;
+}
+
+AVX2_KERNEL static f64 max_float_avx2(const f64* x, u64 n)
+{
+    __m256d m = _mm256_set1_pd(x[0]);
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        m = _mm256_max_pd(_mm256_loadu_pd(x + i), m);
+    }
+    alignas(32) f64 lanes[4];
+    _mm256_store_pd(lanes, m);
+    f64 result = lanes[0];
+    for (u64 lane = 1; lane < 4; ++lane) {
+        result = float_max(lanes[lane], result);
+    }
+    for (; i < n; ++i) {
+        result = float_max(x[i], result);
+    }
+    return result;
+}
+
+AVX2_KERNEL static i64 dot_int_avx2(const i64* x, const i64* y, u64 n)
+{
+    __m256i total = _mm256_setzero_si256();
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        total = _mm256_add_epi64(total, mul_int_lanes_avx2(load_int_avx2(x + i), load_int_avx2(y + i)));
+    }
+    return wrapping_add(sum_int_lanes_avx2(total), dot_int_scalar(x + i, y + i, n - i));
+}
+
+AVX2_KERNEL static f64 dot_float_avx2(const f64* x, const f64* y, u64 n)
+{
+    __m256d total0 = _mm256_setzero_pd();
+    __m256d total1 = _mm256_setzero_pd();
+    u64 i = 0;
+    for (; i + 8 <= n; i += 8) {
+        total0 = _mm256_add_pd(total0, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+        total1 = _mm256_add_pd(total1, _mm256_mul_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4)));
+    }
+    return sum_float_lanes_avx2(_mm256_add_pd(total0, total1)) + dot_float_scalar(x + i, y + i, n - i);
+}
+
+AVX2_KERNEL static void add_int_avx2(i64* z, const i64* x, const i64* y, u64 n)
+{
+    if (writes_ahead(z, x, n) || writes_ahead(z, y, n)) {
+        return add_int_scalar(z, x, y, n);
+    }
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        auto sum = _mm256_add_epi64(load_int_avx2(x + i), load_int_avx2(y + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(z + i), sum);
+    }
+    add_int_scalar(z + i, x + i, y + i, n - i);
+}
+
+AVX2_KERNEL static void add_float_avx2(f64* z, const f64* x, const f64* y, u64 n)
+{
+    if (writes_ahead(z, x, n) || writes_ahead(z, y, n)) {
+        return add_float_scalar(z, x, y, n);
+    }
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(z + i, _mm256_add_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+    }
+    add_float_scalar(z + i, x + i, y + i, n - i);
+}
+
+AVX2_KERNEL static void mul_int_avx2(i64* z, const i64* x, const i64* y, u64 n)
+{
+    if (writes_ahead(z, x, n) || writes_ahead(z, y, n)) {
+        return mul_int_scalar(z, x, y, n);
+    }
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        auto product = mul_int_lanes_avx2(load_int_avx2(x + i), load_int_avx2(y + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(z + i), product);
+    }
+    mul_int_scalar(z + i, x + i, y + i, n - i);
+}
+
+AVX2_KERNEL static void mul_float_avx2(f64* z, const f64* x, const f64* y, u64 n)
+{
+    if (writes_ahead(z, x, n) || writes_ahead(z, y, n)) {
+        return mul_float_scalar(z, x, y, n);
+    }
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(z + i, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+    }
+    mul_float_scalar(z + i, x + i, y + i, n - i);
+}
+
+AVX2_KERNEL static i64 index_int_avx2(const i64* x, u64 n, i64 value)
+{
+    __m256i target = _mm256_set1_epi64x(value);
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i equal = _mm256_cmpeq_epi64(load_int_avx2(x + i), target);
+        if (int mask = _mm256_movemask_pd(_mm256_castsi256_pd(equal)); mask != 0) {
+            return static_cast<i64>(i) + __builtin_ctz(mask);
+        }
+    }
+    i64 index = index_int_scalar(x + i, n - i, value);
+    return index < 0 ? index : static_cast<i64>(i) + index;
+}
+
+AVX2_KERNEL static i64 index_float_avx2(const f64* x, u64 n, f64 value)
+{
+    __m256d target = _mm256_set1_pd(value);
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d equal = _mm256_cmp_pd(_mm256_loadu_pd(x + i), target, _CMP_EQ_OQ);
+        if (int mask = _mm256_movemask_pd(equal); mask != 0) {
+            return static_cast<i64>(i) + __builtin_ctz(mask);
+        }
+    }
+    i64 index = index_float_scalar(x + i, n - i, value);
+    return index < 0 ? index : static_cast<i64>(i) + index;
+}
+
+AVX2_KERNEL static void fill_avx2(u64* x, u64 n, u64 value)
+{
+    __m256i values = _mm256_set1_epi64x(static_cast<i64>(value));
+    u64 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(x + i), values);
+    }
+    fill_scalar(x + i, n - i, value);
+}
+
+#endif /* __x86_64__ */
+
+static SliceKernels select_slice_kernels()
+{
+    SliceKernels kernels{
+        .sum_int = sum_int_scalar,
+        .sum_float = sum_float_scalar,
+        .min_int = min_int_scalar,
+        .min_float = min_float_scalar,
+        .max_int = max_int_scalar,
+        .max_float = max_float_scalar,
+        .dot_int = dot_int_scalar,
+        .dot_float = dot_float_scalar,
+        .add_int = add_int_scalar,
+        .add_float = add_float_scalar,
+        .mul_int = mul_int_scalar,
+        .mul_float = mul_float_scalar,
+        .index_int = index_int_scalar,
+        .index_float = index_float_scalar,
+        .fill = fill_scalar,
+    };
+#if defined(__x86_64__)
+    kernels.sum_int = sum_int_sse2;
+    kernels.sum_float = sum_float_sse2;
+    kernels.min_float = min_float_sse2;
+    kernels.max_float = max_float_sse2;
+    kernels.dot_float = dot_float_sse2;
+    kernels.add_int = add_int_sse2;
+    kernels.add_float = add_float_sse2;
+    kernels.mul_float = mul_float_sse2;
+    kernels.index_int = index_int_sse2;
+    kernels.index_float = index_float_sse2;
+    kernels.fill = fill_sse2;
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels = SliceKernels{
+            .sum_int = sum_int_avx2,
+            .sum_float = sum_float_avx2,
+            .min_int = min_int_avx2,
+            .min_float = min_float_avx2,
+            .max_int = max_int_avx2,
+            .max_float = max_float_avx2,
+            .dot_int = dot_int_avx2,
+            .dot_float = dot_float_avx2,
+            .add_int = add_int_avx2,
+            .add_float = add_float_avx2,
+            .mul_int = mul_int_avx2,
+            .mul_float = mul_float_avx2,
+            .index_int = index_int_avx2,
+            .index_float = index_float_avx2,
+            .fill = fill_avx2,
+        };
+    }
+#endif
+    return kernels;
+}
+
+const SliceKernels& get_slice_kernels()
+{
+    static const SliceKernels kernels = select_slice_kernels();
+    return kernels;
+}
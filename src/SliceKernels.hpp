@@ -0,0 +1,37 @@
+#ifndef SLICE_KERNELS_HPP
+#define SLICE_KERNELS_HPP
+
+#include "Common.hpp"
+
+/*
+ * The loops behind the bulk slice builtins, over raw element arrays. Each
+ * one is the widest of its scalar, SSE2 and AVX2 versions the processor
+ * runs, chosen by CPUID on first use. Integers wrap like the interpreter's
+ * arithmetic. Float sums and dot products add in several lanes at once, so
+ * they can round differently from a loop adding in order.
+ */
+struct SliceKernels
+{
+    i64 (*sum_int)(const i64* x, u64 n);
+    f64 (*sum_float)(const f64* x, u64 n);
+    /* min and max need at least one element */
+    i64 (*min_int)(const i64* x, u64 n);
+    f64 (*min_float)(const f64* x, u64 n);
+    i64 (*max_int)(const i64* x, u64 n);
+    f64 (*max_float)(const f64* x, u64 n);
+    i64 (*dot_int)(const i64* x, const i64* y, u64 n);
+    f64 (*dot_float)(const f64* x, const f64* y, u64 n);
+    /* z may be x or y, or overlap them, as if written one element at a time */
+    void (*add_int)(i64* z, const i64* x, const i64* y, u64 n);
+    void (*add_float)(f64* z, const f64* x, const f64* y, u64 n);
+    void (*mul_int)(i64* z, const i64* x, const i64* y, u64 n);
+    void (*mul_float)(f64* z, const f64* x, const f64* y, u64 n);
+    /* the first index of the value, -1 without one */
+    i64 (*index_int)(const i64* x, u64 n, i64 value);
+    i64 (*index_float)(const f64* x, u64 n, f64 value);
+    void (*fill)(u64* x, u64 n, u64 value);
+};
+
+const SliceKernels& get_slice_kernels();
+
+#endif /* SLICE_KERNELS_HPP */
@@ -18,10 +18,15 @@ public:
         return string_index;
     }
 
-    const std::string& get(u64 string_index)
+    const std::string& get(u64 string_index) const
     {
         return strings[string_index];
     }
+
+    u64 size() const
+    {
+        return strings.size();
+    }
 };
 
 #endif /* STRING_POOL_HPP */
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+#include "Strings.hpp"
+
+std::string_view view_string(Heap& heap, u64 address)
+{
+    if (address == 0) {
+        return {};
+    }
+    const auto& header = heap.load<StringHeader>(address);
+    if (header.length == 0) {
+        return {};
+    }
+    return std::string_view{&heap.access<char>(header.data), header.length};
+}
+
+/* the bytes start right after the header, in the same block */
+static u64 allocate_string(Heap& heap, const Type& string_type, u64 length)
+{
+    u64 words = (sizeof(StringHeader) + length + sizeof(Word) - 1) / sizeof(Word);
+    u64 address = heap.allocate(string_type, words);
+    heap.store(address, StringHeader{.data = address + sizeof(StringHeader), .length = length, .hash = 0});
+    return address;
+}
+
+u64 new_string(Heap& heap, const Type& string_type, std::string_view bytes)
+{
+    if (bytes.empty()) {
+        return 0;
+    }
+    u64 address = allocate_string(heap, string_type, bytes.size());
+    std::memcpy(&heap.access<char>(address + sizeof(StringHeader)), bytes.data(), bytes.size());
+    return address;
+}
+
+u64 concat_strings(Heap& heap, const Type& string_type, u64 x, u64 y)
+{
+    auto x_bytes = view_string(heap, x);
+    auto y_bytes = view_string(heap, y);
+    if (y_bytes.empty()) {
+        return x;
+    }
+    if (x_bytes.empty()) {
+        return y;
+    }
+    u64 address = allocate_string(heap, string_type, x_bytes.size() + y_bytes.size());
+    /* the views stay valid, allocating never moves the heap */
+    char* bytes = &heap.access<char>(address + sizeof(StringHeader));
+    std::memcpy(bytes, x_bytes.data(), x_bytes.size());
+    std::memcpy(bytes + x_bytes.size(), y_bytes.data(), y_bytes.size());
+    return address;
+}
+
+u64 substring(Heap& heap, const Type& string_type, u64 address, i64 low, i64 high)
+{
+    auto bytes = view_string(heap, address);
+    if (low < 0 || high < low || static_cast<u64>(high) > bytes.size()) {
+        throw std::runtime_error(
+            "substring bounds [" + std::to_string(low) + ":" + std::to_string(high) + "] out of range for length " +
+            std::to_string(bytes.size()) + "!");
+    }
+    if (low == 0 && static_cast<u64>(high) == bytes.size()) {
+        return address;
+    }
+    if (low == high) {
+        return 0;
+    }
+    const auto& header = heap.load<StringHeader>(address);
+    u64 substring_address = heap.allocate(string_type, sizeof(StringHeader) / sizeof(Word));
+    heap.store(substring_address, StringHeader{
+        .data = header.data + static_cast<u64>(low),
+        .length = static_cast<u64>(high - low),
+        .hash = 0,
+    });
+    return substring_address;
+}
+
+/* goroutines may race to fill in the hash, all with the same value */
+u64 hash_string(Heap& heap, u64 address)
+{
+    if (address == 0) {
+        return 1;
+    }
+    std::atomic_ref<u64> cached_hash{heap.access<StringHeader>(address).hash};
+    u64 hash = cached_hash.load(std::memory_order_relaxed);
+    if (hash == 0) {
+        hash = std::max<u64>(std::hash<std::string_view>{}(view_string(heap, address)), 1);
+        cached_hash.store(hash, std::memory_order_relaxed);
+    }
+    return hash;
+}
+
+/* memcmp is vectorized by the C library, and only reached by strings of equal length and hash */
+bool strings_equal(Heap& heap, u64 x, u64 y)
+{
+    if (x == y) {
+        return true;
+    }
+    auto x_bytes = view_string(heap, x);
+    auto y_bytes = view_string(heap, y);
+    if (x_bytes.size() != y_bytes.size()) {
+        return false;
+    }
+    if (x_bytes.empty()) {
+        return true;
+    }
+    if (hash_string(heap, x) != hash_string(heap, y)) {
+        return false;
+    }
+    return std::memcmp(x_bytes.data(), y_bytes.data(), x_bytes.size()) == 0;
+}
+
+i64 compare_strings(Heap& heap, u64 x, u64 y)
+{
+    if (x == y) {
+        return 0;
+    }
+    return view_string(heap, x).compare(view_string(heap, y));
+}
+
+static void append_utf8(std::string& bytes, u32 code_point)
+{
+    if (code_point < 0x80) {
+        bytes.push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+        bytes.push_back(static_cast<char>(0xC0 | code_point >> 6));
+        bytes.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        bytes.push_back(static_cast<char>(0xE0 | code_point >> 12));
+        bytes.push_back(static_cast<char>(0x80 | (code_point >> 6 & 0x3F)));
+        bytes.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+        bytes.push_back(static_cast<char>(0xF0 | code_point >> 18));
+        bytes.push_back(static_cast<char>(0x80 | (code_point >> 12 & 0x3F)));
+        bytes.push_back(static_cast<char>(0x80 | (code_point >> 6 & 0x3F)));
+        bytes.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+}
+
+/* the value of the digits of a \x, \u, \U or octal escape */
+static u32 parse_escape_digits(std::string_view text, u64& i, u64 count, int base)
+{
+    if (i + count > text.size()) {
+        throw std::runtime_error("malformed escape in string literal " + std::string{text});
+    }
+    u32 value = std::stoul(std::string{text.substr(i, count)}, nullptr, base);
+    i += count;
+    return value;
+}
+
+std::string decode_string_literal(std::string_view text)
+{
+    auto inner = text.substr(1, text.size() - 2);
+    if (text.front() == '`') {
+        return std::string{inner};
+    }
+    std::string bytes;
+    for (u64 i = 0; i < inner.size();) {
+        char c = inner[i++];
+        if (c != '\\' || i == inner.size()) {
+            bytes.push_back(c);
+            continue;
+        }
+        char escape = inner[i++];
+        switch (escape) {
+            case 'a':
+                bytes.push_back('\a');
+                break;
+            case 'b':
+                bytes.push_back('\b');
+                break;
+            case 'f':
+                bytes.push_back('\f');
+                break;
+            case 'n':
+                bytes.push_back('\n');
+                break;
+            case 'r':
+                bytes.push_back('\r');
+                break;
+            case 't':
+                bytes.push_back('\t');
+                break;
+            case 'v':
+                bytes.push_back('\v');
+                break;
+            case 'x':
+                bytes.push_back(static_cast<char>(parse_escape_digits(inner, i, 2, 16)));
+                break;
+            case 'u':
+                append_utf8(bytes, parse_escape_digits(inner, i, 4, 16));
+                break;
+            case 'U':
+                append_utf8(bytes, parse_escape_digits(inner, i, 8, 16));
+                break;
+            default:
+                if ('0' <= escape && escape <= '7') {
+                    --i;
+                    bytes.push_back(static_cast<char>(parse_escape_digits(inner, i, 3, 8)));
+                } else {
+                    /* \\, \' and \" */
+                    bytes.push_back(escape);
+                }
+                break;
+        }
+    }
+    return bytes;
+}
+
+u64 StringInterner::intern(Heap& heap, const Type& string_type, u64 address)
+{
+    auto bytes = view_string(heap, address);
+    if (bytes.empty()) {
+        return 0;
+    }
+    std::lock_guard lock{mutex};
+    auto [it, inserted] = strings.try_emplace(bytes, address);
+    return it->second;
+}
+
+u64 StringInterner::intern(Heap& heap, const Type& string_type, std::string_view bytes)
+{
+    if (bytes.empty()) {
+        return 0;
+    }
+    std::lock_guard lock{mutex};
+    if (auto it = strings.find(bytes); it != strings.end()) {
+        return it->second;
+    }
+    u64 address = new_string(heap, string_type, bytes);
+    strings.try_emplace(view_string(heap, address), address);
+    return address;
+}
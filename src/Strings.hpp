@@ -0,0 +1,60 @@
+#ifndef STRINGS_HPP
+#define STRINGS_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "Heap.hpp"
+
+/*
+ * Strings are immutable and live in the heap. A string value is the
+ * address of a StringHeader, 0 for the empty string. A new string is one
+ * block, the header followed by its bytes; a substring is a header of its
+ * own pointing into the bytes of the string it was taken from. The hash is
+ * computed the first time it is needed and kept in the header, so that
+ * strings of equal length are only compared byte by byte when their hashes
+ * are equal.
+ */
+struct StringHeader
+{
+    u64 data;
+    u64 length; /* where a slice has its length, so len is slen */
+    u64 hash;   /* 0 until computed, never 0 after */
+};
+
+static_assert(offsetof(StringHeader, length) == offsetof(SliceHeader, length), "len compiles to slen for strings too");
+
+std::string_view view_string(Heap& heap, u64 address);
+u64 new_string(Heap& heap, const Type& string_type, std::string_view bytes);
+/* allocates once, or not at all when either string is empty */
+u64 concat_strings(Heap& heap, const Type& string_type, u64 x, u64 y);
+/* the bytes from low up to high, bounds checked */
+u64 substring(Heap& heap, const Type& string_type, u64 address, i64 low, i64 high);
+u64 hash_string(Heap& heap, u64 address);
+bool strings_equal(Heap& heap, u64 x, u64 y);
+/* negative, zero or positive as x sorts before, with or after y */
+i64 compare_strings(Heap& heap, u64 x, u64 y);
+
+/* the bytes a literal stands for, without its quotes and with its escapes replaced */
+std::string decode_string_literal(std::string_view text);
+
+/*
+ * One string for each distinct content. The string literals are interned
+ * when a program starts, and intern adds the strings a program builds, so
+ * equal strings from either are the same address and compare at once.
+ */
+class StringInterner
+{
+    std::mutex mutex;
+    /* views of the bytes in the heap, which are never moved */
+    std::unordered_map<std::string_view, u64> strings;
+
+public:
+    u64 intern(Heap& heap, const Type& string_type, u64 address);
+    u64 intern(Heap& heap, const Type& string_type, std::string_view bytes);
+};
+
+#endif /* STRINGS_HPP */
@@ -1,14 +1,26 @@
 #include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
 
 #include <iostream>
 
+#include "Profiler.hpp"
 #include "Runtime.hpp"
 #include "Thread.hpp"
 
 Thread::Thread(Runtime& runtime) : runtime{&runtime},
                                    instruction_stream{},
-                                   call_stack{runtime.configuration.call_stack_size},
-                                   operand_stack{runtime.configuration.operand_stack_size}
+                                   call_stack{
+                                       runtime.configuration.initial_call_stack_size,
+                                       runtime.configuration.max_call_stack_size},
+                                   operand_stack{
+                                       runtime.configuration.initial_operand_stack_size,
+                                       runtime.configuration.max_operand_stack_size}
+#ifdef GOATLANG_INSTRUMENT
+                                   ,
+                                   counters{runtime.function_table.size(), runtime.native_function_table.size()}
+#endif
 {
 }
 
@@ -16,25 +28,136 @@ void Thread::initialize()
 {
     std::lock_guard lock{runtime->get_thread_pool_mutex()};
     runtime->get_thread_pool().insert(this);
+    id = ++runtime->thread_count;
 }
 
 void Thread::finalize()
 {
-    std::lock_guard lock{runtime->get_thread_pool_mutex()};
-    auto& thread_pool = runtime->get_thread_pool();
-    thread_pool.erase(this);
-    if (thread_pool.empty()) {
-        runtime->get_termination_condition().notify_all();
+    state.store(ThreadState::waiting);
+    runtime->record_progress();
+    {
+        std::lock_guard lock{runtime->get_thread_pool_mutex()};
+        auto& thread_pool = runtime->get_thread_pool();
+        thread_pool.erase(this);
+        if (thread_pool.empty()) {
+            runtime->get_termination_condition().notify_all();
+        }
     }
+    runtime->notify_safepoint();
 }
 
+void Thread::reset()
+{
+    call_stack.reset();
+    operand_stack.reset();
+}
+
+/* the thread must have been initialized by whoever spawned it */
 void Thread::start()
 {
-    initialize();
-    run();
+    on_wake();
+    Profiler::set_running_thread(this);
+    try {
+        run();
+    } catch (const std::exception& exception) {
+        runtime->panic(*this, exception);
+    }
+    Profiler::set_running_thread(nullptr);
     finalize();
 }
 
+/*
+ * Reached at loop back-edges and function entries once the runtime has
+ * asked this thread to stop, either because its time slice is over or
+ * because the world is being stopped.
+ */
+void Thread::poll_safepoint()
+{
+    safepoint_requested.store(false, std::memory_order_relaxed);
+    if (runtime->is_world_stopped()) {
+        runtime->park(*this);
+    } else {
+        std::this_thread::yield();
+    }
+}
+
+void Thread::on_wait()
+{
+    state.store(ThreadState::blocked);
+    runtime->notify_safepoint();
+}
+
+void Thread::on_wake()
+{
+    state.store(ThreadState::running);
+    runtime->record_progress();
+    if (runtime->is_world_stopped()) {
+        runtime->park(*this);
+    }
+}
+
+/*
+ * Prints the function and program counter of every frame, innermost first.
+ * Only safe while the thread is stopped.
+ */
+void Thread::print_traceback(std::ostream& stream)
+{
+    const auto& function_table = runtime->get_function_table();
+    /* the instruction being executed, for callers the call instruction */
+    u64 program_counter = instruction_stream.get_program_counter() - 1;
+    u64 frame_pointer = call_stack.get_frame_pointer();
+    while (true) {
+        const auto& frame_data = call_stack.read_frame_data(frame_pointer);
+        const auto& function = function_table[frame_data.function_index];
+        stream << "\t" << function.name << " line=" << function.get_line(program_counter) << " pc=" << program_counter << "\n";
+        if (frame_pointer == 0) {
+            break;
+        }
+        program_counter = frame_data.program_counter - 1;
+        frame_pointer = frame_data.frame_pointer;
+    }
+}
+
+/*
+ * Writes the function and program counter of at most max_depth frames,
+ * innermost first. It runs in a signal handler on this thread and may find
+ * a call or a return half done, so it stops at the first frame that does
+ * not look valid.
+ */
+u64 Thread::capture_stack(CodeLocation* locations, u64 max_depth, u64 function_count)
+{
+    u64 program_counter = instruction_stream.get_program_counter();
+    program_counter = program_counter > 0 ? program_counter - 1 : 0;
+    u64 frame_pointer = call_stack.get_frame_pointer();
+    u64 depth = 0;
+    while (depth < max_depth && frame_pointer + sizeof(FrameData) <= call_stack.get_top()) {
+        FrameData frame_data = call_stack.read_frame_data(frame_pointer);
+        if (frame_data.function_index >= function_count) {
+            break;
+        }
+        locations[depth++] = CodeLocation{frame_data.function_index, program_counter};
+        /* callers lie below their callees */
+        if (frame_pointer == 0 || frame_data.frame_pointer >= frame_pointer || frame_data.program_counter == 0) {
+            break;
+        }
+        program_counter = frame_data.program_counter - 1;
+        frame_pointer = frame_data.frame_pointer;
+    }
+    return depth;
+}
+
+/* the address of element index, a negative index is a large unsigned one so one comparison covers both ends */
+static u64 get_checked_element_address(Heap& heap, u64 slice_address, u64 index)
+{
+    SliceHeader header = heap.load_slice_header(slice_address);
+    if (index >= header.length) {
+        throw std::runtime_error(
+            "index " + std::to_string(static_cast<i64>(index)) + " out of range for length " +
+            std::to_string(header.length) + "!");
+    }
+    return header.data + sizeof(Word) * index;
+}
+
 void Thread::run()
 {
 #define GENERIC_BINARY(T, R, op)      \
@@ -63,9 +186,27 @@ void Thread::run()
 #define I_BITWISE_UNARY(op) GENERIC_UNARY(i64, i64, op)
 #define F_ARITH_UNARY(op) GENERIC_UNARY(f64, f64, op)
 
+/* both operands are popped at once, a single underflow check keeps the many branch cases small */
+#define GENERIC_BRANCH(T, condition)                                   \
+    do {                                                               \
+        Word operands[2];                                              \
+        operand_stack.pop_into(operands, 2);                           \
+        T x = bitcast<Word, T>(operands[0]);                           \
+        T y = bitcast<Word, T>(operands[1]);                           \
+        if (condition) {                                               \
+            COUNT_JUMP(instruction.index);                             \
+            instruction_stream.set_program_counter(instruction.index); \
+        }                                                              \
+    } while (false)
+
+#define I_BRANCH(op) GENERIC_BRANCH(i64, x op y)
+#define F_BRANCH(op) GENERIC_BRANCH(f64, x op y)
+#define F_BRANCH_UNLESS(op) GENERIC_BRANCH(f64, !(x op y))
+
     Heap& heap = runtime->get_heap();
     std::vector<Function>& function_table = runtime->get_function_table();
     std::vector<NativeFunction>& native_function_table = runtime->get_native_function_table();
+    const auto& typed_native_table = runtime->get_typed_native_table();
     auto& type_table = runtime->get_type_table();
 
 #define INVOKE_FUNCTION(function)                                       \
@@ -73,15 +214,46 @@ void Thread::run()
         u64 program_counter = instruction_stream.get_program_counter(); \
         call_stack.push_frame(function, program_counter);               \
         instruction_stream.jump_to(function);                           \
+        COUNT(counters.count_invocation(function.index));               \
+    } while (false)
+
+/* the arguments stay on the operand stack, where the callee takes them from */
+#define TAIL_CALL_FUNCTION(function)                      \
+    do {                                                  \
+        call_stack.replace_frame(function);               \
+        instruction_stream.jump_to(function);             \
+        COUNT(counters.count_invocation(function.index)); \
     } while (false)
 
+/* the counters of an instrumented build, compiled out otherwise */
+#ifdef GOATLANG_INSTRUMENT
+#define COUNT(statement) statement
+#define COUNT_JUMP(target)                                                 \
+    counters.count_jump(                                                   \
+        call_stack.peek_frame_data().function_index,                       \
+        instruction_stream.get_program_counter() - 1,                      \
+        target)
+#else
+#define COUNT(statement)
+#define COUNT_JUMP(target)
+#endif
+
+    COUNT(counters.count_goroutine(call_stack.peek_frame_data().function_index));
+
     const Instruction* ptr;
     while ((ptr = instruction_stream.next()) != nullptr) {
         const Instruction& instruction = *ptr;
         // std::cerr << static_cast<u64>(instruction.opcode) << std::endl;
+        COUNT(counters.count_instruction(instruction.opcode));
         switch (instruction.opcode) {
             case Opcode::nop:
                 break;
+            case Opcode::safepoint: {
+                if (safepoint_requested.load(std::memory_order_relaxed)) {
+                    poll_safepoint();
+                }
+                break;
+            }
             case Opcode::load: {
                 Word word = call_stack.load_local<Word>(instruction.index);
                 operand_stack.push(word);
@@ -112,6 +284,10 @@ void Thread::run()
                 operand_stack.push(x);
                 break;
             }
+            case Opcode::ldstr: {
+                operand_stack.push(runtime->get_string_literal(instruction.index));
+                break;
+            }
             case Opcode::wload: {
                 u64 address = operand_stack.pop<u64>() + sizeof(Word) * instruction.index;
                 Word word = heap.load<Word>(address);
@@ -125,7 +301,14 @@ void Thread::run()
                 operand_stack.push(word);
                 break;
             }
-            // TODO
+            case Opcode::mload: {
+                const auto& type = *type_table[instruction.index];
+                u64 source = operand_stack.pop<u64>();
+                u64 address = heap.allocate(type, 1);
+                heap.copy(address, source, type.size);
+                operand_stack.push(address);
+                break;
+            }
             case Opcode::wstore: {
                 Word word = operand_stack.pop<Word>();
                 u64 address = operand_stack.pop<u64>() + sizeof(Word) * instruction.index;
@@ -139,6 +322,53 @@ void Thread::run()
                 heap.store(address, byte);
                 break;
             }
+            case Opcode::mstore: {
+                const auto& type = *type_table[instruction.index];
+                u64 source = operand_stack.pop<u64>();
+                u64 destination = operand_stack.pop<u64>();
+                heap.copy(destination, source, type.size);
+                break;
+            }
+            case Opcode::slen: {
+                u64 address = operand_stack.pop<u64>();
+                operand_stack.push(heap.load_slice_header(address).length);
+                break;
+            }
+            case Opcode::scap: {
+                u64 address = operand_stack.pop<u64>();
+                operand_stack.push(heap.load_slice_header(address).capacity);
+                break;
+            }
+            case Opcode::sload: {
+                u64 index = operand_stack.pop<u64>();
+                u64 address = operand_stack.pop<u64>();
+                Word word = heap.load<Word>(get_checked_element_address(heap, address, index));
+                operand_stack.push(word);
+                break;
+            }
+            case Opcode::sstore: {
+                Word word = operand_stack.pop<Word>();
+                u64 index = operand_stack.pop<u64>();
+                u64 address = operand_stack.pop<u64>();
+                heap.store(get_checked_element_address(heap, address, index), word);
+                break;
+            }
+            case Opcode::uload: {
+                u64 index = operand_stack.pop<u64>();
+                u64 address = operand_stack.pop<u64>();
+                u64 data = heap.load<SliceHeader>(address).data;
+                Word word = heap.load<Word>(data + sizeof(Word) * index);
+                operand_stack.push(word);
+                break;
+            }
+            case Opcode::ustore: {
+                Word word = operand_stack.pop<Word>();
+                u64 index = operand_stack.pop<u64>();
+                u64 address = operand_stack.pop<u64>();
+                u64 data = heap.load<SliceHeader>(address).data;
+                heap.store(data + sizeof(Word) * index, word);
+                break;
+            }
             case Opcode::i2f: {
                 i64 i = operand_stack.pop<i64>();
                 f64 f = static_cast<f64>(i);
@@ -248,21 +478,72 @@ void Thread::run()
                 I_LOGIC_UNARY(!);
                 break;
             case Opcode::goto_: {
+                COUNT_JUMP(instruction.index);
                 instruction_stream.set_program_counter(instruction.index);
                 break;
             }
             case Opcode::if_t: {
                 if (operand_stack.pop<i64>() != 0) {
+                    COUNT_JUMP(instruction.index);
                     instruction_stream.set_program_counter(instruction.index);
                 }
                 break;
             }
             case Opcode::if_f: {
                 if (operand_stack.pop<i64>() == 0) {
+                    COUNT_JUMP(instruction.index);
                     instruction_stream.set_program_counter(instruction.index);
                 }
                 break;
             }
+            case Opcode::if_ieq:
+                I_BRANCH(==);
+                break;
+            case Opcode::if_ilt:
+                I_BRANCH(<);
+                break;
+            case Opcode::if_igt:
+                I_BRANCH(>);
+                break;
+            case Opcode::if_ine:
+                I_BRANCH(!=);
+                break;
+            case Opcode::if_ile:
+                I_BRANCH(<=);
+                break;
+            case Opcode::if_ige:
+                I_BRANCH(>=);
+                break;
+            case Opcode::if_feq:
+                F_BRANCH(==);
+                break;
+            case Opcode::if_flt:
+                F_BRANCH(<);
+                break;
+            case Opcode::if_fgt:
+                F_BRANCH(>);
+                break;
+            case Opcode::if_fne:
+                F_BRANCH(!=);
+                break;
+            case Opcode::if_fle:
+                F_BRANCH(<=);
+                break;
+            case Opcode::if_fge:
+                F_BRANCH(>=);
+                break;
+            case Opcode::if_fnlt:
+                F_BRANCH_UNLESS(<);
+                break;
+            case Opcode::if_fngt:
+                F_BRANCH_UNLESS(>);
+                break;
+            case Opcode::if_fnle:
+                F_BRANCH_UNLESS(<=);
+                break;
+            case Opcode::if_fnge:
+                F_BRANCH_UNLESS(>=);
+                break;
             case Opcode::invoke_static: {
                 const auto& function = function_table[instruction.index];
                 INVOKE_FUNCTION(function);
@@ -283,9 +564,35 @@ void Thread::run()
             case Opcode::invoke_native: {
                 u64 native_function_index = instruction.index;
                 const auto& native_function = native_function_table[native_function_index];
+                COUNT(counters.count_native_call(native_function_index));
                 native_function(*runtime, *this);
                 break;
             }
+            case Opcode::invoke_typed: {
+                const auto& typed_native = typed_native_table[instruction.index];
+                COUNT(counters.count_native_call(instruction.index));
+                Word result = typed_native.function(*runtime, operand_stack.pop_words(typed_native.argc));
+                if (typed_native.returns) {
+                    operand_stack.push(result);
+                }
+                break;
+            }
+            case Opcode::tailcall: {
+                const auto& function = function_table[instruction.index];
+                TAIL_CALL_FUNCTION(function);
+                break;
+            }
+            case Opcode::tailcall_dynamic: {
+                u64 address = operand_stack.pop<u64>();
+                auto& closure_header = heap.load<ClosureHeader>(address);
+                const auto& function = function_table[closure_header.index];
+                TAIL_CALL_FUNCTION(function);
+                for (u16 i = 0; i < function.capc; ++i) {
+                    u64 cap_address = heap.load<u64>(address + sizeof(ClosureHeader) + sizeof(u64) * i);
+                    call_stack.store_local(i, cap_address);
+                }
+                break;
+            }
             case Opcode::ret: {
                 u64 program_counter = call_stack.pop_frame();
                 if (call_stack.empty()) {
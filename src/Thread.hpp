@@ -1,41 +1,87 @@
 #ifndef THREAD_HPP
 #define THREAD_HPP
 
+#include <atomic>
+#include <ostream>
+#include <vector>
+
 #include "Common.hpp"
 
+#include "BlockingQueue.hpp"
 #include "CallStack.hpp"
 #include "Code.hpp"
+#ifdef GOATLANG_INSTRUMENT
+#include "ExecutionCounters.hpp"
+#endif
 #include "InstructionStream.hpp"
 #include "OperandStack.hpp"
 
 class Runtime;
 
-class Thread
+enum class ThreadState
+{
+    /* spawned but not started, or finished */
+    waiting,
+    running,
+    /* asleep on a channel */
+    blocked,
+    /* stopped at a safepoint */
+    parked,
+};
+
+class Thread : public WaitListener
 {
 public:
     Thread() = delete;
     Thread(const Thread&) = delete;
-    Thread(Thread&&) = default;
+    Thread(Thread&&) = delete;
     Thread& operator=(const Thread&) = delete;
-    Thread& operator=(Thread&&) = default;
+    Thread& operator=(Thread&&) = delete;
 
     Thread(Runtime& runtime);
 
     void initialize();
     void finalize();
     void run();
+    void reset();
 
     void start();
 
+    void request_safepoint() { safepoint_requested.store(true, std::memory_order_relaxed); }
+    void poll_safepoint();
+    ThreadState get_state() const { return state.load(); }
+    u64 get_id() const { return id; }
+    void set_state(ThreadState new_state) { state.store(new_state); }
+
+    virtual void on_wait() override;
+    virtual void on_wake() override;
+
+    void print_traceback(std::ostream& stream);
+    u64 capture_stack(CodeLocation* locations, u64 max_depth, u64 function_count);
+
     CallStack& get_call_stack() { return call_stack; }
     OperandStack& get_operand_stack() { return operand_stack; }
     InstructionStream& get_instruction_stream() { return instruction_stream; }
+    std::vector<u64>& get_free_defer_records() { return free_defer_records; }
+#ifdef GOATLANG_INSTRUMENT
+    const ExecutionCounters& get_counters() const { return counters; }
+#endif
 
 private:
     Runtime* runtime;
+    /* numbered from 1 in spawn order, a reused thread gets a new id */
+    u64 id = 0;
     InstructionStream instruction_stream;
     CallStack call_stack;
     OperandStack operand_stack;
+    /* released defer records by word count, each list linked through the first word */
+    std::vector<u64> free_defer_records;
+#ifdef GOATLANG_INSTRUMENT
+    ExecutionCounters counters;
+#endif
+
+    std::atomic<bool> safepoint_requested{false};
+    std::atomic<ThreadState> state{ThreadState::waiting};
 };
 
 #endif /* THREAD_HPP */
@@ -1,37 +1,212 @@
 #include <iostream>
+#include <iterator>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <fstream>
 
+#ifdef GOATLANG_WITH_ANTLR
 #include "antlr4-runtime.h"
 #include "GOatLANGLexer.h"
 #include "GOatLANGParser.h"
+#include "AstBuilder.hpp"
+#endif
+#include "Ast.hpp"
+#include "CompilationCache.hpp"
 #include "Compiler.hpp"
+#include "Image.hpp"
+#include "Parser.hpp"
+#include "Profiler.hpp"
 #include "Runtime.hpp"
 
+static int usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [--antlr] [--cache] [--jobs <n>] [--dump-ast] [<run_options>] <input_file>" << std::endl;
+    std::cerr << "       " << program << " [--antlr] [--cache] [--jobs <n>] --compile-only <input_file> <image_file>" << std::endl;
+    std::cerr << "Run options: --profile <pprof_file> --profile-folded <folded_file> --profile-rate <hz>" << std::endl;
+    std::cerr << "             --counters <json_file>, in a build configured with GOATLANG_INSTRUMENT" << std::endl;
+    return 1;
+}
+
+struct RunOptions
+{
+    std::string pprof_path;
+    std::string folded_path;
+    u64 rate = Profiler::default_rate;
+    std::string counters_path;
+};
+
+/* runs the program, writing the profiles and counters asked for */
+static void run(Runtime& runtime, const RunOptions& run_options, const std::string& source_path)
+{
+    std::optional<Profiler> profiler;
+    if (!run_options.pprof_path.empty() || !run_options.folded_path.empty()) {
+        profiler.emplace(run_options.rate);
+        runtime.profiler = &*profiler;
+    }
+    runtime.start();
+    std::cout << "success!" << std::endl;
+    if (!run_options.pprof_path.empty()) {
+        std::ofstream stream{run_options.pprof_path, std::ios::binary | std::ios::trunc};
+        profiler->write_pprof(stream, source_path);
+    }
+    if (!run_options.folded_path.empty()) {
+        std::ofstream stream{run_options.folded_path, std::ios::trunc};
+        profiler->write_folded(stream);
+    }
+#ifdef GOATLANG_INSTRUMENT
+    if (!run_options.counters_path.empty()) {
+        std::ofstream stream{run_options.counters_path, std::ios::trunc};
+        runtime.counters.write_json(stream, runtime.get_function_table(), runtime.get_native_function_table());
+    }
+#endif
+}
+
 int main(int argc, const char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <input_file>" << std::endl;
-        return 1;
+    bool use_antlr = false;
+    bool print_ast = false;
+    bool compile_only = false;
+    bool use_cache = false;
+    std::optional<u64> jobs;
+    RunOptions run_options;
+    int arg = 1;
+    for (; arg < argc && std::string_view{argv[arg]}.starts_with("--"); ++arg) {
+        std::string_view option{argv[arg]};
+        if (option == "--antlr") {
+            use_antlr = true;
+        } else if (option == "--dump-ast") {
+            print_ast = true;
+        } else if (option == "--compile-only") {
+            compile_only = true;
+        } else if (option == "--cache") {
+            use_cache = true;
+        } else if (option == "--jobs" && arg + 1 < argc) {
+            jobs = std::stoull(argv[++arg]);
+        } else if (option == "--profile" && arg + 1 < argc) {
+            run_options.pprof_path = argv[++arg];
+        } else if (option == "--profile-folded" && arg + 1 < argc) {
+            run_options.folded_path = argv[++arg];
+        } else if (option == "--profile-rate" && arg + 1 < argc) {
+            run_options.rate = std::stoull(argv[++arg]);
+        } else if (option == "--counters" && arg + 1 < argc) {
+#ifdef GOATLANG_INSTRUMENT
+            run_options.counters_path = argv[++arg];
+#else
+            std::cerr << "this build has no execution counters, configure with -DGOATLANG_INSTRUMENT=ON" << std::endl;
+            return 1;
+#endif
+        } else {
+            return usage(argv[0]);
+        }
     }
-    std::ifstream fs{argv[1]};
-    antlr4::ANTLRInputStream input{fs};
-    GOatLANGLexer lexer{&input};
-    antlr4::CommonTokenStream tokens{&lexer};
-    tokens.fill();
-    for (auto token : tokens.getTokens()) {
-        std::cout << token->toString() << std::endl;
+    if (argc - arg != (compile_only ? 2 : 1)) {
+        return usage(argv[0]);
     }
-    GOatLANGParser parser{&tokens};
-    auto tree = parser.sourceFile();
-    std::cout << tree->toStringTree(&parser, true) << std::endl;
+    const char* input_file = argv[arg];
 
+    /* a compiled image skips the front end, its code runs from the mapping */
+    if (!compile_only && !print_ast && Image::is_image(input_file)) {
+        Image image{input_file};
+        Runtime runtime{
+            image.configuration,
+            std::move(image.function_table),
+            std::move(image.native_function_table),
+            std::move(image.type_table),
+            std::move(image.string_pool)
+        };
+        run(runtime, run_options, input_file);
+        return 0;
+    }
+
+    std::ifstream fs{input_file};
+    if (!fs) {
+        std::cerr << "cannot open " << input_file << std::endl;
+        return 1;
+    }
+    std::string source{std::istreambuf_iterator<char>{fs}, std::istreambuf_iterator<char>{}};
+
+    /* errors in the program are reported at their line, not as a crash */
+    AstArena arena;
+    SourceFileNode* tree;
     Compiler compiler{};
-    compiler.visitSourceFile(tree);
     Configuration configuration = Runtime::default_configuration();
+    try {
+        if (use_antlr) {
+#ifdef GOATLANG_WITH_ANTLR
+            antlr4::ANTLRInputStream input{source};
+            GOatLANGLexer lexer{&input};
+            antlr4::CommonTokenStream tokens{&lexer};
+            tokens.fill();
+            GOatLANGParser parser{&tokens};
+            auto parse_tree = parser.sourceFile();
+            /* on stderr, so the dumped tree compares with the one of the other front end */
+            if (print_ast) {
+                for (auto token : tokens.getTokens()) {
+                    std::cerr << token->toString() << std::endl;
+                }
+                std::cerr << parse_tree->toStringTree(&parser, true) << std::endl;
+            }
+            tree = AstBuilder{arena}.build_source_file(parse_tree);
+#else
+            std::cerr << "this build has no ANTLR front end" << std::endl;
+            return 1;
+#endif
+        } else {
+            tree = Parser{source, arena}.parse_source_file();
+        }
+
+        if (print_ast) {
+            dump_ast(std::cout, tree);
+            return 0;
+        }
+
+        /* the code of unchanged declarations is kept next to the source between compilations */
+        auto cache_path = std::string{input_file} + ".cache";
+        std::optional<CompilationCache> cache;
+        if (use_cache) {
+            cache.emplace(cache_path);
+        }
+        compiler.cache = cache ? &*cache : nullptr;
+        if (jobs) {
+            compiler.thread_count = *jobs;
+        }
+        compiler.visitSourceFile(tree);
+        if (cache && compiler.cached_declaration_count != compiler.declaration_records.size()) {
+            cache->write(
+                cache_path,
+                compiler.declaration_records,
+                compiler.function_relocations,
+                compiler.function_table,
+                compiler.type_table,
+                compiler.string_pool,
+                compiler.native_function_table);
+        }
+        auto main_function = compiler.function_indices.find("main");
+        if (main_function == compiler.function_indices.end()) {
+            throw std::runtime_error("function main is undeclared!");
+        }
+        configuration.main_function_index = main_function->second;
+        configuration.channel_type = compiler.type_names.at("chan");
+        configuration.slice_type = compiler.type_names.at("[]");
+        configuration.string_type = compiler.type_names.at("string");
+    } catch (const SourceError& error) {
+        std::cerr << input_file << ":" << error.line << ": " << error.what() << std::endl;
+        return 1;
+    } catch (const std::runtime_error& error) {
+        std::cerr << input_file << ": " << error.what() << std::endl;
+        return 1;
+    }
 
-    configuration.main_function_index = compiler.function_indices.at("main");
-    configuration.channel_type = compiler.type_names.at("chan");
-    configuration.slice_type = compiler.type_names.at("[]");
+    if (compile_only) {
+        Image::write(
+            argv[arg + 1],
+            configuration,
+            compiler.function_table,
+            compiler.native_function_table,
+            compiler.type_table,
+            compiler.string_pool);
+        return 0;
+    }
 
     Runtime runtime{
         configuration,
@@ -40,7 +215,6 @@ int main(int argc, const char* argv[]) {
         std::move(compiler.type_table),
         std::move(compiler.string_pool)
     };
-    runtime.start();
-    std::cout << "success!" << std::endl;
+    run(runtime, run_options, input_file);
     return 0;
 }